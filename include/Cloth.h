@@ -13,12 +13,41 @@
 
 #include "ParticleSystem.h"
 
+#include <array>
 #include <vector>
 
+// Materials shared by each class of cloth springs, at the beginning of the
+// material table of every cloth.
+//
+enum eClothMaterials
+{
+    kStructuralMaterial = 0,
+    kShearMaterial,
+    kBendingMaterial,
+    kNumClothMaterials
+};
+
+// Orders in which Cloth::reorder() can store the particles.
+//
+enum eParticleOrders
+{
+    kInputOrder = 0,        // Keep the current order
+    kMortonOrder,           // Along a Z-order curve through the bounding box of the positions
+    kReverseCuthillMcKee,   // Breadth-first through the springs, which keeps the neighbors of a particle close
+    kNumParticleOrders
+};
+
+// Returns a short lowercase name for particle order @a order, as used on the command line.
+const char* getParticleOrderName(int order);
+
+// Returns the particle order named @a name, or -1 if there is none.
+int findParticleOrder(const char* name);
 
 // A simple cloth class.
 //
 //  The cloth is a nx-by-ny rectangular grid of particles arranged as rows.
+//  Cloths imported from a triangle mesh have no grid layout and report a
+//  width and height of zero.
 //
 //  The springs in the particle system are always stored according to the following layout
 //  in ParticleSystem::m_springs
@@ -28,17 +57,39 @@
 //  The indices for the start of each of these blocks can be accessed by the getters:
 //     getStructuralIndex(), getShearIndex(), and getBendingIndex()
 //
+//  Each class of springs references one of the eClothMaterials, so changing the
+//  stiffness or damping of a class is a single update of the material table.
+//  Additional materials can be added for custom groups of springs.
+//
+//  The triangles of the cloth surface (used for rendering) are stored as
+//  triplets of particle indices.
+//
+//  Removing a spring (e.g. when it tears) keeps this layout by moving one
+//  spring per class, and removes the triangles that contain both of its
+//  particles, so the surface splits along torn springs.
+//
+//  The particles of a grid cloth are stored row by row, so that neighbors are
+//  close in memory.  The vertex order of an imported mesh, and the spring
+//  order left by tearing, can be arbitrary; reorder() and sortSprings() store
+//  them again so that the force and solver loops read nearby memory.
+//
+//  The structural and shear springs can be replaced by a TriangleMembrane
+//  over the surface triangles (see ClothFactory::createMembrane()); the
+//  spring layout is kept with empty structural and shear blocks.
+//
 class Cloth : public ParticleSystem
 {
 public:
-    Cloth() : m_nx(0), m_ny(0), m_structuralIndex(0), m_shearIndex(0), m_bendingIndex(0)
+    Cloth() : m_nx(0), m_ny(0), m_structuralIndex(0), m_shearIndex(0), m_bendingIndex(0), m_nextTriangleId(0)
     {
         m_particles.resize(0);
+        m_materials.resize(kNumClothMaterials);
     }
 
-    explicit Cloth(int _nx, int _ny) : m_nx(_nx), m_ny(_ny), m_structuralIndex(0), m_shearIndex(0), m_bendingIndex(0)
+    explicit Cloth(int _nx, int _ny) : m_nx(_nx), m_ny(_ny), m_structuralIndex(0), m_shearIndex(0), m_bendingIndex(0), m_nextTriangleId(0)
     {
         m_particles.resize(m_nx*m_ny);
+        m_materials.resize(kNumClothMaterials);
     }
 
     virtual ~Cloth() { }
@@ -67,10 +118,55 @@ public:
     int getBendingIndex() const { return m_bendingIndex; }
     void setBendingIndex(int _bendingIndex) { m_bendingIndex = _bendingIndex; }
 
+    // Surface triangles as triplets of particle indices.
+    const std::vector<std::array<int, 3>>& getTriangles() const override { return m_triangles; }
+    void addTriangle(int i0, int i1, int i2);
+
+    // Identifier of each triangle of getTriangles(), kept when removals move
+    // the triangle, and identifiers of the triangles removed since the last
+    // clearRemovedTriangles(), so that a renderer can patch its own copy of
+    // the triangles.  reorder() numbers the triangles again from 0.
+    const std::vector<int>& getTriangleIds() const { return m_triangleIds; }
+    const std::vector<int>& getRemovedTriangles() const { return m_removedTriangles; }
+    void clearRemovedTriangles() { m_removedTriangles.clear(); }
+
+    // Remove @a _spring while keeping the spring class layout, and remove
+    // the triangles spanned by its two particles.
+    void removeSpring(Spring* _spring) override;
+
+    // Store the particles in the order @a order (one of eParticleOrders), then
+    // sort the springs and triangles.  Particle indices and the triangles are
+    // remapped, so state vectors taken before do not match the new order.  A
+    // grid cloth loses its grid layout (width and height become zero) unless
+    // @a order is kInputOrder.
+    void reorder(int order);
+
+    // Sort the springs of each class by their first particle, which becomes
+    // the one with the smaller index, and rebuild the spring lists of the
+    // particles in the same order.  Particle indices do not change.
+    void sortSprings();
+
+    // Delete the structural and shear springs, keeping the bending springs.
+    void removeStretchSprings();
+
+    size_t getMemoryUsage() const override;
 
 protected:
+    // Remove the triangles containing both particles @a i0 and @a i1.
+    void removeEdgeTriangles(int i0, int i1);
+    void removeTriangle(int t);
+
+    // Number the springs by their position in m_springs and rebuild the
+    // spring lists of the particles in that order.
+    void rebuildSpringLists();
+
     int m_nx, m_ny;
     int m_structuralIndex, m_shearIndex, m_bendingIndex;
+    std::vector<std::array<int, 3>> m_triangles;
+    std::vector<std::vector<int>> m_particleTriangles;     // Triangles of each particle, kept up to date for removals
+    std::vector<int> m_triangleIds;                         // Identifier of each triangle
+    std::vector<int> m_removedTriangles;                    // Identifiers of the triangles removed since clearRemovedTriangles()
+    int m_nextTriangleId;
 
 };
 
@@ -7,7 +7,10 @@
  *
  */
 
+#include <string>
+
 class Cloth;
+class CompactCloth;
 
 // Simple factory class to create a Cloth.
 //
@@ -18,4 +21,26 @@ public:
     static Cloth* createHangingCloth(int nx, int ny, float dx, float dy, float k1, float k2, float k3, float b, float startx, float starty);
 
     static Cloth* createTrampoline(int nx, int nz, float dx, float dz, float k1, float k2, float k3, float b, float startx, float startz);
+
+    // Create a cloth from an OBJ or binary PLY triangle mesh, with its particles
+    // stored in the order @a order (one of eParticleOrders). Returns nullptr if
+    // the mesh cannot be loaded.
+    static Cloth* createFromMesh(const std::string& filename, float k1, float k3, float b, int order);
+
+    // Same scenarios as createHangingCloth() and createTrampoline(), built
+    // directly in the compact representation.
+    static CompactCloth* createCompactHangingCloth(int nx, int ny, float dx, float dy, float k1, float k2, float k3, float b, float startx, float starty);
+    static CompactCloth* createCompactTrampoline(int nx, int nz, float dx, float dz, float k1, float k2, float k3, float b, float startx, float startz);
+
+    // Compact copy of the particles, springs and materials of @a cloth.
+    // Returns nullptr if the particles do not all have the same mass, or if
+    // the cloth has a membrane.
+    static CompactCloth* createCompactCloth(const Cloth* cloth);
+
+    // Replace the structural and shear springs of @a cloth by StVK triangle
+    // elements over its surface triangles, at rest in the current positions,
+    // with Young's modulus @a youngsModulus (N/m) and Poisson ratio
+    // @a poissonRatio.  The bending springs are kept.  Returns false if the
+    // cloth has no triangles.
+    static bool createMembrane(Cloth* cloth, float youngsModulus, float poissonRatio);
 };
@@ -8,6 +8,9 @@
  */
 #include <Eigen/Dense>
 
+#include <array>
+#include <vector>
+
 namespace polyscope
 {
     class SurfaceMesh;
@@ -15,8 +18,15 @@ namespace polyscope
 }
 
 class Cloth;
+class DampingField;
+class DomainDecomposition;
+class FrameCache;
+class FrameRecorder;
 class Integrator;
+class MouseSpring;
 class Particle;
+class StabilityWatchdog;
+class Wind;
 
 class ClothViewer 
 {
@@ -29,21 +39,66 @@ public:
 private:
     void createHangingCloth();
     void createTrampoline();
+    void loadMesh();
+    void saveSnapshot();
+    void loadSnapshot();
+    void setCloth(Cloth* cloth);
+    void startRecording();
+    void stopRecording();
+    void openFrameCache();
+    void closeFrameCache();
+    void updatePlayback();
 
     void draw();
     void drawGUI();
+    void drawProfilerGUI();
 
     void initClothData();
     void updateClothData();
+    void updateSpringParameters();
+    void updateForceFields();
+    void updateSolver();
+    void grabParticle(Particle* particle);
+
+    void resetDomainDecomposition();
 
     Cloth* m_cloth;                     // The cloth particle system.
     polyscope::SurfaceMesh* m_clothMesh;    // Cloth surface mesh (visual)
     polyscope::PointCloud* m_clothPoints;   // Cloth particles (visual)
 
+    // Render buffers, kept between frames and only uploaded when dirty.
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> m_renderPositions;
+    std::vector< std::array<float, 3> > m_pointColors;
+    bool m_positionsDirty;              // Particles moved since the last upload
+    bool m_pinsDirty;                   // Particles were pinned or unpinned since the last upload
+    unsigned int m_renderTopologyVersion;   // Cloth topology version of the registered surface mesh
+    std::vector<int> m_renderFaces;     // Face of the registered surface mesh of each cloth triangle id (-1: collapsed)
+    int m_numRenderFaces;               // Faces of the registered surface mesh that are not collapsed
+
     int m_integratorIndex;              // The current integration method.
+    int m_solverMethod;                 // Iteration of the implicit solver (eSolverMethods)
+    int m_solverIterations;             // Sweeps of the implicit solver per step
+    float m_jacobianTolerance;          // Strain and direction change before a spring Jacobian is computed again
+    bool m_implicitSprings[3];          // Structural, shear and bending springs integrated implicitly by imex
     bool m_paused;
     bool m_stepOnce;
 
+    StabilityWatchdog* m_watchdog;      // Rolls back unstable steps and adapts dt and the integrator
+    bool m_useWatchdog;
+    bool m_useSleeping;                 // Let the settled regions of the cloth sleep
+
+    DomainDecomposition* m_domainDecomposition;   // Multi-process tiled simulation (null when not running)
+    bool m_useDomainDecomposition;
+    int m_numTiles;
+
+    FrameRecorder* m_recorder;          // Writes every simulated frame to m_cacheFilename (null when not recording)
+    bool m_recording;
+
+    FrameCache* m_frameCache;           // Cache being played back instead of simulating (null by default)
+    int m_playbackFrame;                // Frame shown by the timeline
+    int m_displayedFrame;               // Frame currently uploaded to the meshes (-1 if none)
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> m_playbackPositions;
+
     Eigen::VectorXf m_q0;               // Initial state of the particle system.
 
     // Simulation parameters
@@ -52,10 +107,30 @@ private:
     float m_shearStiffness;             // Cloth shear spring stiffness.
     float m_bendingStiffness;           // Cloth bending spring stiffness.
     float m_damping;                    // Cloth damping.
+    float m_tearStrain;                 // Strain beyond which springs tear (0: never).
+    float m_maxStrain;                  // Strain beyond which springs are shortened after each step (0: never).
+    bool m_useMembrane;                 // Replace the structural and shear springs of new cloths by triangle elements
+    float m_youngsModulus;              // Membrane Young's modulus (N/m).
+    float m_poissonRatio;               // Membrane Poisson ratio.
+
+    // Force fields, registered with the cloth while they are enabled.
+    Wind* m_wind;
+    bool m_useWind;
+    Eigen::Vector3f m_windVelocity;
+    float m_windDrag;
+    DampingField* m_airDamping;
+    bool m_useAirDamping;
+    float m_airDampingCoefficient;
+    MouseSpring* m_mouseSpring;         // Pulls m_pickParticle while it is dragged
 
     // Misc. cloth parameters
     int m_nx, m_ny;
     float m_width, m_height;
+    char m_meshFilename[256];           // OBJ or PLY file loaded by the "Load mesh" scenario
+    char m_snapshotFilename[256];       // Snapshot file used by "Save snapshot" and "Load snapshot"
+    char m_cacheFilename[256];          // Frame cache written while recording
+    char m_traceFilename[256];          // Chrome trace written by "Capture trace"
+    int m_traceFrames;                  // Number of frames captured by "Capture trace"
 
 
     Particle* m_pickParticle;           // The picked particle for mouse spring interaction (null by default)
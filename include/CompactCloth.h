@@ -0,0 +1,139 @@
+#pragma once
+
+/**
+ * @file CompactCloth.h
+ *
+ * @brief A memory-compact mass-spring cloth for very large simulations.
+ *
+ */
+
+#include "ParticleSystem.h"
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A cloth stored in flat arrays, for cloths too large for the ParticleSystem
+// representation (about a kilobyte per particle once Particle, its spring list
+// and the Spring objects with their 3x3 matrices are counted).
+//
+//  Positions are kept in single precision and velocities in half precision.
+//  Particles have a common mass.  Each spring is stored once, in the list of
+//  its particle with the larger index, as the 32-bit index of its other
+//  particle, an 8-bit material index and a 16-bit rest length quantized in
+//  units of the longest rest length / 65535 (two grid spacings for the
+//  bending springs of a grid cloth).  Spring Jacobians are computed on the
+//  fly when they are needed instead of being stored.
+//
+//  This is about 100 bytes per particle for a grid cloth, scratch buffers of
+//  the implicit integrator included.
+//
+//  The cloth is built by adding all particles, then all springs, and calling
+//  finalize().  Springs do not tear, and there are no render triangles.
+//
+class CompactCloth
+{
+public:
+    CompactCloth(int _nx = 0, int _ny = 0);
+
+    // Building.  Particle indices are given by the order of addParticle() calls.
+    //
+    void reserve(int numParticles, int numSprings);
+    int addParticle(const Eigen::Vector3f& x, bool fixed);
+    void addSpring(int i0, int i1, int material, float restLength);
+
+    // Sort the added springs by particle and quantize their rest lengths.
+    // Returns false if a spring references a missing particle or material.
+    bool finalize();
+
+    // Compute the forces acting on the particles (gravity and springs).
+    //
+    void computeForces();
+
+    // Advance the cloth by one time step @a dt with integrator @a integrator
+    // (one of eIntegrators).  computeForces() must have been called on the
+    // current state.  The integrators follow ExplicitEuler, Midpoint,
+    // SemiImplicitEuler, ImplicitEuler and ImplicitExplicitEuler (a single
+    // Gauss-Seidel sweep).
+    //
+    void step(int integrator, float dt);
+
+    int getNumParticles() const { return m_fixed.size(); }
+    int getNumSprings() const { return m_springs.size(); }
+    int getWidth() const { return m_nx; }
+    int getHeight() const { return m_ny; }
+
+    // Positions of all particles, xyz per particle.
+    const float* getPositions() const { return m_x.data(); }
+    Eigen::Vector3f getPosition(int i) const { return Eigen::Vector3f(m_x[3 * i], m_x[3 * i + 1], m_x[3 * i + 2]); }
+    Eigen::Vector3f getVelocity(int i) const;
+    void setVelocity(int i, const Eigen::Vector3f& v) { storeVelocity(i, v); }
+
+    bool isFixed(int i) const { return m_fixed[i] != 0; }
+    void setFixed(int i, bool fixed);
+
+    float getParticleMass() const { return m_mass; }
+    void setParticleMass(float _mass) { m_mass = _mass; }
+
+    // Spring materials, referenced by index.  At most 256 materials can be used.
+    const std::vector<SpringMaterial>& getMaterials() const { return m_materials; }
+    std::vector<SpringMaterial>& getMaterials() { return m_materials; }
+
+    // Materials integrated implicitly by ImplicitExplicitEuler, as in
+    // ParticleSystem::setImplicitMaterials().
+    void setImplicitMaterials(uint32_t _materials) { m_implicitMaterials = _materials; }
+    uint32_t getImplicitMaterials() const { return m_implicitMaterials; }
+
+    // Copy the positions and velocities into @a particleSystem, which must
+    // have the same particles.
+    void copyStateTo(ParticleSystem* particleSystem) const;
+
+    // Heap memory used by the cloth, in bytes.
+    size_t getMemoryUsage() const;
+
+private:
+    // A spring in the list of its particle with the larger index.
+    struct CompactSpring
+    {
+        uint32_t other;         // Index of the other particle (smaller than the owner)
+        uint16_t restLength;    // Rest length in units of m_lengthQuantum
+        uint8_t material;
+        uint8_t unused;
+    };
+
+    // A spring added before finalize().
+    struct PendingSpring
+    {
+        uint32_t i0, i1;
+        int material;
+        float restLength;
+    };
+
+    void storeVelocity(int i, const Eigen::Vector3f& v);
+
+    // Stiffness matrix of a spring of stiffness @a k and rest length @a r between @a x0 and @a x1.
+    static Eigen::Matrix3f springJacobian(float k, float r, const Eigen::Vector3f& x0, const Eigen::Vector3f& x1);
+
+    // Implicit step with the springs of the materials in @a implicitMaterials
+    // in the Jacobian.
+    void stepImplicit(float dt, uint32_t implicitMaterials);
+
+    int m_nx, m_ny;
+    float m_mass;                           // Mass of every particle
+    float m_lengthQuantum;                  // Rest length of one quantization step
+
+    std::vector<float> m_x;                 // Positions, xyz per particle
+    std::vector<Eigen::half> m_v;           // Velocities, xyz per particle
+    std::vector<uint8_t> m_fixed;
+    std::vector<uint32_t> m_springStart;    // Springs of particle i are [m_springStart[i], m_springStart[i + 1])
+    std::vector<CompactSpring> m_springs;
+    std::vector<SpringMaterial> m_materials;
+    uint32_t m_implicitMaterials;           // Materials integrated implicitly by ImplicitExplicitEuler
+
+    std::vector<float> m_f;                 // Forces, then right-hand side and velocity change of the implicit step
+    std::vector<float> m_diagonal;          // Symmetric 3x3 diagonal blocks of the implicit step (xx, xy, xz, yy, yz, zz)
+
+    std::vector<PendingSpring> m_pending;   // Springs added since the last finalize()
+};
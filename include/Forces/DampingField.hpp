@@ -0,0 +1,43 @@
+#pragma once
+
+/**
+ * @file DampingField.hpp
+ *
+ * @brief Drag of the surrounding air on each particle.
+ *
+ */
+
+#include "Forces/ForceField.h"
+#include "ParticleSystem.h"
+
+// Linear drag f = -c m (v - u) towards the air velocity u, which slows down
+// the motion of the whole cloth, unlike spring damping.
+//
+class DampingField : public ForceField
+{
+public:
+    DampingField(float _c = 0.1f) : m_c(_c), m_airVelocity(0, 0, 0) { }
+
+    void setCoefficient(float _c) { m_c = _c; }
+    float getCoefficient() const { return m_c; }
+
+    void setAirVelocity(const Eigen::Vector3f& _u) { m_airVelocity = _u; }
+
+    virtual int getInputs() const override { return kParticleInputs; }
+
+    virtual bool hasJacobian() const override { return true; }
+
+    virtual void addParticleForce(const Particle& p, Eigen::Vector3f& f) const override
+    {
+        f -= m_c * p.m * (p.v - m_airVelocity);
+    }
+
+    virtual void addParticleJacobian(const Particle& p, Eigen::Matrix3f& dfdx, Eigen::Matrix3f& dfdv) const override
+    {
+        dfdv.diagonal().array() -= m_c * p.m;
+    }
+
+private:
+    float m_c;                      // Drag per unit mass
+    Eigen::Vector3f m_airVelocity;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+/**
+ * @file ForceField.h
+ *
+ * @brief Interface of the force terms added to gravity and the springs.
+ *
+ */
+
+#include <Eigen/Dense>
+
+class Particle;
+
+// Elements a force field reads, combined in ForceField::getInputs().
+//
+enum eForceInputs
+{
+    kParticleInputs = 1,    // Position, velocity and mass of each particle
+    kTriangleInputs = 2     // The three particles of each surface triangle
+};
+
+// A force term evaluated by ParticleSystem::computeForces().
+//
+//  Fields declare the elements they read with getInputs(), so that the
+//  particle system evaluates all particle fields in its particle loop and
+//  all triangle fields in its spring loop, instead of one pass per field.
+//  The particle loop runs in parallel: the evaluation functions must not
+//  modify the field.
+//
+//  Conservative fields report their potential energy, which is added to the
+//  energy of the particle system.  The power of the other fields is
+//  accumulated separately, as work done on the system.
+//
+//  Fields may also give the derivatives of their force on a particle with
+//  respect to its own position and velocity.  The implicit solvers add them
+//  to the diagonal blocks of the system.  Triangle forces have no Jacobian
+//  and are integrated explicitly.
+//
+class ForceField
+{
+public:
+    virtual ~ForceField() { }
+
+    // Elements read by the field, a combination of eForceInputs.
+    virtual int getInputs() const = 0;
+
+    // True if the field derives from a potential energy.
+    virtual bool isConservative() const { return false; }
+
+    // True if addParticleJacobian() adds non-zero blocks.
+    virtual bool hasJacobian() const { return false; }
+
+    // Add the force of the field on @a p to @a f (kParticleInputs).
+    virtual void addParticleForce(const Particle& p, Eigen::Vector3f& f) const { }
+
+    // Potential energy of @a p in the field (conservative fields).
+    virtual float getParticleEnergy(const Particle& p) const { return 0.0f; }
+
+    // Add the derivatives of the force on @a p with respect to its position
+    // and velocity to @a dfdx and @a dfdv.
+    virtual void addParticleJacobian(const Particle& p, Eigen::Matrix3f& dfdx, Eigen::Matrix3f& dfdv) const { }
+
+    // Add the forces of the field on the particles @a p of a triangle to @a f (kTriangleInputs).
+    virtual void addTriangleForces(const Particle* const p[3], Eigen::Vector3f f[3]) const { }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+/**
+ * @file MouseSpring.hpp
+ *
+ * @brief Pulls a particle grabbed with the mouse.
+ *
+ */
+
+#include "Forces/ForceField.h"
+#include "ParticleSystem.h"
+
+// Force f = k d - b (v.u) u on a single particle, where d is the pull set by
+// the viewer (the offset from the particle to the mouse) and u its
+// direction.  Pulls shorter than the dead zone are ignored.
+//
+class MouseSpring : public ForceField
+{
+public:
+    MouseSpring(float _k = 50.0f, float _b = 5.0f) : m_particle(nullptr), m_pull(0, 0, 0), m_k(_k), m_b(_b) { }
+
+    // Grab @a _particle (nullptr to release).
+    void setParticle(const Particle* _particle) { m_particle = _particle; }
+    const Particle* getParticle() const { return m_particle; }
+
+    void setPull(const Eigen::Vector3f& _pull) { m_pull = _pull; }
+
+    virtual int getInputs() const override { return kParticleInputs; }
+
+    virtual bool hasJacobian() const override { return true; }
+
+    virtual void addParticleForce(const Particle& p, Eigen::Vector3f& f) const override
+    {
+        if (&p == m_particle && isPulling())
+        {
+            const Eigen::Vector3f u = m_pull.normalized();
+            f += m_k * m_pull - m_b * p.v.dot(u) * u;
+        }
+    }
+
+    virtual void addParticleJacobian(const Particle& p, Eigen::Matrix3f& dfdx, Eigen::Matrix3f& dfdv) const override
+    {
+        if (&p == m_particle && isPulling())
+        {
+            const Eigen::Vector3f u = m_pull.normalized();
+            dfdv -= m_b * u * u.transpose();
+        }
+    }
+
+private:
+    bool isPulling() const { return m_pull.norm() > 0.1f; }
+
+    const Particle* m_particle;
+    Eigen::Vector3f m_pull;
+    float m_k;
+    float m_b;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+/**
+ * @file PointAttractor.hpp
+ *
+ * @brief Pulls the particles near a point towards it.
+ *
+ */
+
+#include "Forces/ForceField.h"
+#include "ParticleSystem.h"
+
+#include <algorithm>
+
+// A zero-length spring of stiffness k per unit mass between the point c and
+// every particle closer than the radius.  Farther particles are not affected.
+//
+class PointAttractor : public ForceField
+{
+public:
+    PointAttractor(const Eigen::Vector3f& _c = Eigen::Vector3f::Zero(), float _k = 1.0f, float _radius = 1.0f) : m_c(_c), m_k(_k), m_radius(_radius) { }
+
+    void setCenter(const Eigen::Vector3f& _c) { m_c = _c; }
+    const Eigen::Vector3f& getCenter() const { return m_c; }
+    void setStiffness(float _k) { m_k = _k; }
+    void setRadius(float _radius) { m_radius = _radius; }
+
+    virtual int getInputs() const override { return kParticleInputs; }
+
+    virtual bool isConservative() const override { return true; }
+
+    virtual bool hasJacobian() const override { return true; }
+
+    virtual void addParticleForce(const Particle& p, Eigen::Vector3f& f) const override
+    {
+        const Eigen::Vector3f d = p.x - m_c;
+        if (d.squaredNorm() < m_radius * m_radius)
+            f -= m_k * p.m * d;
+    }
+
+    // The energy is constant outside of the radius, so that it is continuous.
+    virtual float getParticleEnergy(const Particle& p) const override
+    {
+        return 0.5f * m_k * p.m * std::min((p.x - m_c).squaredNorm(), m_radius * m_radius);
+    }
+
+    virtual void addParticleJacobian(const Particle& p, Eigen::Matrix3f& dfdx, Eigen::Matrix3f& dfdv) const override
+    {
+        if ((p.x - m_c).squaredNorm() < m_radius * m_radius)
+            dfdx.diagonal().array() -= m_k * p.m;
+    }
+
+private:
+    Eigen::Vector3f m_c;
+    float m_k;
+    float m_radius;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+/**
+ * @file TriangleMembrane.h
+ *
+ * @brief Saint Venant-Kirchhoff triangle elements for the in-plane stretching of a cloth.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+class Particle;
+
+// Membrane made of linear triangle elements with a StVK material.
+//
+//  Each triangle stores the inverse B of its rest edge matrix, expressed in a
+//  2D frame of its plane whose first axis is the edge x1 - x0 (so that B is
+//  upper triangular), and its deformation gradient is F = [x1 - x0, x2 - x0] B.
+//  With the Green strain E = (F^T F - I) / 2, the energy of a triangle of
+//  rest area A is A (mu E:E + lambda/2 tr(E)^2), with the plane stress Lame
+//  parameters of the Young's modulus and Poisson ratio.  The Young's modulus
+//  is per unit of thickness (N/m), like the spring stiffnesses.
+//
+//  The membrane replaces the structural and shear springs of a cloth: about
+//  two triangles per particle instead of four springs, with a response that
+//  does not depend on the direction of the stretch.  It has no damping and
+//  does not tear.
+//
+//  Forces and stiffness blocks are evaluated by batches of kBatch triangles
+//  whose data is gathered in arrays, so that the element computations run
+//  as SIMD lanes; the batches of a pass are processed in parallel.  The
+//  stiffness blocks are the StVK Hessian with the stress of the geometric
+//  term projected on its positive part, which keeps them negative
+//  semi-definite for the implicit solvers.
+//
+class TriangleMembrane
+{
+public:
+    static const int kBatch = 8;
+
+    // Elements for @a triangles (triplets of particle indices) with the
+    // current positions of @a particles as rest shape.  Degenerate
+    // triangles are kept without stiffness.
+    TriangleMembrane(const std::vector<Particle*>& particles, const std::vector<std::array<int, 3>>& triangles);
+
+    void setMaterial(float youngsModulus, float poissonRatio);
+    float getYoungsModulus() const { return m_youngsModulus; }
+    float getPoissonRatio() const { return m_poissonRatio; }
+
+    int getNumTriangles() const { return m_triangles.size(); }
+
+    // Add the elastic forces to the particles that are not fixed and return the elastic energy.
+    double addForces(const std::vector<Particle*>& particles);
+
+    // Compute the stiffness blocks of every triangle at the current positions.
+    void computeJacobians(const std::vector<Particle*>& particles);
+
+    // Sum of the stiffness blocks of particle @a i with itself.
+    Eigen::Matrix3f getDiagonalBlock(int i) const;
+
+    // Add sum_j K_ij x(j) over the other particles j of the triangles of
+    // particle @a i to @a r, where @a x(j) returns a vector of particle j.
+    template <typename X>
+    void addOffDiagonalProduct(int i, const X& x, Eigen::Vector3f& r) const
+    {
+        for (int k = m_vertexStart[i]; k < m_vertexStart[i + 1]; ++k)
+        {
+            const int t = m_vertexCorners[k] / 3;
+            const int a = m_vertexCorners[k] % 3;
+            for (int b = 0; b < 3; ++b)
+            {
+                if (b != a)
+                    r += block(t, a, b) * x(m_triangles[t][b]);
+            }
+        }
+    }
+
+    // Renumber the particles, @a newIndex giving the new index of each particle.
+    void remap(const std::vector<int>& newIndex);
+
+    size_t getMemoryUsage() const;
+
+private:
+    // Number of floats of the stiffness blocks of a triangle: K00, K11, K22, K01, K02 and K12.
+    static const int kBlockFloats = 54;
+
+    // Stiffness block K_ab of triangle @a t, the derivative of the force on corner a with respect to corner b.
+    Eigen::Matrix3f block(int t, int a, int b) const;
+
+    // Gather the edges x1 - x0 and x2 - x0 of the triangles of the batch starting at @a first, zero past the last triangle.
+    void gatherEdges(const std::vector<Particle*>& particles, int first, float e1[3][kBatch], float e2[3][kBatch]) const;
+
+    void buildAdjacency(int numParticles);
+
+    std::vector<std::array<int, 3>> m_triangles;
+    std::vector<float> m_b00, m_b01, m_b11;         // Inverse rest edge matrices, padded to whole batches
+    std::vector<float> m_area;                      // Rest areas, zero for the padding
+    std::vector<float> m_forces;                    // Forces on corners 1 and 2, 6 x kBatch floats per batch
+    std::vector<float> m_energy;                    // Energy of each triangle
+    std::vector<float> m_blocks;                    // kBlockFloats column-major floats per triangle
+    std::vector<int> m_vertexStart;                 // Corners of particle i are [m_vertexStart[i], m_vertexStart[i + 1])
+    std::vector<int> m_vertexCorners;               // 3 * triangle + corner
+
+    float m_youngsModulus, m_poissonRatio;
+    float m_mu, m_lambda;
+};
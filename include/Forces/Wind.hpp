@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+ * @file Wind.hpp
+ *
+ * @brief Aerodynamic drag of a uniform wind on the cloth triangles.
+ *
+ */
+
+#include "Forces/ForceField.h"
+#include "ParticleSystem.h"
+
+#include <cmath>
+
+// Pressure drag on each triangle, f = 0.5 rho Cd A |w.n| (w.n) n, where w is
+// the wind velocity relative to the mean velocity of the triangle and n its
+// normal.  The force is shared equally by the three particles.  Only the
+// normal component is kept, so a triangle parallel to the wind feels nothing.
+//
+class Wind : public ForceField
+{
+public:
+    Wind(const Eigen::Vector3f& _velocity = Eigen::Vector3f(1, 0, 0), float _drag = 0.5f) : m_velocity(_velocity), m_drag(_drag) { }
+
+    void setVelocity(const Eigen::Vector3f& _velocity) { m_velocity = _velocity; }
+    const Eigen::Vector3f& getVelocity() const { return m_velocity; }
+
+    // Product 0.5 rho Cd of the air density and the drag coefficient.
+    void setDrag(float _drag) { m_drag = _drag; }
+    float getDrag() const { return m_drag; }
+
+    virtual int getInputs() const override { return kTriangleInputs; }
+
+    virtual void addTriangleForces(const Particle* const p[3], Eigen::Vector3f f[3]) const override
+    {
+        // |cross| is twice the area of the triangle.
+        const Eigen::Vector3f cross = (p[1]->x - p[0]->x).cross(p[2]->x - p[0]->x);
+        const float doubleArea = cross.norm();
+        if (doubleArea < 1e-12f)
+            return;
+
+        const Eigen::Vector3f n = cross / doubleArea;
+        const Eigen::Vector3f w = m_velocity - (p[0]->v + p[1]->v + p[2]->v) / 3.0f;
+        const float wn = w.dot(n);
+        const Eigen::Vector3f fp = (m_drag * 0.5f * doubleArea * std::abs(wn) * wn / 3.0f) * n;
+        f[0] += fp;
+        f[1] += fp;
+        f[2] += fp;
+    }
+
+private:
+    Eigen::Vector3f m_velocity;
+    float m_drag;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+/**
+ * @file HeadlessRunner.h
+ *
+ * @brief Runs a cloth simulation without a window.
+ *
+ */
+
+#include "IO/Snapshot.h"
+
+#include <cstdint>
+#include <string>
+
+class Cloth;
+class CompactCloth;
+class DampingField;
+class StabilityWatchdog;
+struct StreamCommand;
+
+// Command line driver for batch simulations.
+//
+//  tissu --headless [options]
+//
+//    --load <file>         Start from a snapshot instead of a new scenario
+//    --save <file>         Write a snapshot after the last step
+//    --record <file>       Write every step to a frame cache
+//    --stream <address>    Stream the steps to a remote viewer (tissu --connect <address>) on unix:<path> or
+//                          <host>:<port>, paced to real time, and apply the parameter and pin edits it sends back
+//    --scenario <name>     hanging (default), trampoline or mesh
+//    --mesh <file>         Mesh used by the mesh scenario
+//    --reorder <order>     Store the particles in input, morton or rcm order (default: rcm for meshes, input
+//                          otherwise), and sort the springs again after steps that tore springs
+//    --nx <n>, --ny <n>    Grid resolution (default 16 x 16)
+//    --steps <n>           Number of time steps (default 1000)
+//    --dt <dt>             Time step (default 0.01)
+//    --integrator <name>   explicit (default), midpoint, semi-implicit, implicit or imex
+//    --implicit-springs <classes>
+//                          Comma separated spring classes integrated implicitly by imex: structural, shear and/or
+//                          bending (default: structural)
+//    --solver <name>       Iteration of the implicit solver: gauss-seidel (default), sor or chebyshev
+//    --iterations <n>      Max sweeps of the implicit solver per step (default 1)
+//    --tolerance <r>       Stop the implicit solver at this relative residual (default: run all sweeps)
+//    --autotune <file>     Calibrate the solver method and sweeps, the threads and the time step (up to 4 times
+//                          --dt) on the scene, or load them from this cache of tuned configurations.  The solver
+//                          stops at --tolerance (default 1e-3).  Cannot be combined with --compact, --modal or scenes
+//    --lazy-jacobian <t>   Reuse the spring Jacobians until their strain or direction changes by t (default 0: never)
+//    --tear <strain>       Break springs stretched beyond this strain (default: never)
+//    --strain-limit <s>    Shorten the springs stretched beyond this strain after each step, e.g. 0.1 (default: never)
+//    --watchdog <on|off>   Roll back unstable steps and retry them with a smaller dt or a more stable integrator (default: off)
+//    --sleep <on|off>      Stop simulating the regions of the cloth that came to rest (default: off)
+//    --wind <x,y,z>        Blow a uniform wind of this velocity on the cloth triangles (default: none)
+//    --air-damping <c>     Drag of the air per unit mass (default: none)
+//    --membrane <E>        Replace the structural and shear springs by StVK triangle elements of Young's modulus E
+//                          (default: springs).  Cannot be combined with --save
+//    --poisson <nu>        Poisson ratio of the membrane (default 0.3)
+//    --compact <on|off>    Simulate a CompactCloth, for very large cloths (default: off).  Cannot be combined with
+//                          --save, --record, --tear, --strain-limit, --watchdog, --wind, --air-damping, --membrane or --sleep
+//    --cloths <n>          Simulate n copies of the cloth side by side in a Scene, stepped concurrently (default 1)
+//    --sphere <x,y,z,r>    Add a sphere collider to the scene (default: none)
+//    --threads <n>         Threads stepping the scene (default: all hardware threads)
+//                          Scenes cannot be combined with --save, --record, --watchdog or --compact
+//    --modal <K>           Settle the cloth, then simulate it in its K lowest vibration modes (default 0: full
+//                          simulation).  --cloths sets the number of modal cloths, --wind the air velocity of the
+//                          gusts, which drag them through --air-damping.  Cannot be combined with --save, --record, --tear,
+//                          --strain-limit, --watchdog, --membrane, --sleep, --compact or --sphere
+//    --modal-cache <file>  Load the modes from this file, or compute them and save them there (default: none)
+//    --warping <on|off>    Rotate the modal displacements with the cloth, for large motions (default: on)
+//    --trace <file>        Write a Chrome trace of the profiled phases (TISSU_ENABLE_PROFILING)
+//    --trace-start <n>     First step of the trace (default 0)
+//    --trace-frames <n>    Number of steps in the trace (default 10)
+//
+class HeadlessRunner
+{
+public:
+    HeadlessRunner();
+    virtual ~HeadlessRunner();
+
+    // Returns true if the command line asks for a headless run.
+    static bool isRequested(int argc, char* argv[]);
+
+    // Parse the command line. Returns false and prints usage on invalid options.
+    bool parse(int argc, char* argv[]);
+
+    // Run the simulation. Returns the process exit code.
+    int run();
+
+private:
+    bool createCloth();
+    int runCompact();
+    int runScene();
+    int runModal();
+
+    // Apply the solver and strain limiting options to @a cloth.
+    void configureSolver(Cloth* cloth) const;
+
+    // Apply a parameter or pin edit sent by a remote viewer to m_cloth.
+    void applyCommand(const StreamCommand& command, DampingField& airDamping, StabilityWatchdog& watchdog);
+
+    Cloth* m_cloth;
+    SnapshotParams m_params;
+
+    std::string m_loadFilename;
+    std::string m_saveFilename;
+    std::string m_recordFilename;
+    std::string m_streamAddress;
+    std::string m_autotuneFilename; // Cache of tuned configurations (empty: no tuning)
+    std::string m_traceFilename;
+    int m_traceStart, m_traceFrames;
+    std::string m_scenario;
+    std::string m_meshFilename;
+    int m_nx, m_ny;
+    float m_width, m_height;
+    int m_steps;
+    float m_dt;                     // Time step override (0 keeps the default or snapshot value)
+    int m_integrator;               // Integrator override (-1 keeps the default or snapshot value)
+    int m_solverMethod;             // Iteration of the implicit solver (eSolverMethods)
+    int m_solverIterations;
+    float m_solverTolerance;
+    float m_jacobianTolerance;
+    uint32_t m_implicitMaterials;   // Spring classes integrated implicitly by imex (bit per eClothMaterials)
+    float m_tearStrain;             // Tear strain override (negative keeps the default or snapshot value)
+    float m_maxStrain;              // Strain limit (0: none)
+    int m_order;                    // Particle order (-1 keeps the default order)
+    bool m_watchdog;                // Run the integrator through a StabilityWatchdog
+    bool m_sleeping;                // Let settled regions sleep
+    bool m_useWind;
+    float m_wind[3];                // Wind velocity
+    float m_airDamping;             // Air drag per unit mass (0: none)
+    float m_youngsModulus;          // Membrane Young's modulus (0: springs only)
+    float m_poissonRatio;
+    bool m_compact;                 // Simulate a CompactCloth instead of m_cloth
+    int m_numCloths;                // Copies of the cloth in the scene
+    bool m_useSphere;
+    float m_sphere[4];              // Sphere collider center and radius
+    int m_numThreads;               // Scene threads (0: all hardware threads)
+    int m_numModes;                 // Modes of the reduced-order cloths (0: full simulation)
+    std::string m_modalCacheFilename;
+    bool m_warping;                 // Modal warping of the reduced-order cloths
+};
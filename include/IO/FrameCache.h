@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * @file FrameCache.h
+ *
+ * @brief Random access reader for frame caches written by FrameRecorder.
+ *
+ */
+
+#include "IO/FrameCodec.h"
+#include "IO/FrameRecorder.h"
+#include "IO/MappedFile.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays back a memory-mapped frame cache.
+//
+//  Any frame is decoded from the closest preceding keyframe, so a seek costs
+//  at most keyframeInterval frame decodes whatever the length of the cache.
+//  A prefetch thread decodes the frames that follow the last requested one
+//  into a small pool of decoded frames, so sequential playback and scrubbing
+//  around the play head are served without decoding on the caller's thread.
+//
+class FrameCache
+{
+public:
+    FrameCache(int _numCachedFrames = 64, int _lookahead = 16);
+    virtual ~FrameCache();
+
+    // Map and validate @a filename and start the prefetch thread.
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return m_header != nullptr; }
+
+    int getNumFrames() const { return m_header ? (int)m_header->numFrames : 0; }
+    int getNumParticles() const { return m_header ? (int)m_header->numParticles : 0; }
+    int getNumTriangles() const { return m_header ? (int)m_header->numTriangles : 0; }
+    const int32_t* getTriangles() const { return reinterpret_cast<const int32_t*>(m_file.data() + m_header->trianglesOffset); }
+
+    // Memory used by the decoded frames, in bytes (the mapped file is not counted).
+    size_t getMemoryUsage() const { return (m_slots.size() + 2) * 3 * (size_t)getNumParticles() * sizeof(float); }
+
+    // Copy the positions of @a frame (3 floats per particle) to @a positions and
+    // prefetch the frames that follow. Returns false if the frame cannot be decoded.
+    bool getFrame(int frame, float* positions);
+
+private:
+    struct Slot
+    {
+        int frame;                  // -1 when the slot is free
+        uint64_t lastUse;
+        std::vector<float> positions;
+    };
+
+    // Sequential decoder state.
+    struct Decoder
+    {
+        FrameCodec codec;
+        int frame;                  // Last decoded frame (-1 if none)
+        std::vector<float> positions;
+
+        Decoder(int numParticles, float quantum) : codec(numParticles, quantum), frame(-1), positions(3 * numParticles) {}
+    };
+
+    bool isKeyframe(int frame) const { return (record(frame)->flags & 1) != 0; }
+    const FrameRecordHeader* record(int frame) const { return reinterpret_cast<const FrameRecordHeader*>(m_file.data() + m_index[frame]); }
+
+    // Advance @a decoder to @a frame, restarting from a keyframe if needed.
+    bool decode(Decoder& decoder, int frame) const;
+
+    // Store a decoded frame in the least recently used slot. Requires m_mutex.
+    void store(int frame, const float* positions);
+    Slot* find(int frame);
+
+    void prefetchLoop();
+
+    int m_numCachedFrames;
+    int m_lookahead;
+
+    MappedFile m_file;
+    const FrameCacheHeader* m_header;
+    const uint64_t* m_index;
+
+    Decoder* m_decoder;             // Used by getFrame() on cache misses
+
+    std::vector<Slot> m_slots;
+    uint64_t m_useCounter;
+    int m_prefetchFrame;            // First frame the prefetch thread should decode (-1 when idle)
+    bool m_quit;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::thread m_thread;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+/**
+ * @file FrameCodec.h
+ *
+ * @brief Compact encoding of particle position frames.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encodes frames of particle positions (3 floats per particle).
+//
+//  Positions are quantized to multiples of a fixed quantum, then predicted
+//  from the previous frames (constant velocity extrapolation) or, for
+//  keyframes, from the previous particle.  The residuals are zigzag varint
+//  coded and runs of zeros (pinned or resting particles) are run-length coded.
+//
+//  Frames must be decoded in the order they were encoded, starting from a
+//  keyframe.  Encoder and decoder keep the same reconstructed history, so the
+//  quantization error never accumulates.
+//
+class FrameCodec
+{
+public:
+    FrameCodec(int _numParticles, float _quantum);
+
+    // Append the encoding of @a positions to @a out.
+    void encode(const float* positions, bool keyframe, std::vector<uint8_t>& out);
+
+    // Decode the frame in [data, data+size) into @a positions.
+    // Returns false if the data is malformed.
+    bool decode(const uint8_t* data, size_t size, bool keyframe, float* positions);
+
+    // Forget the previous frames; the next frame must be a keyframe.
+    void reset() { m_history = 0; }
+
+    int getNumParticles() const { return m_numValues / 3; }
+    float getQuantum() const { return m_quantum; }
+
+private:
+    // Prediction of value @a k of the current frame.
+    int64_t predict(int k, bool keyframe) const
+    {
+        if (keyframe)
+            return (k >= 3) ? m_current[k - 3] : 0;
+        if (m_history == 1)
+            return m_previous[k];
+        return 2 * (int64_t)m_previous[k] - m_beforePrevious[k];
+    }
+
+    // Shift the history after the current frame has been reconstructed.
+    void advance(bool keyframe);
+
+    int m_numValues;
+    float m_quantum;
+    int m_history;                          // Number of valid previous frames (0, 1 or 2)
+    std::vector<int32_t> m_current;         // Quantized values of the frame being coded
+    std::vector<int32_t> m_previous;
+    std::vector<int32_t> m_beforePrevious;
+};
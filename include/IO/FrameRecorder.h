@@ -0,0 +1,116 @@
+#pragma once
+
+/**
+ * @file FrameRecorder.h
+ *
+ * @brief Asynchronous recording of particle positions to a compressed frame cache.
+ *
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ParticleSystem;
+class Cloth;
+
+// Header at the beginning of a frame cache file.
+//
+//  The file is laid out as:
+//
+//    header          FrameCacheHeader
+//    triangles       int32[3 * numTriangles]
+//    frames          numFrames records, each made of a FrameRecordHeader
+//                    followed by the FrameCodec payload
+//    padding         zeros up to a multiple of 8 bytes
+//    index           uint64[numFrames] (file offset of every record)
+//
+//  Frames are grouped in chunks that start with a keyframe every
+//  keyframeInterval frames, so any frame can be decoded from the closest
+//  preceding keyframe.  indexOffset and numFrames are written when the
+//  recording is closed; a cache with indexOffset == 0 is incomplete.
+//
+struct FrameCacheHeader
+{
+    char magic[8];                  // "CLTHFRMS"
+    uint32_t version;
+    uint32_t numParticles;
+    uint32_t numTriangles;
+    uint32_t keyframeInterval;
+    float quantum;
+    uint32_t reserved;
+    uint64_t trianglesOffset;
+    uint64_t indexOffset;
+    uint64_t numFrames;
+};
+
+struct FrameRecordHeader
+{
+    uint32_t size;                  // Payload size in bytes
+    uint32_t flags;                 // bit 0: keyframe
+};
+
+// Records the particle positions of every step without blocking the simulation.
+//
+//  record() copies the positions into a preallocated slot of a single-producer
+//  single-consumer ring.  A writer thread encodes the queued frames with a
+//  FrameCodec and appends them to the cache file.  If the writer falls behind
+//  and the ring is full, the frame is dropped and counted instead of waiting.
+//
+class FrameRecorder
+{
+public:
+    static const uint32_t kVersion = 1;
+
+    FrameRecorder(int _queueCapacity = 64, float _quantum = 1e-4f, int _keyframeInterval = 30);
+    virtual ~FrameRecorder();
+
+    // Create @a filename for the particles and triangles of @a cloth and start the writer thread.
+    bool open(const std::string& filename, const Cloth* cloth);
+
+    // Write the remaining queued frames and the frame index, then close the file.
+    void close();
+
+    // Queue the current positions of @a particleSystem. Never blocks.
+    void record(const ParticleSystem* particleSystem);
+
+    bool isOpen() const { return m_thread.joinable(); }
+
+    // Number of frames queued, written and dropped since open().
+    uint64_t getNumRecorded() const { return m_numRecorded; }
+    uint64_t getNumWritten() const { return m_numWritten.load(); }
+    uint64_t getNumDropped() const { return m_numDropped; }
+
+    // Bytes of frame data written so far.
+    uint64_t getBytesWritten() const { return m_bytesWritten.load(); }
+
+    // Memory used by the queue slots, in bytes.
+    size_t getMemoryUsage() const { return m_slots.size() * 3 * (size_t)m_numParticles * sizeof(float); }
+
+private:
+    void writerLoop();
+
+    int m_queueCapacity;
+    float m_quantum;
+    int m_keyframeInterval;
+    int m_numParticles;
+
+    std::ofstream m_file;
+    std::thread m_thread;
+
+    std::vector< std::vector<float> > m_slots;
+    std::atomic<uint64_t> m_head;           // Next slot to fill (producer)
+    std::atomic<uint64_t> m_tail;           // Next slot to write (consumer)
+    std::atomic<bool> m_quit;
+
+    uint64_t m_numRecorded;
+    uint64_t m_numDropped;
+    std::atomic<uint64_t> m_numWritten;
+    std::atomic<uint64_t> m_bytesWritten;
+
+    FrameCacheHeader m_header;
+    std::vector<uint64_t> m_index;          // Owned by the writer thread until close()
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+/**
+ * @file FrameStream.h
+ *
+ * @brief Live streaming of particle position frames to a remote viewer over a socket.
+ *
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Cloth;
+class FrameCodec;
+
+// Messages of a frame stream.
+//
+//  Every message is a StreamMessageHeader followed by its payload, in the
+//  native byte order of the server (StreamTopology::byteOrder):
+//
+//    kStreamTopology     StreamTopology, int32[3 * numTriangles] triangles,
+//                        uint8[numParticles] pins.  Sent first, and again
+//                        whenever springs are torn
+//    kStreamPins         uint8[numParticles], sent when particles are pinned
+//                        or unpinned
+//    kStreamFrame        StreamFrameHeader followed by the FrameCodec payload
+//    kStreamCommand      StreamCommand, from the viewer to the simulation
+//
+//  The first frame after a topology message is a keyframe; the following
+//  ones are predicted from the frames sent before them, so the viewer must
+//  decode every frame it receives, in order.
+//
+enum eStreamMessages {
+    kStreamTopology = 1,
+    kStreamPins,
+    kStreamFrame,
+    kStreamCommand
+};
+
+struct StreamMessageHeader
+{
+    uint32_t type;                  // eStreamMessages
+    uint32_t size;                  // Payload size in bytes
+};
+
+struct StreamTopology
+{
+    char magic[8];                  // "CLTHSTRM"
+    uint32_t version;
+    uint32_t byteOrder;             // 0x01020304 written in native order
+    uint32_t numParticles;
+    uint32_t numTriangles;
+    float quantum;
+    uint32_t reserved;
+};
+
+struct StreamFrameHeader
+{
+    uint64_t step;                  // Simulation step of the frame
+    uint32_t flags;                 // bit 0: keyframe
+    uint32_t reserved;
+};
+
+// Commands sent back by the viewer.
+//
+enum eStreamCommands {
+    kSetParameter = 0,              // Set the parameter called name to value
+    kPinParticle                    // Pin particle (value != 0) or unpin it (value == 0)
+};
+
+struct StreamCommand
+{
+    uint32_t type;                  // eStreamCommands
+    int32_t particle;
+    float value;
+    char name[20];                  // Null-terminated parameter name
+};
+
+// Streams the particle positions of a simulation to one viewer at a time.
+//
+//  Addresses are either "unix:<path>" for a Unix-domain socket or
+//  "<host>:<port>" for TCP (an empty host listens on all interfaces).
+//
+//  publish() copies the positions into a preallocated slot of a
+//  single-producer single-consumer ring, as FrameRecorder::record() does,
+//  and never blocks.  A sender thread accepts the viewer, sends the topology,
+//  then encodes and sends the most recent queued frame, skipping the older
+//  ones: a slow viewer or network fills the socket buffer, which blocks the
+//  sender, so frames are dropped instead of delaying the simulation or
+//  showing stale positions.  The sender also reads the commands of the
+//  viewer, which the simulation takes with pollCommands().
+//
+//  When the viewer disconnects, the sender waits for the next one.
+//
+class FrameStreamServer
+{
+public:
+    static const uint32_t kVersion = 1;
+
+    FrameStreamServer(int _queueCapacity = 4, float _quantum = 1e-4f);
+    virtual ~FrameStreamServer();
+
+    // Listen on @a address for viewers of @a cloth and start the sender thread.
+    bool open(const std::string& address, const Cloth* cloth);
+
+    // Stop the sender thread and close the sockets.
+    void close();
+
+    bool isOpen() const { return m_thread.joinable(); }
+    bool isConnected() const { return m_connected.load(); }
+
+    // Queue the current positions and pins of @a cloth as frame @a step.
+    // Never blocks.
+    void publish(const Cloth* cloth, uint64_t step);
+
+    // Move the commands received since the last call to @a commands.
+    void pollCommands(std::vector<StreamCommand>& commands);
+
+    // Frames published, sent and dropped since open().
+    uint64_t getNumPublished() const { return m_numPublished; }
+    uint64_t getNumSent() const { return m_numSent.load(); }
+    uint64_t getNumDropped() const { return m_numPublished - m_numSent.load(); }
+
+    // Bytes sent so far, headers included.
+    uint64_t getBytesSent() const { return m_bytesSent.load(); }
+
+private:
+    struct Slot
+    {
+        uint64_t step;
+        std::vector<float> positions;
+        std::vector<uint8_t> pins;
+    };
+
+    void senderLoop();
+
+    // Send the topology, pins and frames to the connected viewer until it
+    // disconnects or the server closes.
+    void serve(int socket);
+
+    int m_queueCapacity;
+    float m_quantum;
+    int m_numParticles;
+    int m_listenSocket;
+    std::string m_unixPath;                 // Socket file to remove on close()
+
+    std::thread m_thread;
+    std::vector<Slot> m_slots;
+    std::atomic<uint64_t> m_head;           // Next slot to fill (producer)
+    std::atomic<uint64_t> m_tail;           // Next slot to send (consumer)
+    std::atomic<bool> m_quit;
+    std::atomic<bool> m_connected;
+
+    std::mutex m_mutex;                     // Guards the triangles and the commands
+    std::vector<int32_t> m_triangles;
+    unsigned int m_topologyVersion;         // Incremented when m_triangles changes
+    unsigned int m_clothTopologyVersion;    // Cloth topology version of m_triangles
+    std::vector<StreamCommand> m_commands;
+
+    uint64_t m_numPublished;
+    std::atomic<uint64_t> m_numSent;
+    std::atomic<uint64_t> m_bytesSent;
+};
+
+// Receives a frame stream and sends commands back, for a viewer.
+//
+//  receive() never blocks: it reads what the socket has and decodes the
+//  complete frames, so it can be called once per rendered frame.
+//
+class FrameStreamClient
+{
+public:
+    FrameStreamClient();
+    virtual ~FrameStreamClient();
+
+    // Connect to the server at @a address and wait for the topology.
+    bool connect(const std::string& address);
+    void close();
+
+    bool isConnected() const { return m_socket >= 0; }
+
+    // Decode the frames received so far into getPositions().  Returns true if
+    // at least one frame was decoded; the topology and pins may have changed
+    // too (getTopologyVersion(), getPinsVersion()).  Closes the connection
+    // and returns false if the server disconnected or sent malformed data.
+    bool receive();
+
+    bool sendCommand(const StreamCommand& command);
+    bool setParameter(const char* name, float value);
+    bool pinParticle(int particle, bool pinned);
+
+    int getNumParticles() const { return (int)m_pins.size(); }
+    const std::vector<int32_t>& getTriangles() const { return m_triangles; }
+    const std::vector<uint8_t>& getPins() const { return m_pins; }
+    const std::vector<float>& getPositions() const { return m_positions; }
+
+    // Incremented when a new topology or new pins are received.
+    unsigned int getTopologyVersion() const { return m_topologyVersion; }
+    unsigned int getPinsVersion() const { return m_pinsVersion; }
+
+    // Step of the last decoded frame, frames and bytes received so far.
+    uint64_t getStep() const { return m_step; }
+    uint64_t getNumReceived() const { return m_numReceived; }
+    uint64_t getBytesReceived() const { return m_bytesReceived; }
+
+private:
+    // Handle a message of type @a type with the payload [data, data+size),
+    // setting @a decoded if it is a frame.  Returns false if it is malformed.
+    bool handleMessage(uint32_t type, const uint8_t* data, size_t size, bool& decoded);
+
+    int m_socket;
+    std::vector<uint8_t> m_buffer;          // Received bytes not handled yet
+    FrameCodec* m_codec;
+    std::vector<int32_t> m_triangles;
+    std::vector<uint8_t> m_pins;
+    std::vector<float> m_positions;
+    unsigned int m_topologyVersion;
+    unsigned int m_pinsVersion;
+    uint64_t m_step;
+    uint64_t m_numReceived;
+    uint64_t m_bytesReceived;
+};
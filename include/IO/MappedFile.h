@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * @file MappedFile.h
+ *
+ * @brief Read-only memory mapping of a file.
+ *
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A read-only view of a whole file.
+//
+//  The file is memory-mapped where the platform supports it, otherwise it is
+//  read into memory.  The data stays valid until close() is called or the
+//  object is destroyed.
+//
+class MappedFile
+{
+public:
+    MappedFile();
+    virtual ~MappedFile();
+
+    // Map the file @a filename. Returns false if it could not be opened.
+    bool open(const std::string& filename);
+
+    void close();
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* m_data;
+    size_t m_size;
+    bool m_mapped;                  // True if m_data is a memory mapping, false if it points into m_buffer
+    std::vector<char> m_buffer;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+/**
+ * @file MeshLoader.h
+ *
+ * @brief Fast loaders for triangle meshes (Wavefront OBJ and binary PLY).
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A triangle mesh as loaded from disk.
+//
+struct TriangleMesh
+{
+    std::vector<Eigen::Vector3f> vertices;
+    std::vector<std::array<int, 3>> triangles;
+};
+
+// Loads triangle meshes from memory-mapped files.
+//
+//  OBJ files are split into line-aligned chunks that are parsed in parallel.
+//  Only vertex positions ('v') and faces ('f') are read; polygons are
+//  triangulated as fans.
+//
+//  PLY files must be binary (little or big endian) with a 'vertex' element
+//  holding x, y, z and a 'face' element holding a list of vertex indices.
+//
+class MeshLoader
+{
+public:
+
+    // Load the mesh @a filename, choosing the format from the file extension.
+    // Returns false and prints an error if the file cannot be loaded.
+    static bool load(const std::string& filename, TriangleMesh& mesh);
+
+    static bool loadOBJ(const char* data, size_t size, TriangleMesh& mesh);
+
+    static bool loadPLY(const char* data, size_t size, TriangleMesh& mesh);
+};
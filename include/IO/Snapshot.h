@@ -0,0 +1,101 @@
+#pragma once
+
+/**
+ * @file Snapshot.h
+ *
+ * @brief Binary snapshots of a cloth simulation (topology, parameters and state).
+ *
+ */
+
+#include "IO/MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+class Cloth;
+
+// Simulation parameters saved alongside the cloth.
+//
+struct SnapshotParams
+{
+    float dt;
+    float structuralStiffness;
+    float shearStiffness;
+    float bendingStiffness;
+    float damping;
+    int32_t integrator;             // One of eIntegrators
+
+    SnapshotParams() : dt(0.01f), structuralStiffness(1000.0f), shearStiffness(250.0f), bendingStiffness(50.0f), damping(0.0f), integrator(0) {}
+};
+
+// Fixed-size header at the beginning of a snapshot file.
+//
+//  Every array is stored in native byte order at a 64-byte aligned offset
+//  from the beginning of the file, so a mapped file can be used in place:
+//
+//    positions       float[3 * numParticles]
+//    velocities      float[3 * numParticles]
+//    masses          float[numParticles]
+//    flags           uint8[numParticles]       (bit 0: fixed)
+//    springs         int32[2 * numSprings]     (particle indices)
+//    springMaterials int32[numSprings]         (index in materials)
+//    restLengths     float[numSprings]
+//    materials       float[3 * numMaterials]   (k, b, tearStrain)
+//    triangles       int32[3 * numTriangles]
+//
+struct SnapshotHeader
+{
+    char magic[8];                  // "CLTHSNAP"
+    uint32_t version;
+    uint32_t byteOrder;             // 0x01020304 written in native order
+    uint32_t numParticles, numSprings, numTriangles, numMaterials;
+    int32_t width, height;
+    int32_t structuralIndex, shearIndex, bendingIndex;
+    SnapshotParams params;
+    uint64_t positions, velocities, masses, flags, springs, springMaterials, restLengths, materials, triangles;
+    uint64_t fileSize;
+};
+
+// Read-only view of a memory-mapped snapshot file.
+//
+class SnapshotView
+{
+public:
+    // Map and validate @a filename. Returns false and prints an error if it is not a valid snapshot.
+    bool open(const std::string& filename);
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(m_file.data()); }
+
+    const float* positions() const { return array<float>(header().positions); }
+    const float* velocities() const { return array<float>(header().velocities); }
+    const float* masses() const { return array<float>(header().masses); }
+    const uint8_t* flags() const { return array<uint8_t>(header().flags); }
+    const int32_t* springs() const { return array<int32_t>(header().springs); }
+    const int32_t* springMaterials() const { return array<int32_t>(header().springMaterials); }
+    const float* restLengths() const { return array<float>(header().restLengths); }
+    const float* materials() const { return array<float>(header().materials); }
+    const int32_t* triangles() const { return array<int32_t>(header().triangles); }
+
+private:
+    template<typename T>
+    const T* array(uint64_t offset) const { return reinterpret_cast<const T*>(m_file.data() + offset); }
+
+    MappedFile m_file;
+};
+
+// Saves and restores the full state of a cloth simulation.
+//
+class Snapshot
+{
+public:
+
+    static const uint32_t kVersion = 3;
+
+    // Write @a cloth and @a params to @a filename. Returns false on I/O errors,
+    // or if the cloth has a membrane, which snapshots do not store.
+    static bool save(const std::string& filename, const Cloth* cloth, const SnapshotParams& params);
+
+    // Create a cloth from the snapshot @a filename and optionally return its
+    // parameters in @a params. Returns nullptr if the snapshot cannot be read.
+    static Cloth* load(const std::string& filename, SnapshotParams* params);
+};
@@ -14,6 +14,7 @@
 #include "Integrators/Integrator.h"
 #include "Solvers/MatrixFreePGS.h"
 #include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
 
 #include <Eigen/Dense>
 
@@ -30,13 +31,14 @@ public:
     //  Use deltav to compute updated velocities  v = v + deltav,
     //  and then update positions  x = x + dt*v
     //
-    //  A single iteration of the algorithm is sufficient.
+    //  A single iteration of the algorithm is sufficient.  The solver of the
+    //  particle system sets the iteration and the number of sweeps.
     //
     virtual void step(ParticleSystem* particleSystem, float dt) override{
-        std::vector<Eigen::Vector3f> deltav(particleSystem->getParticles().size(), Eigen::Vector3f::Zero());
-        MatrixFreePGS solver(particleSystem);
-        solver.solve(dt, deltav);
+        std::vector<Eigen::Vector3f> deltav;
+        particleSystem->getSolver()->solve(dt, deltav);
 
+        PROFILE_SCOPE("integrator update");
         for(Particle* p : particleSystem->getParticles())
         {
             p->v += deltav[p->index]; // Update velocities
@@ -0,0 +1,45 @@
+#pragma once
+
+/**
+ * @file ImplicitExplicitEuler.hpp
+ *
+ * @brief Implicit-explicit Euler integration.
+ *
+ */
+
+#include "Integrators/Integrator.h"
+#include "Solvers/MatrixFreePGS.h"
+#include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
+
+#include <Eigen/Dense>
+
+// Implicit Euler on the stiff springs, explicit Euler on the others.
+//
+//  Only the springs of the implicit materials of the particle system
+//  (ParticleSystem::getImplicitMaterials(), the structural springs of a
+//  Cloth by default) enter the Jacobian of the linear system
+//             (M - dt*dfdv - dt*dt*dfdx_implicit) deltav = h*f + dt*dt*dfdx_implicit*v0
+//  while the forces of every spring are in f.  The softer springs are
+//  integrated explicitly, so the time step is bounded by their stiffness
+//  only.  The system has fewer off-diagonal blocks and a smaller spectral
+//  radius than the one of ImplicitEuler, which makes each sweep cheaper and
+//  the iterations converge faster.  The membrane and the force fields stay
+//  implicit.
+//
+class ImplicitExplicitEuler : public Integrator
+{
+public:
+
+    virtual void step(ParticleSystem* particleSystem, float dt) override{
+        std::vector<Eigen::Vector3f> deltav;
+        particleSystem->getSolver()->solve(dt, deltav, particleSystem->getImplicitMaterials());
+
+        PROFILE_SCOPE("integrator update");
+        for(Particle* p : particleSystem->getParticles())
+        {
+            p->v += deltav[p->index]; // Update velocities
+            p->x += dt * p->v;        // Update positions
+        }
+    }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @file Integrators.h
+ *
+ * @brief Table of the available integration methods.
+ *
+ */
+
+class Integrator;
+
+enum eIntegrators {
+    kExplicitEuler = 0,
+    kMidpoint,
+    kSemiImplicitEuler,
+    kImplicitEuler,
+    kImplicitExplicitEuler,
+    kNumIntegrators
+};
+
+// Returns the shared instance of integrator @a index (one of eIntegrators).
+Integrator* getIntegrator(int index);
+
+// Returns a short lowercase name for integrator @a index, as used on the command line.
+const char* getIntegratorName(int index);
+
+// Returns the index of the integrator named @a name, or -1 if there is none.
+int findIntegrator(const char* name);
@@ -13,6 +13,7 @@
 
 #include "Integrator.h"
 #include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
 
 #include <Eigen/Dense>
 
@@ -25,6 +26,7 @@ public:
     //
     virtual void step(ParticleSystem* particleSystem, float dt) override
     {
+        PROFILE_SCOPE("integrator update");
         Eigen::VectorXf dqdt;
         particleSystem->derivs(dqdt);
         Eigen::VectorXf q;
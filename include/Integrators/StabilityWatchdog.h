@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * @file StabilityWatchdog.h
+ *
+ * @brief Detects unstable time steps and retries them with a smaller step or a more stable integrator.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+
+class ParticleSystem;
+
+// Guards the integration of a particle system against blow-ups.
+//
+//  The watchdog reads the energies computed by ParticleSystem::computeForces()
+//  at the beginning of every step.  If the state is not finite, or if the last
+//  step gained more energy than the tolerance, the previous state is restored
+//  and the step is taken again with half the time step.  Once the time step
+//  has been halved kMaxHalvings times, the watchdog switches to the next more
+//  stable integrator (explicit, midpoint -> semi-implicit -> implicit, and
+//  imex -> implicit) at the full time step.
+//
+//  Without external work the total energy can only decrease, so the watchdog
+//  also falls back to a more stable integrator when the energy drifts above
+//  the lowest energy reached by a large fraction of the kinetic and spring
+//  energy, even if every step passed the test.
+//
+//  After kCalmSteps accepted steps in a row, a reduced time step grows back
+//  by kGrowth, up to the requested time step.
+//
+//  The tolerances are relative to the kinetic and spring energy, plus the
+//  energy error of explicit steps in free fall, so that a cloth dropped from
+//  rest is not mistaken for a blow-up, plus the work of the force fields
+//  (e.g. wind) and of the strain limiter.  External forces added after
+//  computeForces() are not accounted for; call discardCheckpoint() while
+//  they are applied.
+//
+class StabilityWatchdog
+{
+public:
+    static const int kMaxHalvings = 6;       // Halvings of dt before falling back to a more stable integrator
+    static const int kCalmSteps = 60;        // Accepted steps before a reduced dt grows again
+    static constexpr float kGrowth = 1.25f;  // Growth factor of a reduced dt
+
+    StabilityWatchdog();
+
+    // Forget the saved state and go back to the integrator @a integrator at the requested time step.
+    void reset(int integrator);
+
+    // Accept the next state whatever its energy, e.g. after the state or the
+    // materials were edited, or while external work is done on the system.
+    void discardCheckpoint() { m_hasCheckpoint = false; }
+
+    // Advance @a particleSystem by one step of at most @a dt, followed by
+    // ParticleSystem::limitStrain().  computeForces() must have been called on
+    // the current state.  Returns false if the state could not be recovered
+    // (the last integrator failed at the smallest step).
+    bool step(ParticleSystem* particleSystem, float dt);
+
+    // Integrator and time step used by the last step.
+    int getCurrentIntegrator() const { return m_integrator; }
+    float getTimeStep(float dt) const { return dt * m_scale; }
+
+    int getNumRollbacks() const { return m_numRollbacks; }
+
+    // Energy gain tolerated per step, relative to the kinetic and spring energy.
+    void setTolerance(float _tolerance) { m_tolerance = _tolerance; }
+
+    // Energy drift tolerated before falling back to a more stable integrator,
+    // relative to the largest kinetic and spring energy reached without drift.
+    void setMaxDrift(float _maxDrift) { m_maxDrift = _maxDrift; }
+
+private:
+
+    // Switch to the next more stable integrator. Returns false if there is none.
+    bool fallBack();
+
+    // Energy gain tolerated for the step taken from the checkpoint.
+    float allowedGain(const ParticleSystem* particleSystem) const;
+
+    // Energy error of one explicit Euler step @a dt in free fall.
+    float freeFallError(float dt) const { return 0.5f * m_freeMass * 9.81f * 9.81f * dt * dt; }
+
+    // Work done by the force fields and the strain limiter during the step taken from the checkpoint.
+    float externalWork() const { return std::max(0.0f, m_checkpointPower) * m_checkpointDt + std::max(0.0f, m_limiterWork); }
+
+    int m_integrator;           // Integrator currently used (eIntegrators)
+    float m_scale;              // Fraction of the requested time step currently used
+    int m_halvings;             // Number of halvings in m_scale
+    int m_calmSteps;            // Steps accepted since the last rollback or growth
+    int m_numRollbacks;
+    float m_tolerance;
+    float m_maxDrift;
+
+    bool m_hasCheckpoint;
+    Eigen::VectorXf m_checkpoint;   // State before the last step
+    float m_checkpointEnergy;       // Total energy of m_checkpoint
+    float m_checkpointScale;        // Kinetic plus spring energy of m_checkpoint
+    float m_checkpointPower;        // Power of the force fields on m_checkpoint
+    float m_checkpointDt;           // Time step taken from m_checkpoint
+    float m_limiterWork;            // Energy added by the strain limiter after the step taken from m_checkpoint
+    float m_referenceEnergy;        // Lowest total energy reached, plus the free fall error and field work allowed since
+    float m_motionScale;            // Largest kinetic plus spring energy of a state below the reference energy
+    float m_freeMass;               // Mass of the particles that are not fixed
+};
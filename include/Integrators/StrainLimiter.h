@@ -0,0 +1,130 @@
+#pragma once
+
+/**
+ * @file StrainLimiter.h
+ *
+ * @brief Post-step filter that keeps the springs of a particle system within a maximum strain.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleSystem;
+
+// Limits the elongation of the springs after each integration step.
+//
+//  Every spring stretched beyond (1 + max strain) times its rest length is
+//  shortened back to that length, by moving its two particles along the
+//  spring in proportion to their inverse masses; fixed and sleeping
+//  particles do not move.  The position correction divided by the time step
+//  is added to the velocities, so that the stretching motion is removed too.
+//  The corrections are repeated until an iteration finds no spring beyond
+//  the limit, for at most the max iterations.
+//
+//  Corrections spread by one spring per iteration, so a cloth hanging from
+//  its top row would need as many iterations as it has rows.  Long range
+//  attachments carry them from the fixed particles first: every particle is
+//  kept within (1 + max strain) times the rest length of the shortest path
+//  of limited springs to its closest fixed particle, a constraint implied
+//  by the spring limits.  The paths are computed again when the topology or
+//  the pins change.
+//
+//  The springs are split into colors such that no two springs of a color
+//  share a particle, and the springs of a color are corrected in parallel.
+//  The colors are computed again when the topology changes.
+//
+//  A moderate stiffness with strain limiting stretches no more than a very
+//  stiff cloth, which needs a much smaller time step.  A particle system
+//  owns one (ParticleSystem::getStrainLimiter()), applied after every step
+//  by ParticleSystem::limitStrain().
+//
+class StrainLimiter
+{
+public:
+    static const int kDefaultIterations = 0;        // Automatic cap
+    static const int kMinIterations = 10;
+    static constexpr float kIterationsPerSide = 4.0f;
+
+    StrainLimiter(ParticleSystem* _particleSystem);
+
+    // Correct the positions and velocities of the particles after a step @a dt.
+    void apply(float dt);
+
+    // Relative elongation (l - r) / r allowed (0: no limit).
+    void setMaxStrain(float _maxStrain) { m_maxStrain = _maxStrain; }
+    float getMaxStrain() const { return m_maxStrain; }
+
+    // Iteration cap (0: kIterationsPerSide times the square root of the
+    // number of particles, and at least kMinIterations).
+    void setMaxIterations(int _iters) { m_iters = _iters; }
+    int getMaxIterations() const { return m_iters; }
+
+    // Materials whose springs are limited, with bit m set for material m
+    // (materials from 32 on are always limited).  All materials by default.
+    void setMaterials(uint32_t _materials) { m_materials = _materials; m_colorStart.clear(); }
+    uint32_t getMaterials() const { return m_materials; }
+
+    // Iterations and corrected springs of the last apply().
+    int getNumIterations() const { return m_numIterations; }
+    int getNumCorrections() const { return m_numCorrections; }
+
+    // Largest strain of the limited springs after the last apply(), above
+    // the max strain if the iterations were capped.
+    float getRemainingStrain() const { return m_remainingStrain; }
+
+    // Kinetic and gravitational energy added by the last apply().  The
+    // corrections also lower the elastic energy of the springs they shorten,
+    // which is not counted.  Corrections that do not converge within the
+    // iterations are finished by the next steps, which can lift the cloth.
+    float getWork() const { return m_work; }
+    int getNumColors() const { return m_colorStart.empty() ? 0 : (int)m_colorStart.size() - 1; }
+
+    // Heap memory used by the colors, in bytes.
+    size_t getMemoryUsage() const;
+
+private:
+
+    // Color the limited springs greedily and sort them by color.
+    void colorSprings();
+
+    // Correct the springs of color @a color.  Returns the number of springs
+    // beyond the limit, adds the energy added by the corrections to @a work
+    // and raises @a maxStretchFound to the largest length over rest length
+    // found before the corrections.
+    int correctColor(int color, float dt, double& work, float& maxStretchFound);
+
+    // Find the closest fixed particle of every particle along the limited springs.
+    void computeAnchors();
+
+    // Bring the particles back within the limit of their anchor.  Returns the
+    // number of particles moved, and adds their energy change to @a work.
+    int attach(float dt, double& work);
+
+    // Largest length over rest length of the limited springs.
+    float measureStretch() const;
+
+    bool isLimited(int material) const { return material >= 32 || (m_materials >> material & 1) != 0; }
+
+    ParticleSystem* m_particleSystem;
+
+    float m_maxStrain;
+    int m_iters;
+    uint32_t m_materials;
+
+    std::vector<int> m_springOrder;         // Indices of the limited springs, by color
+    std::vector<int> m_colorStart;          // Springs of color c are m_springOrder[m_colorStart[c], m_colorStart[c + 1])
+    unsigned int m_colorTopologyVersion;    // Topology version of the colors
+    size_t m_colorSprings;                  // Number of springs of the particle system when colored
+
+    std::vector<int> m_anchors;             // Per particle, closest fixed particle (-1: none)
+    std::vector<float> m_anchorLengths;     // Per particle, rest length of the path to its anchor
+    std::vector<uint8_t> m_anchorFixed;     // Per particle, fixed flag when the anchors were computed
+    int m_autoIterations;                   // Automatic iteration cap
+
+    int m_numIterations;
+    int m_numCorrections;
+    float m_work;
+    float m_remainingStrain;
+};
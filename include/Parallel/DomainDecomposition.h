@@ -0,0 +1,94 @@
+#pragma once
+
+/**
+ * @file DomainDecomposition.h
+ *
+ * @brief Multi-process simulation of a cloth split into row tiles.
+ *
+ */
+
+#include <cstddef>
+#include <vector>
+
+class Cloth;
+class Integrator;
+
+struct SharedState;
+
+// Splits a grid Cloth into horizontal bands of rows (tiles), each one simulated
+// by a separate worker process forked from the caller.
+//
+//  Every worker owns a local copy of its rows plus a halo of neighbor rows wide
+//  enough to cover the longest spring (bending springs span two rows).
+//  Halo particles are pinned in the local copy and refreshed at the beginning
+//  of every step from shared-memory ring buffers filled by the neighbor tiles.
+//  After a step, each worker writes its owned particle states into a shared
+//  gather buffer that the coordinator copies back into the original cloth.
+//
+//  Halo rows hold the states of the beginning of the step.  Forward Euler and
+//  semi-implicit Euler only evaluate forces there, so they match the
+//  single-process result exactly.  Integrators that evaluate forces at an
+//  intermediate state, such as a midpoint step, see the halo rows frozen at
+//  the beginning of the step rather than at that state, so they only
+//  approximate it near the tile boundaries.  The implicit integrators solve
+//  every tile with its halo frozen, which is a one-sweep additive Schwarz
+//  (block Jacobi) method.
+//
+//  Workers run their OpenMP loops on a single thread, since the thread pool
+//  of the parent does not survive fork(); the tiles are the parallelism.
+//
+//  The strain limiter of the cloth is applied to every tile after its step,
+//  with the halo pinned, so a spring crossing a tile boundary is shortened
+//  from both sides and may end up slightly shorter than the limit.
+//
+//  Topology and pins are captured when the workers are started; call stop()
+//  and start() again after changing any of them.  The spring material table
+//  and the strain limiter settings are copied to the workers at every step.
+//  Springs do not tear in tiles, since a spring shared by two tiles could
+//  break in only one of them.  Force fields, sleeping and the stability
+//  watchdog are not applied either.
+//
+class DomainDecomposition
+{
+public:
+
+    DomainDecomposition(Cloth* _cloth, Integrator* _integrator, int _numTiles);
+    virtual ~DomainDecomposition();
+
+    // Fork one worker process per tile. Returns false if the processes could
+    // not be started (e.g. on platforms without fork()), or if the cloth is
+    // not a grid of springs (membrane elements are not split into tiles).
+    bool start();
+
+    // Terminate and reap the worker processes.
+    void stop();
+
+    // Advance all tiles by one time step @a dt and gather the particle states
+    // back into the cloth.  Returns false, and stops the workers, if a worker
+    // died or did not complete the step within kWorkerTimeout seconds.
+    bool step(float dt);
+
+    bool isRunning() const { return !m_workers.empty(); }
+
+    int getNumTiles() const { return m_numTiles; }
+
+    // Rows spanned by the halo on each side of a tile.
+    static const int kHaloRows = 2;
+
+    // Longest time the coordinator waits for a step of the workers, in seconds.
+    static constexpr float kWorkerTimeout = 10.0f;
+
+private:
+
+    void runWorker(int tile);
+
+    Cloth* m_cloth;
+    Integrator* m_integrator;
+    int m_numTiles;
+    std::vector<int> m_rowStart;        // First row of each tile, plus one past the last row
+
+    SharedState* m_shared;              // Shared memory mapping (control block, rings, gather buffer)
+    size_t m_sharedSize;
+    std::vector<int> m_workers;         // Worker process ids
+    unsigned long long m_step;          // Number of steps taken since start()
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * @file TaskGraph.h
+ *
+ * @brief Runs a graph of dependent tasks on a pool of threads.
+ *
+ */
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A directed acyclic graph of tasks executed by a persistent thread pool.
+//
+//  Tasks are added with addTask() and ordered with addDependency(); run()
+//  executes every task once, each one as soon as all of its predecessors are
+//  done, and returns when the whole graph is done.  The calling thread works
+//  on the graph too, so a graph with one thread runs the tasks in order on
+//  the caller.  The graph can then be run again, or cleared and rebuilt.
+//
+//  Tasks are meant to be coarse (e.g. stepping a whole cloth): ready tasks
+//  are taken from a single queue guarded by a mutex.
+//
+class TaskGraph
+{
+public:
+    // @a numThreads counts the calling thread; 0 uses every hardware thread.
+    explicit TaskGraph(int numThreads = 0);
+    virtual ~TaskGraph();
+
+    // Add a task and return its index.
+    int addTask(std::function<void()> work);
+
+    // Run task @a after once task @a before is done.
+    void addDependency(int before, int after);
+
+    // Execute all tasks and wait for them.
+    void run();
+
+    // Remove all tasks.
+    void clear();
+
+    int getNumTasks() const { return m_tasks.size(); }
+    int getNumThreads() const { return m_workers.size() + 1; }
+
+private:
+    struct Task
+    {
+        std::function<void()> work;
+        std::vector<int> successors;
+        int numPredecessors;
+        int remaining;                  // Predecessors not done yet during run()
+    };
+
+    void workerLoop();
+
+    // Run task @a t and queue the successors it releases.
+    void execute(int t);
+
+    std::vector<Task> m_tasks;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;                 // Guards everything below
+    std::condition_variable m_wakeUp;   // Tasks became ready, the graph is done, or the pool stops
+    std::vector<int> m_ready;           // Tasks whose predecessors are done
+    int m_numDone;
+    bool m_stop;
+};
@@ -8,8 +8,14 @@
  */
 
 #include <Eigen/Dense>
+#include <array>
+#include <cstdint>
 #include <vector>
 
+class ForceField;
+class MatrixFreePGS;
+class StrainLimiter;
+class TriangleMembrane;
 class Spring;
 
 // A 3D particle class.
@@ -30,20 +36,29 @@ public:
     Particle() : index(-1), fixed(false), x(0, 0, 0), v(0, 0, 0), f(0, 0, 0), m(1.0) {}
 };
 
+// Stiffness, damping and strength shared by a group of springs.
+//
+struct SpringMaterial
+{
+    float k;          // spring stiffness
+    float b;          // spring damping
+    float tearStrain; // relative elongation (l - r) / r beyond which springs break (0: never)
+
+    SpringMaterial(float _k = 0.0f, float _b = 0.0f, float _tearStrain = 0.0f) : k(_k), b(_b), tearStrain(_tearStrain) {}
+};
+
 // A spring between two particles.
 //
 class Spring
 {
 public:
     Particle *particles[2];
-    float k; // spring stiffness
-    float b; // spring damping
-    float r; // rest (neutral) length
-
-    Eigen::Matrix3f dfdx; // Stiffness matrix
-    Eigen::Matrix3f dfdv; // Damping matrix
+    int index;    // position in the springs of the particle system
+    int slots[2]; // position in the spring list of each particle
+    int material; // index in the material table of the particle system
+    float r;      // rest (neutral) length
 
-    Spring(Particle *_p0, Particle *_p1, float _k, float _b, float _r) : k(_k), b(_b), r(_r)
+    Spring(Particle *_p0, Particle *_p1, int _material, float _r) : index(-1), material(_material), r(_r)
     {
         assert(_p0 != nullptr);
         assert(_p1 != nullptr);
@@ -52,6 +67,8 @@ public:
         // by each particle
         particles[0] = _p0;
         particles[1] = _p1;
+        slots[0] = _p0->springs.size();
+        slots[1] = _p1->springs.size();
         _p0->springs.push_back({this, 0});
         _p1->springs.push_back({this, 1});
     }
@@ -64,18 +81,61 @@ class ParticleSystem
 protected:
     std::vector<Particle *> m_particles; // particles
     std::vector<Spring *> m_springs;     // springs
+    std::vector<SpringMaterial> m_materials; // spring materials, referenced by Spring::material
+    std::vector<Spring *> m_tearCandidates;  // springs stretched beyond their tear strain by the last computeForces()
+    unsigned int m_topologyVersion;          // incremented whenever springs are removed
+    unsigned int m_layoutVersion;            // incremented whenever the particles or springs are rebuilt
+    float m_kineticEnergy;                   // energies of the state seen by the last computeForces()
+    float m_elasticEnergy;
+    float m_gravityEnergy;
+    float m_fieldEnergy;
+    float m_externalPower;                   // power of the non-conservative force fields
+
+    std::vector<ForceField *> m_forceFields;     // force fields, not owned
+    std::vector<ForceField *> m_particleFields;  // fields evaluated in the particle loop
+    std::vector<ForceField *> m_triangleFields;  // fields evaluated in the spring loop
+    std::vector<ForceField *> m_jacobianFields;  // fields with Jacobian blocks
+    std::vector<Eigen::Matrix3f> m_fieldDfdx;    // Jacobian blocks of the force fields, per particle
+    std::vector<Eigen::Matrix3f> m_fieldDfdv;
+    TriangleMembrane *m_membrane;                // triangle elements, owned, or nullptr
+    MatrixFreePGS *m_solver;                     // implicit solver, owned, created when first used
+    uint32_t m_implicitMaterials;                // bit m set when the springs of material m are implicit (ImplicitExplicitEuler)
+    StrainLimiter *m_strainLimiter;              // post-step strain limiting, owned, created when first used
+
+    // Sleeping regions of kSleepRegionSize consecutive particles (see setSleeping()).
+    bool m_sleeping;
+    float m_sleepVelocity;                       // speed below which a particle is calm
+    float m_sleepAcceleration;                   // net force per unit mass below which a particle is calm
+    std::vector<uint8_t> m_regionAsleep;         // per region, empty when sleeping is off
+    std::vector<int> m_regionCalmSteps;          // consecutive calm steps of each awake region
+    std::vector<uint8_t> m_wakeRequests;         // regions disturbed by an awake neighbor during computeForces()
+    std::vector<Spring *> m_activeSprings;       // springs with an awake particle, in the order of m_springs
+    bool m_sleepDirty;                           // m_activeSprings and the sleeping energies are out of date
+    unsigned int m_activeTopologyVersion;        // topology version of m_activeSprings
+    double m_sleepingElasticEnergy;              // energies of the sleeping particles and springs
+    double m_sleepingGravityEnergy;
+    double m_sleepingFieldEnergy;
+
+    // Detach @a _spring from its particles and delete it.
+    void releaseSpring(Spring *_spring);
+
+    // Rebuild m_activeSprings and the energies of the sleeping part.
+    void updateActiveSprings();
+
+    // Put calm regions to sleep and wake the disturbed ones.
+    void updateSleeping();
 
 public:
-    ParticleSystem() : m_particles(), m_springs() {}
+    ParticleSystem() : m_particles(), m_springs(), m_materials(), m_topologyVersion(0), m_layoutVersion(0), m_kineticEnergy(0), m_elasticEnergy(0), m_gravityEnergy(0), m_fieldEnergy(0), m_externalPower(0), m_membrane(nullptr), m_solver(nullptr), m_implicitMaterials(1), m_strainLimiter(nullptr),
+        m_sleeping(false), m_sleepVelocity(0.02f), m_sleepAcceleration(0.2f), m_sleepDirty(false), m_activeTopologyVersion(0),
+        m_sleepingElasticEnergy(0), m_sleepingGravityEnergy(0), m_sleepingFieldEnergy(0) {}
 
-    virtual ~ParticleSystem()
-    {
-        clear();
-    }
+    virtual ~ParticleSystem();
 
-    // Clear all particles and all springs
+    // Clear all particles, all springs and the membrane. The material table is kept.
     void clear()
     {
+        setMembrane(nullptr);
         for (Particle *p : m_particles)
         {
             delete p;
@@ -86,6 +146,12 @@ public:
             delete s;
         }
         m_springs.clear();
+        m_tearCandidates.clear();
+        m_activeSprings.clear();
+        m_regionAsleep.clear();
+        m_sleepDirty = true;
+        ++m_topologyVersion;
+        ++m_layoutVersion;
     }
 
     // Add a particle.  The Particle is copied into m_particles.
@@ -96,11 +162,134 @@ public:
     //
     void addSpring(Spring *_spring);
 
+    // Remove and delete a spring in O(1). The last spring takes its place in m_springs.
+    //
+    virtual void removeSpring(Spring *_spring);
+
+    // Remove the springs that computeForces() found stretched beyond the tear
+    // strain of their material. Returns the number of springs removed.
+    //
+    int tearSprings();
+
+    // Changes whenever springs are removed, so that data derived from the
+    // topology can tell when it must be updated.
+    //
+    unsigned int getTopologyVersion() const { return m_topologyVersion; }
+
+    // Changes whenever the particles or springs are cleared, reordered or
+    // rebuilt, but not when springs are only removed: data kept per spring
+    // index can then follow the removals instead of starting over.
+    //
+    unsigned int getLayoutVersion() const { return m_layoutVersion; }
+
+    // Add a spring material and return its index.
+    //
+    int addMaterial(const SpringMaterial &_material);
+
     // Compute the forces acting on particles. The derivative vector @a dqdt has the layout :
     //   [ v1, f1/m1, v2, f2/m2, ... vn, fn/mn ]
     //
+    //  Gravity and the particle force fields are evaluated in one parallel loop
+    //  over the particles, then the springs and the triangle force fields in
+    //  one loop over the springs, which visits each triangle along with the
+    //  springs of its first particle.
+    //
     void computeForces();
 
+    // Add or remove a force field evaluated by computeForces() along with
+    // gravity and the springs.  The field is not owned by the particle system
+    // and must outlive it or be removed.
+    //
+    void addForceField(ForceField *_field);
+    void removeForceField(ForceField *_field);
+    const std::vector<ForceField *> &getForceFields() const { return m_forceFields; }
+
+    // Jacobian blocks of the force fields on each particle, with respect to
+    // its own position and velocity, computed by the last computeForces().
+    // Empty if no field has a Jacobian.
+    //
+    const std::vector<Eigen::Matrix3f> &getFieldDfdx() const { return m_fieldDfdx; }
+    const std::vector<Eigen::Matrix3f> &getFieldDfdv() const { return m_fieldDfdv; }
+
+    // Triangle elements evaluated by computeForces() and the implicit solver
+    // along with the springs.  The particle system takes ownership of @a _membrane and
+    // deletes the previous one.
+    //
+    void setMembrane(TriangleMembrane *_membrane);
+    TriangleMembrane *getMembrane() const { return m_membrane; }
+
+    // Solver of the implicit integrator, which keeps its settings and
+    // buffers between steps.  Created on the first call.
+    MatrixFreePGS *getSolver();
+
+    // Materials whose springs ImplicitExplicitEuler integrates implicitly, as
+    // a mask with bit m set for material m (materials from 32 on are always
+    // implicit).  The first material, the structural springs of a Cloth, by
+    // default.
+    void setImplicitMaterials(uint32_t _materials) { m_implicitMaterials = _materials; }
+    uint32_t getImplicitMaterials() const { return m_implicitMaterials; }
+
+    // Strain limiting applied by limitStrain(), which keeps its settings and
+    // colors between steps.  Created on the first call, with no limit.
+    StrainLimiter *getStrainLimiter();
+
+    // Apply the strain limiter, if any, after a step @a dt.  The callers of
+    // Integrator::step() call it after every step.  Returns the energy added
+    // by the corrections (StrainLimiter::getWork()).
+    float limitStrain(float dt);
+
+    // Surface triangles, as triplets of particle indices, read by the force
+    // fields with kTriangleInputs.  A particle system has none.
+    //
+    virtual const std::vector<std::array<int, 3>> &getTriangles() const;
+
+    // Sleeping.  Particles are grouped into regions of kSleepRegionSize
+    // consecutive indices, which are tiles of rows for a grid cloth and
+    // neighborhoods for a reordered mesh (see Cloth::reorder()).  A region
+    // whose particles all stay below the sleep velocity and net acceleration
+    // for kSleepSteps steps falls asleep: its velocities are set to zero, and
+    // its particles and the springs between them are no longer evaluated,
+    // solved or integrated, as if they were fixed.  A sleeping region wakes
+    // when a spring to an awake particle moving faster than twice the sleep
+    // velocity pulls on it, or when wakeParticle() or wakeAll() are called
+    // (collider contact, mouse spring, edits of the state or materials).
+    //
+    //  Sleeping is off by default.  The energies of the sleeping part are
+    //  kept from the step it fell asleep.  The forces of sleeping particles
+    //  are not updated.  The membrane and the triangle force fields are still
+    //  evaluated everywhere.
+    //
+    static const int kSleepRegionSize = 64;
+    static const int kSleepSteps = 30;
+
+    void setSleeping(bool _sleeping);
+    bool isSleeping() const { return m_sleeping; }
+    void setSleepThresholds(float _velocity, float _acceleration) { m_sleepVelocity = _velocity; m_sleepAcceleration = _acceleration; }
+
+    bool isAsleep(int _index) const { return !m_regionAsleep.empty() && m_regionAsleep[_index / kSleepRegionSize]; }
+    void wakeParticle(int _index);
+    void wakeAll();
+
+    // Number of sleeping regions and of regions.
+    int getNumSleepingRegions() const;
+    int getNumRegions() const { return (m_particles.size() + kSleepRegionSize - 1) / kSleepRegionSize; }
+
+    // Kinetic, spring and membrane potential, gravitational potential and force field
+    // potential energy of the state seen by the last computeForces(), which
+    // computes them in the same pass.  Fixed particles are not counted. The
+    // total is not finite if the state is not.
+    //
+    float getKineticEnergy() const { return m_kineticEnergy; }
+    float getElasticEnergy() const { return m_elasticEnergy; }
+    float getGravityEnergy() const { return m_gravityEnergy; }
+    float getFieldEnergy() const { return m_fieldEnergy; }
+    float getEnergy() const { return m_kineticEnergy + m_elasticEnergy + m_gravityEnergy + m_fieldEnergy; }
+
+    // Rate of work of the non-conservative force fields (e.g. wind, drag) on
+    // the state seen by the last computeForces().
+    //
+    float getExternalPower() const { return m_externalPower; }
+
     // Compute velocities and forces acting on each particle
     //
     void derivs(Eigen::VectorXf &dqdt);
@@ -112,6 +301,8 @@ public:
 
     // Set the state of the particle system.  The state vector @a q has the layout :
     //   [ x1, v1, x2, v2, ... xn, vn]
+    //  Sleeping particles are set too; callers restoring an earlier state
+    //  wake all regions first (wakeAll()).
     //
     void setState(const Eigen::VectorXf &q);
 
@@ -121,7 +312,9 @@ public:
     std::vector<Particle *> &getParticles() { return m_particles; }
     const std::vector<Spring *> &getSprings() const { return m_springs; }
     std::vector<Spring *> &getSprings() { return m_springs; }
+    const std::vector<SpringMaterial> &getMaterials() const { return m_materials; }
+    std::vector<SpringMaterial> &getMaterials() { return m_materials; }
 
-    // Compute the dfdx matrix for each spring.
-    void dfdx();
+    // Heap memory used by the particles, springs, materials and membrane, in bytes.
+    virtual size_t getMemoryUsage() const;
 };
@@ -0,0 +1,145 @@
+#pragma once
+
+/**
+ * @file Profiler.h
+ *
+ * @brief Scoped timers for the phases of the simulation and render pipeline.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-phase timing statistics collected by the Profiler.
+//
+//  Times are totals per frame, in milliseconds, over every call of the phase
+//  during that frame.
+//
+struct ProfilePhase
+{
+    static const int kHistory = 120;        // Frames kept for the rolling statistics
+    static const int kHistogramBins = 20;   // Bin b counts frames in [2^b, 2^(b+1)) microseconds
+
+    std::string name;
+    float history[kHistory];
+    float average;                          // Rolling average over the history
+    float maximum;                          // Rolling maximum over the history
+    int calls;                              // Calls during the last frame
+    float histogram[kHistogramBins];        // Frames per bin since the last reset
+};
+
+// Collects the time spent in every instrumented phase.
+//
+//  Phases are instrumented with PROFILE_SCOPE("name"), which times the rest of
+//  the enclosing scope, and PROFILE_FRAME() marks the end of a frame.  Both
+//  macros compile to nothing unless TISSU_PROFILING is defined (CMake option
+//  TISSU_ENABLE_PROFILING).
+//
+//  Samples may be added from any thread.  A range of frames can be captured
+//  to a Chrome / Perfetto trace file (chrome://tracing, ui.perfetto.dev).
+//
+class Profiler
+{
+public:
+    static const int kMaxPhases = 64;
+
+    static Profiler& instance();
+
+    // Returns the identifier of the phase called @a name, creating it if needed.
+    int registerPhase(const char* name);
+
+    // Add a call of @a phase that started at @a start and lasted @a duration nanoseconds.
+    void addSample(int phase, int64_t start, int64_t duration);
+
+    // Close the current frame: update the statistics and the trace capture.
+    void endFrame();
+
+    // Nanoseconds since the profiler was created.
+    int64_t now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count(); }
+
+    // Capture the frames [firstFrame, firstFrame + numFrames) to the trace @a filename.
+    void requestCapture(uint64_t firstFrame, int numFrames, const std::string& filename);
+    bool isCapturing() const { return m_captureFrames > 0; }
+
+    uint64_t getFrameIndex() const { return m_frameIndex; }
+    int getNumPhases() const { return m_numPhases.load(); }
+    const ProfilePhase& getPhase(int phase) const { return m_phases[phase]; }
+
+    // Clear the histograms.
+    void resetHistograms();
+
+    // Record the memory used by @a subsystem.
+    void setMemoryUsage(const std::string& subsystem, size_t bytes);
+    const std::vector<std::pair<std::string, size_t>>& getMemoryUsage() const { return m_memory; }
+
+    static bool isEnabled()
+    {
+#ifdef TISSU_PROFILING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    Profiler();
+
+    struct TraceEvent
+    {
+        int phase;
+        int thread;
+        int64_t start, duration;
+    };
+
+    void writeTrace();
+
+    const std::chrono::steady_clock::time_point m_epoch;
+
+    std::mutex m_mutex;                     // Guards phase registration and the trace events
+    ProfilePhase m_phases[kMaxPhases];
+    std::atomic<int> m_numPhases;
+    std::atomic<int64_t> m_frameTime[kMaxPhases];   // Nanoseconds accumulated during the current frame
+    std::atomic<int> m_frameCalls[kMaxPhases];
+    int m_historyIndex;
+    uint64_t m_frameIndex;
+
+    std::atomic<bool> m_tracing;            // Events of the current frame are recorded
+    uint64_t m_captureFirst;
+    int m_captureFrames;
+    std::string m_traceFilename;
+    std::vector<TraceEvent> m_events;
+
+    std::vector<std::pair<std::string, size_t>> m_memory;
+};
+
+// Times the enclosing scope and reports it to the Profiler.
+//
+class ProfileScope
+{
+public:
+    explicit ProfileScope(int _phase) : m_phase(_phase), m_start(Profiler::instance().now()) {}
+    ~ProfileScope() { Profiler::instance().addSample(m_phase, m_start, Profiler::instance().now() - m_start); }
+
+private:
+    int m_phase;
+    int64_t m_start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef TISSU_PROFILING
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profilePhase, __LINE__) = Profiler::instance().registerPhase(name); \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profilePhase, __LINE__))
+#define PROFILE_FRAME() Profiler::instance().endFrame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME()
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+/**
+ * @file ModalBasis.h
+ *
+ * @brief Lowest vibration modes of a particle system, for reduced-order simulation.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class ParticleSystem;
+
+// The lowest vibration modes of a particle system around its current state.
+//
+//  The modes solve the generalized eigenproblem S phi = lambda M phi, where S
+//  is the stiffness matrix -dfdx of the springs at the current positions and
+//  M the mass matrix, with the fixed particles held in place.  They are
+//  computed by subspace iteration with a sparse LDLT factorization of
+//  S + sigma M, and normalized so that Phi^T M Phi = I.
+//
+//  The positions should be at rest, e.g. a cloth settled under gravity: a
+//  flat cloth without tension has no stiffness out of its plane, so its
+//  lowest modes are not meaningful.  Membrane elements are not supported.
+//
+//  Along with the modes, the basis stores for each particle the linear map
+//  from the modal coordinates to the rotation of its neighborhood (the least
+//  squares rotation vector of its springs), used by modal warping, and the
+//  modal forces of a uniform acceleration.
+//
+//  A basis depends only on the rest state, so many ModalCloths can share
+//  one.  It can be cached in a file, keyed by the particles, springs and
+//  materials it was computed from.
+//
+class ModalBasis
+{
+public:
+    // Compute the @a numModes lowest modes of @a particleSystem.  Returns
+    // nullptr and prints an error if they cannot be computed.
+    static ModalBasis* compute(const ParticleSystem* particleSystem, int numModes);
+
+    // Load a basis of @a numModes modes of @a particleSystem saved by save().
+    // Returns nullptr if the file is missing or was computed from another
+    // state or for another number of modes.
+    static ModalBasis* load(const std::string& filename, const ParticleSystem* particleSystem, int numModes);
+
+    // Load the basis cached in @a filename, or compute it and save it there.
+    static ModalBasis* loadOrCompute(const std::string& filename, const ParticleSystem* particleSystem, int numModes);
+
+    bool save(const std::string& filename) const;
+
+    int getNumParticles() const { return (int)m_restPositions.size() / 3; }
+    int getNumModes() const { return (int)m_eigenvalues.size(); }
+
+    // Positions the modes were computed around, xyz per particle.
+    const Eigen::VectorXf& getRestPositions() const { return m_restPositions; }
+
+    // Eigenvalues lambda (squared angular frequencies), in increasing order.
+    const Eigen::VectorXf& getEigenvalues() const { return m_eigenvalues; }
+
+    // Displacements (3 rows per particle) and rotation vectors (3 rows per
+    // particle) of each mode, one column per mode.
+    const Eigen::MatrixXf& getModes() const { return m_modes; }
+    const Eigen::MatrixXf& getRotationModes() const { return m_rotationModes; }
+
+    // Modal forces of a unit acceleration along x, y and z of every particle.
+    const Eigen::MatrixXf& getUniformForces() const { return m_uniformForces; }
+
+    // Heap memory used by the basis, in bytes.
+    size_t getMemoryUsage() const;
+
+private:
+    ModalBasis() : m_key(0) {}
+
+    // Hash of the particles, springs and materials of @a particleSystem.
+    static uint64_t computeKey(const ParticleSystem* particleSystem);
+
+    // Fill m_rotationModes and m_uniformForces from m_modes.
+    void computeDerivedModes(const ParticleSystem* particleSystem);
+
+    uint64_t m_key;                     // computeKey() of the particle system
+    Eigen::VectorXf m_restPositions;
+    Eigen::VectorXf m_eigenvalues;
+    Eigen::MatrixXf m_modes;
+    Eigen::MatrixXf m_rotationModes;
+    Eigen::MatrixXf m_uniformForces;    // numModes x 3
+};
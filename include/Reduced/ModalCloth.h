@@ -0,0 +1,78 @@
+#pragma once
+
+/**
+ * @file ModalCloth.h
+ *
+ * @brief Reduced-order cloth simulated in the space of its lowest vibration modes.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+class ModalBasis;
+class ParticleSystem;
+
+// A cloth simulated in a ModalBasis.
+//
+//  The state is the modal coordinates q and their velocities, so a step
+//  costs O(K) for K modes whatever the number of particles: each mode is an
+//  independent damped oscillator, integrated with implicit Euler,
+//    q'' = f - c q' - lambda q
+//  with Rayleigh damping c = alpha + beta lambda.  The modal forces f are
+//  the uniform accelerations given to step() and the particle forces added
+//  by addForce().
+//
+//  Positions are only reconstructed when they are needed, in O(nK):
+//    x = x0 + Phi q
+//  With modal warping, the displacement of each particle is rotated by the
+//  rotation of its neighborhood, w = Psi q, integrated along the motion
+//  (Choi and Ko 2005):
+//    x = x0 + (I + (1 - cos t) / t^2 [w] + (t - sin t) / t^3 [w]^2) Phi q,  t = |w|
+//  which keeps large swinging motions from shearing the cloth.
+//
+//  The basis is shared, not owned.
+//
+class ModalCloth
+{
+public:
+    ModalCloth(const ModalBasis* _basis);
+
+    // Advance the modal state by @a dt, with a uniform acceleration @a
+    // acceleration of every particle (on top of the loads of the rest state,
+    // e.g. gravity) and the forces added since the last step.
+    void step(float dt, const Eigen::Vector3f& acceleration = Eigen::Vector3f::Zero());
+
+    // Add force @a f on particle @a index during the next step.
+    void addForce(int index, const Eigen::Vector3f& f);
+
+    // Rayleigh damping c = alpha + beta lambda of each mode.
+    void setDamping(float _alpha, float _beta) { m_alpha = _alpha; m_beta = _beta; }
+
+    void setWarping(bool _warping) { m_warping = _warping; }
+    bool isWarping() const { return m_warping; }
+
+    const ModalBasis* getBasis() const { return m_basis; }
+    const Eigen::VectorXf& getCoordinates() const { return m_q; }
+    const Eigen::VectorXf& getVelocities() const { return m_qd; }
+
+    // Reconstruct the positions of the particles.
+    void getPositions(std::vector<Eigen::Vector3f>& x) const;
+
+    // Copy the positions and velocities into @a particleSystem, which must
+    // have the particles of the basis.
+    void copyStateTo(ParticleSystem* particleSystem) const;
+
+private:
+
+    // Displacement of particle @a i, warped if enabled.
+    Eigen::Vector3f displacement(int i) const;
+
+    const ModalBasis* m_basis;
+    Eigen::VectorXf m_q;        // Modal coordinates
+    Eigen::VectorXf m_qd;       // Modal velocities
+    Eigen::VectorXf m_force;    // Modal forces added for the next step
+    float m_alpha, m_beta;
+    bool m_warping;
+};
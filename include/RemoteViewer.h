@@ -0,0 +1,72 @@
+#pragma once
+
+/**
+ * @file RemoteViewer.h
+ *
+ * @brief Thin viewer of a simulation streamed by a headless run.
+ *
+ */
+#include <Eigen/Dense>
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace polyscope
+{
+    class SurfaceMesh;
+    class PointCloud;
+}
+
+class FrameStreamClient;
+
+// Shows the frames streamed by tissu --headless --stream <address>.
+//
+//  tissu --connect <address>
+//
+//  The viewer does not simulate: it decodes the frames of a
+//  FrameStreamClient, and sends the parameters edited in its GUI and the
+//  particles pinned or unpinned with Ctrl + right click back to the
+//  simulation.  The sliders start from the default parameters of a headless
+//  run and are only sent when edited.
+//
+class RemoteViewer
+{
+public:
+    RemoteViewer();
+    virtual ~RemoteViewer();
+
+    // Returns the address following --connect on the command line, or an
+    // empty string if there is none.
+    static std::string getRequestedAddress(int argc, char* argv[]);
+
+    // Connect to @a address and show the stream until the window is closed.
+    // Returns the process exit code.
+    int start(const std::string& address);
+
+private:
+    void draw();
+    void drawGUI();
+
+    // Register the meshes of the received topology.
+    void initMeshes();
+
+    FrameStreamClient* m_client;
+    std::string m_address;
+    polyscope::SurfaceMesh* m_clothMesh;
+    polyscope::PointCloud* m_clothPoints;
+    unsigned int m_topologyVersion;     // Client topology version of the registered meshes
+    unsigned int m_pinsVersion;         // Client pins version of the point colors
+
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> m_renderPositions;
+    std::vector< std::array<float, 3> > m_pointColors;
+
+    // Parameters of the remote simulation.
+    float m_dt;
+    int m_solverIterations;
+    float m_structuralStiffness;
+    float m_shearStiffness;
+    float m_bendingStiffness;
+    float m_damping;
+    float m_airDamping;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+/**
+ * @file Collider.h
+ *
+ * @brief Interface of the rigid obstacles of a scene.
+ *
+ */
+
+#include "ParticleSystem.h"
+
+#include <Eigen/Dense>
+
+// A kinematic obstacle that keeps particles on its outside.
+//
+//  Colliders are only read while a scene steps, so the cloths that touch the
+//  same collider are stepped concurrently.  Move them between frames.
+//
+class Collider
+{
+public:
+    virtual ~Collider() { }
+
+    // Signed distance from @a x to the surface, negative inside, and the
+    // outward normal of the closest surface point in @a normal.
+    virtual float getDistance(const Eigen::Vector3f& x, Eigen::Vector3f& normal) const = 0;
+
+    // Move the particles closer than @a thickness to the surface back to that
+    // distance, and remove their velocity towards the surface.  Fixed
+    // particles are not moved; sleeping particles are woken.
+    void resolve(ParticleSystem* particleSystem, float thickness) const
+    {
+        for (Particle* p : particleSystem->getParticles())
+        {
+            if (p->fixed)
+                continue;
+
+            Eigen::Vector3f n;
+            const float d = getDistance(p->x, n);
+            if (d < thickness)
+            {
+                if (particleSystem->isAsleep(p->index)) particleSystem->wakeParticle(p->index);
+                p->x += (thickness - d) * n;
+                const float vn = p->v.dot(n);
+                if (vn < 0.0f) p->v -= vn * n;
+            }
+        }
+    }
+};
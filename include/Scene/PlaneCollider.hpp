@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @file PlaneCollider.hpp
+ *
+ * @brief An infinite plane obstacle, e.g. the ground.
+ *
+ */
+
+#include "Scene/Collider.h"
+
+// Keeps particles on the side of the plane its normal points to.
+//
+class PlaneCollider : public Collider
+{
+public:
+    PlaneCollider(const Eigen::Vector3f& _point, const Eigen::Vector3f& _normal) : m_point(_point), m_normal(_normal.normalized()) { }
+
+    virtual float getDistance(const Eigen::Vector3f& x, Eigen::Vector3f& normal) const override
+    {
+        normal = m_normal;
+        return (x - m_point).dot(m_normal);
+    }
+
+private:
+    Eigen::Vector3f m_point;
+    Eigen::Vector3f m_normal;
+};
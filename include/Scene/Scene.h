@@ -0,0 +1,89 @@
+#pragma once
+
+/**
+ * @file Scene.h
+ *
+ * @brief Several cloths and colliders stepped concurrently by a task graph.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+class Cloth;
+class Collider;
+class TaskGraph;
+
+// A cloth of a scene, with its own integrator and time step.
+//
+struct SceneObject
+{
+    Cloth* cloth;
+    int integrator;             // One of eIntegrators
+    float dt;                   // Time step; frames are split into steps of at most dt
+    Eigen::AlignedBox3f bounds; // Bounding box of the particles at the end of the last frame
+    float maxSpeed;             // Largest particle speed at the end of the last frame
+};
+
+// A set of cloths and colliders.
+//
+//  Every frame, each cloth is advanced by the frame time in steps of its own
+//  time step, with its own integrator, and pushed out of the colliders after
+//  every step.  These steps only read the colliders, so the cloths are
+//  stepped concurrently.
+//
+//  Cloths whose bounding boxes, grown by the distance their particles can
+//  travel during the frame, come closer than the contact thickness may
+//  touch.  A contact task then separates their particles at the end of the
+//  frame, once both cloths have been stepped.  The contact tasks of a cloth
+//  run one after the other; the other cloths are not held up.
+//
+//  The scene owns its cloths and colliders.
+//
+class Scene
+{
+public:
+    // @a numThreads counts the calling thread; 0 uses every hardware thread.
+    explicit Scene(int numThreads = 0);
+    virtual ~Scene();
+
+    // Add @a cloth, stepped with integrator @a integrator at time step @a dt.
+    // Returns the index of the object.
+    int addCloth(Cloth* cloth, int integrator, float dt);
+
+    void addCollider(Collider* collider);
+
+    // Advance every cloth by @a frameTime and resolve the contacts.
+    void step(float frameTime);
+
+    // Distance kept between the particles and the colliders, and between
+    // the particles of different cloths.
+    void setThickness(float _thickness) { m_thickness = _thickness; }
+    float getThickness() const { return m_thickness; }
+
+    int getNumObjects() const { return m_objects.size(); }
+    const SceneObject& getObject(int i) const { return m_objects[i]; }
+    SceneObject& getObject(int i) { return m_objects[i]; }
+    const std::vector<Collider*>& getColliders() const { return m_colliders; }
+
+    // Contact tasks of the last frame.
+    int getNumContacts() const { return m_numContacts; }
+
+    int getNumThreads() const;
+
+private:
+    // Advance object @a i by @a frameTime.
+    void stepObject(int i, float frameTime);
+
+    // Separate the particles of objects @a a and @a b closer than the thickness.
+    void resolveContact(int a, int b);
+
+    static void updateBounds(SceneObject& object);
+
+    std::vector<SceneObject> m_objects;
+    std::vector<Collider*> m_colliders;
+    TaskGraph* m_taskGraph;
+    float m_thickness;
+    int m_numContacts;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * @file SphereCollider.hpp
+ *
+ * @brief A spherical obstacle.
+ *
+ */
+
+#include "Scene/Collider.h"
+
+class SphereCollider : public Collider
+{
+public:
+    SphereCollider(const Eigen::Vector3f& _center, float _radius) : m_center(_center), m_radius(_radius) { }
+
+    void setCenter(const Eigen::Vector3f& _center) { m_center = _center; }
+    const Eigen::Vector3f& getCenter() const { return m_center; }
+    float getRadius() const { return m_radius; }
+
+    virtual float getDistance(const Eigen::Vector3f& x, Eigen::Vector3f& normal) const override
+    {
+        const Eigen::Vector3f delta = x - m_center;
+        const float length = delta.norm();
+        normal = (length > 1e-6f) ? Eigen::Vector3f(delta / length) : Eigen::Vector3f::UnitY();
+        return length - m_radius;
+    }
+
+private:
+    Eigen::Vector3f m_center;
+    float m_radius;
+};
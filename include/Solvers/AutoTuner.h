@@ -0,0 +1,95 @@
+#pragma once
+
+/**
+ * @file AutoTuner.h
+ *
+ * @brief Calibration of the solver, thread count and time step of a simulation.
+ *
+ */
+
+#include <Eigen/Dense>
+
+#include <string>
+
+class ParticleSystem;
+
+// Configuration of a simulation chosen by an AutoTuner.
+//
+struct TunedConfig
+{
+    int method;             // Iteration of the implicit solver (eSolverMethods)
+    int maxIterations;      // Sweep cap of the implicit solver
+    float tolerance;        // Relative residual the implicit solver stops at
+    int numThreads;         // Threads of the OpenMP loops
+    float dt;               // Time step
+    float msPerStep;        // Measured time of a step
+
+    TunedConfig() : method(0), maxIterations(1), tolerance(0.0f), numThreads(1), dt(0.01f), msPerStep(0.0f) {}
+};
+
+// Picks the fastest stable configuration of a particle system on this machine.
+//
+//  Candidates are measured on the actual scene, over kCalibrationSteps steps
+//  from its current state, which is restored after each one.  A candidate is
+//  rejected if the steps are unstable (a StabilityWatchdog rolls back a step)
+//  or if the implicit solver does not reach the tolerance within
+//  kMaxIterations sweeps.  The search runs one parameter at a time:
+//
+//    1. the solver method, by the time to reach the tolerance,
+//    2. the time step, among multiples of the requested one, by the time per
+//       simulated second,
+//    3. the number of OpenMP threads, by the time per step,
+//
+//  and the sweep cap is set above the sweeps the chosen method needed.
+//  Explicit integrators only tune the time step and the threads.
+//
+//  The result is cached in a small text file, one line per machine (host
+//  name and hardware threads) and problem (particle and spring counts,
+//  integrator, requested time step and tolerance):
+//
+//    <machine> <particles> <springs> <integrator> <dt> <tolerance> <method> <max iterations> <threads> <tuned dt> <ms per step>
+//
+//  so later runs of the same problem size on the same machine load it
+//  instead of calibrating again.
+//
+class AutoTuner
+{
+public:
+    static const int kCalibrationSteps = 20;        // Timed steps per candidate
+    static const int kMaxIterations = 64;           // Largest sweep cap tried
+    static const int kMaxTimeStepFactor = 4;        // Largest multiple of the requested time step tried
+    static constexpr float kDefaultTolerance = 1e-3f;
+
+    AutoTuner(const std::string& _cacheFilename);
+
+    // Find the configuration of @a particleSystem stepped by @a integrator
+    // with at most @a dt, the implicit solver reaching @a tolerance: load it
+    // from the cache, or calibrate it and save it there.  Returns false if
+    // no candidate is stable.
+    bool tune(ParticleSystem* particleSystem, int integrator, float dt, float tolerance, TunedConfig& config);
+
+    // Set the solver and thread count of @a config.
+    static void apply(ParticleSystem* particleSystem, const TunedConfig& config);
+
+    // True if the last tune() loaded the configuration from the cache.
+    bool wasCached() const { return m_cached; }
+
+    // Candidates measured by the last tune().
+    int getNumCandidates() const { return m_numCandidates; }
+
+private:
+    // Step @a particleSystem from state @a q0 with @a config.  Returns false
+    // if the steps are unstable or do not converge; otherwise sets the time
+    // per step and the most sweeps of a step.
+    bool measure(ParticleSystem* particleSystem, int integrator, const Eigen::VectorXf& q0, const TunedConfig& config, double& msPerStep, int& maxSweeps);
+
+    // Key of the machine and problem in the cache.
+    static std::string getKey(const ParticleSystem* particleSystem, int integrator, float dt, float tolerance);
+
+    bool load(const std::string& key, TunedConfig& config) const;
+    bool save(const std::string& key, const TunedConfig& config) const;
+
+    std::string m_cacheFilename;
+    bool m_cached;
+    int m_numCandidates;
+};
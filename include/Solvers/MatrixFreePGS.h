@@ -1,44 +1,217 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 class ParticleSystem;
+class Spring;
+
+// Stationary iterations available in MatrixFreePGS.
+//
+enum eSolverMethods {
+    kGaussSeidel = 0,       // Block Gauss-Seidel, in particle order
+    kSOR,                   // Block successive over-relaxation
+    kChebyshevJacobi,       // Block Jacobi with Chebyshev semi-iterative acceleration
+    kNumSolverMethods
+};
+
+// Returns a short lowercase name for solver method @a index, as used on the command line.
+const char* getSolverMethodName(int index);
+
+// Returns the index of the solver method named @a name, or -1 if there is none.
+int findSolverMethod(const char* name);
 
 // A matrix free PGS solver for mass-spring systems.
 //
+//  The iterations share the inverses of the 3x3 diagonal blocks computed by
+//  assemble().  The blocks and their inverses are symmetric and
+//  stored as 6 floats (xx, xy, xz, yy, yz, zz), by batches of kBatch
+//  particles with each entry in a row of kBatch lanes, so that the inverses
+//  are computed in closed form (adjugate over determinant) as SIMD lanes.
+//  Blocks too close to singular for the closed form are inverted through
+//  an LDLT factorization instead.
+//  Gauss-Seidel and SOR update the particles in order, using the velocity
+//  changes of the particles already updated in the sweep.  Block Jacobi
+//  updates every particle from the previous iterate, so a sweep runs in
+//  parallel; Chebyshev acceleration combines the last two iterates with
+//  weights given by the spectral radius of the Jacobi iteration.
+//
+//  The spectral radius is estimated by a few power iterations, warm started
+//  from the previous estimate, every kEstimateInterval solves.  It gives the
+//  Chebyshev weights and the relaxation factor of SOR when none is set
+//  (2 / (1 + sqrt(1 - rho^2)), the optimum for consistently ordered
+//  matrices).  Chebyshev falls back to SOR until the next estimate
+//  when a sweep changes the iterate much more than the first one did.
+//
+//  With a Jacobian tolerance set, the spring Jacobians are reused across
+//  solves: a spring Jacobian is only computed again once the strain or the
+//  direction of the spring has changed by more than the tolerance since it
+//  was last computed, and only the diagonal blocks of the particles of these
+//  springs are built and inverted again.  Torn springs only invalidate the
+//  Jacobian of the spring moved into their slot and the blocks of their
+//  particles.  The right-hand side still uses the
+//  current forces, so the reused Jacobians only slow the convergence of the
+//  Newton step down, not its fixed point.
+//
+//  The assembly, the Jacobi sweeps and the residuals are OpenMP loops over
+//  the particles of systems of 4096 particles or more.  A process forked
+//  after they ran must limit itself to one thread before its first solve,
+//  since libgomp may block in a forked child; the workers of
+//  DomainDecomposition do.
+//
+//  The solver keeps its buffers and estimates between solves, so a particle
+//  system owns one (ParticleSystem::getSolver()).
+//
 class MatrixFreePGS
 {
 public:
+    static const int kBatch = 8;                // Particles per batch of diagonal blocks
+    static const int kEstimateInterval = 20;    // Solves between two estimates of the spectral radius
+    static const int kPowerIterations = 8;      // Power iterations of an estimate
 
     MatrixFreePGS(ParticleSystem* _particleSystem);
 
     // Solve (M - dt*dfdv - dt*dt*dfdx) x = dt * f + dt * dt * dfdx * v
-    // using the projected Gauss-Seidel method.
+    // using the projected Gauss-Seidel method.  The Jacobians include the
+    // diagonal blocks of the force fields (ParticleSystem::getFieldDfdx())
+    // and the stiffness blocks of the membrane.  Sleeping particles are
+    // skipped, with a zero velocity change.
+    //
+    //  Iterates from x = 0 for at most the max iterations, or until the
+    //  residual relative to the right-hand side is below the tolerance.
+    //
+    //  Only the springs of the materials in @a implicitMaterials (bit m for
+    //  material m, see ParticleSystem::getImplicitMaterials()) are in dfdx;
+    //  the forces of the others are only in f.
     //
-    void solve(float dt, std::vector<Eigen::Vector3f>& x);
+    void solve(float dt, std::vector<Eigen::Vector3f>& x, uint32_t implicitMaterials = ~0u);
 
     // Set the max iterations used by the solver.
     void setMaxIterations(int _iters) { m_iters = _iters; }
+    int getMaxIterations() const { return m_iters; }
+
+    // Stop once the relative residual is below @a _tolerance (0: always run the max iterations).
+    void setTolerance(float _tolerance) { m_tolerance = _tolerance; }
+    float getTolerance() const { return m_tolerance; }
+
+    // Iteration used by solve() (one of eSolverMethods).
+    void setMethod(int _method);
+    int getMethod() const { return m_method; }
+
+    // Relaxation factor of SOR, in (0, 2) (0: estimated from the spectral radius).
+    void setRelaxation(float _omega) { m_omega = _omega; }
+    float getRelaxation() const;
+
+    // Spectral radius of the block Jacobi iteration, as last estimated.
+    float getSpectralRadius() const { return m_spectralRadius; }
+
+    // Sweeps and relative residual of the last solve.  The residual is only
+    // computed when a tolerance is set, and is 0 otherwise.
+    int getNumIterations() const { return m_numIterations; }
+    float getResidual() const { return m_residual; }
+
+    // Reuse the spring Jacobians until the strain or the direction (in
+    // radians) of their spring changes by more than @a _tolerance (0: compute
+    // them at every solve).
+    void setJacobianTolerance(float _tolerance);
+    float getJacobianTolerance() const { return m_jacobianTolerance; }
+
+    // Spring Jacobians computed and diagonal blocks built by the last solve.
+    int getNumUpdatedJacobians() const { return m_numUpdatedJacobians; }
+    int getNumUpdatedBlocks() const { return m_numUpdatedBlocks; }
+
+    // Heap memory used by the buffers of the solver, in bytes.
+    size_t getMemoryUsage() const;
 
 private:
 
-    // Build the right-hand side block vector: 
+    // Compute the spring Jacobians and build, in a single pass over the
+    // particles, the right-hand side block vector
     //   b = dt * f + dt * dt * dfdx * v
-    // for each particle
-    //
-    void buildRHS(float dt, std::vector<Eigen::Vector3f>& b);
+    // and the block diagonal matrices
+    //   A = M - dt*dfdv - dt*dt*dfdx
+    // for each particle, then invert the blocks into m_inverse.
+    void assemble(float dt);
+
+    // Same as assemble(), reusing the spring Jacobians within the Jacobian
+    // tolerance and the blocks whose Jacobians were all reused.
+    void assembleLazy(float dt);
+
+    // Invalidate the Jacobians of the spring slots whose spring changed since
+    // the last solve, and mark the blocks of the particles that lost a spring.
+    void invalidateRemovedSprings();
+
+    // Add the force field and membrane terms of active particle @a i to its
+    // block @a M and to m_b[i].
+    void addFieldTerms(int i, float dt, Eigen::Matrix3f& M);
+
+    // Store @a M as the diagonal block of particle @a i.
+    void storeBlock(int i, const Eigen::Matrix3f& M);
+
+    // Invert the blocks of m_diagonal into m_inverse.
+    void invertBlocks();
+
+    // Invert the blocks of batch @a batch.
+    void invertBatch(int batch);
 
-    // Build and compute the Cholesky decomposition of the block diagonal matrices
-    //   A = M - dt*dfdv - dt*dt*dfdx 
-    // Store the result in the array P, such that each entry contains
-    //    P = llt(A)
-    // for each particle.
-    void buildBlockDiagonal(float dt, std::vector<Eigen::LDLT<Eigen::Matrix3f>>& P);
+    // Sum of the off-diagonal blocks of row @a i times @a x.
+    Eigen::Vector3f offDiagonalProduct(int i, float dt, const std::vector<Eigen::Vector3f>& x) const;
+
+    // One Gauss-Seidel sweep over x, relaxed by @a omega.
+    void sweepGaussSeidel(float dt, float omega, std::vector<Eigen::Vector3f>& x);
+
+    // One block Jacobi sweep from @a x into @a y, extrapolated from @a previous
+    // by @a omega: y = omega (jacobi(x) - previous) + previous.  Returns the
+    // squared norm of y - x.
+    double sweepJacobi(float dt, float omega, const std::vector<Eigen::Vector3f>& x, const std::vector<Eigen::Vector3f>& previous, std::vector<Eigen::Vector3f>& y);
+
+    // Norm of b - A x, relative to the norm of b.
+    float relativeResidual(float dt, const std::vector<Eigen::Vector3f>& x);
+
+    // Update m_spectralRadius by power iterations on the block Jacobi iteration.
+    void estimateSpectralRadius(float dt);
+
+    bool isActive(int i) const;
+
+    // True if the springs of material @a material are in dfdx.
+    bool isImplicit(int material) const { return material >= 32 || (m_implicitMaterials >> material & 1) != 0; }
 
     ParticleSystem* m_particleSystem;
 
     int m_iters;
-    std::vector<Eigen::LDLT<Eigen::Matrix3f>> m_P;              // Block diagonal matrices
+    float m_tolerance;
+    int m_method;
+    float m_omega;
+    uint32_t m_implicitMaterials;                               // Materials of the springs in dfdx
+    std::vector<float> m_diagonal;                              // Block diagonal matrices, batched
+    std::vector<float> m_inverse;                               // Their inverses, batched
+    std::vector<float> m_springJacobians;                       // Per spring, w and alpha of its Jacobian alpha I - w w^T
+
+    float m_jacobianTolerance;
+    std::vector<float> m_springStates;                          // Per spring, direction and length when its Jacobian was computed (length 0: never)
+    std::vector<uint8_t> m_springUpdated;                       // Per spring, Jacobian computed by this solve
+    std::vector<const Spring*> m_springOwners;                  // Per spring slot, spring of the stored Jacobian
+    std::vector<int> m_springEnds;                              // Per spring slot, particle indices of that spring
+    std::vector<uint8_t> m_blockStale;                          // Per particle, block built with a spring since removed
+    std::vector<uint8_t> m_blockActive;                         // Per particle, block built as an active particle
+    std::vector<float> m_jacobianStiffness;                     // Stiffness of the materials of the reused Jacobians
+    unsigned int m_jacobianTopologyVersion;                     // Topology version of the reused Jacobians
+    unsigned int m_jacobianLayoutVersion;                       // Layout version of the reused Jacobians
+    uint32_t m_jacobianMaterials;                               // Implicit materials of the reused Jacobians
+    float m_blockDt;                                            // Time step of the diagonal blocks
+    int m_numUpdatedJacobians;
+    int m_numUpdatedBlocks;
     std::vector<Eigen::Vector3f> m_b;                           // Block vector of rhs values
+    std::vector<Eigen::Vector3f> m_previous, m_next;            // Iterates of the Jacobi sweeps
+
+    float m_spectralRadius;
+    bool m_jacobiDiverged;                                      // Chebyshev diverged since the last estimate
+    float m_estimateDt;                                         // Time step of the last estimate
+    int m_solvesSinceEstimate;
+    std::vector<Eigen::Vector3f> m_eigenvector;                 // Dominant eigenvector of the last estimate
+
+    int m_numIterations;
+    float m_residual;
 };
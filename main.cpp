@@ -1,7 +1,22 @@
 #include "ClothViewer.h"
+#include "HeadlessRunner.h"
+#include "RemoteViewer.h"
 
 int main(int argc, char *argv[])
 {
+    if (HeadlessRunner::isRequested(argc, argv))
+    {
+        HeadlessRunner runner;
+        return runner.parse(argc, argv) ? runner.run() : 1;
+    }
+
+    const std::string address = RemoteViewer::getRequestedAddress(argc, argv);
+    if (!address.empty())
+    {
+        RemoteViewer viewer;
+        return viewer.start(address);
+    }
+
     ClothViewer clothApp;
     clothApp.start();
     return 0;
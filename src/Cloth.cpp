@@ -0,0 +1,405 @@
+#include "Cloth.h"
+
+#include "Forces/TriangleMembrane.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+    // Remove the first occurrence of @a value from @a values, without preserving the order.
+    void eraseValue(std::vector<int>& values, int value)
+    {
+        auto it = std::find(values.begin(), values.end(), value);
+        if (it != values.end())
+        {
+            *it = values.back();
+            values.pop_back();
+        }
+    }
+
+    static const char* orderNames[kNumParticleOrders] = {
+        "input",
+        "morton",
+        "rcm"
+    };
+
+    // Spread the 21 low bits of @a x to every third bit.
+    uint64_t spreadBits(uint64_t x)
+    {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffffull;
+        x = (x | x << 16) & 0x1f0000ff0000ffull;
+        x = (x | x << 8) & 0x100f00f00f00f00full;
+        x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    // Indices of @a particles sorted along a Z-order curve with 21 bits per axis.
+    void mortonOrder(const std::vector<Particle*>& particles, std::vector<int>& order)
+    {
+        Eigen::AlignedBox3f box;
+        for (const Particle* p : particles)
+        {
+            box.extend(p->x);
+        }
+        const Eigen::Vector3f scale = box.sizes().cwiseMax(1e-6f).cwiseInverse() * (float)0x1fffff;
+
+        std::vector<std::pair<uint64_t, int>> keys(particles.size());
+        for (int i = 0; i < (int)particles.size(); ++i)
+        {
+            const Eigen::Vector3f c = (particles[i]->x - box.min()).cwiseProduct(scale).cwiseMax(0.0f).cwiseMin((float)0x1fffff);
+            keys[i] = { spreadBits((uint64_t)c.x()) | spreadBits((uint64_t)c.y()) << 1 | spreadBits((uint64_t)c.z()) << 2, i };
+        }
+        std::sort(keys.begin(), keys.end());
+
+        order.resize(particles.size());
+        for (int i = 0; i < (int)keys.size(); ++i)
+        {
+            order[i] = keys[i].second;
+        }
+    }
+
+    // Breadth-first traversal of the particles connected to @a start, visiting
+    // the neighbors of each particle by increasing number of springs.  Marks
+    // the particles with @a stamp and appends them to @a order.  Returns the
+    // particle of the last level with the fewest springs.
+    int breadthFirst(const std::vector<Particle*>& particles, int start, int stamp, std::vector<int>& marks, std::vector<int>& order)
+    {
+        std::vector<int> neighbors;
+        size_t levelStart = order.size();
+        size_t levelEnd = levelStart + 1;
+        marks[start] = stamp;
+        order.push_back(start);
+        for (size_t k = levelStart; k < order.size(); ++k)
+        {
+            if (k == levelEnd)
+            {
+                levelStart = levelEnd;
+                levelEnd = order.size();
+            }
+
+            neighbors.clear();
+            for (const auto& s : particles[order[k]]->springs)
+            {
+                const int j = s.first->particles[1 - s.second]->index;
+                if (marks[j] != stamp)
+                {
+                    marks[j] = stamp;
+                    neighbors.push_back(j);
+                }
+            }
+            std::sort(neighbors.begin(), neighbors.end(), [&particles](int a, int b)
+            {
+                return std::make_pair(particles[a]->springs.size(), a) < std::make_pair(particles[b]->springs.size(), b);
+            });
+            order.insert(order.end(), neighbors.begin(), neighbors.end());
+        }
+
+        int last = order[levelStart];
+        for (size_t k = levelStart; k < order.size(); ++k)
+        {
+            if (particles[order[k]]->springs.size() < particles[last]->springs.size())
+                last = order[k];
+        }
+        return last;
+    }
+
+    // Indices of @a particles in reverse Cuthill-McKee order of the spring graph.
+    // Each connected group of particles starts from a pseudo-peripheral particle,
+    // found by a few traversals from the first particle of the group.
+    void reverseCuthillMcKeeOrder(const std::vector<Particle*>& particles, std::vector<int>& order)
+    {
+        static const int kPlaced = -1;
+        const int n = particles.size();
+        std::vector<int> marks(n, 0);
+        std::vector<int> probe;
+        int stamp = 0;
+
+        order.clear();
+        order.reserve(n);
+        for (int seed = 0; seed < n; ++seed)
+        {
+            if (marks[seed] == kPlaced)
+                continue;
+
+            int start = seed;
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                probe.clear();
+                start = breadthFirst(particles, start, ++stamp, marks, probe);
+            }
+            breadthFirst(particles, start, kPlaced, marks, order);
+        }
+        std::reverse(order.begin(), order.end());
+    }
+}
+
+const char* getParticleOrderName(int order)
+{
+    assert(order >= 0 && order < kNumParticleOrders);
+    return orderNames[order];
+}
+
+int findParticleOrder(const char* name)
+{
+    for (int i = 0; i < kNumParticleOrders; ++i)
+    {
+        if (strcmp(orderNames[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+size_t Cloth::getMemoryUsage() const
+{
+    size_t bytes = ParticleSystem::getMemoryUsage() + m_triangles.capacity() * sizeof(std::array<int, 3>);
+    bytes += (m_triangleIds.capacity() + m_removedTriangles.capacity()) * sizeof(int);
+    bytes += m_particleTriangles.capacity() * sizeof(std::vector<int>);
+    for (const auto& triangles : m_particleTriangles)
+    {
+        bytes += triangles.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+void Cloth::addTriangle(int i0, int i1, int i2)
+{
+    const int t = m_triangles.size();
+    m_triangles.push_back({ i0, i1, i2 });
+    m_triangleIds.push_back(m_nextTriangleId++);
+
+    const int maxIndex = std::max(i0, std::max(i1, i2));
+    if ((int)m_particleTriangles.size() <= maxIndex)
+    {
+        m_particleTriangles.resize(std::max<size_t>(maxIndex + 1, m_particles.size()));
+    }
+    m_particleTriangles[i0].push_back(t);
+    m_particleTriangles[i1].push_back(t);
+    m_particleTriangles[i2].push_back(t);
+}
+
+void Cloth::removeSpring(Spring* _spring)
+{
+    assert(m_springs[_spring->index] == _spring);
+
+    removeEdgeTriangles(_spring->particles[0]->index, _spring->particles[1]->index);
+
+    // Fill the hole with the last spring of the same class.  The hole then sits
+    // just before the next class, which is shifted down by one by moving its own
+    // last spring into it, until the hole reaches the end of m_springs.
+    //
+    int* const starts[2] = { &m_shearIndex, &m_bendingIndex };
+    const int ends[3] = { m_shearIndex, m_bendingIndex, (int)m_springs.size() };
+
+    int hole = _spring->index;
+    const int first = (hole < m_shearIndex) ? 0 : (hole < m_bendingIndex) ? 1 : 2;
+    for (int c = first; c < 3; ++c)
+    {
+        const int last = ends[c] - 1;
+        if (last != hole)
+        {
+            m_springs[hole] = m_springs[last];
+            m_springs[hole]->index = hole;
+        }
+        hole = last;
+        if (c < 2)
+        {
+            --(*starts[c]);
+        }
+    }
+    m_springs.pop_back();
+
+    releaseSpring(_spring);
+}
+
+void Cloth::removeEdgeTriangles(int i0, int i1)
+{
+    if (i0 >= (int)m_particleTriangles.size())
+        return;
+
+    std::vector<int>& triangles = m_particleTriangles[i0];
+    for (size_t k = 0; k < triangles.size(); )
+    {
+        const std::array<int, 3>& triangle = m_triangles[triangles[k]];
+        if (triangle[0] == i1 || triangle[1] == i1 || triangle[2] == i1)
+        {
+            // Also removes the entry from this list.
+            removeTriangle(triangles[k]);
+        }
+        else
+        {
+            ++k;
+        }
+    }
+}
+
+void Cloth::removeTriangle(int t)
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        eraseValue(m_particleTriangles[m_triangles[t][c]], t);
+    }
+
+    m_removedTriangles.push_back(m_triangleIds[t]);
+
+    const int last = m_triangles.size() - 1;
+    if (t != last)
+    {
+        m_triangles[t] = m_triangles[last];
+        m_triangleIds[t] = m_triangleIds[last];
+        for (int c = 0; c < 3; ++c)
+        {
+            std::replace(m_particleTriangles[m_triangles[t][c]].begin(), m_particleTriangles[m_triangles[t][c]].end(), last, t);
+        }
+    }
+    m_triangles.pop_back();
+    m_triangleIds.pop_back();
+}
+
+void Cloth::reorder(int order)
+{
+    assert(order >= 0 && order < kNumParticleOrders);
+
+    const int n = m_particles.size();
+    if (order != kInputOrder)
+    {
+        std::vector<int> permutation;   // Previous index of each particle
+        if (order == kMortonOrder)
+            mortonOrder(m_particles, permutation);
+        else
+            reverseCuthillMcKeeOrder(m_particles, permutation);
+        assert((int)permutation.size() == n);
+
+        // Copy the particles in their new order, so that they are also
+        // allocated in that order.
+        std::vector<int> newIndex(n);
+        std::vector<Particle*> particles(n);
+        for (int i = 0; i < n; ++i)
+        {
+            newIndex[permutation[i]] = i;
+            particles[i] = new Particle(*m_particles[permutation[i]]);
+            particles[i]->index = i;
+        }
+        for (Spring* s : m_springs)
+        {
+            s->particles[0] = particles[newIndex[s->particles[0]->index]];
+            s->particles[1] = particles[newIndex[s->particles[1]->index]];
+        }
+        for (std::array<int, 3>& triangle : m_triangles)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                triangle[c] = newIndex[triangle[c]];
+            }
+        }
+        m_particles.swap(particles);
+        for (Particle* p : particles)
+        {
+            delete p;
+        }
+        if (m_membrane) m_membrane->remap(newIndex);
+        wakeAll();
+
+        // Rows and columns no longer map to indices.
+        m_nx = m_ny = 0;
+    }
+
+    // Start each triangle at its smallest index, which keeps its orientation,
+    // and sort them so the vertices are read in order when rendering.
+    for (std::array<int, 3>& triangle : m_triangles)
+    {
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+    }
+    std::sort(m_triangles.begin(), m_triangles.end());
+    m_triangleIds.resize(m_triangles.size());
+    std::iota(m_triangleIds.begin(), m_triangleIds.end(), 0);
+    m_nextTriangleId = m_triangles.size();
+    m_removedTriangles.clear();
+    m_particleTriangles.assign(m_triangles.empty() ? 0 : n, std::vector<int>());
+    for (int t = 0; t < (int)m_triangles.size(); ++t)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            m_particleTriangles[m_triangles[t][c]].push_back(t);
+        }
+    }
+
+    sortSprings();
+    ++m_topologyVersion;
+    ++m_layoutVersion;
+}
+
+void Cloth::sortSprings()
+{
+    // Sort keys with the particle indices, so that the sort does not read the springs.
+    std::vector<std::pair<uint64_t, Spring*>> keys(m_springs.size());
+    for (size_t k = 0; k < m_springs.size(); ++k)
+    {
+        Spring* s = m_springs[k];
+        if (s->particles[0]->index > s->particles[1]->index)
+        {
+            std::swap(s->particles[0], s->particles[1]);
+        }
+        keys[k] = { (uint64_t)s->particles[0]->index << 32 | (uint32_t)s->particles[1]->index, s };
+    }
+
+    const int starts[4] = { 0, m_shearIndex, m_bendingIndex, (int)m_springs.size() };
+    for (int c = 0; c < 3; ++c)
+    {
+        std::sort(keys.begin() + starts[c], keys.begin() + starts[c + 1]);
+    }
+
+    // Allocate the springs again in their new order, before freeing the
+    // previous ones so that their memory is not reused out of order.
+    std::vector<Spring*> springs(m_springs.size());
+    for (size_t k = 0; k < m_springs.size(); ++k)
+    {
+        springs[k] = new Spring(*keys[k].second);
+    }
+    m_springs.swap(springs);
+    for (Spring* s : springs)
+    {
+        delete s;
+    }
+    m_tearCandidates.clear();
+    rebuildSpringLists();
+    ++m_topologyVersion;
+    ++m_layoutVersion;
+}
+
+void Cloth::removeStretchSprings()
+{
+    for (int k = 0; k < m_bendingIndex; ++k)
+    {
+        delete m_springs[k];
+    }
+    m_springs.erase(m_springs.begin(), m_springs.begin() + m_bendingIndex);
+    m_structuralIndex = m_shearIndex = m_bendingIndex = 0;
+    m_tearCandidates.clear();
+    rebuildSpringLists();
+    ++m_topologyVersion;
+    ++m_layoutVersion;
+}
+
+void Cloth::rebuildSpringLists()
+{
+    m_sleepDirty = true;
+    for (Particle* p : m_particles)
+    {
+        p->springs.clear();
+    }
+    for (int k = 0; k < (int)m_springs.size(); ++k)
+    {
+        Spring* s = m_springs[k];
+        s->index = k;
+        for (int e = 0; e < 2; ++e)
+        {
+            s->slots[e] = s->particles[e]->springs.size();
+            s->particles[e]->springs.push_back({ s, e });
+        }
+    }
+}
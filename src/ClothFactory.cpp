@@ -1,95 +1,239 @@
 #include "ClothFactory.h"
 #include "Cloth.h"
+#include "CompactCloth.h"
+#include "Forces/TriangleMembrane.h"
+#include "IO/MeshLoader.h"
 
 #include <Eigen/Dense>
 
-// @a nx Number of particles in the x direction
-// @a ny Number of particles in the y direction
-// @a dx Spacing between particles along the x-axis
-// @a dy Spacing between particles along the y-axis
-// @a k1 Structural stiffness
-// @a k2 Shearing stiffness
-// @a k3 Bending stiffness
-// @a b Spring damping
-// @a startx Initial x position of the first particle.
-// @a starty Initial y position of the first particle.
-//
-Cloth* ClothFactory::createHangingCloth(int nx, int ny, float dx, float dy, float k1, float k2, float k3, float b, float startx, float starty)
-{
-    assert(nx > 1 && ny > 1);
-
-    Cloth* cloth = new Cloth(nx, ny);
-    cloth->clear();
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
 
-    int index = 0;
+namespace
+{
+    // Set the stiffness and damping of the three classes of cloth springs.
+    //
+    void setClassMaterials(std::vector<SpringMaterial>& materials, float k1, float k2, float k3, float b)
+    {
+        materials[kStructuralMaterial] = SpringMaterial(k1, b);
+        materials[kShearMaterial] = SpringMaterial(k2, b);
+        materials[kBendingMaterial] = SpringMaterial(k3, b);
+    }
 
-    // Create all particles.
-    for (int i = 0; i < ny; ++i)
+    // Visit the particles of the hanging cloth scenario in index order: a
+    // vertical nx-by-ny grid pinned along its top row.
+    //
+    template <typename AddParticle>
+    void forEachHangingParticle(int nx, int ny, float dx, float dy, float startx, float starty, AddParticle add)
     {
-        for (int j = 0; j < nx; ++j)
+        for (int i = 0; i < ny; ++i)
         {
-            const float x = startx + (float)j * dx;
-            const float y = starty + (float)i * dy;
-            const float z = 2.0f;
-            Particle* particle = new Particle(index, Eigen::Vector3f(x, y, z), Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(0, 0, 0), 1.0);
-            if (i == (ny - 1)) particle->fixed = true;
-            cloth->addParticle(particle);
-            ++index;
+            for (int j = 0; j < nx; ++j)
+            {
+                add(Eigen::Vector3f(startx + (float)j * dx, starty + (float)i * dy, 2.0f), i == (ny - 1));
+            }
         }
     }
-    // Structural springs.
+
+    // Visit the particles of the trampoline scenario in index order: a
+    // horizontal nx-by-nz grid pinned at its four corners.
     //
-    cloth->setStructuralIndex(0);
-    for (int i = 0; i < ny; ++i)
+    template <typename AddParticle>
+    void forEachTrampolineParticle(int nx, int nz, float dx, float dz, float startx, float startz, AddParticle add)
     {
-        for (int j = 0; j < nx; ++j)
+        const float lastz = startz + (float)nz * dz;
+        for (int i = 0; i < nz; ++i)
         {
-            if (i > 0)
+            for (int j = 0; j < nx; ++j)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 1, j), cloth->getParticle(i, j), k1, b, dy));
-            }
-            if (j > 0)
-            {
-                cloth->addSpring(new Spring(cloth->getParticle(i, j - 1), cloth->getParticle(i, j), k1, b, dx));
+                const bool corner = (i == 0 || i == nz - 1) && (j == 0 || j == nx - 1);
+                add(Eigen::Vector3f(startx + (float)j * dx, 2.0f, lastz - (float)i * dz), corner);
             }
         }
     }
 
-    // Shear springs.
+    // Number of springs of a nx-by-ny grid cloth.
     //
-    cloth->setShearIndex(cloth->getSprings().size());
-    for (int i = 0; i < ny; ++i)
+    int numGridSprings(int nx, int ny)
     {
-        for (int j = 0; j < nx; ++j)
+        return (nx * (ny - 1) + (nx - 1) * ny) + 2 * (nx - 1) * (ny - 1) + (std::max(0, nx - 2) * ny + nx * std::max(0, ny - 2));
+    }
+
+    // Visit the springs of a nx-by-ny grid of particles (index i * nx + j for
+    // row i and column j) in the cloth spring layout: @a begin(material) is
+    // called before each class of springs, then @a add(i0, i1, material, restLength)
+    // for each spring of the class.
+    //
+    template <typename BeginClass, typename AddSpring>
+    void forEachGridSpring(int nx, int ny, float dx, float dy, BeginClass begin, AddSpring add)
+    {
+        auto index = [nx](int i, int j) { return nx * i + j; };
+
+        // Structural springs.
+        //
+        begin(kStructuralMaterial);
+        for (int i = 0; i < ny; ++i)
         {
-            if (i > 0 && j > 0)
+            for (int j = 0; j < nx; ++j)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 1, j - 1), cloth->getParticle(i, j), k2, b, std::sqrt(dx * dx + dy * dy)));
+                if (i > 0)
+                {
+                    add(index(i - 1, j), index(i, j), kStructuralMaterial, dy);
+                }
+                if (j > 0)
+                {
+                    add(index(i, j - 1), index(i, j), kStructuralMaterial, dx);
+                }
             }
-            if (i < (ny - 1) && j >0)
+        }
+
+        // Shear springs.
+        //
+        begin(kShearMaterial);
+        const float diagonal = std::sqrt(dx * dx + dy * dy);
+        for (int i = 0; i < ny; ++i)
+        {
+            for (int j = 0; j < nx; ++j)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i + 1, j - 1), cloth->getParticle(i, j), k2, b, std::sqrt(dx * dx + dy * dy)));
+                if (i > 0 && j > 0)
+                {
+                    add(index(i - 1, j - 1), index(i, j), kShearMaterial, diagonal);
+                }
+                if (i < (ny - 1) && j > 0)
+                {
+                    add(index(i + 1, j - 1), index(i, j), kShearMaterial, diagonal);
+                }
+            }
+        }
+
+        // Bend springs.
+        //
+        begin(kBendingMaterial);
+        for (int i = 0; i < ny; ++i)
+        {
+            for (int j = 0; j < nx; ++j)
+            {
+                if (j > 1)
+                {
+                    add(index(i, j - 2), index(i, j), kBendingMaterial, 2.0f * dx);
+                }
+                if (i > 1)
+                {
+                    add(index(i - 2, j), index(i, j), kBendingMaterial, 2.0f * dy);
+                }
             }
         }
     }
 
-    cloth->setBendingIndex(cloth->getSprings().size());
-    for (int i = 0; i < ny; ++i)
+    void addParticle(Cloth* cloth, const Eigen::Vector3f& x, bool fixed)
+    {
+        Particle* particle = new Particle(cloth->getParticles().size(), x, Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(0, 0, 0), 1.0);
+        particle->fixed = fixed;
+        cloth->addParticle(particle);
+    }
+
+    // Add the springs of a grid cloth, keeping track of the start of each class.
+    //
+    void addGridSprings(Cloth* cloth, int nx, int ny, float dx, float dy)
     {
-        for (int j = 0; j < nx; ++j)
+        auto& particles = cloth->getParticles();
+        cloth->getSprings().reserve(numGridSprings(nx, ny));
+        forEachGridSpring(nx, ny, dx, dy,
+            [cloth](int material)
+            {
+                const int start = cloth->getSprings().size();
+                if (material == kStructuralMaterial) cloth->setStructuralIndex(start);
+                else if (material == kShearMaterial) cloth->setShearIndex(start);
+                else cloth->setBendingIndex(start);
+            },
+            [cloth, &particles](int i0, int i1, int material, float r)
+            {
+                cloth->addSpring(new Spring(particles[i0], particles[i1], material, r));
+            });
+    }
+
+    // Add the two triangles of every grid cell to the render mesh.
+    //
+    void addGridTriangles(Cloth* cloth, int width, int height)
+    {
+        for (int j = 0; j < width - 1; ++j)
         {
-            // Bend springs.
-            //
-            if (j > 1)
+            for (int i = 0; i < height - 1; ++i)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i, j - 2), cloth->getParticle(i, j), k3, b, 2.0f * dx));
+                cloth->addTriangle(cloth->getParticleIndex(i, j), cloth->getParticleIndex(i + 1, j + 1), cloth->getParticleIndex(i + 1, j));
+                cloth->addTriangle(cloth->getParticleIndex(i, j), cloth->getParticleIndex(i, j + 1), cloth->getParticleIndex(i + 1, j + 1));
             }
-            if (i > 1)
+        }
+    }
+
+    const uint64_t kEmpty = ~0ull;
+
+    // Open-addressing hash table mapping an undirected edge to an integer.
+    //
+    class EdgeTable
+    {
+    public:
+        explicit EdgeTable(size_t maxEdges) : m_mask(15)
+        {
+            // Keep the load factor below 3/4.
+            while (m_mask + 1 < (4 * maxEdges) / 3 + 1) m_mask = 2 * m_mask + 1;
+            m_keys.assign(m_mask + 1, kEmpty);
+            m_values.resize(m_mask + 1);
+        }
+
+        // Returns the value of edge (a, b), inserting @a value first if the edge is new.
+        // @a inserted tells whether the edge was inserted.
+        int& insert(int a, int b, int value, bool& inserted)
+        {
+            const uint64_t key = ((uint64_t)std::min(a, b) << 32) | (uint32_t)std::max(a, b);
+            const uint64_t h = key * 0x9E3779B97F4A7C15ull;
+            for (size_t slot = (h ^ (h >> 32)) & m_mask; ; slot = (slot + 1) & m_mask)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 2, j), cloth->getParticle(i, j), k3, b, 2.0f * dy));
+                if (m_keys[slot] == key)
+                {
+                    inserted = false;
+                    return m_values[slot];
+                }
+                if (m_keys[slot] == kEmpty)
+                {
+                    inserted = true;
+                    m_keys[slot] = key;
+                    m_values[slot] = value;
+                    return m_values[slot];
+                }
             }
         }
-    }
+
+    private:
+        size_t m_mask;
+        std::vector<uint64_t> m_keys;
+        std::vector<int> m_values;
+    };
+}
+
+// @a nx Number of particles in the x direction
+// @a ny Number of particles in the y direction
+// @a dx Spacing between particles along the x-axis
+// @a dy Spacing between particles along the y-axis
+// @a k1 Structural stiffness
+// @a k2 Shearing stiffness
+// @a k3 Bending stiffness
+// @a b Spring damping
+// @a startx Initial x position of the first particle.
+// @a starty Initial y position of the first particle.
+//
+Cloth* ClothFactory::createHangingCloth(int nx, int ny, float dx, float dy, float k1, float k2, float k3, float b, float startx, float starty)
+{
+    assert(nx > 1 && ny > 1);
+
+    Cloth* cloth = new Cloth(nx, ny);
+    cloth->clear();
+    setClassMaterials(cloth->getMaterials(), k1, k2, k3, b);
+    forEachHangingParticle(nx, ny, dx, dy, startx, starty, [cloth](const Eigen::Vector3f& x, bool fixed) { addParticle(cloth, x, fixed); });
+    addGridSprings(cloth, nx, ny, dx, dy);
+    addGridTriangles(cloth, nx, ny);
 
     return cloth;
 }
@@ -111,80 +255,203 @@ Cloth* ClothFactory::createTrampoline(int nx, int nz, float dx, float dz, float
 
     Cloth* cloth = new Cloth(nx, nz);
     cloth->clear();
+    setClassMaterials(cloth->getMaterials(), k1, k2, k3, b);
+    forEachTrampolineParticle(nx, nz, dx, dz, startx, startz, [cloth](const Eigen::Vector3f& x, bool fixed) { addParticle(cloth, x, fixed); });
+    addGridSprings(cloth, nx, nz, dx, dz);
+    addGridTriangles(cloth, nx, nz);
+
+    return cloth;
+}
 
-    int index = 0;
-    const float lastz = startz + (float)nz * dz;
-    for (int i = 0; i < nz; ++i)
+CompactCloth* ClothFactory::createCompactHangingCloth(int nx, int ny, float dx, float dy, float k1, float k2, float k3, float b, float startx, float starty)
+{
+    assert(nx > 1 && ny > 1);
+
+    CompactCloth* cloth = new CompactCloth(nx, ny);
+    cloth->getMaterials().resize(kNumClothMaterials);
+    setClassMaterials(cloth->getMaterials(), k1, k2, k3, b);
+    cloth->reserve(nx * ny, numGridSprings(nx, ny));
+    forEachHangingParticle(nx, ny, dx, dy, startx, starty, [cloth](const Eigen::Vector3f& x, bool fixed) { cloth->addParticle(x, fixed); });
+    forEachGridSpring(nx, ny, dx, dy, [](int) {}, [cloth](int i0, int i1, int material, float r) { cloth->addSpring(i0, i1, material, r); });
+    cloth->finalize();
+
+    return cloth;
+}
+
+CompactCloth* ClothFactory::createCompactTrampoline(int nx, int nz, float dx, float dz, float k1, float k2, float k3, float b, float startx, float startz)
+{
+    assert(nx > 1 && nz > 1);
+
+    CompactCloth* cloth = new CompactCloth(nx, nz);
+    cloth->getMaterials().resize(kNumClothMaterials);
+    setClassMaterials(cloth->getMaterials(), k1, k2, k3, b);
+    cloth->reserve(nx * nz, numGridSprings(nx, nz));
+    forEachTrampolineParticle(nx, nz, dx, dz, startx, startz, [cloth](const Eigen::Vector3f& x, bool fixed) { cloth->addParticle(x, fixed); });
+    forEachGridSpring(nx, nz, dx, dz, [](int) {}, [cloth](int i0, int i1, int material, float r) { cloth->addSpring(i0, i1, material, r); });
+    cloth->finalize();
+
+    return cloth;
+}
+
+CompactCloth* ClothFactory::createCompactCloth(const Cloth* cloth)
+{
+    if (cloth->getMembrane())
     {
-        for (int j = 0; j < nx; ++j)
-        {
-            const float x = startx + (float)j * dx;
-            const float z = lastz - (float)i * dz;
-            const float y = 2.0f;
-            Particle* particle = new Particle(index, Eigen::Vector3f(x, y, z), Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(0, 0, 0), 1.0);
-            if (i == 0 && j == 0) particle->fixed = true;
-            else if (i == nz - 1 && j == 0) particle->fixed = true;
-            else if (i == nz - 1 && j == nx - 1) particle->fixed = true;
-            else if (i == 0 && j == nx - 1) particle->fixed = true;
-            cloth->addParticle(particle);
-            ++index;
-        }
+        std::cerr << "ClothFactory: compact cloths have no membrane elements." << std::endl;
+        return nullptr;
     }
 
-    // Structural springs.
-    //
-    cloth->setStructuralIndex(0);
-    for (int i = 0; i < nz; ++i)
+    const auto& particles = cloth->getParticles();
+    for (const Particle* p : particles)
     {
-        for (int j = 0; j < nx; ++j)
+        if (p->m != particles[0]->m)
         {
-            if (i > 0)
-            {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 1, j), cloth->getParticle(i, j), k1, b, dz));
-            }
-            if (j > 0)
-            {
-                cloth->addSpring(new Spring(cloth->getParticle(i, j - 1), cloth->getParticle(i, j), k1, b, dx));
-            }
+            std::cerr << "ClothFactory: compact cloths need particles of equal mass." << std::endl;
+            return nullptr;
         }
     }
-    // Shear springs.
+
+    CompactCloth* compact = new CompactCloth(cloth->getWidth(), cloth->getHeight());
+    compact->getMaterials() = cloth->getMaterials();
+    compact->setImplicitMaterials(cloth->getImplicitMaterials());
+    compact->reserve(particles.size(), cloth->getSprings().size());
+    if (!particles.empty())
+    {
+        compact->setParticleMass(particles[0]->m);
+    }
+    for (const Particle* p : particles)
+    {
+        compact->addParticle(p->x, p->fixed);
+    }
+    for (const Spring* s : cloth->getSprings())
+    {
+        compact->addSpring(s->particles[0]->index, s->particles[1]->index, s->material, s->r);
+    }
+    if (!compact->finalize())
+    {
+        delete compact;
+        return nullptr;
+    }
+    for (const Particle* p : particles)
+    {
+        compact->setVelocity(p->index, p->v);
+    }
+    return compact;
+}
+
+// @a filename Path of an OBJ or binary PLY triangle mesh
+// @a k1 Structural stiffness (springs along the mesh edges)
+// @a k3 Bending stiffness (springs across the edges shared by two triangles)
+// @a b Spring damping
+// @a order Order of the particles (eParticleOrders), kInputOrder keeps the vertex order of the file
+//
+Cloth* ClothFactory::createFromMesh(const std::string& filename, float k1, float k3, float b, int order)
+{
+    TriangleMesh mesh;
+    if (!MeshLoader::load(filename, mesh))
+    {
+        return nullptr;
+    }
+
+    const int numParticles = mesh.vertices.size();
+
+    Cloth* cloth = new Cloth;
+    cloth->clear();
+    setClassMaterials(cloth->getMaterials(), k1, 0.0f, k3, b);
+    cloth->getParticles().reserve(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        cloth->addParticle(new Particle(i, mesh.vertices[i], Eigen::Vector3f(0, 0, 0), Eigen::Vector3f(0, 0, 0), 1.0));
+    }
+
+    // Deduplicate the triangle edges.  The first triangle found for an edge stores
+    // its opposite vertex; the second one adds a bending spring between the two
+    // opposite vertices.  Edges shared by more than two triangles are ignored
+    // after that.
     //
-    cloth->setShearIndex(cloth->getSprings().size());
-    for (int i = 0; i < nz; ++i)
+    static const int kPaired = -1;
+    EdgeTable edges(3 * mesh.triangles.size());
+    std::vector<std::pair<int, int>> structural, bending;
+    structural.reserve(3 * mesh.triangles.size() / 2 + 1);
+    bending.reserve(3 * mesh.triangles.size() / 2 + 1);
+    for (const auto& t : mesh.triangles)
     {
-        for (int j = 0; j < nx; ++j)
+        for (int c = 0; c < 3; ++c)
         {
+            const int i0 = t[c], i1 = t[(c + 1) % 3], opposite = t[(c + 2) % 3];
+            if (i0 == i1)
+                continue;
 
-            if (i > 0 && j > 0)
+            bool inserted;
+            int& other = edges.insert(i0, i1, opposite, inserted);
+            if (inserted)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 1, j - 1), cloth->getParticle(i, j), k2, b, std::sqrt(dx * dx + dz * dz)));
+                structural.push_back({ i0, i1 });
             }
-            if (i < (nz - 1) && j >0)
+            else if (other != kPaired)
             {
-                cloth->addSpring(new Spring(cloth->getParticle(i + 1, j - 1), cloth->getParticle(i, j), k2, b, std::sqrt(dx * dx + dz * dz)));
+                if (other != opposite)
+                    bending.push_back({ other, opposite });
+                other = kPaired;
             }
         }
     }
 
+    // Size the spring lists of each particle up front.
+    std::vector<int> valence(numParticles, 0);
+    for (const auto& e : structural) { ++valence[e.first]; ++valence[e.second]; }
+    for (const auto& e : bending) { ++valence[e.first]; ++valence[e.second]; }
+    auto& particles = cloth->getParticles();
+    for (int i = 0; i < numParticles; ++i)
+    {
+        particles[i]->springs.reserve(valence[i]);
+    }
+    cloth->getSprings().reserve(structural.size() + bending.size());
+
+    // Structural springs.
+    //
+    cloth->setStructuralIndex(0);
+    for (const auto& e : structural)
+    {
+        cloth->addSpring(new Spring(particles[e.first], particles[e.second], kStructuralMaterial, (particles[e.second]->x - particles[e.first]->x).norm()));
+    }
+
+    // No shear springs, the mesh edges already resist shearing.
+    //
+    cloth->setShearIndex(cloth->getSprings().size());
+
     // Bend springs.
     //
     cloth->setBendingIndex(cloth->getSprings().size());
-    for (int i = 0; i < nz; ++i)
+    for (const auto& e : bending)
     {
-        for (int j = 0; j < nx; ++j)
-        {
-            if (j > 1)
-            {
-                cloth->addSpring(new Spring(cloth->getParticle(i, j - 2), cloth->getParticle(i, j), k3, b, 2.0f * dx));
-            }
-            if (i > 1)
-            {
-                cloth->addSpring(new Spring(cloth->getParticle(i - 2, j), cloth->getParticle(i, j), k3, b, 2.0f * dz));
-            }
+        cloth->addSpring(new Spring(particles[e.first], particles[e.second], kBendingMaterial, (particles[e.second]->x - particles[e.first]->x).norm()));
+    }
 
-        }
+    for (const auto& t : mesh.triangles)
+    {
+        cloth->addTriangle(t[0], t[1], t[2]);
+    }
+
+    if (order != kInputOrder)
+    {
+        cloth->reorder(order);
     }
 
     return cloth;
 }
+
+bool ClothFactory::createMembrane(Cloth* cloth, float youngsModulus, float poissonRatio)
+{
+    if (cloth->getTriangles().empty())
+    {
+        std::cerr << "ClothFactory: membrane elements need the surface triangles of the cloth." << std::endl;
+        return false;
+    }
+
+    TriangleMembrane* membrane = new TriangleMembrane(cloth->getParticles(), cloth->getTriangles());
+    membrane->setMaterial(youngsModulus, poissonRatio);
+    cloth->removeStretchSprings();
+    cloth->setMembrane(membrane);
+    return true;
+}
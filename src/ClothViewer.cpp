@@ -7,6 +7,9 @@
 #include "polyscope/view.h"
 #include "imgui.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <functional>
 #include <iostream>
 
@@ -14,10 +17,20 @@ using namespace std;
 
 #include "Cloth.h"
 #include "ClothFactory.h"
-#include "Integrators/ExplicitEuler.hpp"
-#include "Integrators/SemiImplicitEuler.hpp"
-#include "Integrators/Midpoint.hpp"
-#include "Integrators/ImplicitEuler.hpp"
+#include "Forces/DampingField.hpp"
+#include "Forces/MouseSpring.hpp"
+#include "Forces/TriangleMembrane.h"
+#include "Forces/Wind.hpp"
+#include "Integrators/Integrator.h"
+#include "Integrators/Integrators.h"
+#include "Integrators/StabilityWatchdog.h"
+#include "Integrators/StrainLimiter.h"
+#include "IO/FrameCache.h"
+#include "IO/FrameRecorder.h"
+#include "IO/Snapshot.h"
+#include "Parallel/DomainDecomposition.h"
+#include "Profiling/Profiler.h"
+#include "Solvers/MatrixFreePGS.h"
 
 namespace polyscope
 {
@@ -39,27 +52,6 @@ namespace polyscope
 
 namespace
 {
-    enum eIntegrators {
-        kExplicitEuler = 0,
-        kMidpoint,
-        kSemiImplicitEuler,
-        kImplicitEuler
-    };
-
-    static SemiImplicitEuler s_semiImplicitEuler;
-    static ExplicitEuler s_explicitEuler;
-    static Midpoint s_midpoint;
-    static ImplicitEuler s_implicitEuler;
-
-    // Stores instances of each integrator
-    //
-    static Integrator* integrators[4] = {
-        &s_explicitEuler,
-        &s_midpoint,
-        &s_semiImplicitEuler,
-        &s_implicitEuler
-    };
-
     static const std::array<float, 3> pinColor = { 1.0f, 0.0f, 0.0f };
     static const std::array<float, 3> pointColor = { 1.0f, 1.0f, 0.0f };
 }
@@ -68,18 +60,37 @@ ClothViewer::ClothViewer() :
     m_cloth(nullptr),
     m_clothMesh(nullptr),
     m_clothPoints(nullptr),
+    m_positionsDirty(false), m_pinsDirty(false), m_renderTopologyVersion(0), m_numRenderFaces(0),
     m_pickParticle(nullptr),
-    m_dt(0.01f), m_paused(true), m_stepOnce(false),
-    m_structuralStiffness(1000.0f), m_shearStiffness(250.0f), m_bendingStiffness(50.0f), m_damping(0.0f), 
+    m_domainDecomposition(nullptr), m_useDomainDecomposition(false), m_numTiles(4),
+    m_recorder(nullptr), m_recording(false),
+    m_frameCache(nullptr), m_playbackFrame(0), m_displayedFrame(-1), m_traceFrames(10),
+    m_dt(0.01f), m_paused(true), m_stepOnce(false), m_watchdog(new StabilityWatchdog), m_useWatchdog(true), m_useSleeping(false),
+    m_structuralStiffness(1000.0f), m_shearStiffness(250.0f), m_bendingStiffness(50.0f), m_damping(0.0f), m_tearStrain(0.0f), m_maxStrain(0.0f), 
+    m_useMembrane(false), m_youngsModulus(1000.0f), m_poissonRatio(0.3f),
+    m_wind(new Wind), m_useWind(false), m_windVelocity(5.0f, 0.0f, 2.0f), m_windDrag(0.5f),
+    m_airDamping(new DampingField), m_useAirDamping(false), m_airDampingCoefficient(0.1f), m_mouseSpring(new MouseSpring),
     m_nx(16), m_ny(16), m_width(8.0f), m_height(8.0f),
-    m_integratorIndex(kExplicitEuler)
+    m_integratorIndex(kExplicitEuler), m_solverMethod(kGaussSeidel), m_solverIterations(1), m_jacobianTolerance(0.0f)
 {
-
+    m_meshFilename[0] = '\0';
+    m_implicitSprings[kStructuralMaterial] = true;
+    m_implicitSprings[kShearMaterial] = m_implicitSprings[kBendingMaterial] = false;
+    strcpy(m_snapshotFilename, "cloth.snapshot");
+    strcpy(m_cacheFilename, "cloth.frames");
+    strcpy(m_traceFilename, "cloth_trace.json");
 }
 
 ClothViewer::~ClothViewer()
 {
+    stopRecording();
+    delete m_frameCache;
+    delete m_domainDecomposition;
+    delete m_watchdog;
     delete m_cloth;
+    delete m_wind;
+    delete m_airDamping;
+    delete m_mouseSpring;
 }
 
 void ClothViewer::start()
@@ -121,23 +132,152 @@ void ClothViewer::drawGUI()
     {
         m_stepOnce = true;
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+    {
+        // Back to the state the cloth was created or loaded with.
+        m_cloth->wakeAll();
+        m_cloth->setState(m_q0);
+        m_positionsDirty = true;
+        m_watchdog->discardCheckpoint();
+        resetDomainDecomposition();
+    }
     ImGui::PushItemWidth(100);
     ImGui::SliderFloat("Time step", &m_dt, 0.0f, 0.1f, "%.3f");
     ImGui::PopItemWidth();
 
+    // The worker processes only integrate and limit the strain.
+    ImGui::BeginDisabled(m_useDomainDecomposition);
+    if (ImGui::Checkbox("Stability watchdog", &m_useWatchdog))
+    {
+        m_watchdog->reset(m_integratorIndex);
+    }
+    if (m_useWatchdog)
+    {
+        ImGui::SameLine();
+        ImGui::Text("dt %.4f, %s, %d rollbacks", m_watchdog->getTimeStep(m_dt), getIntegratorName(m_watchdog->getCurrentIntegrator()), m_watchdog->getNumRollbacks());
+    }
+    if (ImGui::Checkbox("Sleeping", &m_useSleeping))
+    {
+        m_cloth->setSleeping(m_useSleeping);
+    }
+    if (m_useSleeping)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%d / %d regions asleep", m_cloth->getNumSleepingRegions(), m_cloth->getNumRegions());
+    }
+    ImGui::EndDisabled();
+
+    // Worker processes do not evaluate the force fields, so tiles and fields
+    // exclude each other.
+    const bool fieldsActive = m_useWind || m_useAirDamping;
+    ImGui::BeginDisabled(fieldsActive && !m_useDomainDecomposition);
+    if (ImGui::Checkbox("Multi-process tiles", &m_useDomainDecomposition))
+    {
+        resetDomainDecomposition();
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100);
+    if (ImGui::SliderInt("Tiles", &m_numTiles, 1, 16))
+    {
+        resetDomainDecomposition();
+    }
+    ImGui::PopItemWidth();
+    ImGui::EndDisabled();
+    if (fieldsActive && !m_useDomainDecomposition)
+    {
+        ImGui::SameLine();
+        ImGui::Text("(turn off the force fields to use tiles)");
+    }
+    if (m_useDomainDecomposition)
+    {
+        ImGui::Text("Tiles skip the watchdog, sleeping, tearing, force fields and mouse dragging.");
+    }
+
+    // Spring parameters live in the cloth material table, so a change only
+    // updates a few entries.
+    bool materialsChanged = false;
     ImGui::Text("Cloth parameters: ");
     ImGui::PushItemWidth(200);
-    ImGui::SliderFloat("Structural stiffness", &m_structuralStiffness, 0.0f, 10000.0f, "%.1f");
-    ImGui::SliderFloat("Shear stiffness", &m_shearStiffness, 0.0f, 10000.0f, "%.1f");
-    ImGui::SliderFloat("Bending stiffness", &m_bendingStiffness, 0.0f, 10000.0f, "%.1f");
-    ImGui::SliderFloat("Damping", &m_damping, 0.0f, 100.0f, "%.1f");
+    materialsChanged |= ImGui::SliderFloat("Structural stiffness", &m_structuralStiffness, 0.0f, 10000.0f, "%.1f");
+    materialsChanged |= ImGui::SliderFloat("Shear stiffness", &m_shearStiffness, 0.0f, 10000.0f, "%.1f");
+    materialsChanged |= ImGui::SliderFloat("Bending stiffness", &m_bendingStiffness, 0.0f, 10000.0f, "%.1f");
+    materialsChanged |= ImGui::SliderFloat("Damping", &m_damping, 0.0f, 100.0f, "%.1f");
+    ImGui::BeginDisabled(m_useDomainDecomposition);
+    materialsChanged |= ImGui::SliderFloat("Tear strain (0: off)", &m_tearStrain, 0.0f, 1.0f, "%.2f");
+    ImGui::EndDisabled();
+    materialsChanged |= ImGui::SliderFloat("Strain limit (0: off)", &m_maxStrain, 0.0f, 0.5f, "%.2f");
+    ImGui::Checkbox("Membrane elements (new cloths)", &m_useMembrane);
+    materialsChanged |= ImGui::SliderFloat("Young's modulus", &m_youngsModulus, 0.0f, 10000.0f, "%.1f");
+    materialsChanged |= ImGui::SliderFloat("Poisson ratio", &m_poissonRatio, 0.0f, 0.49f, "%.2f");
     ImGui::PopItemWidth();
 
+    if (materialsChanged)
+    {
+        updateSpringParameters();
+        m_cloth->wakeAll();
+        m_watchdog->discardCheckpoint();
+    }
+
+    bool fieldsChanged = false;
+    ImGui::Text(m_useDomainDecomposition ? "Force fields (not evaluated by tiles): " : "Force fields: ");
+    ImGui::BeginDisabled(m_useDomainDecomposition);
+    ImGui::PushItemWidth(200);
+    fieldsChanged |= ImGui::Checkbox("Wind", &m_useWind);
+    fieldsChanged |= ImGui::SliderFloat3("Wind velocity", m_windVelocity.data(), -20.0f, 20.0f, "%.1f");
+    fieldsChanged |= ImGui::SliderFloat("Wind drag", &m_windDrag, 0.0f, 2.0f, "%.2f");
+    fieldsChanged |= ImGui::Checkbox("Air damping", &m_useAirDamping);
+    fieldsChanged |= ImGui::SliderFloat("Air damping per unit mass", &m_airDampingCoefficient, 0.0f, 5.0f, "%.2f");
+    ImGui::PopItemWidth();
+    ImGui::EndDisabled();
+
+    if (fieldsChanged)
+    {
+        updateForceFields();
+    }
+
+    // Worker processes capture the integrator when they start.
+    bool integratorChanged = false;
     ImGui::Text("Integrators: ");
-    ImGui::RadioButton("Explicit", &m_integratorIndex, kExplicitEuler); ImGui::SameLine();
-    ImGui::RadioButton("Midpoint", &m_integratorIndex, kMidpoint); ImGui::SameLine();
-    ImGui::RadioButton("Semi-implicit", &m_integratorIndex, kSemiImplicitEuler); ImGui::SameLine();
-    ImGui::RadioButton("Implicit", &m_integratorIndex, kImplicitEuler);
+    integratorChanged |= ImGui::RadioButton("Explicit", &m_integratorIndex, kExplicitEuler); ImGui::SameLine();
+    integratorChanged |= ImGui::RadioButton("Midpoint", &m_integratorIndex, kMidpoint); ImGui::SameLine();
+    integratorChanged |= ImGui::RadioButton("Semi-implicit", &m_integratorIndex, kSemiImplicitEuler); ImGui::SameLine();
+    integratorChanged |= ImGui::RadioButton("Implicit", &m_integratorIndex, kImplicitEuler); ImGui::SameLine();
+    integratorChanged |= ImGui::RadioButton("IMEX", &m_integratorIndex, kImplicitExplicitEuler);
+
+    if (integratorChanged)
+    {
+        m_watchdog->reset(m_integratorIndex);
+        resetDomainDecomposition();
+    }
+    if (m_integratorIndex == kImplicitEuler || m_integratorIndex == kImplicitExplicitEuler)
+    {
+        bool solverChanged = false;
+        if (m_integratorIndex == kImplicitExplicitEuler)
+        {
+            ImGui::Text("Implicit springs: "); ImGui::SameLine();
+            solverChanged |= ImGui::Checkbox("Structural", &m_implicitSprings[kStructuralMaterial]); ImGui::SameLine();
+            solverChanged |= ImGui::Checkbox("Shear", &m_implicitSprings[kShearMaterial]); ImGui::SameLine();
+            solverChanged |= ImGui::Checkbox("Bending", &m_implicitSprings[kBendingMaterial]);
+        }
+        solverChanged |= ImGui::RadioButton("Gauss-Seidel", &m_solverMethod, kGaussSeidel); ImGui::SameLine();
+        solverChanged |= ImGui::RadioButton("SOR", &m_solverMethod, kSOR); ImGui::SameLine();
+        solverChanged |= ImGui::RadioButton("Chebyshev", &m_solverMethod, kChebyshevJacobi);
+        ImGui::PushItemWidth(100);
+        solverChanged |= ImGui::SliderInt("Solver sweeps", &m_solverIterations, 1, 100);
+        ImGui::SameLine();
+        solverChanged |= ImGui::SliderFloat("Jacobian reuse", &m_jacobianTolerance, 0.0f, 0.1f);
+        ImGui::PopItemWidth();
+        if (solverChanged)
+        {
+            updateSolver();
+        }
+        if (m_solverMethod != kGaussSeidel)
+        {
+            ImGui::SameLine();
+            ImGui::Text("spectral radius %.3f", m_cloth->getSolver()->getSpectralRadius());
+        }
+    }
 
     ImGui::Text("Scenarios: ");
     ImGui::PushItemWidth(200);
@@ -152,93 +292,263 @@ void ClothViewer::drawGUI()
     else if (ImGui::Button("Trampoline cloth")) {
         createTrampoline();
     }
+    ImGui::PushItemWidth(200);
+    ImGui::InputText("Mesh file", m_meshFilename, sizeof(m_meshFilename));
+    ImGui::PopItemWidth();
+    if (ImGui::Button("Load mesh")) {
+        loadMesh();
+    }
+
+    ImGui::PushItemWidth(200);
+    ImGui::InputText("Snapshot file", m_snapshotFilename, sizeof(m_snapshotFilename));
+    ImGui::PopItemWidth();
+    if (ImGui::Button("Save snapshot")) {
+        saveSnapshot();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load snapshot")) {
+        loadSnapshot();
+    }
+
+    ImGui::Text("Recording: ");
+    ImGui::PushItemWidth(200);
+    ImGui::InputText("Frame cache", m_cacheFilename, sizeof(m_cacheFilename));
+    ImGui::PopItemWidth();
+    if (ImGui::Checkbox("Record frames", &m_recording))
+    {
+        if (m_recording)
+            startRecording();
+        else
+            stopRecording();
+    }
+    if (m_recorder)
+    {
+        ImGui::Text("%llu frames, %llu dropped, %.1f MB", (unsigned long long)m_recorder->getNumWritten(),
+                    (unsigned long long)m_recorder->getNumDropped(), m_recorder->getBytesWritten() / (1024.0 * 1024.0));
+    }
 
+    // Playing back a cache replaces the simulation until the cache is closed.
+    ImGui::Text("Playback: ");
+    if (ImGui::Button("Open cache")) {
+        openFrameCache();
+    }
+    if (m_frameCache)
+    {
+        ImGui::SameLine();
+        if (ImGui::Button("Close cache")) {
+            closeFrameCache();
+            initClothData();
+        }
+    }
+    if (m_frameCache)
+    {
+        ImGui::PushItemWidth(300);
+        ImGui::SliderInt("Frame", &m_playbackFrame, 0, m_frameCache->getNumFrames() - 1);
+        ImGui::PopItemWidth();
+    }
+
+    drawProfilerGUI();
+}
+
+void ClothViewer::drawProfilerGUI()
+{
+    if (!ImGui::CollapsingHeader("Profiler"))
+        return;
+
+    Profiler& profiler = Profiler::instance();
+    if (!Profiler::isEnabled())
+    {
+        ImGui::Text("Timers are compiled out (TISSU_ENABLE_PROFILING is off).");
+    }
+    else
+    {
+        // Per-frame totals of each phase: rolling statistics, history and a
+        // histogram with power-of-two microsecond bins.
+        for (int p = 0; p < profiler.getNumPhases(); ++p)
+        {
+            const ProfilePhase& phase = profiler.getPhase(p);
+            ImGui::PushID(p);
+            ImGui::Text("%-26s avg %8.3f ms  max %8.3f ms  %d calls", phase.name.c_str(), phase.average, phase.maximum, phase.calls);
+            ImGui::PlotLines("##history", phase.history, ProfilePhase::kHistory, 0, nullptr, 0.0f, FLT_MAX, ImVec2(300, 30));
+            ImGui::SameLine();
+            ImGui::PlotHistogram("##histogram", phase.histogram, ProfilePhase::kHistogramBins, 0, nullptr, 0.0f, FLT_MAX, ImVec2(150, 30));
+            ImGui::PopID();
+        }
+        if (ImGui::Button("Reset histograms")) {
+            profiler.resetHistograms();
+        }
+
+        ImGui::PushItemWidth(200);
+        ImGui::InputText("Trace file", m_traceFilename, sizeof(m_traceFilename));
+        ImGui::InputInt("Trace frames", &m_traceFrames);
+        ImGui::PopItemWidth();
+        m_traceFrames = std::max(1, m_traceFrames);
+        if (profiler.isCapturing())
+        {
+            ImGui::Text("Capturing...");
+        }
+        else if (ImGui::Button("Capture trace")) {
+            profiler.requestCapture(profiler.getFrameIndex() + 1, m_traceFrames, m_traceFilename);
+        }
+    }
+
+    // Memory footprint of each subsystem.
+    profiler.setMemoryUsage("Cloth", m_cloth ? m_cloth->getMemoryUsage() : 0);
+    profiler.setMemoryUsage("Render buffers", m_renderPositions.size() * sizeof(float) + m_pointColors.capacity() * sizeof(m_pointColors[0]) +
+                                              m_playbackPositions.size() * sizeof(float));
+    profiler.setMemoryUsage("Frame recorder", m_recorder ? m_recorder->getMemoryUsage() : 0);
+    profiler.setMemoryUsage("Frame cache", m_frameCache ? m_frameCache->getMemoryUsage() : 0);
+    ImGui::Text("Memory: ");
+    for (const auto& entry : profiler.getMemoryUsage())
+    {
+        ImGui::Text("  %-20s %10.1f kB", entry.first.c_str(), entry.second / 1024.0);
+    }
 }
 
 void ClothViewer::initClothData()
 {
     const auto& particles = m_cloth->getParticles();
     const unsigned int numParticles = particles.size();
-    const int width = m_cloth->getWidth();
-    const int height = m_cloth->getHeight();
-    const unsigned numTriangles = 2 * (width - 1) * (height - 1);
+    const auto& triangles = m_cloth->getTriangles();
+    const unsigned numTriangles = triangles.size();
 
-    Eigen::MatrixXf meshV(numParticles, 3);
+    // The render buffers are sized once per cloth and reused by updateClothData().
+    m_renderPositions.resize(numParticles, 3);
+    m_pointColors.resize(numParticles);
     Eigen::MatrixXi meshF(numTriangles, 3);
 
     for (int i = 0; i < numParticles; ++i)
     {
-        meshV.row(i) << particles[i]->x(0), particles[i]->x(1), particles[i]->x(2);
+        m_renderPositions.row(i) = particles[i]->x.transpose();
+        m_pointColors[i] = particles[i]->fixed ? pinColor : pointColor;
     }
-    unsigned int k = 0;
-    for (int j = 0; j < width - 1; ++j)
+    for (unsigned int k = 0; k < numTriangles; ++k)
     {
-        for (int i = 0; i < height - 1; ++i)
-        {
-            meshF.row(k++) << m_cloth->getParticleIndex(i, j), m_cloth->getParticleIndex(i + 1, j + 1), m_cloth->getParticleIndex(i + 1, j);
-            meshF.row(k++) << m_cloth->getParticleIndex(i, j), m_cloth->getParticleIndex(i, j + 1), m_cloth->getParticleIndex(i + 1, j + 1);
-        }
+        meshF.row(k) << triangles[k][0], triangles[k][1], triangles[k][2];
     }
 
     // Register the mesh with Polyscope
-    m_clothMesh = polyscope::registerSurfaceMesh("cloth", meshV, meshF);
+    m_clothMesh = polyscope::registerSurfaceMesh("cloth", m_renderPositions, meshF);
     m_clothMesh->setSmoothShade(true);
 
     // Register the particles point cloud with Polyscope
-    m_clothPoints = polyscope::registerPointCloud("particles", meshV);
+    m_clothPoints = polyscope::registerPointCloud("particles", m_renderPositions);
     m_clothPoints->setPointRadius(0.01);
     m_clothPoints->setPointRenderMode(polyscope::PointRenderMode::Sphere);
-    m_clothPoints->addColorQuantity("colors", std::vector< std::array<float, 3> >(numParticles, pointColor))->setEnabled(true);
+    m_clothPoints->addColorQuantity("colors", m_pointColors)->setEnabled(true);
+
+    m_positionsDirty = false;
+    m_pinsDirty = false;
+    m_renderTopologyVersion = m_cloth->getTopologyVersion();
+
+    const std::vector<int>& ids = m_cloth->getTriangleIds();
+    m_renderFaces.assign(ids.empty() ? 0 : *std::max_element(ids.begin(), ids.end()) + 1, -1);
+    for (unsigned int k = 0; k < numTriangles; ++k)
+    {
+        m_renderFaces[ids[k]] = k;
+    }
+    m_numRenderFaces = numTriangles;
+    m_cloth->clearRemovedTriangles();
 }
 
 void ClothViewer::updateClothData()
 {
+    PROFILE_SCOPE("render upload");
+
     const auto& particles = m_cloth->getParticles();
     const unsigned int numParticles = particles.size();
 
-    Eigen::MatrixXf meshV(numParticles, 3);
-    for (int i = 0; i < numParticles; ++i)
+    // Springs were torn: collapse the faces of the triangles removed since
+    // the last frame onto one of their vertices, in the index buffer through
+    // which the registered mesh reads its vertex positions.  The upload of
+    // the positions below gathers them with the patched indices, so a tear
+    // costs its own faces rather than registering the mesh again.  The smooth
+    // normals still average the collapsed faces until the next registration.
+    if (m_renderTopologyVersion != m_cloth->getTopologyVersion())
     {
-        meshV.row(i) << particles[i]->x(0), particles[i]->x(1), particles[i]->x(2);
-    }
-    m_clothMesh->updateVertexPositions(meshV);
-    m_clothPoints->updatePointPositions(meshV);
+        const std::vector<int>& removed = m_cloth->getRemovedTriangles();
+        if (!removed.empty())
+        {
+            auto& indices = m_clothMesh->triangleVertexInds;
+            indices.ensureHostBufferPopulated();
+            for (int id : removed)
+            {
+                const int face = id < (int)m_renderFaces.size() ? m_renderFaces[id] : -1;
+                if (face < 0)
+                    continue;
+                indices.data[3 * face + 1] = indices.data[3 * face];
+                indices.data[3 * face + 2] = indices.data[3 * face];
+                m_renderFaces[id] = -1;
+                --m_numRenderFaces;
+            }
+            indices.markHostBufferUpdated();
+            m_cloth->clearRemovedTriangles();
+            m_positionsDirty = true;
+        }
+        m_renderTopologyVersion = m_cloth->getTopologyVersion();
 
-    // Polyscope requires updating *all* point quantities
-    //
-    std::vector< std::array<float, 3> > pointColors(numParticles, pointColor);
-    for (int i = 0; i < numParticles; ++i)
-    {
-        if (particles[i]->fixed)
-            pointColors[i] = pinColor;
+        // The triangles were rebuilt rather than removed (e.g. reordered).
+        if (m_numRenderFaces != (int)m_cloth->getTriangles().size())
+        {
+            initClothData();
+            return;
+        }
     }
-    m_clothPoints->addColorQuantity("colors", pointColors);
 
-    auto& springs = m_cloth->getSprings();
-    for (int i = m_cloth->getStructuralIndex(); i < m_cloth->getShearIndex(); ++i)
+    if (m_positionsDirty)
     {
-        springs[i]->k = m_structuralStiffness;
-        springs[i]->b = m_damping;
+        for (int i = 0; i < numParticles; ++i)
+        {
+            m_renderPositions.row(i) = particles[i]->x.transpose();
+        }
+        m_clothMesh->updateVertexPositions(m_renderPositions);
+        m_clothPoints->updatePointPositions(m_renderPositions);
+        m_positionsDirty = false;
     }
-    for (int i = m_cloth->getShearIndex(); i < m_cloth->getBendingIndex(); ++i)
+
+    if (m_pinsDirty)
     {
-        springs[i]->k = m_shearStiffness;
-        springs[i]->b = m_damping;
+        for (int i = 0; i < numParticles; ++i)
+        {
+            m_pointColors[i] = particles[i]->fixed ? pinColor : pointColor;
+        }
+        m_clothPoints->addColorQuantity("colors", m_pointColors);
+        m_pinsDirty = false;
     }
-    for (int i = m_cloth->getBendingIndex(); i < springs.size(); ++i)
+}
+
+void ClothViewer::updateSpringParameters()
+{
+    auto& materials = m_cloth->getMaterials();
+    materials[kStructuralMaterial] = SpringMaterial(m_structuralStiffness, m_damping, m_tearStrain);
+    materials[kShearMaterial] = SpringMaterial(m_shearStiffness, m_damping, m_tearStrain);
+    materials[kBendingMaterial] = SpringMaterial(m_bendingStiffness, m_damping, m_tearStrain);
+    m_cloth->getStrainLimiter()->setMaxStrain(m_maxStrain);
+    if (m_cloth->getMembrane())
     {
-        springs[i]->k = m_bendingStiffness;
-        springs[i]->b = m_damping;
+        m_cloth->getMembrane()->setMaterial(m_youngsModulus, m_poissonRatio);
     }
 }
 
 void ClothViewer::draw()
 {
-    drawGUI();
+    // A frame spans from one draw() callback to the next.
+    PROFILE_FRAME();
+
+    {
+        PROFILE_SCOPE("drawGUI");
+        drawGUI();
+    }
+
+    if (m_frameCache)
+    {
+        updatePlayback();
+        return;
+    }
 
 	// Perform particle selection
 	//
-	if (ImGui::IsMouseDown(0) && ImGui::GetIO().KeyCtrl && m_pickParticle == nullptr)
+	if (ImGui::IsMouseDown(0) && ImGui::GetIO().KeyCtrl && m_pickParticle == nullptr && !m_useDomainDecomposition)
 	{
 		const ImVec2 mouseP = ImGui::GetMousePos();
 		const auto selection = polyscope::pick::evaluatePickQuery(mouseP.x, mouseP.y);
@@ -247,7 +557,7 @@ void ClothViewer::draw()
 		{
 			const unsigned int pickInd = selection.second;
 			auto& particles = m_cloth->getParticles();
-			m_pickParticle = particles[pickInd];
+			grabParticle(particles[pickInd]);
 		}
 	}
 	// Perform particle pinning
@@ -262,61 +572,101 @@ void ClothViewer::draw()
 			const unsigned int pickInd = selection.second;
 			auto& particles = m_cloth->getParticles();
 			particles[pickInd]->fixed = !(particles[pickInd]->fixed);
+			m_cloth->wakeParticle(pickInd);
+			m_pinsDirty = true;
+			m_watchdog->discardCheckpoint();
+			resetDomainDecomposition();
 		}
 	}
 	else if (ImGui::IsMouseReleased(0) && m_pickParticle)
 	{
-		m_pickParticle = nullptr;
+		grabParticle(nullptr);
 	}
 
     // Simulation stepping
 	//
-	if (!m_paused || m_stepOnce)
+	if ((!m_paused || m_stepOnce) && m_useDomainDecomposition)
 	{
-		// Compute cloth forces.
+		// Lazily (re)start the worker processes from the current cloth state.
 		//
-		m_cloth->computeForces();
+		if (m_domainDecomposition == nullptr)
+		{
+			m_domainDecomposition = new DomainDecomposition(m_cloth, getIntegrator(m_integratorIndex), m_numTiles);
+			if (!m_domainDecomposition->start())
+			{
+				resetDomainDecomposition();
+				m_useDomainDecomposition = false;
+			}
+		}
+		if (m_domainDecomposition)
+		{
+			PROFILE_SCOPE("DomainDecomposition::step");
+			if (m_domainDecomposition->step(m_dt))
+			{
+				m_positionsDirty = true;
+				if (m_recorder) m_recorder->record(m_cloth);
+			}
+			else
+			{
+				// A worker died or is stuck: fall back to the single-process simulation.
+				resetDomainDecomposition();
+				m_useDomainDecomposition = false;
+				m_paused = true;
+			}
+		}
 
-		// Particle being dragged by the mouse spring.
-        // Note: mouse spring force must be applied after
-        // computeForces() is called.
+		m_stepOnce = false;
+	}
+	else if (!m_paused || m_stepOnce)
+	{
+		// Particle being dragged by the mouse spring, which pulls it towards
+		// the mouse in the plane of the screen.
 		// 
-		if (ImGui::IsMouseDown(0) && ImGui::GetIO().KeyCtrl && m_pickParticle )
+		if (m_pickParticle)
 		{
-			ImVec2 mouseP = ImGui::GetMousePos();
-
-			glm::vec3 p = { m_pickParticle->x.x(), m_pickParticle->x.y(), m_pickParticle->x.z() };
-			glm::vec2 screenCoord = polyscope::view::worldToScreenCoords(p);
-
-			auto& particles = m_cloth->getParticles();
+			Eigen::Vector3f pull(0, 0, 0);
+			if (ImGui::IsMouseDown(0) && ImGui::GetIO().KeyCtrl)
+			{
+				ImVec2 mouseP = ImGui::GetMousePos();
 
-			glm::vec3 lookDir, upDir, rightDir;
-			polyscope::view::getCameraFrame(lookDir, upDir, rightDir);
+				glm::vec3 p = { m_pickParticle->x.x(), m_pickParticle->x.y(), m_pickParticle->x.z() };
+				glm::vec2 screenCoord = polyscope::view::worldToScreenCoords(p);
 
-			glm::vec3 f = (mouseP.x - screenCoord.x) * rightDir + (screenCoord.y - mouseP.y) * upDir;
+				glm::vec3 lookDir, upDir, rightDir;
+				polyscope::view::getCameraFrame(lookDir, upDir, rightDir);
 
-			// Apply mouse spring force.
-			{
-				static const float K_mouse = 50.0f;
-				Eigen::Vector3f u(f.x, f.y, f.z);
-				const float ulen = u.norm();
-				u.normalize();
-
-				if (ulen > 0.1f)
-				{
-					m_pickParticle->f += K_mouse * ulen * u - 0.1f * K_mouse * (m_pickParticle->v.dot(u)) * u;
-				}
+				glm::vec3 f = (mouseP.x - screenCoord.x) * rightDir + (screenCoord.y - mouseP.y) * upDir;
+				pull = Eigen::Vector3f(f.x, f.y, f.z);
 			}
+			m_mouseSpring->setPull(pull);
+			m_cloth->wakeParticle(m_pickParticle->index);
+
+			// The mouse does work on the cloth.
+			m_watchdog->discardCheckpoint();
 		}
 
+		// Compute cloth forces, including the force fields.
+		//
+		m_cloth->computeForces();
+
 		// Step the simulation
-		integrators[m_integratorIndex]->step(m_cloth, m_dt);
+		if (!m_useWatchdog)
+		{
+			getIntegrator(m_integratorIndex)->step(m_cloth, m_dt);
+			m_cloth->limitStrain(m_dt);
+		}
+		else if (!m_watchdog->step(m_cloth, m_dt))
+		{
+			m_paused = true;
+		}
+		m_cloth->tearSprings();
+		m_positionsDirty = true;
+		if (m_recorder) m_recorder->record(m_cloth);
 
 		m_stepOnce = false;
 	}
 
-	// Update cloth mesh and point positions for rendering, 
-	//  as well as cloth params.
+	// Upload the cloth mesh and point positions that changed.
     //
     updateClothData();
 
@@ -331,11 +681,7 @@ void ClothViewer::createHangingCloth()
     const float xoff = 0.5f * m_width;
     const float zoff = 0.5f * m_height;
 
-    delete m_cloth;
-    m_cloth = ClothFactory::createHangingCloth(m_nx, m_ny, m_width / (m_nx - 1), m_height / (m_ny - 1), m_structuralStiffness, m_shearStiffness, m_bendingStiffness, m_damping, -xoff, -zoff);
-    m_cloth->getState(m_q0);
-
-    initClothData();
+    setCloth(ClothFactory::createHangingCloth(m_nx, m_ny, m_width / (m_nx - 1), m_height / (m_ny - 1), m_structuralStiffness, m_shearStiffness, m_bendingStiffness, m_damping, -xoff, -zoff));
 }
 
 void ClothViewer::createTrampoline()
@@ -346,9 +692,218 @@ void ClothViewer::createTrampoline()
     const float xoff = 0.5f * m_width;
     const float zoff = 0.5f * m_height;
 
+    setCloth(ClothFactory::createTrampoline(m_nx, m_ny, m_width / (m_nx - 1), m_height / (m_ny - 1), m_structuralStiffness, m_shearStiffness, m_bendingStiffness, m_damping, -xoff, -zoff));
+}
+
+void ClothViewer::loadMesh()
+{
+    Cloth* cloth = ClothFactory::createFromMesh(m_meshFilename, m_structuralStiffness, m_bendingStiffness, m_damping, kReverseCuthillMcKee);
+    if (cloth == nullptr)
+    {
+        std::cerr << "Unable to load mesh " << m_meshFilename << std::endl;
+        return;
+    }
+
+    setCloth(cloth);
+}
+
+void ClothViewer::saveSnapshot()
+{
+    SnapshotParams params;
+    params.dt = m_dt;
+    params.structuralStiffness = m_structuralStiffness;
+    params.shearStiffness = m_shearStiffness;
+    params.bendingStiffness = m_bendingStiffness;
+    params.damping = m_damping;
+    params.integrator = m_integratorIndex;
+
+    Snapshot::save(m_snapshotFilename, m_cloth, params);
+}
+
+void ClothViewer::loadSnapshot()
+{
+    SnapshotParams params;
+    Cloth* cloth = Snapshot::load(m_snapshotFilename, &params);
+    if (cloth == nullptr)
+    {
+        return;
+    }
+
+    m_dt = params.dt;
+    m_structuralStiffness = params.structuralStiffness;
+    m_shearStiffness = params.shearStiffness;
+    m_bendingStiffness = params.bendingStiffness;
+    m_damping = params.damping;
+    m_tearStrain = cloth->getMaterials()[kStructuralMaterial].tearStrain;
+    if (params.integrator >= 0 && params.integrator < kNumIntegrators)
+    {
+        m_integratorIndex = params.integrator;
+    }
+
+    setCloth(cloth);
+}
+
+// Replace the simulated cloth by @a cloth and register it for rendering.
+//
+void ClothViewer::setCloth(Cloth* cloth)
+{
+    resetDomainDecomposition();
+    stopRecording();
+    closeFrameCache();
+    grabParticle(nullptr);
     delete m_cloth;
-    m_cloth = ClothFactory::createTrampoline(m_nx, m_ny, m_width / (m_nx - 1), m_height / (m_ny - 1), m_structuralStiffness, m_shearStiffness, m_bendingStiffness, m_damping, -xoff, -zoff);
+    m_cloth = cloth;
+    if (m_useMembrane && !m_cloth->getMembrane())
+    {
+        ClothFactory::createMembrane(m_cloth, m_youngsModulus, m_poissonRatio);
+    }
     m_cloth->getState(m_q0);
+    m_cloth->setSleeping(m_useSleeping);
+    updateSolver();
+    updateSpringParameters();
+    updateForceFields();
+    m_watchdog->reset(m_integratorIndex);
 
     initClothData();
 }
+
+// Apply the solver settings to the implicit solver of the cloth.
+//
+void ClothViewer::updateSolver()
+{
+    MatrixFreePGS* solver = m_cloth->getSolver();
+    solver->setMethod(m_solverMethod);
+    solver->setMaxIterations(m_solverIterations);
+    solver->setJacobianTolerance(m_jacobianTolerance);
+
+    uint32_t implicitMaterials = 0;
+    for (int m = 0; m < kNumClothMaterials; ++m)
+    {
+        if (m_implicitSprings[m]) implicitMaterials |= 1u << m;
+    }
+    m_cloth->setImplicitMaterials(implicitMaterials);
+}
+
+// Register the enabled force fields with the cloth and update their parameters.
+//
+void ClothViewer::updateForceFields()
+{
+    m_wind->setVelocity(m_windVelocity);
+    m_wind->setDrag(m_windDrag);
+    m_airDamping->setCoefficient(m_airDampingCoefficient);
+
+    m_cloth->removeForceField(m_wind);
+    m_cloth->removeForceField(m_airDamping);
+    if (m_useWind) m_cloth->addForceField(m_wind);
+    if (m_useAirDamping) m_cloth->addForceField(m_airDamping);
+    m_cloth->wakeAll();
+}
+
+// Attach the mouse spring to @a particle, or release it if null.
+//
+void ClothViewer::grabParticle(Particle* particle)
+{
+    if (m_pickParticle)
+    {
+        m_cloth->removeForceField(m_mouseSpring);
+    }
+    m_pickParticle = particle;
+    m_mouseSpring->setParticle(particle);
+    m_mouseSpring->setPull(Eigen::Vector3f::Zero());
+    if (m_pickParticle)
+    {
+        m_cloth->addForceField(m_mouseSpring);
+    }
+}
+
+void ClothViewer::resetDomainDecomposition()
+{
+    delete m_domainDecomposition;
+    m_domainDecomposition = nullptr;
+}
+
+void ClothViewer::startRecording()
+{
+    stopRecording();
+
+    m_recorder = new FrameRecorder;
+    if (!m_recorder->open(m_cacheFilename, m_cloth))
+    {
+        stopRecording();
+        return;
+    }
+    m_recording = true;
+}
+
+void ClothViewer::stopRecording()
+{
+    delete m_recorder;
+    m_recorder = nullptr;
+    m_recording = false;
+}
+
+void ClothViewer::openFrameCache()
+{
+    // The cache may be the file being recorded.
+    stopRecording();
+    closeFrameCache();
+
+    m_frameCache = new FrameCache;
+    if (!m_frameCache->open(m_cacheFilename))
+    {
+        closeFrameCache();
+        return;
+    }
+
+    const int numParticles = m_frameCache->getNumParticles();
+    const int numTriangles = m_frameCache->getNumTriangles();
+    const int32_t* triangles = m_frameCache->getTriangles();
+
+    m_playbackPositions.resize(numParticles, 3);
+    m_frameCache->getFrame(0, m_playbackPositions.data());
+    m_playbackFrame = 0;
+    m_displayedFrame = 0;
+
+    Eigen::MatrixXi meshF(numTriangles, 3);
+    for (int k = 0; k < numTriangles; ++k)
+    {
+        meshF.row(k) << triangles[3 * k], triangles[3 * k + 1], triangles[3 * k + 2];
+    }
+
+    // Replace the simulated cloth meshes by the cached ones.
+    m_clothMesh = polyscope::registerSurfaceMesh("cloth", m_playbackPositions, meshF);
+    m_clothMesh->setSmoothShade(true);
+    m_clothPoints = polyscope::registerPointCloud("particles", m_playbackPositions);
+    m_clothPoints->setPointRadius(0.01);
+    m_clothPoints->setPointRenderMode(polyscope::PointRenderMode::Sphere);
+    m_clothPoints->addColorQuantity("colors", std::vector< std::array<float, 3> >(numParticles, pointColor))->setEnabled(true);
+    grabParticle(nullptr);
+}
+
+void ClothViewer::closeFrameCache()
+{
+    delete m_frameCache;
+    m_frameCache = nullptr;
+    m_displayedFrame = -1;
+}
+
+void ClothViewer::updatePlayback()
+{
+    PROFILE_SCOPE("playback");
+
+    const int numFrames = m_frameCache->getNumFrames();
+    if (!m_paused || m_stepOnce)
+    {
+        m_playbackFrame = (m_playbackFrame + 1) % numFrames;
+        m_stepOnce = false;
+    }
+    m_playbackFrame = std::max(0, std::min(m_playbackFrame, numFrames - 1));
+
+    // Only upload positions when the frame changes.
+    if (m_playbackFrame != m_displayedFrame && m_frameCache->getFrame(m_playbackFrame, m_playbackPositions.data()))
+    {
+        m_clothMesh->updateVertexPositions(m_playbackPositions);
+        m_clothPoints->updatePointPositions(m_playbackPositions);
+        m_displayedFrame = m_playbackFrame;
+    }
+}
@@ -0,0 +1,304 @@
+#include "CompactCloth.h"
+
+#include "Integrators/Integrators.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+    const Eigen::Vector3f kGravity(0, -9.81f, 0);
+}
+
+CompactCloth::CompactCloth(int _nx, int _ny) : m_nx(_nx), m_ny(_ny), m_mass(1.0f), m_lengthQuantum(0.0f), m_implicitMaterials(1)
+{
+}
+
+void CompactCloth::reserve(int numParticles, int numSprings)
+{
+    m_x.reserve(3 * numParticles);
+    m_v.reserve(3 * numParticles);
+    m_fixed.reserve(numParticles);
+    m_pending.reserve(numSprings);
+}
+
+int CompactCloth::addParticle(const Eigen::Vector3f& x, bool fixed)
+{
+    m_x.insert(m_x.end(), { x.x(), x.y(), x.z() });
+    m_v.insert(m_v.end(), 3, Eigen::half(0.0f));
+    m_fixed.push_back(fixed ? 1 : 0);
+    return m_fixed.size() - 1;
+}
+
+void CompactCloth::addSpring(int i0, int i1, int material, float restLength)
+{
+    m_pending.push_back({ (uint32_t)i0, (uint32_t)i1, material, restLength });
+}
+
+bool CompactCloth::finalize()
+{
+    const uint32_t numParticles = m_fixed.size();
+    if (m_materials.size() > 256)
+    {
+        std::cerr << "CompactCloth: at most 256 materials are supported." << std::endl;
+        return false;
+    }
+
+    float maxLength = 0.0f;
+    for (const PendingSpring& s : m_pending)
+    {
+        if (s.i0 >= numParticles || s.i1 >= numParticles || s.i0 == s.i1 || s.material < 0 || s.material >= (int)m_materials.size())
+        {
+            std::cerr << "CompactCloth: invalid spring between particles " << s.i0 << " and " << s.i1 << std::endl;
+            return false;
+        }
+        maxLength = std::max(maxLength, s.restLength);
+    }
+
+    // Keep the springs that were already finalized.
+    for (uint32_t i = 0; i + 1 < m_springStart.size(); ++i)
+    {
+        for (uint32_t s = m_springStart[i]; s < m_springStart[i + 1]; ++s)
+        {
+            const CompactSpring& spring = m_springs[s];
+            m_pending.push_back({ i, spring.other, spring.material, spring.restLength * m_lengthQuantum });
+            maxLength = std::max(maxLength, m_pending.back().restLength);
+        }
+    }
+    m_lengthQuantum = (maxLength > 0.0f) ? maxLength / 65535.0f : 1.0f;
+
+    // Counting sort of the springs by their larger particle index.
+    m_springStart.assign(numParticles + 1, 0);
+    for (const PendingSpring& s : m_pending)
+    {
+        ++m_springStart[std::max(s.i0, s.i1) + 1];
+    }
+    for (uint32_t i = 0; i < numParticles; ++i)
+    {
+        m_springStart[i + 1] += m_springStart[i];
+    }
+
+    std::vector<uint32_t> next(m_springStart.begin(), m_springStart.end() - 1);
+    m_springs.resize(m_pending.size());
+    for (const PendingSpring& s : m_pending)
+    {
+        CompactSpring& spring = m_springs[next[std::max(s.i0, s.i1)]++];
+        spring.other = std::min(s.i0, s.i1);
+        spring.restLength = (uint16_t)std::min(65535.0f, std::round(s.restLength / m_lengthQuantum));
+        spring.material = (uint8_t)s.material;
+        spring.unused = 0;
+    }
+    m_springs.shrink_to_fit();
+    std::vector<PendingSpring>().swap(m_pending);
+
+    m_f.assign(3 * numParticles, 0.0f);
+    return true;
+}
+
+Eigen::Vector3f CompactCloth::getVelocity(int i) const
+{
+    return Eigen::Vector3f(static_cast<float>(m_v[3 * i]), static_cast<float>(m_v[3 * i + 1]), static_cast<float>(m_v[3 * i + 2]));
+}
+
+void CompactCloth::storeVelocity(int i, const Eigen::Vector3f& v)
+{
+    m_v[3 * i] = Eigen::half(v.x());
+    m_v[3 * i + 1] = Eigen::half(v.y());
+    m_v[3 * i + 2] = Eigen::half(v.z());
+}
+
+void CompactCloth::setFixed(int i, bool fixed)
+{
+    m_fixed[i] = fixed ? 1 : 0;
+    if (fixed) storeVelocity(i, Eigen::Vector3f::Zero());
+}
+
+Eigen::Matrix3f CompactCloth::springJacobian(float k, float r, const Eigen::Vector3f& x0, const Eigen::Vector3f& x1)
+{
+    const Eigen::Vector3f delta = x1 - x0;
+    const float length = std::max(delta.norm(), 1e-6f);
+    const Eigen::Vector3f n = delta / length;
+    return -k * (1 - r / length) * Eigen::Matrix3f::Identity() - k * (r / length) * (n * n.transpose());
+}
+
+void CompactCloth::computeForces()
+{
+    PROFILE_SCOPE("computeForces");
+
+    const int numParticles = getNumParticles();
+    Eigen::Map<Eigen::Matrix3Xf> f(m_f.data(), 3, numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        f.col(i) = m_fixed[i] ? Eigen::Vector3f::Zero() : Eigen::Vector3f(m_mass * kGravity);
+    }
+
+    for (int i = 0; i < numParticles; ++i)
+    {
+        const Eigen::Vector3f x1 = getPosition(i);
+        const Eigen::Vector3f v1 = getVelocity(i);
+        for (uint32_t s = m_springStart[i]; s < m_springStart[i + 1]; ++s)
+        {
+            const CompactSpring& spring = m_springs[s];
+            const SpringMaterial& material = m_materials[spring.material];
+            const int j = spring.other;
+
+            const Eigen::Vector3f delta = x1 - getPosition(j);
+            const float length = delta.norm();
+            const Eigen::Vector3f n = delta.normalized();
+            const float projectedVel = (v1 - getVelocity(j)).dot(n);
+            const Eigen::Vector3f fs = (material.k * (length - spring.restLength * m_lengthQuantum) + material.b * projectedVel) * n;
+
+            if (!m_fixed[j]) f.col(j) += fs;
+            if (!m_fixed[i]) f.col(i) -= fs;
+        }
+    }
+}
+
+void CompactCloth::step(int integrator, float dt)
+{
+    if (integrator == kImplicitEuler || integrator == kImplicitExplicitEuler)
+    {
+        stepImplicit(dt, integrator == kImplicitEuler ? ~0u : m_implicitMaterials);
+        return;
+    }
+
+    PROFILE_SCOPE("integrator update");
+    const int numParticles = getNumParticles();
+    const Eigen::Map<const Eigen::Matrix3Xf> f(m_f.data(), 3, numParticles);
+    Eigen::Map<Eigen::Matrix3Xf> x(m_x.data(), 3, numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        if (m_fixed[i])
+            continue;
+
+        const Eigen::Vector3f v = getVelocity(i);
+        const Eigen::Vector3f a = f.col(i) / m_mass;
+        switch (integrator)
+        {
+        case kExplicitEuler:
+            x.col(i) += dt * v;
+            break;
+        case kMidpoint:
+            // Midpoint.hpp evaluates the derivative at the midpoint with the forces of the current state.
+            x.col(i) += dt * (v + 0.5f * dt * a);
+            break;
+        default:
+            x.col(i) += dt * (v + dt * a);
+            break;
+        }
+        storeVelocity(i, v + dt * a);
+    }
+}
+
+void CompactCloth::stepImplicit(float dt, uint32_t implicitMaterials)
+{
+    // One Gauss-Seidel sweep over (M - dt*dt*dfdx) deltav = dt*f + dt*dt*dfdx*v,
+    // as in MatrixFreePGS, with the spring Jacobians computed when needed.
+    const auto isImplicit = [implicitMaterials](int material) { return material >= 32 || (implicitMaterials >> material & 1) != 0; };
+    const int numParticles = getNumParticles();
+    const float dt2 = dt * dt;
+    Eigen::Map<Eigen::Matrix3Xf> b(m_f.data(), 3, numParticles);
+    m_diagonal.resize(6 * numParticles);
+
+    {
+        PROFILE_SCOPE("buildRHS");
+        b *= dt;
+        for (int i = 0; i < numParticles; ++i)
+        {
+            m_diagonal[6 * i] = m_diagonal[6 * i + 3] = m_diagonal[6 * i + 5] = m_mass;
+            m_diagonal[6 * i + 1] = m_diagonal[6 * i + 2] = m_diagonal[6 * i + 4] = 0.0f;
+        }
+
+        for (int i = 0; i < numParticles; ++i)
+        {
+            const Eigen::Vector3f x1 = getPosition(i);
+            const Eigen::Vector3f v1 = getVelocity(i);
+            for (uint32_t s = m_springStart[i]; s < m_springStart[i + 1]; ++s)
+            {
+                const CompactSpring& spring = m_springs[s];
+                if (!isImplicit(spring.material))
+                    continue;
+                const int j = spring.other;
+                const Eigen::Matrix3f K = dt2 * springJacobian(m_materials[spring.material].k, spring.restLength * m_lengthQuantum, getPosition(j), x1);
+                const Eigen::Vector3f Kdv = K * (v1 - getVelocity(j));
+                b.col(i) += Kdv;
+                b.col(j) -= Kdv;
+
+                for (int p : { i, j })
+                {
+                    float* d = &m_diagonal[6 * p];
+                    d[0] -= K(0, 0); d[1] -= K(0, 1); d[2] -= K(0, 2);
+                    d[3] -= K(1, 1); d[4] -= K(1, 2); d[5] -= K(2, 2);
+                }
+            }
+        }
+    }
+
+    // Springs to particles with a larger index see a zero velocity change, so
+    // only the springs stored with particle i contribute.  The velocity change
+    // of particle i replaces its right-hand side.
+    {
+        PROFILE_SCOPE("PGS sweep");
+        for (int i = 0; i < numParticles; ++i)
+        {
+            if (m_fixed[i])
+            {
+                b.col(i).setZero();
+                continue;
+            }
+
+            const Eigen::Vector3f x1 = getPosition(i);
+            Eigen::Vector3f r = b.col(i);
+            for (uint32_t s = m_springStart[i]; s < m_springStart[i + 1]; ++s)
+            {
+                const CompactSpring& spring = m_springs[s];
+                const int j = spring.other;
+                if (!m_fixed[j] && isImplicit(spring.material))
+                {
+                    r -= dt2 * springJacobian(m_materials[spring.material].k, spring.restLength * m_lengthQuantum, getPosition(j), x1) * b.col(j);
+                }
+            }
+
+            const float* d = &m_diagonal[6 * i];
+            Eigen::Matrix3f A;
+            A << d[0], d[1], d[2],
+                 d[1], d[3], d[4],
+                 d[2], d[4], d[5];
+            b.col(i) = A.ldlt().solve(r);
+        }
+    }
+
+    PROFILE_SCOPE("integrator update");
+    Eigen::Map<Eigen::Matrix3Xf> x(m_x.data(), 3, numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        if (m_fixed[i])
+            continue;
+
+        const Eigen::Vector3f v = getVelocity(i) + b.col(i);
+        storeVelocity(i, v);
+        x.col(i) += dt * v;
+    }
+}
+
+void CompactCloth::copyStateTo(ParticleSystem* particleSystem) const
+{
+    auto& particles = particleSystem->getParticles();
+    assert((int)particles.size() == getNumParticles());
+    for (int i = 0; i < getNumParticles(); ++i)
+    {
+        particles[i]->x = getPosition(i);
+        particles[i]->v = getVelocity(i);
+    }
+}
+
+size_t CompactCloth::getMemoryUsage() const
+{
+    return m_x.capacity() * sizeof(float) + m_v.capacity() * sizeof(Eigen::half) + m_fixed.capacity() +
+           m_springStart.capacity() * sizeof(uint32_t) + m_springs.capacity() * sizeof(CompactSpring) +
+           m_materials.capacity() * sizeof(SpringMaterial) + m_f.capacity() * sizeof(float) +
+           m_diagonal.capacity() * sizeof(float) + m_pending.capacity() * sizeof(PendingSpring);
+}
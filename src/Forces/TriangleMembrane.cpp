@@ -0,0 +1,306 @@
+#include "Forces/TriangleMembrane.h"
+
+#include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int TriangleMembrane::kBatch;
+const int TriangleMembrane::kBlockFloats;
+
+namespace
+{
+    // Batches of a pass below which the pass is not worth running in parallel.
+    const int kMinParallelBatches = 64;
+
+    // Position of the block of corners @a a <= @a b in the stiffness blocks of a triangle.
+    inline int blockIndex(int a, int b)
+    {
+        return (a == b) ? a : 2 + a + b;
+    }
+
+    int numBatches(int numTriangles)
+    {
+        return (numTriangles + TriangleMembrane::kBatch - 1) / TriangleMembrane::kBatch;
+    }
+}
+
+TriangleMembrane::TriangleMembrane(const std::vector<Particle*>& particles, const std::vector<std::array<int, 3>>& triangles) :
+    m_triangles(triangles), m_youngsModulus(0.0f), m_poissonRatio(0.0f), m_mu(0.0f), m_lambda(0.0f)
+{
+    const int numTriangles = m_triangles.size();
+    const int padded = numBatches(numTriangles) * kBatch;
+    m_b00.assign(padded, 0.0f);
+    m_b01.assign(padded, 0.0f);
+    m_b11.assign(padded, 0.0f);
+    m_area.assign(padded, 0.0f);
+    m_forces.assign(6 * padded, 0.0f);
+    m_energy.assign(padded, 0.0f);
+
+    for (int t = 0; t < numTriangles; ++t)
+    {
+        const Eigen::Vector3f e1 = particles[m_triangles[t][1]]->x - particles[m_triangles[t][0]]->x;
+        const Eigen::Vector3f e2 = particles[m_triangles[t][2]]->x - particles[m_triangles[t][0]]->x;
+        const Eigen::Vector3f n = e1.cross(e2);
+        const float l1 = e1.norm();
+        const float doubleArea = n.norm();
+        if (l1 < 1e-12f || doubleArea < 1e-6f * l1 * l1)
+            continue;
+
+        // Rest edge matrix [[l1, e2.u], [0, e2.v]] in the frame (u, v) of the
+        // triangle, where u is along e1, and its inverse.
+        const Eigen::Vector3f u = e1 / l1;
+        const Eigen::Vector3f v = n.cross(e1).normalized();
+        const float d01 = e2.dot(u);
+        const float d11 = e2.dot(v);
+        m_b00[t] = 1.0f / l1;
+        m_b01[t] = -d01 / (l1 * d11);
+        m_b11[t] = 1.0f / d11;
+        m_area[t] = 0.5f * doubleArea;
+    }
+
+    buildAdjacency(particles.size());
+    setMaterial(1000.0f, 0.3f);
+}
+
+void TriangleMembrane::setMaterial(float youngsModulus, float poissonRatio)
+{
+    m_youngsModulus = youngsModulus;
+    m_poissonRatio = poissonRatio;
+    m_mu = youngsModulus / (2.0f * (1.0f + poissonRatio));
+    m_lambda = youngsModulus * poissonRatio / (1.0f - poissonRatio * poissonRatio);
+}
+
+void TriangleMembrane::buildAdjacency(int numParticles)
+{
+    m_vertexStart.assign(numParticles + 1, 0);
+    for (const std::array<int, 3>& triangle : m_triangles)
+    {
+        for (int a = 0; a < 3; ++a) ++m_vertexStart[triangle[a] + 1];
+    }
+    for (int i = 0; i < numParticles; ++i)
+    {
+        m_vertexStart[i + 1] += m_vertexStart[i];
+    }
+
+    std::vector<int> next(m_vertexStart.begin(), m_vertexStart.end() - 1);
+    m_vertexCorners.resize(3 * m_triangles.size());
+    for (int t = 0; t < (int)m_triangles.size(); ++t)
+    {
+        for (int a = 0; a < 3; ++a) m_vertexCorners[next[m_triangles[t][a]]++] = 3 * t + a;
+    }
+}
+
+void TriangleMembrane::remap(const std::vector<int>& newIndex)
+{
+    for (std::array<int, 3>& triangle : m_triangles)
+    {
+        for (int a = 0; a < 3; ++a) triangle[a] = newIndex[triangle[a]];
+    }
+    buildAdjacency(m_vertexStart.size() - 1);
+}
+
+void TriangleMembrane::gatherEdges(const std::vector<Particle*>& particles, int first, float e1[3][kBatch], float e2[3][kBatch]) const
+{
+    for (int l = 0; l < kBatch; ++l)
+    {
+        if (first + l < (int)m_triangles.size())
+        {
+            const std::array<int, 3>& triangle = m_triangles[first + l];
+            const Eigen::Vector3f& x0 = particles[triangle[0]]->x;
+            const Eigen::Vector3f& x1 = particles[triangle[1]]->x;
+            const Eigen::Vector3f& x2 = particles[triangle[2]]->x;
+            for (int c = 0; c < 3; ++c)
+            {
+                e1[c][l] = x1[c] - x0[c];
+                e2[c][l] = x2[c] - x0[c];
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 3; ++c) e1[c][l] = e2[c][l] = 0.0f;
+        }
+    }
+}
+
+double TriangleMembrane::addForces(const std::vector<Particle*>& particles)
+{
+    PROFILE_SCOPE("membrane forces");
+
+    const int numTriangles = m_triangles.size();
+    const int batches = numBatches(numTriangles);
+    const float mu = m_mu;
+    const float lambda = m_lambda;
+
+    #pragma omp parallel for if (batches >= kMinParallelBatches)
+    for (int batch = 0; batch < batches; ++batch)
+    {
+        const int first = batch * kBatch;
+        float e1[3][kBatch], e2[3][kBatch];
+        gatherEdges(particles, first, e1, e2);
+
+        const float* b00 = &m_b00[first];
+        const float* b01 = &m_b01[first];
+        const float* b11 = &m_b11[first];
+        const float* area = &m_area[first];
+        float* f = &m_forces[6 * first];
+        float* energy = &m_energy[first];
+
+        #pragma omp simd
+        for (int l = 0; l < kBatch; ++l)
+        {
+            // Columns of the deformation gradient and Green strain.
+            float F0[3], F1[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                F0[c] = e1[c][l] * b00[l];
+                F1[c] = e1[c][l] * b01[l] + e2[c][l] * b11[l];
+            }
+            const float E00 = 0.5f * (F0[0] * F0[0] + F0[1] * F0[1] + F0[2] * F0[2] - 1.0f);
+            const float E01 = 0.5f * (F0[0] * F1[0] + F0[1] * F1[1] + F0[2] * F1[2]);
+            const float E11 = 0.5f * (F1[0] * F1[0] + F1[1] * F1[1] + F1[2] * F1[2] - 1.0f);
+            const float trace = E00 + E11;
+
+            // Second Piola-Kirchhoff stress, and forces -A F S B^T on corners 1 and 2.
+            const float S00 = 2.0f * mu * E00 + lambda * trace;
+            const float S01 = 2.0f * mu * E01;
+            const float S11 = 2.0f * mu * E11 + lambda * trace;
+            for (int c = 0; c < 3; ++c)
+            {
+                const float P0 = F0[c] * S00 + F1[c] * S01;
+                const float P1 = F0[c] * S01 + F1[c] * S11;
+                f[c * kBatch + l] = -area[l] * (P0 * b00[l] + P1 * b01[l]);
+                f[(3 + c) * kBatch + l] = -area[l] * P1 * b11[l];
+            }
+            energy[l] = area[l] * (mu * (E00 * E00 + 2.0f * E01 * E01 + E11 * E11) + 0.5f * lambda * trace * trace);
+        }
+    }
+
+    double elasticEnergy = 0.0;
+    for (int t = 0; t < numTriangles; ++t)
+    {
+        const int l = t % kBatch;
+        const float* f = &m_forces[6 * (t - l)];
+        const Eigen::Vector3f f1(f[l], f[kBatch + l], f[2 * kBatch + l]);
+        const Eigen::Vector3f f2(f[3 * kBatch + l], f[4 * kBatch + l], f[5 * kBatch + l]);
+        Particle* p0 = particles[m_triangles[t][0]];
+        Particle* p1 = particles[m_triangles[t][1]];
+        Particle* p2 = particles[m_triangles[t][2]];
+        if (!p0->fixed) p0->f -= f1 + f2;
+        if (!p1->fixed) p1->f += f1;
+        if (!p2->fixed) p2->f += f2;
+        elasticEnergy += m_energy[t];
+    }
+    return elasticEnergy;
+}
+
+void TriangleMembrane::computeJacobians(const std::vector<Particle*>& particles)
+{
+    PROFILE_SCOPE("membrane dfdx");
+
+    const int numTriangles = m_triangles.size();
+    const int batches = numBatches(numTriangles);
+    const float mu = m_mu;
+    const float lambda = m_lambda;
+    m_blocks.resize(kBlockFloats * batches * kBatch);
+
+    #pragma omp parallel for if (batches >= kMinParallelBatches)
+    for (int batch = 0; batch < batches; ++batch)
+    {
+        const int first = batch * kBatch;
+        float e1[3][kBatch], e2[3][kBatch];
+        gatherEdges(particles, first, e1, e2);
+
+        const float* b00 = &m_b00[first];
+        const float* b01 = &m_b01[first];
+        const float* b11 = &m_b11[first];
+        const float* area = &m_area[first];
+        float* blocks = &m_blocks[kBlockFloats * first];
+
+        #pragma omp simd
+        for (int l = 0; l < kBatch; ++l)
+        {
+            float F0[3], F1[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                F0[c] = e1[c][l] * b00[l];
+                F1[c] = e1[c][l] * b01[l] + e2[c][l] * b11[l];
+            }
+            const float E00 = 0.5f * (F0[0] * F0[0] + F0[1] * F0[1] + F0[2] * F0[2] - 1.0f);
+            const float E01 = 0.5f * (F0[0] * F1[0] + F0[1] * F1[1] + F0[2] * F1[2]);
+            const float E11 = 0.5f * (F1[0] * F1[0] + F1[1] * F1[1] + F1[2] * F1[2] - 1.0f);
+            const float trace = E00 + E11;
+            const float S00 = 2.0f * mu * E00 + lambda * trace;
+            const float S01 = 2.0f * mu * E01;
+            const float S11 = 2.0f * mu * E11 + lambda * trace;
+
+            // Positive part G of the stress, from its eigenvalues m +- r and spectral projectors.
+            const float m = 0.5f * (S00 + S11);
+            const float d = 0.5f * (S00 - S11);
+            const float r = std::sqrt(d * d + S01 * S01);
+            const float positive = std::max(m + r, 0.0f);
+            const float negative = std::max(m - r, 0.0f);
+            const bool distinct = r > 1e-6f * (std::abs(m) + 1e-6f);
+            const float inv = distinct ? 0.5f / r : 0.0f;
+            const float G00 = distinct ? (positive * (S00 - m + r) + negative * (m + r - S00)) * inv : std::max(m, 0.0f);
+            const float G01 = distinct ? (positive - negative) * S01 * inv : 0.0f;
+            const float G11 = distinct ? (positive * (S11 - m + r) + negative * (m + r - S11)) * inv : std::max(m, 0.0f);
+
+            // Gradients g_a of the deformation gradient with respect to each
+            // corner (F = sum x_a g_a^T) and their images F g_a.
+            const float g[3][2] = { { -b00[l], -b01[l] - b11[l] }, { b00[l], b01[l] }, { 0.0f, b11[l] } };
+            float u[3][3], FF[3][3];
+            for (int c = 0; c < 3; ++c)
+            {
+                for (int a = 0; a < 3; ++a) u[a][c] = F0[c] * g[a][0] + F1[c] * g[a][1];
+                for (int k = 0; k < 3; ++k) FF[c][k] = F0[c] * F0[k] + F1[c] * F1[k];
+            }
+
+            // K_ab = -A ((g_b.G g_a) I + mu (F g_b)(F g_a)^T + mu (g_a.g_b) F F^T + lambda (F g_a)(F g_b)^T)
+            float* K = blocks + kBlockFloats * l;
+            for (int a = 0; a < 3; ++a)
+            {
+                for (int b = a; b < 3; ++b)
+                {
+                    const float geometric = g[b][0] * (G00 * g[a][0] + G01 * g[a][1]) + g[b][1] * (G01 * g[a][0] + G11 * g[a][1]);
+                    const float gg = g[a][0] * g[b][0] + g[a][1] * g[b][1];
+                    float* Kab = K + 9 * blockIndex(a, b);
+                    for (int col = 0; col < 3; ++col)
+                    {
+                        for (int row = 0; row < 3; ++row)
+                        {
+                            Kab[3 * col + row] = -area[l] * ((row == col ? geometric : 0.0f) + mu * u[b][row] * u[a][col] +
+                                                             mu * gg * FF[row][col] + lambda * u[a][row] * u[b][col]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+Eigen::Matrix3f TriangleMembrane::block(int t, int a, int b) const
+{
+    const Eigen::Map<const Eigen::Matrix3f> K(&m_blocks[kBlockFloats * t + 9 * blockIndex(std::min(a, b), std::max(a, b))]);
+    return (a <= b) ? Eigen::Matrix3f(K) : Eigen::Matrix3f(K.transpose());
+}
+
+Eigen::Matrix3f TriangleMembrane::getDiagonalBlock(int i) const
+{
+    Eigen::Matrix3f K = Eigen::Matrix3f::Zero();
+    for (int k = m_vertexStart[i]; k < m_vertexStart[i + 1]; ++k)
+    {
+        const int t = m_vertexCorners[k] / 3;
+        const int a = m_vertexCorners[k] % 3;
+        K += block(t, a, a);
+    }
+    return K;
+}
+
+size_t TriangleMembrane::getMemoryUsage() const
+{
+    return m_triangles.capacity() * sizeof(std::array<int, 3>) +
+           (m_b00.capacity() + m_b01.capacity() + m_b11.capacity() + m_area.capacity() + m_forces.capacity() + m_energy.capacity() + m_blocks.capacity()) * sizeof(float) +
+           (m_vertexStart.capacity() + m_vertexCorners.capacity()) * sizeof(int);
+}
@@ -0,0 +1,755 @@
+#include "HeadlessRunner.h"
+
+#include "Cloth.h"
+#include "ClothFactory.h"
+#include "CompactCloth.h"
+#include "Forces/DampingField.hpp"
+#include "Forces/TriangleMembrane.h"
+#include "Forces/Wind.hpp"
+#include "Integrators/Integrator.h"
+#include "Integrators/Integrators.h"
+#include "Integrators/StabilityWatchdog.h"
+#include "Integrators/StrainLimiter.h"
+#include "IO/FrameRecorder.h"
+#include "IO/FrameStream.h"
+#include "Profiling/Profiler.h"
+#include "Reduced/ModalBasis.h"
+#include "Reduced/ModalCloth.h"
+#include "Scene/Scene.h"
+#include "Scene/SphereCollider.hpp"
+#include "Solvers/AutoTuner.h"
+#include "Solvers/MatrixFreePGS.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    // Settling of the cloth before computing its modes: implicit steps with
+    // air drag until the particles are nearly at rest.
+    const float kSettleDt = 0.01f;
+    const float kSettleDamping = 2.0f;
+    const float kSettleSpeed = 1e-3f;
+    const int kMaxSettleSteps = 5000;
+
+    // Period of the gusts of wind on modal cloths, in seconds.
+    const float kGustPeriod = 3.0f;
+
+    // Print the average time per step of every profiled phase.
+    void printProfile()
+    {
+        const Profiler& profiler = Profiler::instance();
+        for (int p = 0; p < profiler.getNumPhases(); ++p)
+        {
+            const ProfilePhase& phase = profiler.getPhase(p);
+            std::cout << "  " << phase.name << ": " << phase.average << " ms per step (max " << phase.maximum << " ms)" << std::endl;
+        }
+        if (profiler.isCapturing())
+        {
+            std::cerr << "The trace range ends after the last step; no trace was written." << std::endl;
+        }
+    }
+
+    // Parse a comma separated list of cloth spring classes into a mask of
+    // eClothMaterials.  Returns false on an unknown class.
+    bool parseSpringClasses(const char* value, uint32_t& materials)
+    {
+        static const char* classes[kNumClothMaterials] = { "structural", "shear", "bending" };
+        materials = 0;
+        std::string list(value);
+        size_t start = 0;
+        while (start <= list.size())
+        {
+            const size_t end = std::min(list.find(',', start), list.size());
+            const std::string name = list.substr(start, end - start);
+            const int m = (int)(std::find(classes, classes + kNumClothMaterials, name) - classes);
+            if (m == kNumClothMaterials)
+                return false;
+            materials |= 1u << m;
+            start = end + 1;
+        }
+        return true;
+    }
+}
+
+HeadlessRunner::HeadlessRunner() :
+    m_cloth(nullptr), m_params(), m_traceStart(0), m_traceFrames(10), m_scenario("hanging"),
+    m_nx(16), m_ny(16), m_width(8.0f), m_height(8.0f), m_steps(1000), m_dt(0.0f), m_integrator(-1), m_solverMethod(kGaussSeidel), m_solverIterations(1), m_solverTolerance(0.0f), m_jacobianTolerance(0.0f), m_implicitMaterials(1 << kStructuralMaterial), m_tearStrain(-1.0f), m_maxStrain(0.0f), m_order(-1), m_watchdog(false), m_sleeping(false), m_useWind(false), m_airDamping(0.0f), m_youngsModulus(0.0f), m_poissonRatio(0.3f), m_compact(false),
+    m_numCloths(1), m_useSphere(false), m_numThreads(0), m_numModes(0), m_warping(true)
+{
+    m_wind[0] = m_wind[1] = m_wind[2] = 0.0f;
+    m_sphere[0] = m_sphere[1] = m_sphere[2] = m_sphere[3] = 0.0f;
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+    delete m_cloth;
+}
+
+bool HeadlessRunner::isRequested(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+            return true;
+    }
+    return false;
+}
+
+bool HeadlessRunner::parse(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (option == "--headless")
+            continue;
+
+        if (value == nullptr)
+        {
+            std::cerr << "Missing value for option " << option << std::endl;
+            return false;
+        }
+        ++i;
+
+        if (option == "--load") m_loadFilename = value;
+        else if (option == "--save") m_saveFilename = value;
+        else if (option == "--record") m_recordFilename = value;
+        else if (option == "--stream") m_streamAddress = value;
+        else if (option == "--autotune") m_autotuneFilename = value;
+        else if (option == "--trace") m_traceFilename = value;
+        else if (option == "--trace-start") m_traceStart = atoi(value);
+        else if (option == "--trace-frames") m_traceFrames = atoi(value);
+        else if (option == "--scenario") m_scenario = value;
+        else if (option == "--mesh") m_meshFilename = value;
+        else if (option == "--nx") m_nx = atoi(value);
+        else if (option == "--ny") m_ny = atoi(value);
+        else if (option == "--steps") m_steps = atoi(value);
+        else if (option == "--dt") m_dt = (float)atof(value);
+        else if (option == "--tear") m_tearStrain = (float)atof(value);
+        else if (option == "--strain-limit") m_maxStrain = (float)atof(value);
+        else if (option == "--iterations") m_solverIterations = atoi(value);
+        else if (option == "--tolerance") m_solverTolerance = (float)atof(value);
+        else if (option == "--lazy-jacobian") m_jacobianTolerance = (float)atof(value);
+        else if (option == "--air-damping") m_airDamping = (float)atof(value);
+        else if (option == "--membrane") m_youngsModulus = (float)atof(value);
+        else if (option == "--poisson") m_poissonRatio = (float)atof(value);
+        else if (option == "--cloths") m_numCloths = atoi(value);
+        else if (option == "--threads") m_numThreads = atoi(value);
+        else if (option == "--modal") m_numModes = atoi(value);
+        else if (option == "--modal-cache") m_modalCacheFilename = value;
+        else if (option == "--sphere")
+        {
+            m_useSphere = sscanf(value, "%f,%f,%f,%f", &m_sphere[0], &m_sphere[1], &m_sphere[2], &m_sphere[3]) == 4 && m_sphere[3] > 0.0f;
+            if (!m_useSphere)
+            {
+                std::cerr << "--sphere expects a center and a positive radius x,y,z,r" << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--wind")
+        {
+            m_useWind = sscanf(value, "%f,%f,%f", &m_wind[0], &m_wind[1], &m_wind[2]) == 3;
+            if (!m_useWind)
+            {
+                std::cerr << "--wind expects a velocity x,y,z" << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--watchdog" || option == "--compact" || option == "--sleep" || option == "--warping")
+        {
+            bool& flag = (option == "--watchdog") ? m_watchdog : (option == "--compact") ? m_compact : (option == "--sleep") ? m_sleeping : m_warping;
+            flag = strcmp(value, "on") == 0;
+            if (!flag && strcmp(value, "off") != 0)
+            {
+                std::cerr << option << " expects on or off" << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--reorder")
+        {
+            m_order = findParticleOrder(value);
+            if (m_order < 0)
+            {
+                std::cerr << "Unknown particle order " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--integrator")
+        {
+            m_integrator = findIntegrator(value);
+            if (m_integrator < 0)
+            {
+                std::cerr << "Unknown integrator " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--implicit-springs")
+        {
+            if (!parseSpringClasses(value, m_implicitMaterials))
+            {
+                std::cerr << "--implicit-springs expects spring classes among structural, shear and bending" << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--solver")
+        {
+            m_solverMethod = findSolverMethod(value);
+            if (m_solverMethod < 0)
+            {
+                std::cerr << "Unknown solver " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+
+    if (m_nx < 2 || m_ny < 2 || m_steps < 0 || m_dt < 0.0f)
+    {
+        std::cerr << "Invalid resolution, step count or time step." << std::endl;
+        return false;
+    }
+    if (m_solverIterations < 1 || m_solverTolerance < 0.0f || m_jacobianTolerance < 0.0f)
+    {
+        std::cerr << "Invalid solver iterations or tolerance." << std::endl;
+        return false;
+    }
+    if (m_maxStrain < 0.0f)
+    {
+        std::cerr << "Invalid strain limit." << std::endl;
+        return false;
+    }
+    if (m_youngsModulus < 0.0f || m_poissonRatio < 0.0f || m_poissonRatio >= 0.5f)
+    {
+        std::cerr << "Invalid membrane Young's modulus or Poisson ratio." << std::endl;
+        return false;
+    }
+    if (m_compact && (!m_saveFilename.empty() || !m_recordFilename.empty() || !m_streamAddress.empty() || m_tearStrain >= 0.0f || m_maxStrain > 0.0f || m_watchdog || m_useWind || m_airDamping > 0.0f || m_youngsModulus > 0.0f || m_sleeping))
+    {
+        std::cerr << "--compact cannot be combined with --save, --record, --stream, --tear, --strain-limit, --watchdog, --wind, --air-damping, --membrane or --sleep." << std::endl;
+        return false;
+    }
+    if (m_numCloths < 1 || m_numThreads < 0)
+    {
+        std::cerr << "Invalid number of cloths or threads." << std::endl;
+        return false;
+    }
+    if ((m_numCloths > 1 || m_useSphere) && (!m_saveFilename.empty() || !m_recordFilename.empty() || !m_streamAddress.empty() || m_watchdog || m_compact))
+    {
+        std::cerr << "Scenes cannot be combined with --save, --record, --stream, --watchdog or --compact." << std::endl;
+        return false;
+    }
+    if (m_numModes < 0)
+    {
+        std::cerr << "Invalid number of modes." << std::endl;
+        return false;
+    }
+    if (m_numModes > 0 && (!m_saveFilename.empty() || !m_recordFilename.empty() || !m_streamAddress.empty() || m_tearStrain >= 0.0f || m_maxStrain > 0.0f || m_watchdog || m_youngsModulus > 0.0f || m_sleeping || m_compact || m_useSphere))
+    {
+        std::cerr << "--modal cannot be combined with --save, --record, --stream, --tear, --strain-limit, --watchdog, --membrane, --sleep, --compact or --sphere." << std::endl;
+        return false;
+    }
+    if (!m_autotuneFilename.empty() && (m_compact || m_numModes > 0 || m_numCloths > 1 || m_useSphere))
+    {
+        std::cerr << "--autotune cannot be combined with --compact, --modal, --cloths or --sphere." << std::endl;
+        return false;
+    }
+    if (m_youngsModulus > 0.0f && !m_saveFilename.empty())
+    {
+        std::cerr << "--membrane cannot be combined with --save." << std::endl;
+        return false;
+    }
+    if (!m_traceFilename.empty() && !Profiler::isEnabled())
+    {
+        std::cerr << "--trace needs a build with TISSU_ENABLE_PROFILING." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessRunner::createCloth()
+{
+    delete m_cloth;
+    m_cloth = nullptr;
+
+    if (!m_loadFilename.empty())
+    {
+        m_cloth = Snapshot::load(m_loadFilename, &m_params);
+        if (m_cloth != nullptr && m_order >= 0)
+            m_cloth->reorder(m_order);
+        return m_cloth != nullptr;
+    }
+
+    const float xoff = 0.5f * m_width;
+    const float zoff = 0.5f * m_height;
+    const float dx = m_width / (m_nx - 1);
+    const float dy = m_height / (m_ny - 1);
+    if (m_scenario == "hanging")
+        m_cloth = ClothFactory::createHangingCloth(m_nx, m_ny, dx, dy, m_params.structuralStiffness, m_params.shearStiffness, m_params.bendingStiffness, m_params.damping, -xoff, -zoff);
+    else if (m_scenario == "trampoline")
+        m_cloth = ClothFactory::createTrampoline(m_nx, m_ny, dx, dy, m_params.structuralStiffness, m_params.shearStiffness, m_params.bendingStiffness, m_params.damping, -xoff, -zoff);
+    else if (m_scenario == "mesh")
+        m_cloth = ClothFactory::createFromMesh(m_meshFilename, m_params.structuralStiffness, m_params.bendingStiffness, m_params.damping, m_order >= 0 ? m_order : kReverseCuthillMcKee);
+    else
+        std::cerr << "Unknown scenario " << m_scenario << std::endl;
+
+    // Mesh cloths were reordered by the factory.
+    if (m_cloth != nullptr && m_scenario != "mesh" && m_order >= 0)
+        m_cloth->reorder(m_order);
+
+    if (m_cloth != nullptr && m_youngsModulus > 0.0f && !ClothFactory::createMembrane(m_cloth, m_youngsModulus, m_poissonRatio))
+    {
+        delete m_cloth;
+        m_cloth = nullptr;
+    }
+
+    return m_cloth != nullptr;
+}
+
+void HeadlessRunner::configureSolver(Cloth* cloth) const
+{
+    MatrixFreePGS* solver = cloth->getSolver();
+    solver->setMethod(m_solverMethod);
+    solver->setMaxIterations(m_solverIterations);
+    solver->setTolerance(m_solverTolerance);
+    solver->setJacobianTolerance(m_jacobianTolerance);
+    cloth->setImplicitMaterials(m_implicitMaterials);
+    if (m_maxStrain > 0.0f)
+        cloth->getStrainLimiter()->setMaxStrain(m_maxStrain);
+}
+
+void HeadlessRunner::applyCommand(const StreamCommand& command, DampingField& airDamping, StabilityWatchdog& watchdog)
+{
+    std::vector<Particle*>& particles = m_cloth->getParticles();
+    if (command.type == kPinParticle && command.particle >= 0 && command.particle < (int)particles.size())
+    {
+        particles[command.particle]->fixed = command.value != 0.0f;
+        m_cloth->wakeParticle(command.particle);
+        watchdog.discardCheckpoint();
+        return;
+    }
+    if (command.type != kSetParameter)
+        return;
+
+    static const char* materials[kNumClothMaterials] = { "structural", "shear", "bending" };
+    const std::string name = command.name;
+    const float value = command.value;
+    if (name == "dt" && value > 0.0f) m_params.dt = value;
+    else if (name == "iterations" && value >= 1.0f) m_cloth->getSolver()->setMaxIterations((int)value);
+    else if (name == "tolerance" && value >= 0.0f) m_cloth->getSolver()->setTolerance(value);
+    else if (name == "air-damping" && value >= 0.0f) airDamping.setCoefficient(value);
+    else if (name == "damping" && value >= 0.0f)
+    {
+        for (SpringMaterial& material : m_cloth->getMaterials()) material.b = value;
+    }
+    else
+    {
+        const int m = (int)(std::find(materials, materials + kNumClothMaterials, name) - materials);
+        if (m < (int)m_cloth->getMaterials().size() && value > 0.0f)
+            m_cloth->getMaterials()[m].k = value;
+        else
+            std::cerr << "Ignoring remote parameter " << name << " = " << value << std::endl;
+    }
+    // The edit changes the energy of the cloth.
+    watchdog.discardCheckpoint();
+}
+
+int HeadlessRunner::run()
+{
+    if (m_numModes > 0)
+        return runModal();
+    if (m_compact)
+        return runCompact();
+    if (m_numCloths > 1 || m_useSphere)
+        return runScene();
+
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point loadStart = Clock::now();
+    if (!createCloth())
+        return 1;
+
+    // Options given on the command line override the snapshot parameters.
+    if (m_dt > 0.0f) m_params.dt = m_dt;
+    if (m_integrator >= 0) m_params.integrator = m_integrator;
+    if (m_params.integrator < 0 || m_params.integrator >= kNumIntegrators) m_params.integrator = kExplicitEuler;
+    if (m_tearStrain >= 0.0f)
+    {
+        for (SpringMaterial& material : m_cloth->getMaterials()) material.tearStrain = m_tearStrain;
+    }
+    const Clock::time_point loadEnd = Clock::now();
+
+    std::cout << "Cloth with " << m_cloth->getParticles().size() << " particles, " << m_cloth->getSprings().size() << " springs and "
+              << (m_cloth->getMembrane() ? m_cloth->getMembrane()->getNumTriangles() : 0) << " membrane triangles ready in "
+              << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+
+    FrameRecorder recorder;
+    if (!m_recordFilename.empty() && !recorder.open(m_recordFilename, m_cloth))
+        return 1;
+    FrameStreamServer stream;
+    if (!m_streamAddress.empty() && !stream.open(m_streamAddress, m_cloth))
+        return 1;
+
+    if (!m_traceFilename.empty())
+    {
+        Profiler::instance().requestCapture(std::max(0, m_traceStart), m_traceFrames, m_traceFilename);
+    }
+
+    Wind wind(Eigen::Vector3f(m_wind[0], m_wind[1], m_wind[2]));
+    DampingField airDamping(m_airDamping);
+    if (m_useWind) m_cloth->addForceField(&wind);
+    if (m_airDamping > 0.0f || stream.isOpen()) m_cloth->addForceField(&airDamping);
+    m_cloth->setSleeping(m_sleeping);
+    configureSolver(m_cloth);
+
+    if (!m_autotuneFilename.empty())
+    {
+        const Clock::time_point tuneStart = Clock::now();
+        AutoTuner tuner(m_autotuneFilename);
+        TunedConfig config;
+        if (!tuner.tune(m_cloth, m_params.integrator, m_params.dt, m_solverTolerance > 0.0f ? m_solverTolerance : AutoTuner::kDefaultTolerance, config))
+            return 1;
+        AutoTuner::apply(m_cloth, config);
+        m_params.dt = config.dt;
+        std::cout << "Tuned configuration " << (tuner.wasCached() ? "loaded from " + m_autotuneFilename : "calibrated on " + std::to_string(tuner.getNumCandidates()) + " candidates")
+                  << " in " << std::chrono::duration<double, std::milli>(Clock::now() - tuneStart).count() << " ms: ";
+        if (m_params.integrator == kImplicitEuler || m_params.integrator == kImplicitExplicitEuler)
+            std::cout << getSolverMethodName(config.method) << " solver, up to " << config.maxIterations << " sweeps, ";
+        std::cout << config.numThreads << " threads, dt = " << config.dt << " (" << config.msPerStep << " ms per step)" << std::endl;
+    }
+
+    Integrator* integrator = getIntegrator(m_params.integrator);
+    StabilityWatchdog watchdog;
+    watchdog.reset(m_params.integrator);
+    int numTorn = 0;
+    long long numSweeps = 0, numUpdatedJacobians = 0, numLimiterIterations = 0, numLimitedSprings = 0;
+    int numSolves = 0;
+    float maxRemainingStrain = 0.0f;
+    std::vector<StreamCommand> commands;
+    double streamTime = 0.0;
+    const Clock::time_point simStart = Clock::now();
+    for (int i = 0; i < m_steps; ++i)
+    {
+        if (stream.isOpen())
+        {
+            stream.pollCommands(commands);
+            for (const StreamCommand& command : commands) applyCommand(command, airDamping, watchdog);
+
+            // The remote viewer watches the simulation in real time.
+            streamTime += m_params.dt;
+            std::this_thread::sleep_until(simStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(streamTime)));
+        }
+
+        m_cloth->computeForces();
+        if (!m_watchdog)
+        {
+            integrator->step(m_cloth, m_params.dt);
+            m_cloth->limitStrain(m_params.dt);
+        }
+        else if (!watchdog.step(m_cloth, m_params.dt))
+        {
+            std::cerr << "Unrecoverable instability at step " << i << std::endl;
+            return 1;
+        }
+        const int integrator = m_watchdog ? watchdog.getCurrentIntegrator() : m_params.integrator;
+        if (integrator == kImplicitEuler || integrator == kImplicitExplicitEuler)
+        {
+            numSweeps += m_cloth->getSolver()->getNumIterations();
+            numUpdatedJacobians += m_cloth->getSolver()->getNumUpdatedJacobians();
+            ++numSolves;
+        }
+        if (m_maxStrain > 0.0f)
+        {
+            numLimiterIterations += m_cloth->getStrainLimiter()->getNumIterations();
+            numLimitedSprings += m_cloth->getStrainLimiter()->getNumCorrections();
+            maxRemainingStrain = std::max(maxRemainingStrain, m_cloth->getStrainLimiter()->getRemainingStrain());
+        }
+        const int torn = m_cloth->tearSprings();
+        if (torn > 0 && m_order >= 0)
+            m_cloth->sortSprings();
+        numTorn += torn;
+        recorder.record(m_cloth);
+        stream.publish(m_cloth, i);
+        PROFILE_FRAME();
+    }
+    const Clock::time_point simEnd = Clock::now();
+
+    std::cout << m_steps << " " << getIntegratorName(m_params.integrator) << " steps in "
+              << std::chrono::duration<double, std::milli>(simEnd - simStart).count() << " ms" << std::endl;
+    if (m_watchdog)
+    {
+        std::cout << watchdog.getNumRollbacks() << " steps rolled back, ending with " << getIntegratorName(watchdog.getCurrentIntegrator())
+                  << " at dt = " << watchdog.getTimeStep(m_params.dt) << std::endl;
+    }
+    if (numSolves > 0)
+    {
+        const MatrixFreePGS* solver = m_cloth->getSolver();
+        std::cout << getSolverMethodName(solver->getMethod()) << " solver: " << (double)numSweeps / numSolves << " sweeps per step";
+        if (solver->getTolerance() > 0.0f)
+            std::cout << ", last residual " << solver->getResidual();
+        if (solver->getMethod() != kGaussSeidel)
+            std::cout << ", spectral radius " << solver->getSpectralRadius();
+        if (solver->getJacobianTolerance() > 0.0f && !m_cloth->getSprings().empty())
+            std::cout << ", " << 100.0 * (1.0 - (double)numUpdatedJacobians / ((double)numSolves * m_cloth->getSprings().size())) << "% of spring Jacobians reused";
+        std::cout << std::endl;
+    }
+    if (m_maxStrain > 0.0f && m_steps > 0)
+    {
+        std::cout << "Strain limiter: " << (double)numLimiterIterations / m_steps << " iterations and " << (double)numLimitedSprings / m_steps
+                  << " corrections per step over " << m_cloth->getStrainLimiter()->getNumColors() << " colors, largest strain left "
+                  << maxRemainingStrain << std::endl;
+    }
+    if (numTorn > 0)
+    {
+        std::cout << numTorn << " springs torn, " << m_cloth->getTriangles().size() << " triangles left" << std::endl;
+    }
+    if (m_sleeping)
+    {
+        std::cout << m_cloth->getNumSleepingRegions() << " of " << m_cloth->getNumRegions() << " regions asleep" << std::endl;
+    }
+    printProfile();
+
+    if (recorder.isOpen())
+    {
+        recorder.close();
+        const uint64_t raw = recorder.getNumWritten() * m_cloth->getParticles().size() * 3 * sizeof(float);
+        std::cout << recorder.getNumWritten() << " frames recorded (" << recorder.getNumDropped() << " dropped), "
+                  << recorder.getBytesWritten() << " bytes, " << (double)raw / std::max<uint64_t>(1, recorder.getBytesWritten())
+                  << "x smaller than raw positions" << std::endl;
+    }
+
+    if (stream.isOpen())
+    {
+        std::cout << stream.getNumSent() << " frames streamed (" << stream.getNumDropped() << " dropped), " << stream.getBytesSent() << " bytes" << std::endl;
+        stream.close();
+    }
+
+    if (!m_saveFilename.empty() && !Snapshot::save(m_saveFilename, m_cloth, m_params))
+        return 1;
+
+    return 0;
+}
+
+int HeadlessRunner::runCompact()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Grid scenarios are built directly in the compact representation, so the
+    // full particle system never needs to fit in memory.
+    const Clock::time_point loadStart = Clock::now();
+    CompactCloth* cloth = nullptr;
+    const float xoff = 0.5f * m_width;
+    const float zoff = 0.5f * m_height;
+    const float dx = m_width / (m_nx - 1);
+    const float dy = m_height / (m_ny - 1);
+    if (m_loadFilename.empty() && m_scenario == "hanging")
+        cloth = ClothFactory::createCompactHangingCloth(m_nx, m_ny, dx, dy, m_params.structuralStiffness, m_params.shearStiffness, m_params.bendingStiffness, m_params.damping, -xoff, -zoff);
+    else if (m_loadFilename.empty() && m_scenario == "trampoline")
+        cloth = ClothFactory::createCompactTrampoline(m_nx, m_ny, dx, dy, m_params.structuralStiffness, m_params.shearStiffness, m_params.bendingStiffness, m_params.damping, -xoff, -zoff);
+    else if (createCloth())
+    {
+        cloth = ClothFactory::createCompactCloth(m_cloth);
+        delete m_cloth;
+        m_cloth = nullptr;
+    }
+    if (cloth == nullptr)
+        return 1;
+    cloth->setImplicitMaterials(m_implicitMaterials);
+
+    if (m_dt > 0.0f) m_params.dt = m_dt;
+    if (m_integrator >= 0) m_params.integrator = m_integrator;
+    if (m_params.integrator < 0 || m_params.integrator >= kNumIntegrators) m_params.integrator = kExplicitEuler;
+    const Clock::time_point loadEnd = Clock::now();
+
+    std::cout << "Compact cloth with " << cloth->getNumParticles() << " particles and " << cloth->getNumSprings() << " springs ready in "
+              << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+
+    if (!m_traceFilename.empty())
+    {
+        Profiler::instance().requestCapture(std::max(0, m_traceStart), m_traceFrames, m_traceFilename);
+    }
+
+    for (int i = 0; i < m_steps; ++i)
+    {
+        cloth->computeForces();
+        cloth->step(m_params.integrator, m_params.dt);
+        PROFILE_FRAME();
+    }
+    const Clock::time_point simEnd = Clock::now();
+
+    std::cout << m_steps << " " << getIntegratorName(m_params.integrator) << " steps in "
+              << std::chrono::duration<double, std::milli>(simEnd - loadEnd).count() << " ms, "
+              << (double)cloth->getMemoryUsage() / std::max(1, cloth->getNumParticles()) << " bytes per particle" << std::endl;
+    printProfile();
+
+    delete cloth;
+    return 0;
+}
+
+int HeadlessRunner::runScene()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point loadStart = Clock::now();
+    Scene scene(m_numThreads);
+    if (m_dt > 0.0f) m_params.dt = m_dt;
+    if (m_integrator >= 0) m_params.integrator = m_integrator;
+
+    // Copies of the cloth side by side along x.
+    Wind wind(Eigen::Vector3f(m_wind[0], m_wind[1], m_wind[2]));
+    DampingField airDamping(m_airDamping);
+    int numParticles = 0;
+    for (int c = 0; c < m_numCloths; ++c)
+    {
+        if (!createCloth())
+            return 1;
+
+        Eigen::AlignedBox3f bounds;
+        for (const Particle* p : m_cloth->getParticles()) bounds.extend(p->x);
+        const Eigen::Vector3f offset(c * 1.25f * bounds.sizes().x(), 0.0f, 0.0f);
+        for (Particle* p : m_cloth->getParticles()) p->x += offset;
+
+        if (m_tearStrain >= 0.0f)
+        {
+            for (SpringMaterial& material : m_cloth->getMaterials()) material.tearStrain = m_tearStrain;
+        }
+        if (m_useWind) m_cloth->addForceField(&wind);
+        if (m_airDamping > 0.0f) m_cloth->addForceField(&airDamping);
+        m_cloth->setSleeping(m_sleeping);
+        configureSolver(m_cloth);
+        numParticles += m_cloth->getParticles().size();
+
+        // Snapshots keep their own parameters.
+        const int integrator = (m_params.integrator >= 0 && m_params.integrator < kNumIntegrators) ? m_params.integrator : kExplicitEuler;
+        scene.addCloth(m_cloth, integrator, m_params.dt);
+        m_cloth = nullptr;
+    }
+    if (m_useSphere)
+    {
+        scene.addCollider(new SphereCollider(Eigen::Vector3f(m_sphere[0], m_sphere[1], m_sphere[2]), m_sphere[3]));
+    }
+    const Clock::time_point loadEnd = Clock::now();
+
+    std::cout << "Scene with " << scene.getNumObjects() << " cloths, " << numParticles << " particles and " << scene.getColliders().size()
+              << " colliders ready in " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+
+    if (!m_traceFilename.empty())
+    {
+        Profiler::instance().requestCapture(std::max(0, m_traceStart), m_traceFrames, m_traceFilename);
+    }
+
+    int numContacts = 0;
+    for (int i = 0; i < m_steps; ++i)
+    {
+        scene.step(m_params.dt);
+        numContacts += scene.getNumContacts();
+        PROFILE_FRAME();
+    }
+    const Clock::time_point simEnd = Clock::now();
+
+    std::cout << m_steps << " frames on " << scene.getNumThreads() << " threads in "
+              << std::chrono::duration<double, std::milli>(simEnd - loadEnd).count() << " ms, "
+              << numContacts << " cloth contact tasks" << std::endl;
+    printProfile();
+    return 0;
+}
+
+int HeadlessRunner::runModal()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point loadStart = Clock::now();
+    if (!createCloth())
+        return 1;
+    if (m_dt > 0.0f) m_params.dt = m_dt;
+
+    // The modes are computed around the rest state under gravity.
+    DampingField settleDamping(kSettleDamping);
+    m_cloth->addForceField(&settleDamping);
+    m_cloth->getSolver()->setMaxIterations(std::max(m_solverIterations, 20));
+    Integrator* implicitEuler = getIntegrator(kImplicitEuler);
+    int numSettleSteps = 0;
+    float speed = 0.0f;
+    do
+    {
+        m_cloth->computeForces();
+        implicitEuler->step(m_cloth, kSettleDt);
+        speed = 0.0f;
+        for (const Particle* p : m_cloth->getParticles()) speed = std::max(speed, p->v.norm());
+    } while (++numSettleSteps < kMaxSettleSteps && speed > kSettleSpeed);
+    m_cloth->removeForceField(&settleDamping);
+    const Clock::time_point settleEnd = Clock::now();
+
+    ModalBasis* basis = m_modalCacheFilename.empty() ? ModalBasis::compute(m_cloth, m_numModes) : ModalBasis::loadOrCompute(m_modalCacheFilename, m_cloth, m_numModes);
+    if (basis == nullptr)
+        return 1;
+    const Clock::time_point loadEnd = Clock::now();
+
+    std::cout << "Cloth with " << m_cloth->getParticles().size() << " particles settled in " << numSettleSteps << " steps ("
+              << std::chrono::duration<double, std::milli>(settleEnd - loadStart).count() << " ms), " << m_numModes << " modes ready in "
+              << std::chrono::duration<double, std::milli>(loadEnd - settleEnd).count() << " ms, " << basis->getMemoryUsage() << " bytes" << std::endl;
+    std::cout << "Mode frequencies: " << std::sqrt(std::max(0.0f, basis->getEigenvalues()[0])) / (2.0 * M_PI) << " to "
+              << std::sqrt(std::max(0.0f, basis->getEigenvalues()[m_numModes - 1])) / (2.0 * M_PI) << " Hz" << std::endl;
+
+    // The gusts drag the cloths towards the wind velocity, out of phase.
+    std::vector<ModalCloth> cloths(m_numCloths, ModalCloth(basis));
+    for (ModalCloth& cloth : cloths)
+    {
+        cloth.setDamping(m_airDamping, 0.0f);
+        cloth.setWarping(m_warping);
+    }
+    const Eigen::Vector3f wind(m_wind[0], m_wind[1], m_wind[2]);
+
+    if (!m_traceFilename.empty())
+    {
+        Profiler::instance().requestCapture(std::max(0, m_traceStart), m_traceFrames, m_traceFilename);
+    }
+
+    double stepTime = 0.0, positionTime = 0.0;
+    std::vector<Eigen::Vector3f> x;
+    for (int i = 0; i < m_steps; ++i)
+    {
+        const float t = i * m_params.dt;
+        const Clock::time_point stepStart = Clock::now();
+        {
+            PROFILE_SCOPE("ModalStep");
+            for (int c = 0; c < m_numCloths; ++c)
+            {
+                const float gust = 0.5f * (1.0f + std::sin(2.0f * (float)M_PI * (t / kGustPeriod + (float)c / m_numCloths)));
+                cloths[c].step(m_params.dt, (m_airDamping * gust) * wind);
+            }
+        }
+        const Clock::time_point stepEnd = Clock::now();
+        {
+            PROFILE_SCOPE("ModalPositions");
+            for (const ModalCloth& cloth : cloths) cloth.getPositions(x);
+        }
+        stepTime += std::chrono::duration<double, std::micro>(stepEnd - stepStart).count();
+        positionTime += std::chrono::duration<double, std::micro>(Clock::now() - stepEnd).count();
+        PROFILE_FRAME();
+    }
+
+    if (m_steps > 0)
+    {
+        const double count = (double)m_steps * m_numCloths;
+        std::cout << m_steps << " modal steps of " << m_numCloths << " cloths: " << stepTime / count << " us per cloth step, "
+                  << positionTime / count << " us per cloth to reconstruct the positions" << (m_warping ? " (warped)" : "") << std::endl;
+    }
+    printProfile();
+
+    // The first cloth ends in the particle system, e.g. for inspection.
+    cloths[0].copyStateTo(m_cloth);
+    delete basis;
+    return 0;
+}
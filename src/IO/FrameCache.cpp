@@ -0,0 +1,216 @@
+#include "IO/FrameCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    const char kMagic[8] = { 'C', 'L', 'T', 'H', 'F', 'R', 'M', 'S' };
+}
+
+FrameCache::FrameCache(int _numCachedFrames, int _lookahead) :
+    m_numCachedFrames(std::max(1, _numCachedFrames)), m_lookahead(std::max(0, std::min(_lookahead, _numCachedFrames - 1))),
+    m_header(nullptr), m_index(nullptr), m_decoder(nullptr),
+    m_useCounter(0), m_prefetchFrame(-1), m_quit(false)
+{
+}
+
+FrameCache::~FrameCache()
+{
+    close();
+}
+
+bool FrameCache::open(const std::string& filename)
+{
+    close();
+
+    if (!m_file.open(filename))
+    {
+        std::cerr << "FrameCache: unable to open " << filename << std::endl;
+        return false;
+    }
+
+    const FrameCacheHeader* header = reinterpret_cast<const FrameCacheHeader*>(m_file.data());
+    if (m_file.size() < sizeof(FrameCacheHeader) || memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != FrameRecorder::kVersion)
+    {
+        std::cerr << "FrameCache: " << filename << " is not a supported frame cache." << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    // The index is written last; a cache without one was not closed properly.
+    const uint64_t trianglesEnd = header->trianglesOffset + 3 * (uint64_t)header->numTriangles * sizeof(int32_t);
+    bool valid = header->indexOffset >= trianglesEnd && header->indexOffset + header->numFrames * sizeof(uint64_t) == m_file.size() &&
+                 header->indexOffset % sizeof(uint64_t) == 0 && header->quantum > 0.0f;
+
+    const uint64_t* index = valid ? reinterpret_cast<const uint64_t*>(m_file.data() + header->indexOffset) : nullptr;
+    for (uint64_t f = 0; valid && f < header->numFrames; ++f)
+    {
+        valid = index[f] >= trianglesEnd && index[f] + sizeof(FrameRecordHeader) <= header->indexOffset &&
+                index[f] + sizeof(FrameRecordHeader) + reinterpret_cast<const FrameRecordHeader*>(m_file.data() + index[f])->size <= header->indexOffset;
+    }
+    const int32_t* triangles = reinterpret_cast<const int32_t*>(m_file.data() + header->trianglesOffset);
+    for (uint64_t k = 0; valid && k < 3 * (uint64_t)header->numTriangles; ++k)
+    {
+        valid = triangles[k] >= 0 && triangles[k] < (int32_t)header->numParticles;
+    }
+    if (!valid || header->numFrames == 0 || (reinterpret_cast<const FrameRecordHeader*>(m_file.data() + index[0])->flags & 1) == 0)
+    {
+        std::cerr << "FrameCache: " << filename << " is empty, truncated or corrupted." << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    m_header = header;
+    m_index = index;
+    m_decoder = new Decoder(header->numParticles, header->quantum);
+
+    m_slots.resize(m_numCachedFrames);
+    for (Slot& slot : m_slots)
+    {
+        slot.frame = -1;
+        slot.lastUse = 0;
+        slot.positions.resize(3 * header->numParticles);
+    }
+    m_useCounter = 0;
+    m_prefetchFrame = -1;
+    m_quit = false;
+    m_thread = std::thread(&FrameCache::prefetchLoop, this);
+
+    return true;
+}
+
+void FrameCache::close()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+    }
+
+    delete m_decoder;
+    m_decoder = nullptr;
+    m_slots.clear();
+    m_header = nullptr;
+    m_index = nullptr;
+    m_file.close();
+}
+
+bool FrameCache::getFrame(int frame, float* positions)
+{
+    if (m_header == nullptr || frame < 0 || frame >= getNumFrames())
+        return false;
+
+    const size_t n = 3 * (size_t)m_header->numParticles;
+    bool hit = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_prefetchFrame = (frame + 1 < getNumFrames()) ? frame + 1 : -1;
+
+        Slot* slot = find(frame);
+        if (slot)
+        {
+            slot->lastUse = ++m_useCounter;
+            memcpy(positions, slot->positions.data(), n * sizeof(float));
+            hit = true;
+        }
+    }
+    m_wakeUp.notify_one();
+
+    if (hit)
+        return true;
+
+    if (!decode(*m_decoder, frame))
+        return false;
+
+    memcpy(positions, m_decoder->positions.data(), n * sizeof(float));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    store(frame, positions);
+    return true;
+}
+
+bool FrameCache::decode(Decoder& decoder, int frame) const
+{
+    int keyframe = frame;
+    while (keyframe > 0 && !isKeyframe(keyframe))
+        --keyframe;
+
+    // Continue from the last decoded frame when it is in the same chunk.
+    int f = (decoder.frame >= keyframe && decoder.frame <= frame) ? decoder.frame : keyframe - 1;
+    for (++f; f <= frame; ++f)
+    {
+        const FrameRecordHeader* header = record(f);
+        if (!decoder.codec.decode(reinterpret_cast<const uint8_t*>(header + 1), header->size, (header->flags & 1) != 0, decoder.positions.data()))
+        {
+            std::cerr << "FrameCache: unable to decode frame " << f << std::endl;
+            decoder.codec.reset();
+            decoder.frame = -1;
+            return false;
+        }
+        decoder.frame = f;
+    }
+    return true;
+}
+
+FrameCache::Slot* FrameCache::find(int frame)
+{
+    for (Slot& slot : m_slots)
+    {
+        if (slot.frame == frame)
+            return &slot;
+    }
+    return nullptr;
+}
+
+void FrameCache::store(int frame, const float* positions)
+{
+    if (find(frame))
+        return;
+
+    Slot* lru = &m_slots[0];
+    for (Slot& slot : m_slots)
+    {
+        if (slot.lastUse < lru->lastUse)
+            lru = &slot;
+    }
+    lru->frame = frame;
+    lru->lastUse = ++m_useCounter;
+    memcpy(lru->positions.data(), positions, lru->positions.size() * sizeof(float));
+}
+
+void FrameCache::prefetchLoop()
+{
+    Decoder decoder(m_header->numParticles, m_header->quantum);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wakeUp.wait(lock, [this] { return m_quit || m_prefetchFrame >= 0; });
+        if (m_quit)
+            break;
+
+        const int start = m_prefetchFrame;
+        const int end = std::min(start + m_lookahead, getNumFrames());
+        m_prefetchFrame = -1;
+
+        // Stop early if the play head moves; the new request is handled on the next pass.
+        for (int f = start; f < end && m_prefetchFrame < 0 && !m_quit; ++f)
+        {
+            if (find(f))
+                continue;
+
+            lock.unlock();
+            const bool decoded = decode(decoder, f);
+            lock.lock();
+
+            if (!decoded)
+                break;
+            store(f, decoder.positions.data());
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#include "IO/FrameCodec.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+    const int32_t kMaxQuantized = 1 << 29;
+
+    inline void putVarint(uint64_t value, std::vector<uint8_t>& out)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (p >= end)
+                return false;
+            const uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+    inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+}
+
+FrameCodec::FrameCodec(int _numParticles, float _quantum) :
+    m_numValues(3 * _numParticles), m_quantum(_quantum), m_history(0),
+    m_current(m_numValues, 0), m_previous(m_numValues, 0), m_beforePrevious(m_numValues, 0)
+{
+    assert(m_quantum > 0.0f);
+}
+
+void FrameCodec::advance(bool keyframe)
+{
+    m_beforePrevious.swap(m_previous);
+    m_previous.swap(m_current);
+    m_history = keyframe ? 1 : std::min(m_history + 1, 2);
+}
+
+void FrameCodec::encode(const float* positions, bool keyframe, std::vector<uint8_t>& out)
+{
+    assert(keyframe || m_history > 0);
+
+    const float scale = 1.0f / m_quantum;
+    int64_t zeros = 0;
+    for (int k = 0; k < m_numValues; ++k)
+    {
+        const float x = positions[k] * scale;
+        m_current[k] = std::isfinite(x) ? (int32_t)std::max<float>(-kMaxQuantized, std::min<float>(kMaxQuantized, std::round(x))) : 0;
+
+        const int64_t residual = m_current[k] - predict(k, keyframe);
+        if (residual == 0)
+        {
+            ++zeros;
+            continue;
+        }
+
+        // A zero token is followed by the length of the run of zero residuals.
+        if (zeros > 0)
+        {
+            putVarint(0, out);
+            putVarint(zeros - 1, out);
+            zeros = 0;
+        }
+        putVarint(zigzag(residual), out);
+    }
+    if (zeros > 0)
+    {
+        putVarint(0, out);
+        putVarint(zeros - 1, out);
+    }
+
+    advance(keyframe);
+}
+
+bool FrameCodec::decode(const uint8_t* data, size_t size, bool keyframe, float* positions)
+{
+    if (!keyframe && m_history == 0)
+        return false;
+
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    for (int k = 0; k < m_numValues; )
+    {
+        uint64_t token;
+        if (!getVarint(p, end, token))
+            return false;
+
+        if (token != 0)
+        {
+            m_current[k] = (int32_t)(predict(k, keyframe) + unzigzag(token));
+            ++k;
+            continue;
+        }
+
+        uint64_t run;
+        if (!getVarint(p, end, run) || run + 1 > (uint64_t)(m_numValues - k))
+            return false;
+        for (uint64_t r = 0; r <= run; ++r, ++k)
+        {
+            m_current[k] = (int32_t)predict(k, keyframe);
+        }
+    }
+    if (p != end)
+        return false;
+
+    for (int k = 0; k < m_numValues; ++k)
+    {
+        positions[k] = m_current[k] * m_quantum;
+    }
+
+    advance(keyframe);
+    return true;
+}
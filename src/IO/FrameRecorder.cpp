@@ -0,0 +1,174 @@
+#include "IO/FrameRecorder.h"
+
+#include "Cloth.h"
+#include "IO/FrameCodec.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    const char kMagic[8] = { 'C', 'L', 'T', 'H', 'F', 'R', 'M', 'S' };
+}
+
+FrameRecorder::FrameRecorder(int _queueCapacity, float _quantum, int _keyframeInterval) :
+    m_queueCapacity(std::max(2, _queueCapacity)), m_quantum(_quantum), m_keyframeInterval(std::max(1, _keyframeInterval)), m_numParticles(0),
+    m_head(0), m_tail(0), m_quit(false),
+    m_numRecorded(0), m_numDropped(0), m_numWritten(0), m_bytesWritten(0)
+{
+    memset(static_cast<void*>(&m_header), 0, sizeof(m_header));
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+bool FrameRecorder::open(const std::string& filename, const Cloth* cloth)
+{
+    close();
+
+    m_file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+    {
+        std::cerr << "FrameRecorder: unable to write " << filename << std::endl;
+        return false;
+    }
+
+    const auto& triangles = cloth->getTriangles();
+    m_numParticles = (int)cloth->getParticles().size();
+
+    memset(static_cast<void*>(&m_header), 0, sizeof(m_header));
+    memcpy(m_header.magic, kMagic, sizeof(kMagic));
+    m_header.version = kVersion;
+    m_header.numParticles = m_numParticles;
+    m_header.numTriangles = triangles.size();
+    m_header.keyframeInterval = m_keyframeInterval;
+    m_header.quantum = m_quantum;
+    m_header.trianglesOffset = sizeof(FrameCacheHeader);
+
+    std::vector<int32_t> triangleIndices(3 * triangles.size());
+    for (size_t k = 0; k < triangles.size(); ++k)
+    {
+        for (int c = 0; c < 3; ++c) triangleIndices[3 * k + c] = triangles[k][c];
+    }
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.write(reinterpret_cast<const char*>(triangleIndices.data()), triangleIndices.size() * sizeof(int32_t));
+
+    // All slots are allocated up front so that record() never allocates.
+    m_slots.assign(m_queueCapacity, std::vector<float>(3 * m_numParticles));
+    m_index.clear();
+    m_head = 0;
+    m_tail = 0;
+    m_quit = false;
+    m_numRecorded = 0;
+    m_numDropped = 0;
+    m_numWritten = 0;
+    m_bytesWritten = 0;
+
+    m_thread = std::thread(&FrameRecorder::writerLoop, this);
+    return true;
+}
+
+void FrameRecorder::close()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_quit = true;
+    m_thread.join();
+
+    // The index is read in place from a mapping of the file, so it starts
+    // on a multiple of its entry size.
+    const char padding[sizeof(uint64_t)] = {};
+    const uint64_t end = m_file.tellp();
+    m_file.write(padding, (sizeof(uint64_t) - end % sizeof(uint64_t)) % sizeof(uint64_t));
+    m_header.indexOffset = m_file.tellp();
+    m_header.numFrames = m_index.size();
+    m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(uint64_t));
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.close();
+
+    if (m_numDropped > 0)
+    {
+        std::cerr << "FrameRecorder: dropped " << m_numDropped << " of " << m_numRecorded << " frames." << std::endl;
+    }
+
+    m_slots.clear();
+    m_index.clear();
+}
+
+void FrameRecorder::record(const ParticleSystem* particleSystem)
+{
+    PROFILE_SCOPE("FrameRecorder::record");
+
+    if (!m_thread.joinable())
+        return;
+
+    const auto& particles = particleSystem->getParticles();
+    assert((int)particles.size() == m_numParticles);
+
+    ++m_numRecorded;
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= (uint64_t)m_queueCapacity)
+    {
+        ++m_numDropped;
+        return;
+    }
+
+    float* slot = m_slots[head % m_queueCapacity].data();
+    for (int i = 0; i < m_numParticles; ++i)
+    {
+        const Eigen::Vector3f& x = particles[i]->x;
+        slot[3 * i] = x.x();
+        slot[3 * i + 1] = x.y();
+        slot[3 * i + 2] = x.z();
+    }
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void FrameRecorder::writerLoop()
+{
+    FrameCodec codec(m_numParticles, m_quantum);
+    std::vector<uint8_t> payload;
+    payload.reserve(12 * m_numParticles);
+
+    for (;;)
+    {
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+        {
+            // The producer sets m_quit after its last record(), so an empty ring means we are done.
+            if (m_quit.load())
+            {
+                if (tail == m_head.load(std::memory_order_acquire))
+                    break;
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+
+        const bool keyframe = (m_index.size() % m_keyframeInterval) == 0;
+        payload.clear();
+        codec.encode(m_slots[tail % m_queueCapacity].data(), keyframe, payload);
+
+        // The slot can be reused as soon as it is encoded.
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        FrameRecordHeader record;
+        record.size = payload.size();
+        record.flags = keyframe ? 1 : 0;
+        m_index.push_back(m_file.tellp());
+        m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        m_file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+        m_bytesWritten += sizeof(record) + payload.size();
+        ++m_numWritten;
+    }
+}
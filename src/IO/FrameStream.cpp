@@ -0,0 +1,651 @@
+#include "IO/FrameStream.h"
+
+#include "Cloth.h"
+#include "IO/FrameCodec.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char kMagic[8] = { 'C', 'L', 'T', 'H', 'S', 'T', 'R', 'M' };
+    const uint32_t kByteOrder = 0x01020304;
+
+    // Poll timeout of the sender thread, which bounds the time close() waits.
+    const int kPollTimeoutMs = 100;
+
+    // Time the client waits for the topology after connecting.
+    const int kConnectTimeoutMs = 5000;
+
+    // Largest message accepted by the client.
+    const uint32_t kMaxMessageSize = 1u << 30;
+
+    // Append a message of type @a type with @a size bytes of payload at @a
+    // data to @a out.
+    void appendMessage(std::vector<uint8_t>& out, uint32_t type, const void* data, size_t size)
+    {
+        StreamMessageHeader header;
+        header.type = type;
+        header.size = (uint32_t)size;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+        out.insert(out.end(), bytes, bytes + sizeof(header));
+        bytes = reinterpret_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    template<typename T>
+    void appendBytes(std::vector<uint8_t>& out, const T* data, size_t count)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+#ifndef _WIN32
+    // Create a socket listening on, or connected to, @a address.  Returns -1
+    // and prints an error on failure.  @a unixPath receives the path of a
+    // Unix-domain socket.
+    int openSocket(const std::string& address, bool listening, std::string& unixPath)
+    {
+        unixPath.clear();
+        int fd = -1;
+        if (address.compare(0, 5, "unix:") == 0)
+        {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            const std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            {
+                std::cerr << "FrameStream: invalid socket path " << path << std::endl;
+                return -1;
+            }
+            strcpy(addr.sun_path, path.c_str());
+
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                return -1;
+            if (listening)
+            {
+                unlink(path.c_str());
+                if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 1) != 0)
+                {
+                    std::cerr << "FrameStream: unable to listen on " << address << std::endl;
+                    ::close(fd);
+                    return -1;
+                }
+                unixPath = path;
+            }
+            else if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            {
+                std::cerr << "FrameStream: unable to connect to " << address << std::endl;
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        const size_t colon = address.rfind(':');
+        if (colon == std::string::npos)
+        {
+            std::cerr << "FrameStream: " << address << " is neither unix:<path> nor <host>:<port>" << std::endl;
+            return -1;
+        }
+        const std::string host = address.substr(0, colon);
+        const std::string port = address.substr(colon + 1);
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        addrinfo* results = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results) != 0)
+        {
+            std::cerr << "FrameStream: unable to resolve " << address << std::endl;
+            return -1;
+        }
+        for (addrinfo* ai = results; ai != nullptr && fd < 0; ai = ai->ai_next)
+        {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0)
+                continue;
+            const int on = 1;
+            bool ok;
+            if (listening)
+            {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+                ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0;
+            }
+            else
+            {
+                ok = ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+            }
+            if (!ok)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(results);
+        if (fd < 0)
+        {
+            std::cerr << "FrameStream: unable to " << (listening ? "listen on " : "connect to ") << address << std::endl;
+        }
+        return fd;
+    }
+
+    // Frames are small and latency matters more than throughput.
+    void setNoDelay(int fd)
+    {
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    // Send @a size bytes at @a data, waiting for the socket buffer to drain
+    // as long as @a quit is not set.  Returns false if the peer disconnected.
+    bool sendAll(int fd, const uint8_t* data, size_t size, const std::atomic<bool>& quit)
+    {
+        while (size > 0)
+        {
+            const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0)
+            {
+                data += sent;
+                size -= sent;
+                continue;
+            }
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                return false;
+            if (quit.load())
+                return false;
+            pollfd p = { fd, POLLOUT, 0 };
+            poll(&p, 1, kPollTimeoutMs);
+        }
+        return true;
+    }
+
+    // Append the bytes available on @a fd to @a buffer.  Returns false if the
+    // peer disconnected.
+    bool receiveAvailable(int fd, std::vector<uint8_t>& buffer, uint64_t& numBytes)
+    {
+        uint8_t chunk[65536];
+        for (;;)
+        {
+            const ssize_t received = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (received > 0)
+            {
+                buffer.insert(buffer.end(), chunk, chunk + received);
+                numBytes += received;
+                continue;
+            }
+            if (received == 0)
+                return false;
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+    }
+#endif
+}
+
+FrameStreamServer::FrameStreamServer(int _queueCapacity, float _quantum) :
+    m_queueCapacity(std::max(2, _queueCapacity)), m_quantum(_quantum), m_numParticles(0), m_listenSocket(-1),
+    m_head(0), m_tail(0), m_quit(false), m_connected(false),
+    m_topologyVersion(0), m_clothTopologyVersion(0),
+    m_numPublished(0), m_numSent(0), m_bytesSent(0)
+{
+}
+
+FrameStreamServer::~FrameStreamServer()
+{
+    close();
+}
+
+bool FrameStreamServer::open(const std::string& address, const Cloth* cloth)
+{
+    close();
+
+#ifndef _WIN32
+    m_listenSocket = openSocket(address, true, m_unixPath);
+    if (m_listenSocket < 0)
+        return false;
+
+    m_numParticles = (int)cloth->getParticles().size();
+    const auto& triangles = cloth->getTriangles();
+    m_triangles.resize(3 * triangles.size());
+    for (size_t k = 0; k < triangles.size(); ++k)
+    {
+        for (int c = 0; c < 3; ++c) m_triangles[3 * k + c] = triangles[k][c];
+    }
+    ++m_topologyVersion;
+    m_clothTopologyVersion = cloth->getTopologyVersion();
+    m_commands.clear();
+
+    // All slots are allocated up front so that publish() never allocates.
+    m_slots.assign(m_queueCapacity, Slot());
+    for (Slot& slot : m_slots)
+    {
+        slot.positions.resize(3 * m_numParticles);
+        slot.pins.resize(m_numParticles);
+    }
+    m_head = 0;
+    m_tail = 0;
+    m_quit = false;
+    m_numPublished = 0;
+    m_numSent = 0;
+    m_bytesSent = 0;
+
+    m_thread = std::thread(&FrameStreamServer::senderLoop, this);
+    return true;
+#else
+    std::cerr << "FrameStream: sockets are not supported on this platform." << std::endl;
+    return false;
+#endif
+}
+
+void FrameStreamServer::close()
+{
+#ifndef _WIN32
+    if (m_thread.joinable())
+    {
+        m_quit = true;
+        m_thread.join();
+    }
+    if (m_listenSocket >= 0)
+    {
+        ::close(m_listenSocket);
+        m_listenSocket = -1;
+    }
+    if (!m_unixPath.empty())
+    {
+        unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+    }
+    m_slots.clear();
+#endif
+}
+
+void FrameStreamServer::publish(const Cloth* cloth, uint64_t step)
+{
+    PROFILE_SCOPE("FrameStreamServer::publish");
+
+    if (!m_thread.joinable())
+        return;
+
+    const auto& particles = cloth->getParticles();
+    assert((int)particles.size() == m_numParticles);
+
+    // Springs were torn: the viewer gets the remaining triangles with the
+    // next frame.
+    if (cloth->getTopologyVersion() != m_clothTopologyVersion)
+    {
+        const auto& triangles = cloth->getTriangles();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_triangles.resize(3 * triangles.size());
+        for (size_t k = 0; k < triangles.size(); ++k)
+        {
+            for (int c = 0; c < 3; ++c) m_triangles[3 * k + c] = triangles[k][c];
+        }
+        ++m_topologyVersion;
+        m_clothTopologyVersion = cloth->getTopologyVersion();
+    }
+
+    ++m_numPublished;
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= (uint64_t)m_queueCapacity)
+        return;
+
+    Slot& slot = m_slots[head % m_queueCapacity];
+    slot.step = step;
+    for (int i = 0; i < m_numParticles; ++i)
+    {
+        const Eigen::Vector3f& x = particles[i]->x;
+        slot.positions[3 * i] = x.x();
+        slot.positions[3 * i + 1] = x.y();
+        slot.positions[3 * i + 2] = x.z();
+        slot.pins[i] = particles[i]->fixed ? 1 : 0;
+    }
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void FrameStreamServer::pollCommands(std::vector<StreamCommand>& commands)
+{
+    commands.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    commands.swap(m_commands);
+}
+
+void FrameStreamServer::senderLoop()
+{
+#ifndef _WIN32
+    while (!m_quit.load())
+    {
+        pollfd p = { m_listenSocket, POLLIN, 0 };
+        if (poll(&p, 1, kPollTimeoutMs) <= 0)
+            continue;
+
+        const int fd = accept(m_listenSocket, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        if (m_unixPath.empty())
+            setNoDelay(fd);
+
+        m_connected = true;
+        serve(fd);
+        m_connected = false;
+        ::close(fd);
+    }
+#endif
+}
+
+void FrameStreamServer::serve(int socket)
+{
+#ifndef _WIN32
+    FrameCodec codec(m_numParticles, m_quantum);
+    unsigned int sentTopologyVersion = 0;
+    std::vector<uint8_t> sentPins;
+    std::vector<uint8_t> message, payload, received;
+    payload.reserve(12 * m_numParticles);
+    uint64_t numReceived = 0;
+
+    // The frames queued before the viewer connected are stale.
+    m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+
+    while (!m_quit.load())
+    {
+        // Commands of the viewer.
+        if (!receiveAvailable(socket, received, numReceived))
+            return;
+        size_t offset = 0;
+        while (received.size() - offset >= sizeof(StreamMessageHeader))
+        {
+            StreamMessageHeader header;
+            memcpy(&header, received.data() + offset, sizeof(header));
+            if (header.type != kStreamCommand || header.size != sizeof(StreamCommand))
+            {
+                std::cerr << "FrameStream: malformed message from the viewer." << std::endl;
+                return;
+            }
+            if (received.size() - offset < sizeof(header) + header.size)
+                break;
+            StreamCommand command;
+            memcpy(&command, received.data() + offset + sizeof(header), sizeof(command));
+            command.name[sizeof(command.name) - 1] = '\0';
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_commands.push_back(command);
+            }
+            offset += sizeof(header) + header.size;
+        }
+        received.erase(received.begin(), received.begin() + offset);
+
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        if (head == m_tail.load(std::memory_order_relaxed))
+        {
+            pollfd p = { socket, POLLIN, 0 };
+            poll(&p, 1, 1);
+            continue;
+        }
+
+        // Only the most recent frame is sent; the slots before it are released
+        // with it.
+        const Slot& slot = m_slots[(head - 1) % m_queueCapacity];
+        message.clear();
+        bool keyframe = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (sentTopologyVersion != m_topologyVersion)
+            {
+                StreamTopology topology;
+                memset(&topology, 0, sizeof(topology));
+                memcpy(topology.magic, kMagic, sizeof(kMagic));
+                topology.version = kVersion;
+                topology.byteOrder = kByteOrder;
+                topology.numParticles = m_numParticles;
+                topology.numTriangles = m_triangles.size() / 3;
+                topology.quantum = m_quantum;
+
+                payload.clear();
+                appendBytes(payload, &topology, 1);
+                appendBytes(payload, m_triangles.data(), m_triangles.size());
+                appendBytes(payload, slot.pins.data(), slot.pins.size());
+                appendMessage(message, kStreamTopology, payload.data(), payload.size());
+                sentTopologyVersion = m_topologyVersion;
+                sentPins = slot.pins;
+                codec.reset();
+                keyframe = true;
+            }
+        }
+        if (slot.pins != sentPins)
+        {
+            appendMessage(message, kStreamPins, slot.pins.data(), slot.pins.size());
+            sentPins = slot.pins;
+        }
+
+        StreamFrameHeader frame;
+        frame.step = slot.step;
+        frame.flags = keyframe ? 1 : 0;
+        frame.reserved = 0;
+        payload.clear();
+        appendBytes(payload, &frame, 1);
+        codec.encode(slot.positions.data(), keyframe, payload);
+        appendMessage(message, kStreamFrame, payload.data(), payload.size());
+
+        // The slots can be reused as soon as the frame is encoded.
+        m_tail.store(head, std::memory_order_release);
+
+        if (!sendAll(socket, message.data(), message.size(), m_quit))
+            return;
+        m_bytesSent += message.size();
+        ++m_numSent;
+    }
+#endif
+}
+
+FrameStreamClient::FrameStreamClient() :
+    m_socket(-1), m_codec(nullptr), m_topologyVersion(0), m_pinsVersion(0), m_step(0), m_numReceived(0), m_bytesReceived(0)
+{
+}
+
+FrameStreamClient::~FrameStreamClient()
+{
+    close();
+}
+
+bool FrameStreamClient::connect(const std::string& address)
+{
+    close();
+
+#ifndef _WIN32
+    std::string unixPath;
+    m_socket = openSocket(address, false, unixPath);
+    if (m_socket < 0)
+        return false;
+    if (address.compare(0, 5, "unix:") != 0)
+        setNoDelay(m_socket);
+
+    // The server sends the topology with the first frame it publishes.
+    const unsigned int topologyVersion = m_topologyVersion;
+    while (m_socket >= 0 && m_topologyVersion == topologyVersion)
+    {
+        pollfd p = { m_socket, POLLIN, 0 };
+        if (poll(&p, 1, kConnectTimeoutMs) <= 0)
+        {
+            std::cerr << "FrameStream: no frame received from " << address << std::endl;
+            close();
+            return false;
+        }
+        receive();
+    }
+    return m_socket >= 0;
+#else
+    std::cerr << "FrameStream: sockets are not supported on this platform." << std::endl;
+    return false;
+#endif
+}
+
+void FrameStreamClient::close()
+{
+#ifndef _WIN32
+    if (m_socket >= 0)
+    {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+#endif
+    m_buffer.clear();
+    delete m_codec;
+    m_codec = nullptr;
+}
+
+bool FrameStreamClient::receive()
+{
+    PROFILE_SCOPE("FrameStreamClient::receive");
+
+#ifndef _WIN32
+    if (m_socket < 0)
+        return false;
+
+    const bool connected = receiveAvailable(m_socket, m_buffer, m_bytesReceived);
+
+    bool decoded = false;
+    size_t offset = 0;
+    while (m_buffer.size() - offset >= sizeof(StreamMessageHeader))
+    {
+        StreamMessageHeader header;
+        memcpy(&header, m_buffer.data() + offset, sizeof(header));
+        if (header.size > kMaxMessageSize)
+        {
+            std::cerr << "FrameStream: malformed message from the server." << std::endl;
+            close();
+            return false;
+        }
+        if (m_buffer.size() - offset < sizeof(header) + header.size)
+            break;
+        if (!handleMessage(header.type, m_buffer.data() + offset + sizeof(header), header.size, decoded))
+        {
+            std::cerr << "FrameStream: malformed message from the server." << std::endl;
+            close();
+            return false;
+        }
+        offset += sizeof(header) + header.size;
+    }
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + offset);
+
+    if (!connected)
+    {
+        std::cerr << "FrameStream: the server closed the connection." << std::endl;
+        close();
+    }
+    return decoded;
+#else
+    return false;
+#endif
+}
+
+bool FrameStreamClient::handleMessage(uint32_t type, const uint8_t* data, size_t size, bool& decoded)
+{
+    if (type == kStreamTopology)
+    {
+        StreamTopology topology;
+        if (size < sizeof(topology))
+            return false;
+        memcpy(&topology, data, sizeof(topology));
+        if (memcmp(topology.magic, kMagic, sizeof(kMagic)) != 0 || topology.version != FrameStreamServer::kVersion || topology.byteOrder != kByteOrder)
+            return false;
+        const size_t trianglesSize = 3 * (size_t)topology.numTriangles * sizeof(int32_t);
+        if (size != sizeof(topology) + trianglesSize + topology.numParticles)
+            return false;
+
+        if (m_codec == nullptr || m_codec->getNumParticles() != (int)topology.numParticles || m_codec->getQuantum() != topology.quantum)
+        {
+            delete m_codec;
+            m_codec = new FrameCodec(topology.numParticles, topology.quantum);
+        }
+        m_codec->reset();
+        m_triangles.resize(3 * topology.numTriangles);
+        memcpy(m_triangles.data(), data + sizeof(topology), trianglesSize);
+        m_pins.assign(data + sizeof(topology) + trianglesSize, data + size);
+        m_positions.resize(3 * (size_t)topology.numParticles);
+        ++m_topologyVersion;
+        ++m_pinsVersion;
+        return true;
+    }
+    if (type == kStreamPins)
+    {
+        if (size != m_pins.size())
+            return false;
+        m_pins.assign(data, data + size);
+        ++m_pinsVersion;
+        return true;
+    }
+    if (type == kStreamFrame)
+    {
+        StreamFrameHeader frame;
+        if (m_codec == nullptr || size < sizeof(frame))
+            return false;
+        memcpy(&frame, data, sizeof(frame));
+        if (!m_codec->decode(data + sizeof(frame), size - sizeof(frame), (frame.flags & 1) != 0, m_positions.data()))
+            return false;
+        m_step = frame.step;
+        ++m_numReceived;
+        decoded = true;
+        return true;
+    }
+    return false;
+}
+
+bool FrameStreamClient::sendCommand(const StreamCommand& command)
+{
+#ifndef _WIN32
+    if (m_socket < 0)
+        return false;
+
+    std::vector<uint8_t> message;
+    appendMessage(message, kStreamCommand, &command, sizeof(command));
+    const std::atomic<bool> quit(false);
+    if (!sendAll(m_socket, message.data(), message.size(), quit))
+    {
+        std::cerr << "FrameStream: the server closed the connection." << std::endl;
+        close();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FrameStreamClient::setParameter(const char* name, float value)
+{
+    StreamCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = kSetParameter;
+    command.particle = -1;
+    command.value = value;
+    strncpy(command.name, name, sizeof(command.name) - 1);
+    return sendCommand(command);
+}
+
+bool FrameStreamClient::pinParticle(int particle, bool pinned)
+{
+    StreamCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = kPinParticle;
+    command.particle = particle;
+    command.value = pinned ? 1.0f : 0.0f;
+    return sendCommand(command);
+}
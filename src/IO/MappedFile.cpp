@@ -0,0 +1,81 @@
+#include "IO/MappedFile.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_mapped(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+#ifndef _WIN32
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    m_size = st.st_size;
+    if (m_size > 0)
+    {
+        void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            m_data = static_cast<const char*>(mapping);
+            m_mapped = true;
+        }
+    }
+    ::close(fd);
+
+    if (m_mapped || m_size == 0)
+    {
+        m_data = m_mapped ? m_data : "";
+        return true;
+    }
+#endif
+
+    // Fall back to reading the file into memory.
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    m_size = file.tellg();
+    m_buffer.resize(m_size + 1, 0);
+    file.seekg(0);
+    file.read(m_buffer.data(), m_size);
+    m_data = m_buffer.data();
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (m_mapped)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
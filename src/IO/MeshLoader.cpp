@@ -0,0 +1,562 @@
+#include "IO/MeshLoader.h"
+#include "IO/MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    inline const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && isBlank(*p)) ++p;
+        return p;
+    }
+
+    inline const char* nextLine(const char* p, const char* end)
+    {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        return eol ? eol + 1 : end;
+    }
+
+    // Locale independent parser for decimal and scientific notation.
+    //
+    inline bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        p = skipBlanks(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = (*p == '-');
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int exponent = 0, numDigits = 0;
+        bool digits = false;
+        for (; p < end && isDigit(*p); ++p, digits = true)
+        {
+            if (numDigits < 18) { mantissa = 10 * mantissa + (*p - '0'); ++numDigits; }
+            else ++exponent;
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && isDigit(*p); ++p, digits = true)
+            {
+                if (numDigits < 18) { mantissa = 10 * mantissa + (*p - '0'); ++numDigits; --exponent; }
+            }
+        }
+        if (!digits)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = (*p == '-');
+                ++p;
+            }
+            int e = 0;
+            for (; p < end && isDigit(*p); ++p)
+            {
+                if (e < 10000) e = 10 * e + (*p - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double v = (double)mantissa;
+        if (exponent < 0)
+            v = (exponent >= -22) ? v / powers[-exponent] : v * std::pow(10.0, exponent);
+        else if (exponent > 0)
+            v = (exponent <= 22) ? v * powers[exponent] : v * std::pow(10.0, exponent);
+
+        value = (float)(negative ? -v : v);
+        return true;
+    }
+
+    inline bool parseInt(const char*& p, const char* end, int& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = (*p == '-');
+            ++p;
+        }
+        if (p >= end || !isDigit(*p))
+            return false;
+
+        long long v = 0;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            v = 10 * v + (*p - '0');
+            if (v > INT32_MAX) return false;
+        }
+        value = (int)(negative ? -v : v);
+        return true;
+    }
+
+    // Parsed content of a line-aligned part of an OBJ file.
+    //
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        std::vector<Eigen::Vector3f> vertices;
+        std::vector<int> indices;           // Triangle corners (3 per triangle)
+        std::vector<size_t> relative;       // Positions in @a indices relative to the first vertex of this chunk
+        bool ok;
+
+        ObjChunk() : begin(nullptr), end(nullptr), ok(true) {}
+
+        void parse()
+        {
+            std::vector<std::pair<int, bool>> polygon;
+
+            for (const char* p = begin; p < end; p = nextLine(p, end))
+            {
+                p = skipBlanks(p, end);
+                if (end - p < 2 || !isBlank(p[1]))
+                    continue;
+
+                if (p[0] == 'v')
+                {
+                    ++p;
+                    Eigen::Vector3f x;
+                    if (!parseFloat(p, end, x(0)) || !parseFloat(p, end, x(1)) || !parseFloat(p, end, x(2)))
+                    {
+                        ok = false;
+                        return;
+                    }
+                    vertices.push_back(x);
+                }
+                else if (p[0] == 'f')
+                {
+                    ++p;
+                    polygon.clear();
+                    while (true)
+                    {
+                        p = skipBlanks(p, end);
+                        if (p >= end || *p == '\n')
+                            break;
+
+                        int index;
+                        if (!parseInt(p, end, index) || index == 0)
+                        {
+                            ok = false;
+                            return;
+                        }
+                        // Skip texture and normal indices.
+                        while (p < end && !isBlank(*p) && *p != '\n') ++p;
+
+                        // Negative indices are relative to the last vertex read so far.
+                        if (index > 0)
+                            polygon.push_back({ index - 1, false });
+                        else
+                            polygon.push_back({ (int)vertices.size() + index, true });
+                    }
+
+                    // Fan triangulation.
+                    for (size_t k = 2; k < polygon.size(); ++k)
+                    {
+                        for (size_t c : { (size_t)0, k - 1, k })
+                        {
+                            if (polygon[c].second) relative.push_back(indices.size());
+                            indices.push_back(polygon[c].first);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    int numThreads()
+    {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    // PLY property types.
+    enum ePlyType { kPlyInvalid = 0, kPlyInt8, kPlyUInt8, kPlyInt16, kPlyUInt16, kPlyInt32, kPlyUInt32, kPlyFloat32, kPlyFloat64 };
+
+    ePlyType plyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8") return kPlyInt8;
+        if (name == "uchar" || name == "uint8") return kPlyUInt8;
+        if (name == "short" || name == "int16") return kPlyInt16;
+        if (name == "ushort" || name == "uint16") return kPlyUInt16;
+        if (name == "int" || name == "int32") return kPlyInt32;
+        if (name == "uint" || name == "uint32") return kPlyUInt32;
+        if (name == "float" || name == "float32") return kPlyFloat32;
+        if (name == "double" || name == "float64") return kPlyFloat64;
+        return kPlyInvalid;
+    }
+
+    size_t plySize(ePlyType type)
+    {
+        static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+        return sizes[type];
+    }
+
+    template<typename T>
+    T readRaw(const char* p, bool swap)
+    {
+        char bytes[sizeof(T)];
+        memcpy(bytes, p, sizeof(T));
+        if (swap) std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    double readPly(const char* p, ePlyType type, bool swap)
+    {
+        switch (type)
+        {
+        case kPlyInt8: return (double)readRaw<int8_t>(p, swap);
+        case kPlyUInt8: return (double)readRaw<uint8_t>(p, swap);
+        case kPlyInt16: return (double)readRaw<int16_t>(p, swap);
+        case kPlyUInt16: return (double)readRaw<uint16_t>(p, swap);
+        case kPlyInt32: return (double)readRaw<int32_t>(p, swap);
+        case kPlyUInt32: return (double)readRaw<uint32_t>(p, swap);
+        case kPlyFloat32: return (double)readRaw<float>(p, swap);
+        case kPlyFloat64: return readRaw<double>(p, swap);
+        default: return 0.0;
+        }
+    }
+
+    struct PlyProperty
+    {
+        std::string name;
+        ePlyType type;          // Value type (element type for lists)
+        ePlyType countType;     // List count type, kPlyInvalid for scalar properties
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+
+        // Record size in bytes, or 0 if the records contain lists.
+        size_t stride() const
+        {
+            size_t size = 0;
+            for (const PlyProperty& prop : properties)
+            {
+                if (prop.countType != kPlyInvalid) return 0;
+                size += plySize(prop.type);
+            }
+            return size;
+        }
+    };
+
+    // Visit the properties of the record starting at @a p.  @a visit is called
+    // with the property index, a pointer to its data and its list length (1 for scalars).
+    // Returns the end of the record, or nullptr if it overruns @a end.
+    //
+    template<typename Visit>
+    const char* visitPlyRecord(const char* p, const char* end, const PlyElement& element, bool swap, Visit visit)
+    {
+        for (size_t k = 0; k < element.properties.size(); ++k)
+        {
+            const PlyProperty& prop = element.properties[k];
+            size_t count = 1;
+            if (prop.countType != kPlyInvalid)
+            {
+                if (p + plySize(prop.countType) > end) return nullptr;
+                count = (size_t)readPly(p, prop.countType, swap);
+                p += plySize(prop.countType);
+            }
+            const size_t size = count * plySize(prop.type);
+            if (p + size > end) return nullptr;
+            visit(k, p, count);
+            p += size;
+        }
+        return p;
+    }
+
+    bool validate(TriangleMesh& mesh)
+    {
+        const int numVertices = mesh.vertices.size();
+        for (const auto& t : mesh.triangles)
+        {
+            for (int i : t)
+            {
+                if (i < 0 || i >= numVertices)
+                {
+                    std::cerr << "MeshLoader: vertex index " << i << " out of range." << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+bool MeshLoader::load(const std::string& filename, TriangleMesh& mesh)
+{
+    std::string extension = filename.substr(std::min(filename.size(), filename.find_last_of('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower(c); });
+
+    MappedFile file;
+    if (!file.open(filename))
+    {
+        std::cerr << "MeshLoader: unable to open " << filename << std::endl;
+        return false;
+    }
+
+    if (extension == ".obj")
+        return loadOBJ(file.data(), file.size(), mesh);
+    if (extension == ".ply")
+        return loadPLY(file.data(), file.size(), mesh);
+
+    std::cerr << "MeshLoader: unsupported file type " << filename << std::endl;
+    return false;
+}
+
+bool MeshLoader::loadOBJ(const char* data, size_t size, TriangleMesh& mesh)
+{
+    const char* end = data + size;
+
+    // Split the file in line-aligned chunks of at least 64 KiB.
+    const size_t numChunks = std::max<size_t>(1, std::min<size_t>(4 * numThreads(), size / 65536));
+    std::vector<ObjChunk> chunks(numChunks);
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        chunks[i].begin = (i == 0) ? data : chunks[i - 1].end;
+        chunks[i].end = (i == numChunks - 1) ? end : std::max(chunks[i].begin, nextLine(data + (i + 1) * (size / numChunks), end));
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)numChunks; ++i)
+    {
+        chunks[i].parse();
+    }
+
+    // Prefix sums of the chunk sizes.
+    std::vector<size_t> vertexOffset(numChunks + 1, 0), indexOffset(numChunks + 1, 0);
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        if (!chunks[i].ok)
+        {
+            std::cerr << "MeshLoader: malformed OBJ data." << std::endl;
+            return false;
+        }
+        vertexOffset[i + 1] = vertexOffset[i] + chunks[i].vertices.size();
+        indexOffset[i + 1] = indexOffset[i] + chunks[i].indices.size();
+    }
+
+    mesh.vertices.resize(vertexOffset[numChunks]);
+    mesh.triangles.resize(indexOffset[numChunks] / 3);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)numChunks; ++i)
+    {
+        ObjChunk& chunk = chunks[i];
+        for (size_t k : chunk.relative)
+        {
+            chunk.indices[k] += (int)vertexOffset[i];
+        }
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + vertexOffset[i]);
+        memcpy(mesh.triangles.data() + indexOffset[i] / 3, chunk.indices.data(), chunk.indices.size() * sizeof(int));
+
+        std::vector<Eigen::Vector3f>().swap(chunk.vertices);
+        std::vector<int>().swap(chunk.indices);
+    }
+
+    return validate(mesh);
+}
+
+bool MeshLoader::loadPLY(const char* data, size_t size, TriangleMesh& mesh)
+{
+    const char* end = data + size;
+    const char* p = data;
+
+    // Parse the ASCII header.
+    std::vector<PlyElement> elements;
+    bool littleEndian = true;
+    bool formatFound = false;
+    bool headerEnd = false;
+    for (int lineNumber = 0; p < end && !headerEnd; ++lineNumber)
+    {
+        const char* eol = nextLine(p, end);
+        std::istringstream line(std::string(p, eol));
+        p = eol;
+
+        std::string keyword;
+        line >> keyword;
+        if (lineNumber == 0)
+        {
+            if (keyword != "ply") break;
+        }
+        else if (keyword == "format")
+        {
+            std::string format;
+            line >> format;
+            if (format != "binary_little_endian" && format != "binary_big_endian")
+            {
+                std::cerr << "MeshLoader: unsupported PLY format " << format << std::endl;
+                return false;
+            }
+            littleEndian = (format == "binary_little_endian");
+            formatFound = true;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            line >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty prop;
+            std::string type;
+            line >> type;
+            if (type == "list")
+            {
+                std::string countType, valueType;
+                line >> countType >> valueType;
+                prop.countType = plyType(countType);
+                prop.type = plyType(valueType);
+                if (prop.countType == kPlyInvalid)
+                    prop.type = kPlyInvalid;
+            }
+            else
+            {
+                prop.countType = kPlyInvalid;
+                prop.type = plyType(type);
+            }
+            line >> prop.name;
+            if (prop.type == kPlyInvalid)
+            {
+                std::cerr << "MeshLoader: unsupported PLY property type " << type << std::endl;
+                return false;
+            }
+            elements.back().properties.push_back(prop);
+        }
+        else if (keyword == "end_header")
+        {
+            headerEnd = true;
+        }
+    }
+    if (!headerEnd || !formatFound)
+    {
+        std::cerr << "MeshLoader: invalid PLY header." << std::endl;
+        return false;
+    }
+
+    const uint16_t one = 1;
+    const bool swap = littleEndian != (*reinterpret_cast<const char*>(&one) == 1);
+
+    mesh.vertices.clear();
+    mesh.triangles.clear();
+    for (const PlyElement& element : elements)
+    {
+        if (element.name == "vertex")
+        {
+            int xyz[3] = { -1, -1, -1 };
+            for (size_t k = 0; k < element.properties.size(); ++k)
+            {
+                const PlyProperty& prop = element.properties[k];
+                if (prop.countType == kPlyInvalid && prop.name.size() == 1 && prop.name[0] >= 'x' && prop.name[0] <= 'z')
+                    xyz[prop.name[0] - 'x'] = (int)k;
+            }
+            if (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0)
+            {
+                std::cerr << "MeshLoader: PLY vertices have no x, y, z properties." << std::endl;
+                return false;
+            }
+
+            mesh.vertices.resize(element.count);
+            auto readVertex = [&](const char* record, size_t i)
+            {
+                return visitPlyRecord(record, end, element, swap, [&](size_t k, const char* value, size_t)
+                    {
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            if ((int)k == xyz[c]) mesh.vertices[i](c) = (float)readPly(value, element.properties[k].type, swap);
+                        }
+                    });
+            };
+
+            // Fixed-size records can be read in parallel.
+            const size_t stride = element.stride();
+            if (stride > 0)
+            {
+                if ((size_t)(end - p) < stride * element.count)
+                {
+                    std::cerr << "MeshLoader: truncated PLY file." << std::endl;
+                    return false;
+                }
+                #pragma omp parallel for
+                for (long long i = 0; i < (long long)element.count; ++i)
+                {
+                    readVertex(p + i * stride, i);
+                }
+                p += stride * element.count;
+            }
+            else
+            {
+                for (size_t i = 0; i < element.count && p; ++i)
+                {
+                    p = readVertex(p, i);
+                }
+            }
+        }
+        else if (element.name == "face")
+        {
+            mesh.triangles.reserve(element.count);
+            for (size_t i = 0; i < element.count && p; ++i)
+            {
+                p = visitPlyRecord(p, end, element, swap, [&](size_t k, const char* value, size_t count)
+                    {
+                        const PlyProperty& prop = element.properties[k];
+                        if (prop.countType == kPlyInvalid || (prop.name != "vertex_indices" && prop.name != "vertex_index"))
+                            return;
+
+                        // Fan triangulation.
+                        const size_t size = plySize(prop.type);
+                        const int first = (int)readPly(value, prop.type, swap);
+                        for (size_t c = 2; c < count; ++c)
+                        {
+                            mesh.triangles.push_back({ first, (int)readPly(value + (c - 1) * size, prop.type, swap), (int)readPly(value + c * size, prop.type, swap) });
+                        }
+                    });
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < element.count && p; ++i)
+            {
+                p = visitPlyRecord(p, end, element, swap, [](size_t, const char*, size_t) {});
+            }
+        }
+
+        if (p == nullptr)
+        {
+            std::cerr << "MeshLoader: truncated PLY file." << std::endl;
+            return false;
+        }
+    }
+
+    return validate(mesh);
+}
@@ -0,0 +1,250 @@
+#include "IO/Snapshot.h"
+
+#include "Cloth.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    const char kMagic[8] = { 'C', 'L', 'T', 'H', 'S', 'N', 'A', 'P' };
+    const uint32_t kByteOrder = 0x01020304;
+
+    uint64_t alignUp(uint64_t n) { return (n + 63) & ~(uint64_t)63; }
+
+    // Computes the offset of every array for the given sizes.
+    //
+    void layout(SnapshotHeader& header)
+    {
+        const uint64_t n = header.numParticles, m = header.numSprings, t = header.numTriangles, numMaterials = header.numMaterials;
+        header.positions = alignUp(sizeof(SnapshotHeader));
+        header.velocities = alignUp(header.positions + 3 * n * sizeof(float));
+        header.masses = alignUp(header.velocities + 3 * n * sizeof(float));
+        header.flags = alignUp(header.masses + n * sizeof(float));
+        header.springs = alignUp(header.flags + n * sizeof(uint8_t));
+        header.springMaterials = alignUp(header.springs + 2 * m * sizeof(int32_t));
+        header.restLengths = alignUp(header.springMaterials + m * sizeof(int32_t));
+        header.materials = alignUp(header.restLengths + m * sizeof(float));
+        header.triangles = alignUp(header.materials + 3 * numMaterials * sizeof(float));
+        header.fileSize = header.triangles + 3 * t * sizeof(int32_t);
+    }
+
+    template<typename T>
+    void writeArray(std::ofstream& file, uint64_t offset, const std::vector<T>& values)
+    {
+        // Zero padding up to the aligned offset.
+        static const char zeros[64] = { 0 };
+        const uint64_t position = file.tellp();
+        file.write(zeros, offset - position);
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+}
+
+bool SnapshotView::open(const std::string& filename)
+{
+    if (!m_file.open(filename))
+    {
+        std::cerr << "Snapshot: unable to open " << filename << std::endl;
+        return false;
+    }
+
+    const SnapshotHeader& h = header();
+    if (m_file.size() < sizeof(SnapshotHeader) || memcmp(h.magic, kMagic, sizeof(kMagic)) != 0)
+    {
+        std::cerr << "Snapshot: " << filename << " is not a snapshot file." << std::endl;
+        return false;
+    }
+    if (h.version != Snapshot::kVersion || h.byteOrder != kByteOrder)
+    {
+        std::cerr << "Snapshot: unsupported version or byte order in " << filename << std::endl;
+        return false;
+    }
+
+    SnapshotHeader expected = h;
+    layout(expected);
+    if (memcmp(&expected, &h, sizeof(SnapshotHeader)) != 0 || h.fileSize != m_file.size())
+    {
+        std::cerr << "Snapshot: " << filename << " is truncated or corrupted." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Snapshot::save(const std::string& filename, const Cloth* cloth, const SnapshotParams& params)
+{
+    if (cloth->getMembrane())
+    {
+        std::cerr << "Snapshot: cloths with membrane elements cannot be saved." << std::endl;
+        return false;
+    }
+
+    const auto& particles = cloth->getParticles();
+    const auto& springs = cloth->getSprings();
+    const auto& triangles = cloth->getTriangles();
+    const auto& materials = cloth->getMaterials();
+
+    SnapshotHeader header;
+    memset(static_cast<void*>(&header), 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrder;
+    header.numParticles = particles.size();
+    header.numSprings = springs.size();
+    header.numTriangles = triangles.size();
+    header.numMaterials = materials.size();
+    header.width = cloth->getWidth();
+    header.height = cloth->getHeight();
+    header.structuralIndex = cloth->getStructuralIndex();
+    header.shearIndex = cloth->getShearIndex();
+    header.bendingIndex = cloth->getBendingIndex();
+    header.params = params;
+    layout(header);
+
+    const size_t n = particles.size(), m = springs.size();
+    std::vector<float> positions(3 * n), velocities(3 * n), masses(n);
+    std::vector<uint8_t> flags(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector3f::Map(&positions[3 * i]) = particles[i]->x;
+        Eigen::Vector3f::Map(&velocities[3 * i]) = particles[i]->v;
+        masses[i] = particles[i]->m;
+        flags[i] = particles[i]->fixed ? 1 : 0;
+    }
+
+    std::vector<int32_t> springIndices(2 * m), springMaterials(m);
+    std::vector<float> restLengths(m);
+    for (size_t k = 0; k < m; ++k)
+    {
+        springIndices[2 * k] = springs[k]->particles[0]->index;
+        springIndices[2 * k + 1] = springs[k]->particles[1]->index;
+        springMaterials[k] = springs[k]->material;
+        restLengths[k] = springs[k]->r;
+    }
+
+    std::vector<float> materialParams(3 * materials.size());
+    for (size_t k = 0; k < materials.size(); ++k)
+    {
+        materialParams[3 * k] = materials[k].k;
+        materialParams[3 * k + 1] = materials[k].b;
+        materialParams[3 * k + 2] = materials[k].tearStrain;
+    }
+
+    std::vector<int32_t> triangleIndices(3 * triangles.size());
+    for (size_t k = 0; k < triangles.size(); ++k)
+    {
+        for (int c = 0; c < 3; ++c) triangleIndices[3 * k + c] = triangles[k][c];
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "Snapshot: unable to write " << filename << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeArray(file, header.positions, positions);
+    writeArray(file, header.velocities, velocities);
+    writeArray(file, header.masses, masses);
+    writeArray(file, header.flags, flags);
+    writeArray(file, header.springs, springIndices);
+    writeArray(file, header.springMaterials, springMaterials);
+    writeArray(file, header.restLengths, restLengths);
+    writeArray(file, header.materials, materialParams);
+    writeArray(file, header.triangles, triangleIndices);
+
+    return (bool)file;
+}
+
+Cloth* Snapshot::load(const std::string& filename, SnapshotParams* params)
+{
+    SnapshotView view;
+    if (!view.open(filename))
+        return nullptr;
+
+    const SnapshotHeader& header = view.header();
+    const int n = header.numParticles;
+    const int m = header.numSprings;
+
+    const int numMaterials = header.numMaterials;
+    const int32_t* springIndices = view.springs();
+    const int32_t* springMaterials = view.springMaterials();
+    const int32_t* triangleIndices = view.triangles();
+    if (numMaterials < kNumClothMaterials)
+    {
+        std::cerr << "Snapshot: missing spring materials in " << filename << std::endl;
+        return nullptr;
+    }
+    for (int k = 0; k < m; ++k)
+    {
+        if (springIndices[2 * k] < 0 || springIndices[2 * k] >= n || springIndices[2 * k + 1] < 0 || springIndices[2 * k + 1] >= n ||
+            springMaterials[k] < 0 || springMaterials[k] >= numMaterials)
+        {
+            std::cerr << "Snapshot: invalid spring in " << filename << std::endl;
+            return nullptr;
+        }
+    }
+    if (header.structuralIndex < 0 || header.structuralIndex > header.shearIndex ||
+        header.shearIndex > header.bendingIndex || header.bendingIndex > m)
+    {
+        std::cerr << "Snapshot: invalid spring classes in " << filename << std::endl;
+        return nullptr;
+    }
+    for (uint32_t k = 0; k < 3 * header.numTriangles; ++k)
+    {
+        if (triangleIndices[k] < 0 || triangleIndices[k] >= n)
+        {
+            std::cerr << "Snapshot: invalid triangle in " << filename << std::endl;
+            return nullptr;
+        }
+    }
+
+    Cloth* cloth = new Cloth(header.width, header.height);
+    cloth->clear();
+
+    const float* positions = view.positions();
+    const float* velocities = view.velocities();
+    const float* masses = view.masses();
+    const uint8_t* flags = view.flags();
+    cloth->getParticles().reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+        Particle* particle = new Particle(i, Eigen::Vector3f::Map(positions + 3 * i), Eigen::Vector3f::Map(velocities + 3 * i), Eigen::Vector3f(0, 0, 0), masses[i]);
+        particle->fixed = (flags[i] & 1) != 0;
+        cloth->addParticle(particle);
+    }
+
+    const float* materialParams = view.materials();
+    auto& materials = cloth->getMaterials();
+    materials.resize(numMaterials);
+    for (int k = 0; k < numMaterials; ++k)
+    {
+        const float* p = materialParams + 3 * k;
+        materials[k] = SpringMaterial(p[0], p[1], p[2]);
+    }
+
+    auto& particles = cloth->getParticles();
+    const float* restLengths = view.restLengths();
+    cloth->getSprings().reserve(m);
+    for (int k = 0; k < m; ++k)
+    {
+        cloth->addSpring(new Spring(particles[springIndices[2 * k]], particles[springIndices[2 * k + 1]], springMaterials[k], restLengths[k]));
+    }
+    cloth->setStructuralIndex(header.structuralIndex);
+    cloth->setShearIndex(header.shearIndex);
+    cloth->setBendingIndex(header.bendingIndex);
+
+    for (uint32_t k = 0; k < header.numTriangles; ++k)
+    {
+        cloth->addTriangle(triangleIndices[3 * k], triangleIndices[3 * k + 1], triangleIndices[3 * k + 2]);
+    }
+
+    if (params)
+    {
+        *params = header.params;
+    }
+
+    return cloth;
+}
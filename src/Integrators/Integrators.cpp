@@ -0,0 +1,59 @@
+#include "Integrators/Integrators.h"
+
+#include "Integrators/ExplicitEuler.hpp"
+#include "Integrators/SemiImplicitEuler.hpp"
+#include "Integrators/Midpoint.hpp"
+#include "Integrators/ImplicitEuler.hpp"
+#include "Integrators/ImplicitExplicitEuler.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    static SemiImplicitEuler s_semiImplicitEuler;
+    static ExplicitEuler s_explicitEuler;
+    static Midpoint s_midpoint;
+    static ImplicitEuler s_implicitEuler;
+    static ImplicitExplicitEuler s_implicitExplicitEuler;
+
+    // Stores instances of each integrator
+    //
+    static Integrator* integrators[kNumIntegrators] = {
+        &s_explicitEuler,
+        &s_midpoint,
+        &s_semiImplicitEuler,
+        &s_implicitEuler,
+        &s_implicitExplicitEuler
+    };
+
+    static const char* names[kNumIntegrators] = {
+        "explicit",
+        "midpoint",
+        "semi-implicit",
+        "implicit",
+        "imex"
+    };
+}
+
+Integrator* getIntegrator(int index)
+{
+    assert(index >= 0 && index < kNumIntegrators);
+    return integrators[index];
+}
+
+const char* getIntegratorName(int index)
+{
+    assert(index >= 0 && index < kNumIntegrators);
+    return names[index];
+}
+
+int findIntegrator(const char* name)
+{
+    for (int i = 0; i < kNumIntegrators; ++i)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,153 @@
+#include "Integrators/StabilityWatchdog.h"
+
+#include "Integrators/Integrator.h"
+#include "Integrators/Integrators.h"
+#include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const int StabilityWatchdog::kMaxHalvings;
+const int StabilityWatchdog::kCalmSteps;
+constexpr float StabilityWatchdog::kGrowth;
+
+namespace
+{
+    // Next integrator tried when @a integrator is unstable at the smallest time step, or -1.
+    int fallbackIntegrator(int integrator)
+    {
+        switch (integrator)
+        {
+        case kExplicitEuler:
+        case kMidpoint:
+            return kSemiImplicitEuler;
+        case kSemiImplicitEuler:
+        case kImplicitExplicitEuler:
+            return kImplicitEuler;
+        default:
+            return -1;
+        }
+    }
+}
+
+StabilityWatchdog::StabilityWatchdog() :
+    m_integrator(kExplicitEuler), m_scale(1.0f), m_halvings(0), m_calmSteps(0), m_numRollbacks(0),
+    m_tolerance(0.01f), m_maxDrift(0.5f), m_hasCheckpoint(false), m_checkpointEnergy(0.0f), m_checkpointScale(0.0f),
+    m_checkpointPower(0.0f), m_checkpointDt(0.0f), m_limiterWork(0.0f), m_referenceEnergy(0.0f), m_motionScale(0.0f), m_freeMass(0.0f)
+{
+}
+
+void StabilityWatchdog::reset(int integrator)
+{
+    m_integrator = integrator;
+    m_scale = 1.0f;
+    m_halvings = 0;
+    m_calmSteps = 0;
+    m_numRollbacks = 0;
+    m_hasCheckpoint = false;
+}
+
+bool StabilityWatchdog::fallBack()
+{
+    const int fallback = fallbackIntegrator(m_integrator);
+    if (fallback < 0)
+        return false;
+
+    std::cerr << "StabilityWatchdog: " << getIntegratorName(m_integrator) << " is unstable, falling back to " << getIntegratorName(fallback) << std::endl;
+    m_integrator = fallback;
+    m_scale = 1.0f;
+    m_halvings = 0;
+    return true;
+}
+
+float StabilityWatchdog::allowedGain(const ParticleSystem* particleSystem) const
+{
+    // Twice the free fall error leaves room for the error of the energies,
+    // along with a few float roundings of the gravitational energy.  The
+    // force fields can do up to twice their work of the first state.
+    return m_tolerance * m_checkpointScale + 2.0f * (freeFallError(m_checkpointDt) + externalWork()) + 1e-5f * std::abs(particleSystem->getGravityEnergy());
+}
+
+bool StabilityWatchdog::step(ParticleSystem* particleSystem, float dt)
+{
+    PROFILE_SCOPE("StabilityWatchdog");
+
+    // The energies were computed for the current state by computeForces().
+    // Retry the last step until it does not gain too much energy.
+    while (m_hasCheckpoint && !(particleSystem->getEnergy() - m_checkpointEnergy <= allowedGain(particleSystem)))
+    {
+        // Regions that fell asleep since the checkpoint would keep their state.
+        particleSystem->wakeAll();
+        particleSystem->setState(m_checkpoint);
+        ++m_numRollbacks;
+        m_calmSteps = 0;
+
+        if (m_halvings < kMaxHalvings)
+        {
+            m_scale *= 0.5f;
+            ++m_halvings;
+        }
+        else if (!fallBack())
+        {
+            std::cerr << "StabilityWatchdog: " << getIntegratorName(m_integrator) << " is unstable at dt = " << dt * m_scale << std::endl;
+            m_hasCheckpoint = false;
+            return false;
+        }
+
+        // Take the step again from the restored state.
+        particleSystem->computeForces();
+        m_checkpointDt = dt * m_scale;
+        getIntegrator(m_integrator)->step(particleSystem, m_checkpointDt);
+        m_limiterWork = particleSystem->limitStrain(m_checkpointDt);
+        particleSystem->computeForces();
+    }
+
+    const float energy = particleSystem->getEnergy();
+    const float motion = particleSystem->getKineticEnergy() + particleSystem->getElasticEnergy();
+    if (!m_hasCheckpoint)
+    {
+        m_referenceEnergy = energy;
+        m_motionScale = 0.0f;
+        m_freeMass = 0.0f;
+        for (const Particle* p : particleSystem->getParticles())
+        {
+            if (!p->fixed) m_freeMass += p->m;
+        }
+    }
+    // The scale of the drift is the kinetic and spring energy of states that
+    // did not gain energy.
+    if (energy <= m_referenceEnergy)
+    {
+        m_motionScale = std::max(m_motionScale, motion);
+    }
+
+    // Steps small enough to pass the test above can still add up to a large
+    // energy gain: the integrator is not stable at any affordable time step.
+    if (energy - m_referenceEnergy > m_maxDrift * m_motionScale + allowedGain(particleSystem) && fallBack())
+    {
+        m_referenceEnergy = energy;
+    }
+
+    // Grow a reduced time step back after a while.
+    if (m_scale < 1.0f && ++m_calmSteps >= kCalmSteps)
+    {
+        m_scale = std::min(1.0f, m_scale * kGrowth);
+        m_halvings = std::max(0, (int)std::ceil(-std::log2(m_scale)));
+        m_calmSteps = 0;
+    }
+
+    // Keep the accepted state in case the next step fails.
+    m_checkpointDt = dt * m_scale;
+    m_checkpointEnergy = energy;
+    m_checkpointScale = motion;
+    m_checkpointPower = particleSystem->getExternalPower();
+    m_referenceEnergy = std::min(m_referenceEnergy, energy) + freeFallError(m_checkpointDt) + externalWork();
+    particleSystem->getState(m_checkpoint);
+    m_hasCheckpoint = true;
+
+    getIntegrator(m_integrator)->step(particleSystem, m_checkpointDt);
+    m_limiterWork = particleSystem->limitStrain(m_checkpointDt);
+    return true;
+}
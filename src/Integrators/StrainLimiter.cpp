@@ -0,0 +1,292 @@
+#include "Integrators/StrainLimiter.h"
+
+#include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+const int StrainLimiter::kDefaultIterations;
+const int StrainLimiter::kMinIterations;
+
+namespace
+{
+    // Springs below which a color is not worth correcting in parallel.
+    const int kMinParallelSprings = 4096;
+
+    // Strain beyond the limit tolerated by the early exit, so that the
+    // roundings of springs shortened exactly to the limit are not corrected
+    // over and over.
+    const float kStrainTolerance = 1e-3f;
+
+    const float kGravity = 9.81f;
+
+    // Kinetic and gravitational energy added to particle @a p by moving it by @a dx and changing its velocity by @a dv.
+    inline double correctionWork(const Particle* p, const Eigen::Vector3f& dx, const Eigen::Vector3f& dv)
+    {
+        return p->m * (p->v.dot(dv) + 0.5f * dv.squaredNorm() + kGravity * dx.y());
+    }
+}
+
+StrainLimiter::StrainLimiter(ParticleSystem* _particleSystem) : m_particleSystem(_particleSystem), m_maxStrain(0.0f),
+    m_iters(kDefaultIterations), m_materials(~0u), m_colorTopologyVersion(0), m_colorSprings(0), m_autoIterations(kMinIterations), m_numIterations(0), m_numCorrections(0),
+    m_work(0.0f), m_remainingStrain(0.0f)
+{
+}
+
+void StrainLimiter::apply(float dt)
+{
+    m_numIterations = 0;
+    m_numCorrections = 0;
+    m_work = 0.0f;
+    m_remainingStrain = 0.0f;
+    if (m_maxStrain <= 0.0f || dt <= 0.0f)
+        return;
+
+    PROFILE_SCOPE("StrainLimiter");
+    if (m_colorStart.empty() || m_colorTopologyVersion != m_particleSystem->getTopologyVersion() || m_colorSprings != m_particleSystem->getSprings().size())
+    {
+        colorSprings();
+        m_anchorFixed.clear();
+    }
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    bool pinsChanged = m_anchorFixed.size() != particles.size();
+    for (size_t i = 0; i < particles.size() && !pinsChanged; ++i)
+    {
+        pinsChanged = m_anchorFixed[i] != (uint8_t)particles[i]->fixed;
+    }
+    if (pinsChanged)
+    {
+        computeAnchors();
+    }
+
+    double work = 0.0;
+    m_numCorrections += attach(dt, work);
+
+    const int maxIterations = m_iters > 0 ? m_iters : m_autoIterations;
+    float maxStretch = 0.0f;
+    while (m_numIterations < maxIterations)
+    {
+        int numViolations = 0;
+        maxStretch = 0.0f;
+        for (int c = 0; c + 1 < (int)m_colorStart.size(); ++c)
+        {
+            numViolations += correctColor(c, dt, work, maxStretch);
+        }
+        ++m_numIterations;
+        m_numCorrections += numViolations;
+        if (numViolations == 0)
+            break;
+    }
+    // The stretches are measured before the corrections of an iteration,
+    // which only leaves them unchanged when it found no violation.
+    m_remainingStrain = (m_numIterations < maxIterations ? maxStretch : measureStretch()) - 1.0f;
+    m_work = (float)work;
+}
+
+int StrainLimiter::attach(float dt, double& work)
+{
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const int numParticles = particles.size();
+    const float maxStretch = 1.0f + m_maxStrain;
+    const float tolerance = maxStretch + kStrainTolerance;
+    const float invDt = 1.0f / dt;
+
+    int numViolations = 0;
+    double attachWork = 0.0;
+    #pragma omp parallel for reduction(+ : numViolations, attachWork) if (numParticles >= kMinParallelSprings)
+    for (int i = 0; i < numParticles; ++i)
+    {
+        const int anchor = m_anchors[i];
+        Particle* p = particles[i];
+        if (anchor < 0 || p->fixed || m_particleSystem->isAsleep(i))
+            continue;
+
+        const Eigen::Vector3f delta = p->x - particles[anchor]->x;
+        const float length = delta.norm();
+        if (length <= tolerance * m_anchorLengths[i])
+            continue;
+
+        const Eigen::Vector3f dx = -((length - maxStretch * m_anchorLengths[i]) / length) * delta;
+        attachWork += correctionWork(p, dx, invDt * dx);
+        p->x += dx;
+        p->v += invDt * dx;
+        ++numViolations;
+    }
+    work += attachWork;
+    return numViolations;
+}
+
+void StrainLimiter::computeAnchors()
+{
+    PROFILE_SCOPE("StrainLimiter anchors");
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const int numParticles = particles.size();
+
+    // Shortest rest-length paths along the limited springs from the fixed
+    // particles, by Dijkstra's algorithm started from all of them at once.
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    m_anchors.assign(numParticles, -1);
+    m_anchorLengths.assign(numParticles, HUGE_VALF);
+    m_anchorFixed.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        m_anchorFixed[i] = particles[i]->fixed;
+        if (particles[i]->fixed)
+        {
+            m_anchors[i] = i;
+            m_anchorLengths[i] = 0.0f;
+            queue.push(Entry(0.0f, i));
+        }
+    }
+    while (!queue.empty())
+    {
+        const Entry entry = queue.top();
+        queue.pop();
+        const int i = entry.second;
+        if (entry.first > m_anchorLengths[i])
+            continue;
+        for (const auto& link : particles[i]->springs)
+        {
+            const Spring* s = link.first;
+            if (!isLimited(s->material))
+                continue;
+            const int j = s->particles[0] == particles[i] ? s->particles[1]->index : s->particles[0]->index;
+            const float length = entry.first + s->r;
+            if (length < m_anchorLengths[j])
+            {
+                m_anchors[j] = m_anchors[i];
+                m_anchorLengths[j] = length;
+                queue.push(Entry(length, j));
+            }
+        }
+    }
+
+    m_autoIterations = std::max(kMinIterations, (int)std::ceil(kIterationsPerSide * std::sqrt((float)numParticles)));
+}
+
+float StrainLimiter::measureStretch() const
+{
+    const std::vector<Spring*>& springs = m_particleSystem->getSprings();
+    const int numSprings = m_springOrder.size();
+    float maxStretch = 0.0f;
+    #pragma omp parallel for reduction(max : maxStretch) if (numSprings >= kMinParallelSprings)
+    for (int k = 0; k < numSprings; ++k)
+    {
+        const Spring* s = springs[m_springOrder[k]];
+        maxStretch = std::max(maxStretch, (s->particles[1]->x - s->particles[0]->x).norm() / s->r);
+    }
+    return maxStretch;
+}
+
+int StrainLimiter::correctColor(int color, float dt, double& work, float& maxStretchFound)
+{
+    const std::vector<Spring*>& springs = m_particleSystem->getSprings();
+    const int begin = m_colorStart[color], end = m_colorStart[color + 1];
+    const float maxStretch = 1.0f + m_maxStrain;
+    const float tolerance = maxStretch + kStrainTolerance;
+    const float invDt = 1.0f / dt;
+
+    int numViolations = 0;
+    double colorWork = 0.0;
+    float colorStretch = maxStretchFound;
+    #pragma omp parallel for reduction(+ : numViolations, colorWork) reduction(max : colorStretch) if (end - begin >= kMinParallelSprings)
+    for (int k = begin; k < end; ++k)
+    {
+        const Spring* s = springs[m_springOrder[k]];
+        Particle* p0 = s->particles[0];
+        Particle* p1 = s->particles[1];
+        const Eigen::Vector3f delta = p1->x - p0->x;
+        const float length = delta.norm();
+        colorStretch = std::max(colorStretch, length / s->r);
+        if (length <= tolerance * s->r)
+            continue;
+
+        const float w0 = (p0->fixed || m_particleSystem->isAsleep(p0->index)) ? 0.0f : 1.0f / p0->m;
+        const float w1 = (p1->fixed || m_particleSystem->isAsleep(p1->index)) ? 0.0f : 1.0f / p1->m;
+        if (w0 + w1 <= 0.0f)
+            continue;
+
+        // Move both ends along the spring to bring it back to the limit.
+        const Eigen::Vector3f correction = ((length - maxStretch * s->r) / (length * (w0 + w1))) * delta;
+        const Eigen::Vector3f dx0 = w0 * correction, dx1 = -w1 * correction;
+        colorWork += correctionWork(p0, dx0, invDt * dx0) + correctionWork(p1, dx1, invDt * dx1);
+        p0->x += dx0;
+        p0->v += invDt * dx0;
+        p1->x += dx1;
+        p1->v += invDt * dx1;
+        ++numViolations;
+    }
+    work += colorWork;
+    maxStretchFound = colorStretch;
+    return numViolations;
+}
+
+void StrainLimiter::colorSprings()
+{
+    PROFILE_SCOPE("StrainLimiter colors");
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const std::vector<Spring*>& springs = m_particleSystem->getSprings();
+
+    // A spring has fewer than 2 * maxDegree neighbor springs, so the greedy
+    // coloring uses fewer colors than that.
+    size_t maxDegree = 0;
+    for (const Particle* p : particles)
+    {
+        maxDegree = std::max(maxDegree, p->springs.size());
+    }
+    const int words = (int)(2 * maxDegree + 63) / 64;
+    std::vector<uint64_t> used(particles.size() * words, 0);
+
+    std::vector<int> colors(springs.size(), -1);
+    int numColors = 0;
+    for (int k = 0; k < (int)springs.size(); ++k)
+    {
+        const Spring* s = springs[k];
+        if (!isLimited(s->material))
+            continue;
+        const uint64_t* used0 = &used[s->particles[0]->index * words];
+        const uint64_t* used1 = &used[s->particles[1]->index * words];
+        int c = 0;
+        while ((used0[c / 64] | used1[c / 64]) >> (c % 64) & 1)
+        {
+            ++c;
+        }
+        assert(c < 64 * words);
+        colors[k] = c;
+        numColors = std::max(numColors, c + 1);
+        used[s->particles[0]->index * words + c / 64] |= (uint64_t)1 << (c % 64);
+        used[s->particles[1]->index * words + c / 64] |= (uint64_t)1 << (c % 64);
+    }
+
+    // Counting sort by color, keeping the spring order within a color.
+    m_colorStart.assign(numColors + 1, 0);
+    for (int c : colors)
+    {
+        if (c >= 0) ++m_colorStart[c + 1];
+    }
+    for (int c = 0; c < numColors; ++c)
+    {
+        m_colorStart[c + 1] += m_colorStart[c];
+    }
+    m_springOrder.resize(m_colorStart[numColors]);
+    std::vector<int> next(m_colorStart.begin(), m_colorStart.end() - 1);
+    for (int k = 0; k < (int)springs.size(); ++k)
+    {
+        if (colors[k] >= 0) m_springOrder[next[colors[k]]++] = k;
+    }
+
+    m_colorTopologyVersion = m_particleSystem->getTopologyVersion();
+    m_colorSprings = springs.size();
+}
+
+size_t StrainLimiter::getMemoryUsage() const
+{
+    return (m_springOrder.capacity() + m_colorStart.capacity() + m_anchors.capacity()) * sizeof(int) +
+           m_anchorLengths.capacity() * sizeof(float) + m_anchorFixed.capacity();
+}
@@ -0,0 +1,524 @@
+#include "Parallel/DomainDecomposition.h"
+
+#include "Cloth.h"
+#include "Integrators/Integrator.h"
+#include "Integrators/StrainLimiter.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <new>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared-memory counters must be lock-free to work across processes.");
+
+// Control block at the beginning of the shared mapping.
+//
+struct SharedState
+{
+    alignas(64) std::atomic<unsigned long long> targetStep;     // Step count requested by the coordinator
+    std::atomic<int> quit;
+    float dt;
+    int numMaterials;               // Size of the material table, fixed at start()
+    float maxStrain;                // Strain limiter settings of the cloth, published with every step
+    int strainIterations;
+    uint32_t strainMaterials;
+};
+
+namespace
+{
+    const int kRingSlots = 4;
+    const size_t kCacheLine = 64;
+
+    // Per-tile step counter, on its own cache line.
+    //
+    struct alignas(64) Counter
+    {
+        std::atomic<unsigned long long> value;
+    };
+
+    // Single-producer single-consumer ring buffer of halo row states.
+    // The slots (kRingSlots * slotFloats floats) directly follow the header in memory.
+    //
+    struct HaloRing
+    {
+        alignas(64) std::atomic<unsigned long long> head;   // Number of slots written by the producer
+        alignas(64) std::atomic<unsigned long long> tail;   // Number of slots read by the consumer
+
+        float* slot(unsigned long long i, size_t slotFloats)
+        {
+            return reinterpret_cast<float*>(this + 1) + (i % kRingSlots) * slotFloats;
+        }
+    };
+
+    size_t alignUp(size_t n) { return (n + kCacheLine - 1) / kCacheLine * kCacheLine; }
+
+    // Spin, then yield, then sleep until @a done returns true.
+    // Gives up and returns false as soon as @a alive returns false.
+    //
+    template<typename Done, typename Alive>
+    bool waitUntil(Done done, Alive alive)
+    {
+        for (unsigned int spin = 0; !done(); ++spin)
+        {
+            if (spin < 64)
+                continue;
+            if (spin < 4096)
+            {
+                sched_yield();
+                continue;
+            }
+            if (!alive())
+                return false;
+            usleep(50);
+        }
+        return true;
+    }
+
+    // Copy the states of rows [row0, row0+numRows) into @a dst as [x, v] per particle.
+    void packRows(Cloth* cloth, int row0, int numRows, float* dst)
+    {
+        for (int i = row0; i < row0 + numRows; ++i)
+        {
+            for (int j = 0; j < cloth->getWidth(); ++j, dst += 6)
+            {
+                const Particle* p = cloth->getParticle(i, j);
+                Eigen::Vector3f::Map(dst) = p->x;
+                Eigen::Vector3f::Map(dst + 3) = p->v;
+            }
+        }
+    }
+
+    void unpackRows(Cloth* cloth, int row0, int numRows, const float* src)
+    {
+        for (int i = row0; i < row0 + numRows; ++i)
+        {
+            for (int j = 0; j < cloth->getWidth(); ++j, src += 6)
+            {
+                Particle* p = cloth->getParticle(i, j);
+                p->x = Eigen::Map<const Eigen::Vector3f>(src);
+                p->v = Eigen::Map<const Eigen::Vector3f>(src + 3);
+            }
+        }
+    }
+
+    // Build a cloth containing rows [haloBegin, haloEnd) of @a cloth.
+    // Only springs touching an owned row [ownBegin, ownEnd) are copied, and the
+    // halo particles are pinned.
+    //
+    Cloth* createLocalCloth(Cloth* cloth, int haloBegin, int haloEnd, int ownBegin, int ownEnd)
+    {
+        const int nx = cloth->getWidth();
+
+        Cloth* local = new Cloth(nx, haloEnd - haloBegin);
+        local->clear();
+        local->getMaterials() = cloth->getMaterials();
+
+        for (int i = haloBegin; i < haloEnd; ++i)
+        {
+            for (int j = 0; j < nx; ++j)
+            {
+                const Particle* src = cloth->getParticle(i, j);
+                Particle* particle = new Particle(local->getParticleIndex(i - haloBegin, j), src->x, src->v, src->f, src->m);
+                particle->fixed = src->fixed || i < ownBegin || i >= ownEnd;
+                local->addParticle(particle);
+            }
+        }
+
+        const auto& springs = cloth->getSprings();
+        const int numSprings = springs.size();
+        local->setStructuralIndex(0);
+        local->setShearIndex(0);
+        local->setBendingIndex(0);
+        for (int k = 0; k < numSprings; ++k)
+        {
+            if (k == cloth->getShearIndex()) local->setShearIndex(local->getSprings().size());
+            if (k == cloth->getBendingIndex()) local->setBendingIndex(local->getSprings().size());
+
+            const Spring* s = springs[k];
+            const int i0 = s->particles[0]->index / nx;
+            const int i1 = s->particles[1]->index / nx;
+            const bool inHalo = std::min(i0, i1) >= haloBegin && std::max(i0, i1) < haloEnd;
+            const bool owned = (i0 >= ownBegin && i0 < ownEnd) || (i1 >= ownBegin && i1 < ownEnd);
+            if (inHalo && owned)
+            {
+                Particle* p0 = local->getParticle(i0 - haloBegin, s->particles[0]->index % nx);
+                Particle* p1 = local->getParticle(i1 - haloBegin, s->particles[1]->index % nx);
+                local->addSpring(new Spring(p0, p1, s->material, s->r));
+            }
+        }
+        if (cloth->getShearIndex() >= numSprings) local->setShearIndex(local->getSprings().size());
+        if (cloth->getBendingIndex() >= numSprings) local->setBendingIndex(local->getSprings().size());
+
+        return local;
+    }
+}
+
+// Offsets of the various regions inside the shared mapping.
+//
+namespace
+{
+    struct SharedLayout
+    {
+        size_t materials, counters, rings, ringStride, gather, total;
+        size_t slotFloats;
+
+        SharedLayout(int numTiles, int nx, int numParticles, int numMaterials)
+        {
+            slotFloats = (size_t)DomainDecomposition::kHaloRows * nx * 6;
+            materials = alignUp(sizeof(SharedState));
+            counters = materials + alignUp(numMaterials * sizeof(SpringMaterial));
+            rings = counters + alignUp(numTiles * sizeof(Counter));
+            ringStride = alignUp(sizeof(HaloRing) + kRingSlots * slotFloats * sizeof(float));
+            gather = rings + 2 * (numTiles - 1) * ringStride;
+            total = gather + alignUp(6 * (size_t)numParticles * sizeof(float));
+        }
+    };
+
+    Counter* counterAt(SharedState* shared, const SharedLayout& layout, int tile)
+    {
+        return reinterpret_cast<Counter*>(reinterpret_cast<char*>(shared) + layout.counters) + tile;
+    }
+
+    // Ring carrying the rows sent across boundary @a b (between tiles b and b+1),
+    // upwards (b -> b+1) or downwards (b+1 -> b).
+    HaloRing* ringAt(SharedState* shared, const SharedLayout& layout, int b, bool up)
+    {
+        return reinterpret_cast<HaloRing*>(reinterpret_cast<char*>(shared) + layout.rings + (2 * b + (up ? 0 : 1)) * layout.ringStride);
+    }
+
+    float* gatherBuffer(SharedState* shared, const SharedLayout& layout)
+    {
+        return reinterpret_cast<float*>(reinterpret_cast<char*>(shared) + layout.gather);
+    }
+
+    // Spring material table published by the coordinator at every step.
+    SpringMaterial* materialTable(SharedState* shared, const SharedLayout& layout)
+    {
+        return reinterpret_cast<SpringMaterial*>(reinterpret_cast<char*>(shared) + layout.materials);
+    }
+}
+
+const int DomainDecomposition::kHaloRows;
+constexpr float DomainDecomposition::kWorkerTimeout;
+
+DomainDecomposition::DomainDecomposition(Cloth* _cloth, Integrator* _integrator, int _numTiles) :
+    m_cloth(_cloth), m_integrator(_integrator), m_numTiles(_numTiles),
+    m_shared(nullptr), m_sharedSize(0), m_step(0)
+{
+    assert(m_cloth != nullptr && m_integrator != nullptr);
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+    stop();
+}
+
+bool DomainDecomposition::start()
+{
+    stop();
+
+    const int nx = m_cloth->getWidth();
+    const int ny = m_cloth->getHeight();
+    const int numParticles = m_cloth->getParticles().size();
+    if (nx * ny != numParticles || ny < kHaloRows)
+    {
+        std::cerr << "DomainDecomposition: the cloth is not a grid." << std::endl;
+        return false;
+    }
+    if (m_cloth->getMembrane())
+    {
+        std::cerr << "DomainDecomposition: membrane elements are not supported." << std::endl;
+        return false;
+    }
+
+    // Every tile must be at least as tall as the halo so that halo rows
+    // always come from the immediate neighbors.
+    m_numTiles = std::max(1, std::min(m_numTiles, ny / kHaloRows));
+    m_rowStart.resize(m_numTiles + 1);
+    for (int t = 0; t <= m_numTiles; ++t)
+    {
+        m_rowStart[t] = (t * ny) / m_numTiles;
+    }
+
+    const SharedLayout layout(m_numTiles, nx, numParticles, m_cloth->getMaterials().size());
+    void* mapping = mmap(nullptr, layout.total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        perror("DomainDecomposition: mmap");
+        return false;
+    }
+    m_sharedSize = layout.total;
+    m_shared = new (mapping) SharedState;
+    m_shared->targetStep.store(0);
+    m_shared->quit.store(0);
+    m_shared->dt = 0.0f;
+    m_shared->numMaterials = m_cloth->getMaterials().size();
+    m_shared->maxStrain = 0.0f;
+    m_shared->strainIterations = StrainLimiter::kDefaultIterations;
+    m_shared->strainMaterials = ~0u;
+    std::copy(m_cloth->getMaterials().begin(), m_cloth->getMaterials().end(), materialTable(m_shared, layout));
+    for (int t = 0; t < m_numTiles; ++t)
+    {
+        new (counterAt(m_shared, layout, t)) Counter;
+        counterAt(m_shared, layout, t)->value.store(0);
+    }
+    for (int b = 0; b < m_numTiles - 1; ++b)
+    {
+        for (bool up : { true, false })
+        {
+            HaloRing* ring = new (ringAt(m_shared, layout, b, up)) HaloRing;
+            ring->head.store(0);
+            ring->tail.store(0);
+        }
+    }
+    m_step = 0;
+
+    // Avoid duplicating pending output in the children.
+    fflush(stdout);
+    std::cout.flush();
+
+    for (int t = 0; t < m_numTiles; ++t)
+    {
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("DomainDecomposition: fork");
+            stop();
+            return false;
+        }
+        if (pid == 0)
+        {
+            runWorker(t);
+            _exit(0);
+        }
+        m_workers.push_back(pid);
+    }
+
+    return true;
+}
+
+void DomainDecomposition::stop()
+{
+    if (m_shared == nullptr)
+        return;
+
+    m_shared->quit.store(1, std::memory_order_release);
+    for (pid_t pid : m_workers)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+    m_workers.clear();
+
+    munmap(m_shared, m_sharedSize);
+    m_shared = nullptr;
+    m_sharedSize = 0;
+}
+
+bool DomainDecomposition::step(float dt)
+{
+    if (!isRunning())
+        return false;
+
+    const auto& materials = m_cloth->getMaterials();
+    const SharedLayout layout(m_numTiles, m_cloth->getWidth(), m_cloth->getParticles().size(), m_shared->numMaterials);
+    assert(materials.size() == m_shared->numMaterials);
+
+    // The material table is small, so it is sent with every step rather than
+    // restarting the workers when a stiffness or damping changes.
+    std::copy(materials.begin(), materials.end(), materialTable(m_shared, layout));
+    const StrainLimiter* limiter = m_cloth->getStrainLimiter();
+    m_shared->maxStrain = limiter->getMaxStrain();
+    m_shared->strainIterations = limiter->getMaxIterations();
+    m_shared->strainMaterials = limiter->getMaterials();
+    m_shared->dt = dt;
+    m_shared->targetStep.store(++m_step, std::memory_order_release);
+
+    // Reports false if any worker died or the step takes longer than
+    // kWorkerTimeout, to avoid waiting forever.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(kWorkerTimeout);
+    bool timedOut = false;
+    auto workersAlive = [&]()
+    {
+        for (pid_t pid : m_workers)
+        {
+            if (waitpid(pid, nullptr, WNOHANG) != 0)
+                return false;
+        }
+        timedOut = std::chrono::steady_clock::now() > deadline;
+        return !timedOut;
+    };
+
+    for (int t = 0; t < m_numTiles; ++t)
+    {
+        Counter* completed = counterAt(m_shared, layout, t);
+        const bool ok = waitUntil([&]() { return completed->value.load(std::memory_order_acquire) >= m_step; }, workersAlive);
+        if (!ok)
+        {
+            if (timedOut)
+                std::cerr << "DomainDecomposition: tile " << t << " did not complete step " << m_step << " within " << kWorkerTimeout << " s." << std::endl;
+            else
+                std::cerr << "DomainDecomposition: a worker process terminated unexpectedly." << std::endl;
+            for (pid_t pid : m_workers)
+            {
+                kill(pid, SIGTERM);
+            }
+            stop();
+            return false;
+        }
+    }
+
+    // Gather the owned particle states of every tile.
+    const float* src = gatherBuffer(m_shared, layout);
+    for (Particle* p : m_cloth->getParticles())
+    {
+        p->x = Eigen::Map<const Eigen::Vector3f>(src + 6 * p->index);
+        p->v = Eigen::Map<const Eigen::Vector3f>(src + 6 * p->index + 3);
+    }
+    return true;
+}
+
+void DomainDecomposition::runWorker(int tile)
+{
+#ifdef _OPENMP
+    // The OpenMP thread pool of the parent is not carried over by fork(), and
+    // libgomp may block in the first parallel region of the child.  Workers
+    // run the force, solver and limiter loops on their own thread.
+    omp_set_num_threads(1);
+#endif
+
+    const pid_t parent = getppid();
+    const int nx = m_cloth->getWidth();
+    const int ny = m_cloth->getHeight();
+    const SharedLayout layout(m_numTiles, nx, m_cloth->getParticles().size(), m_shared->numMaterials);
+
+    const int ownBegin = m_rowStart[tile];
+    const int ownEnd = m_rowStart[tile + 1];
+    const int haloBegin = std::max(0, ownBegin - kHaloRows);
+    const int haloEnd = std::min(ny, ownEnd + kHaloRows);
+
+    Cloth* local = createLocalCloth(m_cloth, haloBegin, haloEnd, ownBegin, ownEnd);
+
+    HaloRing* sendDown = tile > 0 ? ringAt(m_shared, layout, tile - 1, false) : nullptr;
+    HaloRing* recvDown = tile > 0 ? ringAt(m_shared, layout, tile - 1, true) : nullptr;
+    HaloRing* sendUp = tile < m_numTiles - 1 ? ringAt(m_shared, layout, tile, true) : nullptr;
+    HaloRing* recvUp = tile < m_numTiles - 1 ? ringAt(m_shared, layout, tile, false) : nullptr;
+
+    Counter* completed = counterAt(m_shared, layout, tile);
+    float* gather = gatherBuffer(m_shared, layout);
+
+    auto parentAlive = [parent]() { return getppid() == parent; };
+
+    auto send = [&](HaloRing* ring, int row0)
+    {
+        const unsigned long long head = ring->head.load(std::memory_order_relaxed);
+        if (!waitUntil([&]() { return head - ring->tail.load(std::memory_order_acquire) < kRingSlots; }, parentAlive))
+            _exit(1);
+        packRows(local, row0 - haloBegin, kHaloRows, ring->slot(head, layout.slotFloats));
+        ring->head.store(head + 1, std::memory_order_release);
+    };
+
+    auto receive = [&](HaloRing* ring, int row0)
+    {
+        const unsigned long long tail = ring->tail.load(std::memory_order_relaxed);
+        if (!waitUntil([&]() { return ring->head.load(std::memory_order_acquire) > tail; }, parentAlive))
+            _exit(1);
+        unpackRows(local, row0 - haloBegin, kHaloRows, ring->slot(tail, layout.slotFloats));
+        ring->tail.store(tail + 1, std::memory_order_release);
+    };
+
+    unsigned long long step = 0;
+    while (true)
+    {
+        const bool alive = waitUntil([&]()
+            {
+                return m_shared->quit.load(std::memory_order_acquire) != 0 ||
+                       m_shared->targetStep.load(std::memory_order_acquire) > step;
+            }, parentAlive);
+
+        if (!alive || m_shared->quit.load(std::memory_order_acquire) != 0)
+            break;
+
+        const float dt = m_shared->dt;
+        const SpringMaterial* materials = materialTable(m_shared, layout);
+        std::copy(materials, materials + local->getMaterials().size(), local->getMaterials().begin());
+        for (SpringMaterial& material : local->getMaterials())
+        {
+            material.tearStrain = 0.0f;
+        }
+
+        // Halo exchange: publish the boundary rows, then read the neighbors'.
+        if (sendDown) send(sendDown, ownBegin);
+        if (sendUp) send(sendUp, ownEnd - kHaloRows);
+        if (recvDown) receive(recvDown, ownBegin - kHaloRows);
+        if (recvUp) receive(recvUp, ownEnd);
+
+        local->computeForces();
+        m_integrator->step(local, dt);
+
+        if (m_shared->maxStrain > 0.0f)
+        {
+            StrainLimiter* limiter = local->getStrainLimiter();
+            limiter->setMaxStrain(m_shared->maxStrain);
+            limiter->setMaxIterations(m_shared->strainIterations);
+            if (limiter->getMaterials() != m_shared->strainMaterials)
+                limiter->setMaterials(m_shared->strainMaterials);
+            local->limitStrain(dt);
+        }
+
+        packRows(local, ownBegin - haloBegin, ownEnd - ownBegin, gather + 6 * (size_t)ownBegin * nx);
+        completed->value.store(++step, std::memory_order_release);
+    }
+
+    delete local;
+}
+
+#else
+
+// Process-based decomposition relies on fork() and shared anonymous mappings.
+//
+struct SharedState { };
+
+DomainDecomposition::DomainDecomposition(Cloth* _cloth, Integrator* _integrator, int _numTiles) :
+    m_cloth(_cloth), m_integrator(_integrator), m_numTiles(_numTiles),
+    m_shared(nullptr), m_sharedSize(0), m_step(0)
+{
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+}
+
+bool DomainDecomposition::start()
+{
+    std::cerr << "DomainDecomposition: worker processes are not supported on this platform." << std::endl;
+    return false;
+}
+
+void DomainDecomposition::stop()
+{
+}
+
+bool DomainDecomposition::step(float dt)
+{
+    return false;
+}
+
+void DomainDecomposition::runWorker(int tile)
+{
+}
+
+#endif
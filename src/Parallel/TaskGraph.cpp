@@ -0,0 +1,115 @@
+#include "Parallel/TaskGraph.h"
+
+#include <algorithm>
+#include <cassert>
+
+TaskGraph::TaskGraph(int numThreads) : m_numDone(0), m_stop(false)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 1; i < numThreads; ++i)
+    {
+        m_workers.emplace_back(&TaskGraph::workerLoop, this);
+    }
+}
+
+TaskGraph::~TaskGraph()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+int TaskGraph::addTask(std::function<void()> work)
+{
+    m_tasks.push_back({ std::move(work), std::vector<int>(), 0, 0 });
+    return m_tasks.size() - 1;
+}
+
+void TaskGraph::addDependency(int before, int after)
+{
+    assert(before >= 0 && before < (int)m_tasks.size());
+    assert(after >= 0 && after < (int)m_tasks.size() && after != before);
+    m_tasks[before].successors.push_back(after);
+    ++m_tasks[after].numPredecessors;
+}
+
+void TaskGraph::clear()
+{
+    m_tasks.clear();
+}
+
+void TaskGraph::run()
+{
+    const int numTasks = m_tasks.size();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_numDone = 0;
+    m_ready.clear();
+    for (int t = 0; t < numTasks; ++t)
+    {
+        m_tasks[t].remaining = m_tasks[t].numPredecessors;
+        if (m_tasks[t].remaining == 0) m_ready.push_back(t);
+    }
+    // Pop from the back, so the first tasks added start first.
+    std::reverse(m_ready.begin(), m_ready.end());
+    m_wakeUp.notify_all();
+
+    while (m_numDone < numTasks)
+    {
+        if (m_ready.empty())
+        {
+            m_wakeUp.wait(lock);
+            continue;
+        }
+        const int t = m_ready.back();
+        m_ready.pop_back();
+        lock.unlock();
+        execute(t);
+        lock.lock();
+    }
+}
+
+void TaskGraph::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeUp.wait(lock, [this] { return m_stop || !m_ready.empty(); });
+        if (m_stop)
+            return;
+
+        const int t = m_ready.back();
+        m_ready.pop_back();
+        lock.unlock();
+        execute(t);
+        lock.lock();
+    }
+}
+
+void TaskGraph::execute(int t)
+{
+    m_tasks[t].work();
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int s : m_tasks[t].successors)
+        {
+            if (--m_tasks[s].remaining == 0)
+            {
+                m_ready.push_back(s);
+                wake = true;
+            }
+        }
+        wake |= (++m_numDone == (int)m_tasks.size());
+    }
+    if (wake) m_wakeUp.notify_all();
+}
@@ -1,26 +1,301 @@
 #include "ParticleSystem.h"
 #include "Eigen/src/Core/Matrix.h"
+#include "Forces/ForceField.h"
+#include "Forces/TriangleMembrane.h"
+#include "Profiling/Profiler.h"
+#include "Integrators/StrainLimiter.h"
+#include "Solvers/MatrixFreePGS.h"
+
+#include <algorithm>
+
+namespace {
+    // Particle count below which the particle loop is not worth running in parallel.
+    const int kMinParallelParticles = 4096;
+
+    // Add the forces of @a fields on the particles of @a triangle and return their power.
+    double addTriangleForces(const std::vector<ForceField *> &fields, const std::vector<Particle *> &particles, const std::array<int, 3> &triangle) {
+        const Particle *const p[3] = { particles[triangle[0]], particles[triangle[1]], particles[triangle[2]] };
+        Eigen::Vector3f f[3] = { Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero() };
+        for (const ForceField *field : fields) {
+            field->addTriangleForces(p, f);
+        }
+
+        double power = 0.0;
+        for (int c = 0; c < 3; ++c) {
+            if (!p[c]->fixed) {
+                particles[triangle[c]]->f += f[c];
+                power += f[c].dot(p[c]->v);
+            }
+        }
+        return power;
+    }
+}
 
 void ParticleSystem::addParticle(Particle *_particle) {
     m_particles.push_back(_particle);
 }
 
 void ParticleSystem::addSpring(Spring *_spring) {
+    assert(_spring->material >= 0 && _spring->material < m_materials.size());
+    _spring->index = m_springs.size();
     m_springs.push_back(_spring);
 }
 
+void ParticleSystem::removeSpring(Spring *_spring) {
+    assert(m_springs[_spring->index] == _spring);
+    Spring *last = m_springs.back();
+    m_springs[_spring->index] = last;
+    last->index = _spring->index;
+    m_springs.pop_back();
+    releaseSpring(_spring);
+}
+
+void ParticleSystem::releaseSpring(Spring *_spring) {
+    // The particles lose a force that held them at rest.
+    wakeParticle(_spring->particles[0]->index);
+    wakeParticle(_spring->particles[1]->index);
+
+    // Swap the spring with the last entry of each particle spring list.
+    for (int side = 0; side < 2; ++side) {
+        auto &springs = _spring->particles[side]->springs;
+        const int slot = _spring->slots[side];
+        const std::pair<Spring *, int> last = springs.back();
+        springs[slot] = last;
+        last.first->slots[last.second] = slot;
+        springs.pop_back();
+    }
+    delete _spring;
+    ++m_topologyVersion;
+}
+
+int ParticleSystem::tearSprings() {
+    PROFILE_SCOPE("tearSprings");
+    const int numTorn = m_tearCandidates.size();
+    for (Spring *spring : m_tearCandidates) {
+        removeSpring(spring);
+    }
+    m_tearCandidates.clear();
+    return numTorn;
+}
+
+size_t ParticleSystem::getMemoryUsage() const {
+    size_t bytes = m_particles.capacity() * sizeof(Particle *) + m_particles.size() * sizeof(Particle);
+    for (const Particle *p : m_particles) {
+        bytes += p->springs.capacity() * sizeof(std::pair<Spring *, int>);
+    }
+    bytes += m_springs.capacity() * sizeof(Spring *) + m_springs.size() * sizeof(Spring);
+    bytes += m_materials.capacity() * sizeof(SpringMaterial) + m_tearCandidates.capacity() * sizeof(Spring *);
+    if (m_membrane) bytes += sizeof(TriangleMembrane) + m_membrane->getMemoryUsage();
+    if (m_solver) bytes += sizeof(MatrixFreePGS) + m_solver->getMemoryUsage();
+    if (m_strainLimiter) bytes += sizeof(StrainLimiter) + m_strainLimiter->getMemoryUsage();
+    return bytes;
+}
+
+void ParticleSystem::addForceField(ForceField *_field) {
+    assert(std::find(m_forceFields.begin(), m_forceFields.end(), _field) == m_forceFields.end());
+    m_forceFields.push_back(_field);
+    if (_field->getInputs() & kParticleInputs) m_particleFields.push_back(_field);
+    if (_field->getInputs() & kTriangleInputs) m_triangleFields.push_back(_field);
+    if (_field->hasJacobian()) m_jacobianFields.push_back(_field);
+}
+
+void ParticleSystem::removeForceField(ForceField *_field) {
+    for (std::vector<ForceField *> *fields : { &m_forceFields, &m_particleFields, &m_triangleFields, &m_jacobianFields }) {
+        fields->erase(std::remove(fields->begin(), fields->end(), _field), fields->end());
+    }
+}
+
+ParticleSystem::~ParticleSystem() {
+    clear();
+    delete m_solver;
+    delete m_strainLimiter;
+}
+
+void ParticleSystem::setMembrane(TriangleMembrane *_membrane) {
+    if (_membrane == m_membrane)
+        return;
+    delete m_membrane;
+    m_membrane = _membrane;
+}
+
+MatrixFreePGS *ParticleSystem::getSolver() {
+    if (!m_solver) m_solver = new MatrixFreePGS(this);
+    return m_solver;
+}
+
+StrainLimiter *ParticleSystem::getStrainLimiter() {
+    if (!m_strainLimiter) m_strainLimiter = new StrainLimiter(this);
+    return m_strainLimiter;
+}
+
+float ParticleSystem::limitStrain(float dt) {
+    if (!m_strainLimiter)
+        return 0.0f;
+    m_strainLimiter->apply(dt);
+    return m_strainLimiter->getWork();
+}
+
+void ParticleSystem::setSleeping(bool _sleeping) {
+    m_sleeping = _sleeping;
+    m_regionAsleep.clear();
+    m_regionCalmSteps.clear();
+    m_activeSprings.clear();
+    m_sleepDirty = true;
+}
+
+void ParticleSystem::wakeParticle(int _index) {
+    const int region = _index / kSleepRegionSize;
+    if (region >= (int)m_regionAsleep.size())
+        return;
+    if (m_regionAsleep[region]) {
+        m_regionAsleep[region] = 0;
+        m_sleepDirty = true;
+    }
+    m_regionCalmSteps[region] = 0;
+}
+
+void ParticleSystem::wakeAll() {
+    std::fill(m_regionAsleep.begin(), m_regionAsleep.end(), 0);
+    std::fill(m_regionCalmSteps.begin(), m_regionCalmSteps.end(), 0);
+    m_sleepDirty = true;
+}
+
+int ParticleSystem::getNumSleepingRegions() const {
+    return std::count(m_regionAsleep.begin(), m_regionAsleep.end(), 1);
+}
+
+void ParticleSystem::updateActiveSprings() {
+    PROFILE_SCOPE("updateActiveSprings");
+    const int numRegions = getNumRegions();
+    if ((int)m_regionAsleep.size() != numRegions) {
+        m_regionAsleep.assign(numRegions, 0);
+        m_regionCalmSteps.assign(numRegions, 0);
+    }
+    m_wakeRequests.assign(numRegions, 0);
+
+    // Springs between two sleeping particles keep the energy they had when
+    // their regions fell asleep.
+    m_activeSprings.clear();
+    m_sleepingElasticEnergy = 0.0;
+    for (Spring *s : m_springs) {
+        if (!isAsleep(s->particles[0]->index) || !isAsleep(s->particles[1]->index)) {
+            m_activeSprings.push_back(s);
+        } else {
+            const float stretch = (s->particles[1]->x - s->particles[0]->x).norm() - s->r;
+            m_sleepingElasticEnergy += 0.5f * m_materials[s->material].k * stretch * stretch;
+        }
+    }
+
+    const Eigen::Vector3f g(0, -9.81f, 0);
+    m_sleepingGravityEnergy = 0.0;
+    m_sleepingFieldEnergy = 0.0;
+    for (int i = 0; i < (int)m_particles.size(); ++i) {
+        const Particle *p = m_particles[i];
+        if (!isAsleep(i) || p->fixed)
+            continue;
+        m_sleepingGravityEnergy -= p->m * g.dot(p->x);
+        for (const ForceField *field : m_particleFields) {
+            if (field->isConservative()) m_sleepingFieldEnergy += field->getParticleEnergy(*p);
+        }
+    }
+
+    m_activeTopologyVersion = m_topologyVersion;
+    m_sleepDirty = false;
+}
+
+void ParticleSystem::updateSleeping() {
+    PROFILE_SCOPE("updateSleeping");
+    const int numParticles = m_particles.size();
+    const float velocity2 = m_sleepVelocity * m_sleepVelocity;
+    const float acceleration2 = m_sleepAcceleration * m_sleepAcceleration;
+    for (int r = 0; r < (int)m_regionAsleep.size(); ++r) {
+        const int first = r * kSleepRegionSize;
+        const int last = std::min(numParticles, first + kSleepRegionSize);
+        if (m_regionAsleep[r]) {
+            if (m_wakeRequests[r]) {
+                m_regionAsleep[r] = 0;
+                m_regionCalmSteps[r] = 0;
+                m_sleepDirty = true;
+            }
+            continue;
+        }
+
+        bool calm = true;
+        for (int i = first; i < last && calm; ++i) {
+            const Particle *p = m_particles[i];
+            calm = p->fixed || (p->v.squaredNorm() <= velocity2 && p->f.squaredNorm() <= acceleration2 * p->m * p->m);
+        }
+        if (!calm) {
+            m_regionCalmSteps[r] = 0;
+        } else if (++m_regionCalmSteps[r] >= kSleepSteps) {
+            for (int i = first; i < last; ++i) {
+                m_particles[i]->v.setZero();
+                m_particles[i]->f.setZero();
+            }
+            m_regionAsleep[r] = 1;
+            m_sleepDirty = true;
+        }
+    }
+    std::fill(m_wakeRequests.begin(), m_wakeRequests.end(), 0);
+}
+
+const std::vector<std::array<int, 3>> &ParticleSystem::getTriangles() const {
+    static const std::vector<std::array<int, 3>> none;
+    return none;
+}
+
+int ParticleSystem::addMaterial(const SpringMaterial &_material) {
+    m_materials.push_back(_material);
+    return m_materials.size() - 1;
+}
+
 // Compute forces for each particle p and accumulate the net force in p.f
 // Note: force should not be applied to fixed particles.
 //
 void ParticleSystem::computeForces() {
+    PROFILE_SCOPE("computeForces");
 
     const int numParticles = m_particles.size();
+    if (m_sleeping && (m_sleepDirty || m_activeTopologyVersion != m_topologyVersion || (int)m_regionAsleep.size() != getNumRegions()))
+        updateActiveSprings();
+
     // TODO Initialize and compute the gravity acting on each particle. -> Done
     Eigen::Vector3f g(0, -9.81, 0);
 
+    const bool jacobians = !m_jacobianFields.empty();
+    m_fieldDfdx.resize(jacobians ? numParticles : 0);
+    m_fieldDfdv.resize(jacobians ? numParticles : 0);
+
+    // Gravity and the particle force fields.
+    double kineticEnergy = 0.0;
+    double gravityEnergy = 0.0;
+    double fieldEnergy = 0.0;
+    double externalPower = 0.0;
+    #pragma omp parallel for reduction(+ : kineticEnergy, gravityEnergy, fieldEnergy, externalPower) if (numParticles >= kMinParallelParticles)
     for (int i = 0; i < numParticles; i++) {
-        if (!m_particles[i]->fixed) {
-            m_particles[i]->f = g * m_particles[i]->m; // gravity
+        Particle *p = m_particles[i];
+        if (jacobians) {
+            m_fieldDfdx[i].setZero();
+            m_fieldDfdv[i].setZero();
+        }
+        if (isAsleep(i) || p->fixed)
+            continue;
+
+        p->f = g * p->m; // gravity
+        kineticEnergy += 0.5f * p->m * p->v.squaredNorm();
+        gravityEnergy -= p->m * g.dot(p->x);
+
+        for (const ForceField *field : m_particleFields) {
+            Eigen::Vector3f f = Eigen::Vector3f::Zero();
+            field->addParticleForce(*p, f);
+            p->f += f;
+            if (field->isConservative())
+                fieldEnergy += field->getParticleEnergy(*p);
+            else
+                externalPower += f.dot(p->v);
+        }
+        for (const ForceField *field : m_jacobianFields) {
+            field->addParticleJacobian(*p, m_fieldDfdx[i], m_fieldDfdv[i]);
         }
     }
 
@@ -28,25 +303,74 @@ void ParticleSystem::computeForces() {
     //      Recall that the force acting on particle with index0 is equal and
     //      opposite the force acting on index1.
     //
-    const int numSprings = m_springs.size();
+    // Springs between sleeping particles are skipped.
+    const std::vector<Spring *> &springs = m_sleeping ? m_activeSprings : m_springs;
+    const int numSprings = springs.size();
+    m_tearCandidates.clear();
+    double elasticEnergy = 0.0;
+
+    // The triangles are visited with the springs, before the first spring
+    // whose first particle follows theirs.  When both are sorted by particle
+    // (see Cloth::reorder()) the particles of a triangle are still in cache.
+    const std::vector<std::array<int, 3>> &triangles = getTriangles();
+    const int numTriangles = m_triangleFields.empty() ? 0 : triangles.size();
+    int t = 0;
 
     for (int i = 0; i < numSprings; i++) {
-        Spring *currentSpring = m_springs[i];
+        Spring *currentSpring = springs[i];
+        const SpringMaterial &material = m_materials[currentSpring->material];
 
         Particle *part0 = currentSpring->particles[0];
         Particle *part1 = currentSpring->particles[1];
 
+        for (; t < numTriangles && triangles[t][0] <= part0->index; ++t) {
+            externalPower += addTriangleForces(m_triangleFields, m_particles, triangles[t]);
+        }
+
         Eigen::Vector3f delta = part1->x - part0->x; // vector from part0 to part1
         float length = delta.norm();
         Eigen::Vector3f deltaNorm = delta.normalized(); // normalized delta vec
         float projectedVel =
         (part1->v - part0->v).dot(deltaNorm); // for damping : project the velocities onto the delta vector
 
-        Eigen::Vector3f f = (currentSpring->k * (length - currentSpring->r) + currentSpring->b * (projectedVel)) * deltaNorm;
+        Eigen::Vector3f f = (material.k * (length - currentSpring->r) + material.b * (projectedVel)) * deltaNorm;
+
+        const bool asleep0 = isAsleep(part0->index);
+        const bool asleep1 = isAsleep(part1->index);
+        if (!part0->fixed && !asleep0) part0->f += f;
+        if (!part1->fixed && !asleep1) part1->f -= f;
+        if (asleep0 != asleep1) {
+            // A moving neighbor pulls on a sleeping region.  Twice the sleep
+            // velocity keeps a region from waking right after it fell asleep.
+            const Particle *mover = asleep0 ? part1 : part0;
+            if (mover->v.squaredNorm() > 4.0f * m_sleepVelocity * m_sleepVelocity)
+                m_wakeRequests[(asleep0 ? part0 : part1)->index / kSleepRegionSize] = 1;
+        }
+        elasticEnergy += 0.5f * material.k * (length - currentSpring->r) * (length - currentSpring->r);
+
+        if (material.tearStrain > 0.0f && length > (1.0f + material.tearStrain) * currentSpring->r) {
+            m_tearCandidates.push_back(currentSpring);
+        }
+    }
 
-        if (!part0->fixed) part0->f += f;
-        if (!part1->fixed) part1->f -= f;
+    for (; t < numTriangles; ++t) {
+        externalPower += addTriangleForces(m_triangleFields, m_particles, triangles[t]);
     }
+
+    if (m_membrane) elasticEnergy += m_membrane->addForces(m_particles);
+
+    if (m_sleeping) {
+        elasticEnergy += m_sleepingElasticEnergy;
+        gravityEnergy += m_sleepingGravityEnergy;
+        fieldEnergy += m_sleepingFieldEnergy;
+        updateSleeping();
+    }
+
+    m_kineticEnergy = (float)kineticEnergy;
+    m_elasticEnergy = (float)elasticEnergy;
+    m_gravityEnergy = (float)gravityEnergy;
+    m_fieldEnergy = (float)fieldEnergy;
+    m_externalPower = (float)externalPower;
 }
 
 // TODO Computes the derivative of the state vector and returns in @a dqdt.
@@ -61,7 +385,7 @@ void ParticleSystem::derivs(Eigen::VectorXf &dqdt) {
 
     // Loop over all particles and compute dqdt.
     for (int i = 0; i < numParticles; i++) {
-        if (m_particles[i]->fixed) {
+        if (m_particles[i]->fixed || isAsleep(i)) {
             dqdt.segment(6 * i, 6).setZero();
         } else {
             dqdt.segment(6 * i, 3) = m_particles[i]->v;
@@ -108,19 +432,4 @@ void ParticleSystem::setState(const Eigen::VectorXf &q) {
             m_particles[i]->v = q.segment(6 * i + 3, 3);
         }
     }
-}
-
-// Construct the dfdx matrices per spring
-void ParticleSystem::dfdx() {
-    // TODO Compute the dfdx matrix for the springs (see slides)
-    //
-    for (Spring *spring : m_springs) {
-        float length = (spring->particles[1]->x - spring->particles[0]->x).norm();
-        if (length < 1e-6f) length = 1e-6f;
-
-        Eigen::Matrix<float, 3, 3> alpha = spring->k * (1 - spring->r / length) * Eigen::Matrix<float, 3, 3>::Identity();
-
-        Eigen::Matrix<float, 3, 3> dfdx = -alpha - spring->k * (spring->r / length) * (((spring->particles[1]->x - spring->particles[0]->x) / length) * ((spring->particles[1]->x - spring->particles[0]->x).transpose() / length));
-        spring->dfdx = dfdx;
-    }
 }
\ No newline at end of file
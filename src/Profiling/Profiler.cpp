@@ -0,0 +1,170 @@
+#include "Profiling/Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+const int ProfilePhase::kHistory;
+const int ProfilePhase::kHistogramBins;
+const int Profiler::kMaxPhases;
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() :
+    m_epoch(std::chrono::steady_clock::now()), m_numPhases(0), m_historyIndex(0), m_frameIndex(0),
+    m_tracing(false), m_captureFirst(0), m_captureFrames(0)
+{
+    for (int p = 0; p < kMaxPhases; ++p)
+    {
+        m_frameTime[p] = 0;
+        m_frameCalls[p] = 0;
+    }
+}
+
+int Profiler::registerPhase(const char* name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const int numPhases = m_numPhases.load();
+    for (int p = 0; p < numPhases; ++p)
+    {
+        if (m_phases[p].name == name)
+            return p;
+    }
+    if (numPhases == kMaxPhases)
+    {
+        std::cerr << "Profiler: too many phases, " << name << " is merged into " << m_phases[kMaxPhases - 1].name << std::endl;
+        return kMaxPhases - 1;
+    }
+
+    ProfilePhase& phase = m_phases[numPhases];
+    phase.name = name;
+    std::fill(phase.history, phase.history + ProfilePhase::kHistory, 0.0f);
+    std::fill(phase.histogram, phase.histogram + ProfilePhase::kHistogramBins, 0.0f);
+    phase.average = phase.maximum = 0.0f;
+    phase.calls = 0;
+    m_numPhases.store(numPhases + 1);
+    return numPhases;
+}
+
+void Profiler::addSample(int phase, int64_t start, int64_t duration)
+{
+    m_frameTime[phase].fetch_add(duration, std::memory_order_relaxed);
+    m_frameCalls[phase].fetch_add(1, std::memory_order_relaxed);
+
+    if (m_tracing.load(std::memory_order_relaxed))
+    {
+        static std::atomic<int> nextThread(0);
+        thread_local const int thread = nextThread++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.push_back({ phase, thread, start, duration });
+    }
+}
+
+void Profiler::endFrame()
+{
+    const int numPhases = m_numPhases.load();
+    for (int p = 0; p < numPhases; ++p)
+    {
+        ProfilePhase& phase = m_phases[p];
+        const int64_t ns = m_frameTime[p].exchange(0, std::memory_order_relaxed);
+        phase.calls = m_frameCalls[p].exchange(0, std::memory_order_relaxed);
+        phase.history[m_historyIndex] = 1e-6f * ns;
+
+        float sum = 0.0f;
+        phase.maximum = 0.0f;
+        for (int k = 0; k < ProfilePhase::kHistory; ++k)
+        {
+            sum += phase.history[k];
+            phase.maximum = std::max(phase.maximum, phase.history[k]);
+        }
+        phase.average = sum / ProfilePhase::kHistory;
+
+        if (phase.calls > 0)
+        {
+            int bin = 0;
+            for (int64_t us = ns / 1000; us > 1 && bin < ProfilePhase::kHistogramBins - 1; us >>= 1)
+                ++bin;
+            phase.histogram[bin] += 1.0f;
+        }
+    }
+    m_historyIndex = (m_historyIndex + 1) % ProfilePhase::kHistory;
+
+    // Frame m_frameIndex is over; decide whether the next one is traced.
+    ++m_frameIndex;
+    if (m_captureFrames > 0)
+    {
+        if (m_frameIndex >= m_captureFirst + m_captureFrames)
+        {
+            m_tracing = false;
+            writeTrace();
+            m_captureFrames = 0;
+        }
+        else
+        {
+            m_tracing = m_frameIndex >= m_captureFirst;
+        }
+    }
+}
+
+void Profiler::requestCapture(uint64_t firstFrame, int numFrames, const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_captureFirst = std::max(firstFrame, m_frameIndex);
+    m_captureFrames = std::max(1, numFrames);
+    m_traceFilename = filename;
+    m_tracing = m_frameIndex >= m_captureFirst;
+}
+
+void Profiler::writeTrace()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::ofstream file(m_traceFilename);
+    if (!file)
+    {
+        std::cerr << "Profiler: unable to write " << m_traceFilename << std::endl;
+        m_events.clear();
+        return;
+    }
+
+    // Trace event format: complete events ("ph":"X") with microsecond times.
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (size_t k = 0; k < m_events.size(); ++k)
+    {
+        const TraceEvent& e = m_events[k];
+        file << (k ? ",\n" : "\n") << "{\"name\":\"" << m_phases[e.phase].name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+             << ",\"ts\":" << 1e-3 * e.start << ",\"dur\":" << 1e-3 * e.duration << "}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::cout << "Profiler: wrote " << m_events.size() << " events to " << m_traceFilename << std::endl;
+    m_events.clear();
+}
+
+void Profiler::resetHistograms()
+{
+    for (int p = 0; p < m_numPhases.load(); ++p)
+    {
+        std::fill(m_phases[p].histogram, m_phases[p].histogram + ProfilePhase::kHistogramBins, 0.0f);
+    }
+}
+
+void Profiler::setMemoryUsage(const std::string& subsystem, size_t bytes)
+{
+    for (auto& entry : m_memory)
+    {
+        if (entry.first == subsystem)
+        {
+            entry.second = bytes;
+            return;
+        }
+    }
+    m_memory.push_back({ subsystem, bytes });
+}
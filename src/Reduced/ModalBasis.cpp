@@ -0,0 +1,359 @@
+#include "Reduced/ModalBasis.h"
+
+#include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const char kMagic[8] = { 'C', 'L', 'T', 'H', 'M', 'O', 'D', 'E' };
+    const uint32_t kVersion = 1;
+    const uint32_t kByteOrder = 0x01020304;
+
+    // Subspace iterations before giving up, and relative change of the
+    // eigenvalues below which they have converged.
+    const int kMaxSubspaceIterations = 100;
+    const double kEigenvalueTolerance = 1e-6;
+
+    // Shift of the factorized matrix S + sigma M, relative to the mean
+    // diagonal of M^-1 S, which keeps it nonsingular when the particle system
+    // has free rigid motions.
+    const double kRelativeShift = 1e-4;
+
+    // Fixed-size header of a basis file, followed by the rest positions
+    // float[3n], eigenvalues float[K], modes float[3n K], rotation modes
+    // float[3n K] and uniform forces float[3K], in native byte order.
+    struct ModalBasisHeader
+    {
+        char magic[8];                  // "CLTHMODE"
+        uint32_t version;
+        uint32_t byteOrder;             // 0x01020304 written in native order
+        uint32_t numParticles, numModes;
+        uint64_t key;
+    };
+
+    // FNV-1a hash of @a size bytes at @a data, continuing from @a hash.
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    uint64_t hashValue(uint64_t hash, const T& value) { return hashBytes(hash, &value, sizeof(T)); }
+
+    bool readMatrix(std::ifstream& file, float* data, size_t count)
+    {
+        file.read(reinterpret_cast<char*>(data), count * sizeof(float));
+        return (size_t)file.gcount() == count * sizeof(float);
+    }
+
+    void writeMatrix(std::ofstream& file, const float* data, size_t count)
+    {
+        file.write(reinterpret_cast<const char*>(data), count * sizeof(float));
+    }
+}
+
+uint64_t ModalBasis::computeKey(const ParticleSystem* particleSystem)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const Particle* p : particleSystem->getParticles())
+    {
+        hash = hashBytes(hash, p->x.data(), 3 * sizeof(float));
+        hash = hashValue(hash, p->m);
+        hash = hashValue(hash, p->fixed);
+    }
+    for (const Spring* s : particleSystem->getSprings())
+    {
+        hash = hashValue(hash, s->particles[0]->index);
+        hash = hashValue(hash, s->particles[1]->index);
+        hash = hashValue(hash, s->material);
+        hash = hashValue(hash, s->r);
+    }
+    for (const SpringMaterial& material : particleSystem->getMaterials())
+    {
+        hash = hashValue(hash, material.k);
+    }
+    return hash;
+}
+
+ModalBasis* ModalBasis::compute(const ParticleSystem* particleSystem, int numModes)
+{
+    PROFILE_SCOPE("ModalBasis");
+    if (particleSystem->getMembrane())
+    {
+        std::cerr << "ModalBasis: membrane elements are not supported." << std::endl;
+        return nullptr;
+    }
+
+    // Free particles, 3 degrees of freedom each.
+    const std::vector<Particle*>& particles = particleSystem->getParticles();
+    const int n = particles.size();
+    std::vector<int> dof(n, -1);
+    int numDofs = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        if (!particles[i]->fixed)
+        {
+            dof[i] = numDofs;
+            numDofs += 3;
+        }
+    }
+    if (numModes < 1 || numModes > numDofs)
+    {
+        std::cerr << "ModalBasis: " << numModes << " modes requested for " << numDofs << " degrees of freedom." << std::endl;
+        return nullptr;
+    }
+
+    // Stiffness S = -dfdx of the springs, with the Jacobian of each spring
+    // alpha I - w w^T as in MatrixFreePGS::assemble(), and lumped masses.
+    // The geometric stiffness of compressed springs (alpha > 0) is dropped so
+    // that S is positive semidefinite: it would otherwise give modes of
+    // negative eigenvalue, buckling out of the rest state.
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(36 * particleSystem->getSprings().size());
+    const std::vector<SpringMaterial>& materials = particleSystem->getMaterials();
+    for (const Spring* s : particleSystem->getSprings())
+    {
+        const Eigen::Vector3d delta = (s->particles[1]->x - s->particles[0]->x).cast<double>();
+        const double length = std::max(delta.norm(), 1e-6);
+        const double k = materials[s->material].k;
+        const double alpha = std::min(0.0, -k * (1 - s->r / length));
+        const Eigen::Vector3d w = (std::sqrt(std::max(0.0, k * s->r / length)) / length) * delta;
+        const Eigen::Matrix3d K = alpha * Eigen::Matrix3d::Identity() - w * w.transpose();
+
+        const int d[2] = { dof[s->particles[0]->index], dof[s->particles[1]->index] };
+        for (int a = 0; a < 2; ++a)
+        {
+            for (int b = 0; b < 2; ++b)
+            {
+                if (d[a] < 0 || d[b] < 0)
+                    continue;
+                const double sign = (a == b) ? -1.0 : 1.0;
+                for (int r = 0; r < 3; ++r)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        triplets.emplace_back(d[a] + r, d[b] + c, sign * K(r, c));
+                    }
+                }
+            }
+        }
+    }
+    Eigen::SparseMatrix<double> S(numDofs, numDofs);
+    S.setFromTriplets(triplets.begin(), triplets.end());
+    Eigen::VectorXd mass(numDofs);
+    for (int i = 0; i < n; ++i)
+    {
+        if (dof[i] >= 0) mass.segment<3>(dof[i]).setConstant(particles[i]->m);
+    }
+
+    double meanRatio = 0.0;
+    for (int k = 0; k < numDofs; ++k)
+    {
+        meanRatio += S.coeff(k, k) / mass[k];
+    }
+    meanRatio /= numDofs;
+    const double sigma = kRelativeShift * std::max(meanRatio, 1.0);
+
+    Eigen::SparseMatrix<double> A = S;
+    for (int k = 0; k < numDofs; ++k)
+    {
+        A.coeffRef(k, k) += sigma * mass[k];
+    }
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt(A);
+    if (ldlt.info() != Eigen::Success)
+    {
+        std::cerr << "ModalBasis: the stiffness matrix could not be factorized." << std::endl;
+        return nullptr;
+    }
+
+    // Subspace iteration X <- (S + sigma M)^-1 M X, with Rayleigh-Ritz
+    // projections, on a few more vectors than modes for faster convergence.
+    const int p = std::min(numDofs, std::max(2 * numModes, numModes + 8));
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    Eigen::MatrixXd X(numDofs, p);
+    for (int c = 0; c < p; ++c)
+    {
+        for (int r = 0; r < numDofs; ++r)
+        {
+            X(r, c) = uniform(random);
+        }
+    }
+
+    Eigen::VectorXd eigenvalues = Eigen::VectorXd::Zero(p);
+    bool converged = false;
+    for (int iteration = 0; iteration < kMaxSubspaceIterations && !converged; ++iteration)
+    {
+        const Eigen::MatrixXd Y = ldlt.solve(mass.asDiagonal() * X);
+        const Eigen::MatrixXd SY = S * Y;
+        const Eigen::MatrixXd Sr = Y.transpose() * SY;
+        const Eigen::MatrixXd Mr = Y.transpose() * mass.asDiagonal() * Y;
+        Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> ritz(0.5 * (Sr + Sr.transpose()), 0.5 * (Mr + Mr.transpose()));
+        if (ritz.info() != Eigen::Success)
+        {
+            std::cerr << "ModalBasis: the subspace iteration broke down." << std::endl;
+            return nullptr;
+        }
+        X = Y * ritz.eigenvectors();
+
+        const Eigen::VectorXd previous = eigenvalues;
+        eigenvalues = ritz.eigenvalues();
+        converged = iteration > 0;
+        for (int k = 0; k < numModes; ++k)
+        {
+            converged &= std::abs(eigenvalues[k] - previous[k]) <= kEigenvalueTolerance * std::max(std::abs(eigenvalues[k]), sigma);
+        }
+    }
+    if (!converged)
+    {
+        std::cerr << "ModalBasis: the modes did not converge in " << kMaxSubspaceIterations << " iterations; using the last estimate." << std::endl;
+    }
+
+    ModalBasis* basis = new ModalBasis();
+    basis->m_key = computeKey(particleSystem);
+    basis->m_restPositions.resize(3 * n);
+    for (int i = 0; i < n; ++i)
+    {
+        basis->m_restPositions.segment<3>(3 * i) = particles[i]->x;
+    }
+    basis->m_eigenvalues = eigenvalues.head(numModes).cast<float>();
+    basis->m_modes = Eigen::MatrixXf::Zero(3 * n, numModes);
+    for (int i = 0; i < n; ++i)
+    {
+        if (dof[i] >= 0) basis->m_modes.middleRows<3>(3 * i) = X.block(dof[i], 0, 3, numModes).cast<float>();
+    }
+    basis->computeDerivedModes(particleSystem);
+    return basis;
+}
+
+void ModalBasis::computeDerivedModes(const ParticleSystem* particleSystem)
+{
+    const std::vector<Particle*>& particles = particleSystem->getParticles();
+    const int n = particles.size();
+    const int numModes = getNumModes();
+
+    // Least squares rotation vector of the springs of each particle:
+    // minimizes sum |w x d - (u_j - u_i)|^2 over the rest vectors d.
+    m_rotationModes = Eigen::MatrixXf::Zero(3 * n, numModes);
+    for (int i = 0; i < n; ++i)
+    {
+        const Particle* p = particles[i];
+        Eigen::Matrix3f A = Eigen::Matrix3f::Zero();
+        Eigen::MatrixXf B = Eigen::MatrixXf::Zero(3, numModes);
+        for (std::pair<Spring*, int> pair : p->springs)
+        {
+            const int j = pair.first->particles[(pair.second + 1) % 2]->index;
+            const Eigen::Vector3f d = m_restPositions.segment<3>(3 * j) - m_restPositions.segment<3>(3 * i);
+            Eigen::Matrix3f cross;
+            cross << 0.0f, -d.z(), d.y(),
+                     d.z(), 0.0f, -d.x(),
+                     -d.y(), d.x(), 0.0f;
+            A += d.squaredNorm() * Eigen::Matrix3f::Identity() - d * d.transpose();
+            B += cross * (m_modes.middleRows<3>(3 * j) - m_modes.middleRows<3>(3 * i));
+        }
+        if (!p->springs.empty())
+        {
+            m_rotationModes.middleRows<3>(3 * i) = A.ldlt().solve(B);
+        }
+    }
+
+    m_uniformForces = Eigen::MatrixXf::Zero(numModes, 3);
+    for (int i = 0; i < n; ++i)
+    {
+        m_uniformForces += particles[i]->m * m_modes.middleRows<3>(3 * i).transpose();
+    }
+}
+
+ModalBasis* ModalBasis::load(const std::string& filename, const ParticleSystem* particleSystem, int numModes)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return nullptr;
+
+    ModalBasisHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (file.gcount() != sizeof(header) || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.byteOrder != kByteOrder)
+    {
+        std::cerr << "ModalBasis: " << filename << " is not a modal basis file." << std::endl;
+        return nullptr;
+    }
+    if (header.numParticles != particleSystem->getParticles().size() || (int)header.numModes != numModes || header.key != computeKey(particleSystem))
+        return nullptr;
+
+    const int n = header.numParticles;
+    ModalBasis* basis = new ModalBasis();
+    basis->m_key = header.key;
+    basis->m_restPositions.resize(3 * n);
+    basis->m_eigenvalues.resize(numModes);
+    basis->m_modes.resize(3 * n, numModes);
+    basis->m_rotationModes.resize(3 * n, numModes);
+    basis->m_uniformForces.resize(numModes, 3);
+    if (!readMatrix(file, basis->m_restPositions.data(), basis->m_restPositions.size()) ||
+        !readMatrix(file, basis->m_eigenvalues.data(), basis->m_eigenvalues.size()) ||
+        !readMatrix(file, basis->m_modes.data(), basis->m_modes.size()) ||
+        !readMatrix(file, basis->m_rotationModes.data(), basis->m_rotationModes.size()) ||
+        !readMatrix(file, basis->m_uniformForces.data(), basis->m_uniformForces.size()))
+    {
+        std::cerr << "ModalBasis: " << filename << " is truncated." << std::endl;
+        delete basis;
+        return nullptr;
+    }
+    return basis;
+}
+
+ModalBasis* ModalBasis::loadOrCompute(const std::string& filename, const ParticleSystem* particleSystem, int numModes)
+{
+    if (ModalBasis* basis = load(filename, particleSystem, numModes))
+        return basis;
+
+    ModalBasis* basis = compute(particleSystem, numModes);
+    if (basis) basis->save(filename);
+    return basis;
+}
+
+bool ModalBasis::save(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "ModalBasis: unable to write " << filename << std::endl;
+        return false;
+    }
+
+    ModalBasisHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrder;
+    header.numParticles = getNumParticles();
+    header.numModes = getNumModes();
+    header.key = m_key;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeMatrix(file, m_restPositions.data(), m_restPositions.size());
+    writeMatrix(file, m_eigenvalues.data(), m_eigenvalues.size());
+    writeMatrix(file, m_modes.data(), m_modes.size());
+    writeMatrix(file, m_rotationModes.data(), m_rotationModes.size());
+    writeMatrix(file, m_uniformForces.data(), m_uniformForces.size());
+    return (bool)file;
+}
+
+size_t ModalBasis::getMemoryUsage() const
+{
+    return (m_restPositions.size() + m_eigenvalues.size() + m_modes.size() + m_rotationModes.size() + m_uniformForces.size()) * sizeof(float);
+}
@@ -0,0 +1,82 @@
+#include "Reduced/ModalCloth.h"
+
+#include "ParticleSystem.h"
+#include "Reduced/ModalBasis.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ModalCloth::ModalCloth(const ModalBasis* _basis) : m_basis(_basis), m_alpha(0.0f), m_beta(0.0f), m_warping(false)
+{
+    const int numModes = m_basis->getNumModes();
+    m_q = Eigen::VectorXf::Zero(numModes);
+    m_qd = Eigen::VectorXf::Zero(numModes);
+    m_force = Eigen::VectorXf::Zero(numModes);
+}
+
+void ModalCloth::addForce(int index, const Eigen::Vector3f& f)
+{
+    assert(index >= 0 && index < m_basis->getNumParticles());
+    m_force.noalias() += m_basis->getModes().middleRows<3>(3 * index).transpose() * f;
+}
+
+void ModalCloth::step(float dt, const Eigen::Vector3f& acceleration)
+{
+    m_force.noalias() += m_basis->getUniformForces() * acceleration;
+
+    // Implicit Euler on each decoupled mode:
+    //   qd' = (qd + dt (f - lambda q)) / (1 + dt c + dt^2 lambda)
+    const Eigen::VectorXf& eigenvalues = m_basis->getEigenvalues();
+    for (int k = 0; k < m_q.size(); ++k)
+    {
+        const float lambda = std::max(0.0f, eigenvalues[k]);
+        const float c = m_alpha + m_beta * lambda;
+        m_qd[k] = (m_qd[k] + dt * (m_force[k] - lambda * m_q[k])) / (1.0f + dt * c + dt * dt * lambda);
+        m_q[k] += dt * m_qd[k];
+    }
+    m_force.setZero();
+}
+
+Eigen::Vector3f ModalCloth::displacement(int i) const
+{
+    const Eigen::Vector3f u = m_basis->getModes().middleRows<3>(3 * i) * m_q;
+    if (!m_warping)
+        return u;
+
+    const Eigen::Vector3f w = m_basis->getRotationModes().middleRows<3>(3 * i) * m_q;
+    const float t = w.norm();
+    if (t < 1e-6f)
+        return u;
+
+    // (I + (1 - cos t) / t^2 [w] + (t - sin t) / t^3 [w]^2) u
+    const Eigen::Vector3f wu = w.cross(u);
+    return u + ((1.0f - std::cos(t)) / (t * t)) * wu + ((t - std::sin(t)) / (t * t * t)) * w.cross(wu);
+}
+
+void ModalCloth::getPositions(std::vector<Eigen::Vector3f>& x) const
+{
+    const int n = m_basis->getNumParticles();
+    const Eigen::VectorXf& x0 = m_basis->getRestPositions();
+    x.resize(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = x0.segment<3>(3 * i) + displacement(i);
+    }
+}
+
+void ModalCloth::copyStateTo(ParticleSystem* particleSystem) const
+{
+    std::vector<Particle*>& particles = particleSystem->getParticles();
+    const int n = m_basis->getNumParticles();
+    assert((int)particles.size() == n);
+    const Eigen::VectorXf& x0 = m_basis->getRestPositions();
+    const Eigen::MatrixXf& modes = m_basis->getModes();
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        particles[i]->x = x0.segment<3>(3 * i) + displacement(i);
+        particles[i]->v = modes.middleRows<3>(3 * i) * m_qd;
+    }
+}
@@ -0,0 +1,173 @@
+#include "RemoteViewer.h"
+
+#include "polyscope/polyscope.h"
+#include "polyscope/surface_mesh.h"
+#include "polyscope/point_cloud.h"
+#include "polyscope/pick.h"
+#include "imgui.h"
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+#include "IO/FrameStream.h"
+
+namespace
+{
+    static const std::array<float, 3> pinColor = { 1.0f, 0.0f, 0.0f };
+    static const std::array<float, 3> pointColor = { 1.0f, 1.0f, 0.0f };
+}
+
+RemoteViewer::RemoteViewer() :
+    m_client(new FrameStreamClient),
+    m_clothMesh(nullptr), m_clothPoints(nullptr), m_topologyVersion(0), m_pinsVersion(0),
+    m_dt(0.01f), m_solverIterations(1),
+    m_structuralStiffness(1000.0f), m_shearStiffness(250.0f), m_bendingStiffness(50.0f), m_damping(0.0f), m_airDamping(0.0f)
+{
+}
+
+RemoteViewer::~RemoteViewer()
+{
+    delete m_client;
+}
+
+std::string RemoteViewer::getRequestedAddress(int argc, char* argv[])
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (strcmp(argv[i], "--connect") == 0)
+            return argv[i + 1];
+    }
+    return std::string();
+}
+
+int RemoteViewer::start(const std::string& address)
+{
+    m_address = address;
+    if (!m_client->connect(m_address))
+        return 1;
+
+    polyscope::options::programName = "MTI855 Devoir 01 - Cloth Sim (remote)";
+    polyscope::options::verbosity = 0;
+    polyscope::options::usePrefsFile = false;
+    polyscope::options::alwaysRedraw = true;
+    polyscope::options::openImGuiWindowForUserCallback = true;
+    polyscope::options::groundPlaneHeightFactor = 1.0;
+    polyscope::options::buildGui = true;
+    polyscope::options::maxFPS = 60;
+
+    polyscope::init();
+    polyscope::state::userCallback = std::bind(&RemoteViewer::draw, this);
+    initMeshes();
+    polyscope::show();
+    return 0;
+}
+
+void RemoteViewer::initMeshes()
+{
+    const int numParticles = m_client->getNumParticles();
+    const std::vector<int32_t>& triangles = m_client->getTriangles();
+    const std::vector<float>& positions = m_client->getPositions();
+
+    m_renderPositions.resize(numParticles, 3);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        m_renderPositions.row(i) << positions[3 * i], positions[3 * i + 1], positions[3 * i + 2];
+    }
+    Eigen::MatrixXi meshF(triangles.size() / 3, 3);
+    for (int k = 0; k < (int)triangles.size() / 3; ++k)
+    {
+        meshF.row(k) << triangles[3 * k], triangles[3 * k + 1], triangles[3 * k + 2];
+    }
+
+    m_clothMesh = polyscope::registerSurfaceMesh("cloth", m_renderPositions, meshF);
+    m_clothMesh->setSmoothShade(true);
+    m_clothPoints = polyscope::registerPointCloud("particles", m_renderPositions);
+    m_clothPoints->setPointRadius(0.01);
+    m_clothPoints->setPointRenderMode(polyscope::PointRenderMode::Sphere);
+
+    m_pointColors.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        m_pointColors[i] = m_client->getPins()[i] ? pinColor : pointColor;
+    }
+    m_clothPoints->addColorQuantity("colors", m_pointColors)->setEnabled(true);
+
+    m_topologyVersion = m_client->getTopologyVersion();
+    m_pinsVersion = m_client->getPinsVersion();
+}
+
+void RemoteViewer::drawGUI()
+{
+    ImGui::Text("Remote simulation: %s", m_address.c_str());
+    if (!m_client->isConnected())
+    {
+        ImGui::Text("Disconnected");
+        if (ImGui::Button("Reconnect") && m_client->connect(m_address))
+        {
+            initMeshes();
+        }
+        return;
+    }
+    ImGui::Text("Step %llu, %llu frames, %.1f MB received", (unsigned long long)m_client->getStep(),
+                (unsigned long long)m_client->getNumReceived(), m_client->getBytesReceived() / (1024.0 * 1024.0));
+
+    // Only the edited parameters are sent.
+    ImGui::PushItemWidth(200);
+    if (ImGui::SliderFloat("Time step", &m_dt, 0.001f, 0.1f, "%.3f")) m_client->setParameter("dt", m_dt);
+    if (ImGui::SliderInt("Solver iterations", &m_solverIterations, 1, 100)) m_client->setParameter("iterations", (float)m_solverIterations);
+    if (ImGui::SliderFloat("Structural stiffness", &m_structuralStiffness, 1.0f, 10000.0f, "%.1f")) m_client->setParameter("structural", m_structuralStiffness);
+    if (ImGui::SliderFloat("Shear stiffness", &m_shearStiffness, 1.0f, 10000.0f, "%.1f")) m_client->setParameter("shear", m_shearStiffness);
+    if (ImGui::SliderFloat("Bending stiffness", &m_bendingStiffness, 1.0f, 10000.0f, "%.1f")) m_client->setParameter("bending", m_bendingStiffness);
+    if (ImGui::SliderFloat("Damping", &m_damping, 0.0f, 100.0f, "%.1f")) m_client->setParameter("damping", m_damping);
+    if (ImGui::SliderFloat("Air damping", &m_airDamping, 0.0f, 2.0f, "%.2f")) m_client->setParameter("air-damping", m_airDamping);
+    ImGui::PopItemWidth();
+    ImGui::Text("Ctrl + right click: pin or unpin a particle");
+}
+
+void RemoteViewer::draw()
+{
+    drawGUI();
+    if (!m_client->isConnected())
+        return;
+
+    // Particle pinning, applied by the simulation and shown once its next
+    // frame arrives.
+    if (ImGui::IsMouseClicked(1) && ImGui::GetIO().KeyCtrl)
+    {
+        const ImVec2 mouseP = ImGui::GetMousePos();
+        const auto selection = polyscope::pick::evaluatePickQuery(mouseP.x, mouseP.y);
+        if (m_clothPoints == selection.first && selection.second < m_client->getPins().size())
+        {
+            const unsigned int pickInd = selection.second;
+            m_client->pinParticle(pickInd, !m_client->getPins()[pickInd]);
+        }
+    }
+
+    if (!m_client->receive())
+        return;
+
+    if (m_topologyVersion != m_client->getTopologyVersion())
+    {
+        initMeshes();
+        return;
+    }
+
+    const std::vector<float>& positions = m_client->getPositions();
+    for (int i = 0; i < m_renderPositions.rows(); ++i)
+    {
+        m_renderPositions.row(i) << positions[3 * i], positions[3 * i + 1], positions[3 * i + 2];
+    }
+    m_clothMesh->updateVertexPositions(m_renderPositions);
+    m_clothPoints->updatePointPositions(m_renderPositions);
+
+    if (m_pinsVersion != m_client->getPinsVersion())
+    {
+        for (int i = 0; i < (int)m_pointColors.size(); ++i)
+        {
+            m_pointColors[i] = m_client->getPins()[i] ? pinColor : pointColor;
+        }
+        m_clothPoints->addColorQuantity("colors", m_pointColors);
+        m_pinsVersion = m_client->getPinsVersion();
+    }
+}
@@ -0,0 +1,233 @@
+#include "Scene/Scene.h"
+
+#include "Cloth.h"
+#include "Integrators/Integrator.h"
+#include "Integrators/Integrators.h"
+#include "Parallel/TaskGraph.h"
+#include "Profiling/Profiler.h"
+#include "Scene/Collider.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    const float kGravity = 9.81f;
+
+    // Cell of side @a h containing @a x.
+    Eigen::Vector3i cellOf(const Eigen::Vector3f& x, float h)
+    {
+        return (x / h).array().floor().cast<int>();
+    }
+
+    // Hash key of a cell, 21 bits per coordinate.
+    uint64_t cellKey(const Eigen::Vector3i& c)
+    {
+        return (uint64_t)(c.x() & 0x1fffff) << 42 | (uint64_t)(c.y() & 0x1fffff) << 21 | (uint64_t)(c.z() & 0x1fffff);
+    }
+
+    // Number of threads of the OpenMP loops started by the calling thread.
+    int getLoopThreads()
+    {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    void setLoopThreads(int numThreads)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(numThreads);
+#endif
+    }
+}
+
+Scene::Scene(int numThreads) : m_taskGraph(new TaskGraph(numThreads)), m_thickness(0.02f), m_numContacts(0)
+{
+}
+
+Scene::~Scene()
+{
+    delete m_taskGraph;
+    for (SceneObject& object : m_objects)
+    {
+        delete object.cloth;
+    }
+    for (Collider* collider : m_colliders)
+    {
+        delete collider;
+    }
+}
+
+int Scene::getNumThreads() const
+{
+    return m_taskGraph->getNumThreads();
+}
+
+int Scene::addCloth(Cloth* cloth, int integrator, float dt)
+{
+    SceneObject object;
+    object.cloth = cloth;
+    object.integrator = integrator;
+    object.dt = dt;
+    updateBounds(object);
+    m_objects.push_back(object);
+    return m_objects.size() - 1;
+}
+
+void Scene::addCollider(Collider* collider)
+{
+    m_colliders.push_back(collider);
+}
+
+void Scene::updateBounds(SceneObject& object)
+{
+    object.bounds.setEmpty();
+    object.maxSpeed = 0.0f;
+    for (const Particle* p : object.cloth->getParticles())
+    {
+        object.bounds.extend(p->x);
+        if (!p->fixed) object.maxSpeed = std::max(object.maxSpeed, p->v.norm());
+    }
+}
+
+void Scene::step(float frameTime)
+{
+    PROFILE_SCOPE("Scene::step");
+
+    const int numObjects = m_objects.size();
+    m_taskGraph->clear();
+
+    // The graph spreads the cloths over the cores, so their parallel loops
+    // run on one thread.  A cloth alone keeps them.
+    const int loopThreads = getLoopThreads();
+    const bool serialLoops = numObjects > 1 && m_taskGraph->getNumThreads() > 1;
+
+    // Last task that modifies each cloth.
+    std::vector<int> last(numObjects);
+    for (int i = 0; i < numObjects; ++i)
+    {
+        last[i] = m_taskGraph->addTask([this, i, frameTime, serialLoops]
+        {
+            if (serialLoops) setLoopThreads(1);
+            stepObject(i, frameTime);
+        });
+    }
+
+    // Pairs of cloths that can touch during the frame.
+    m_numContacts = 0;
+    for (int a = 0; a < numObjects; ++a)
+    {
+        for (int b = a + 1; b < numObjects; ++b)
+        {
+            const float travel = (m_objects[a].maxSpeed + m_objects[b].maxSpeed + 2.0f * kGravity * frameTime) * frameTime;
+            Eigen::AlignedBox3f reach = m_objects[a].bounds;
+            reach.min().array() -= travel + m_thickness;
+            reach.max().array() += travel + m_thickness;
+            if (!reach.intersects(m_objects[b].bounds))
+                continue;
+
+            const int contact = m_taskGraph->addTask([this, a, b] { resolveContact(a, b); });
+            m_taskGraph->addDependency(last[a], contact);
+            m_taskGraph->addDependency(last[b], contact);
+            last[a] = last[b] = contact;
+            ++m_numContacts;
+        }
+    }
+
+    m_taskGraph->run();
+    setLoopThreads(loopThreads);
+}
+
+void Scene::stepObject(int i, float frameTime)
+{
+    SceneObject& object = m_objects[i];
+    Integrator* integrator = getIntegrator(object.integrator);
+
+    // Equal steps of at most dt, so that every cloth ends the frame at the same time.
+    const int numSteps = std::max(1, (int)std::ceil(frameTime / object.dt - 1e-4f));
+    const float dt = frameTime / numSteps;
+    for (int s = 0; s < numSteps; ++s)
+    {
+        object.cloth->computeForces();
+        integrator->step(object.cloth, dt);
+        object.cloth->limitStrain(dt);
+        object.cloth->tearSprings();
+        for (const Collider* collider : m_colliders)
+        {
+            collider->resolve(object.cloth, m_thickness);
+        }
+    }
+    updateBounds(object);
+}
+
+void Scene::resolveContact(int a, int b)
+{
+    PROFILE_SCOPE("Scene contact");
+
+    const float h = m_thickness;
+    const std::vector<Particle*>& particlesA = m_objects[a].cloth->getParticles();
+    const std::vector<Particle*>& particlesB = m_objects[b].cloth->getParticles();
+
+    // Particles of b sorted by cell.
+    std::vector<std::pair<uint64_t, int>> cells(particlesB.size());
+    for (int j = 0; j < (int)particlesB.size(); ++j)
+    {
+        cells[j] = { cellKey(cellOf(particlesB[j]->x, h)), j };
+    }
+    std::sort(cells.begin(), cells.end());
+
+    Eigen::AlignedBox3f reach = m_objects[b].bounds;
+    reach.min().array() -= h;
+    reach.max().array() += h;
+
+    for (Particle* p : particlesA)
+    {
+        if (!reach.contains(p->x))
+            continue;
+
+        const Eigen::Vector3i c = cellOf(p->x, h);
+        for (int dz = -1; dz <= 1; ++dz)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    const uint64_t key = cellKey(c + Eigen::Vector3i(dx, dy, dz));
+                    auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(key, 0));
+                    for (; it != cells.end() && it->first == key; ++it)
+                    {
+                        Particle* q = particlesB[it->second];
+                        const Eigen::Vector3f delta = p->x - q->x;
+                        const float d2 = delta.squaredNorm();
+                        const float wp = p->fixed ? 0.0f : 1.0f;
+                        const float wq = q->fixed ? 0.0f : 1.0f;
+                        if (d2 >= h * h || d2 < 1e-12f || wp + wq == 0.0f)
+                            continue;
+
+                        // Push the particles apart to the thickness and remove
+                        // their approaching velocity.
+                        const float d = std::sqrt(d2);
+                        const Eigen::Vector3f n = delta / d;
+                        const float correction = (h - d) / (wp + wq);
+                        p->x += wp * correction * n;
+                        q->x -= wq * correction * n;
+                        const float vn = (p->v - q->v).dot(n);
+                        if (vn < 0.0f)
+                        {
+                            p->v -= (wp / (wp + wq)) * vn * n;
+                            q->v += (wq / (wp + wq)) * vn * n;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
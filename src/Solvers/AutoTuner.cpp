@@ -0,0 +1,271 @@
+#include "Solvers/AutoTuner.h"
+
+#include "Integrators/Integrator.h"
+#include "Integrators/Integrators.h"
+#include "Integrators/StabilityWatchdog.h"
+#include "ParticleSystem.h"
+#include "Solvers/MatrixFreePGS.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Sweep cap relative to the most sweeps a calibration step needed.
+    const float kIterationMargin = 1.5f;
+
+    int getLoopThreads()
+    {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    void setLoopThreads(int numThreads)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(numThreads);
+#endif
+    }
+
+    std::string getMachineName()
+    {
+        char name[256] = "unknown";
+#ifndef _WIN32
+        if (gethostname(name, sizeof(name)) != 0) strcpy(name, "unknown");
+        name[sizeof(name) - 1] = '\0';
+#else
+        if (const char* computer = getenv("COMPUTERNAME")) snprintf(name, sizeof(name), "%s", computer);
+#endif
+        std::ostringstream machine;
+        machine << name << "/" << std::thread::hardware_concurrency();
+        return machine.str();
+    }
+
+    bool isImplicit(int integrator)
+    {
+        return integrator == kImplicitEuler || integrator == kImplicitExplicitEuler;
+    }
+}
+
+AutoTuner::AutoTuner(const std::string& _cacheFilename) : m_cacheFilename(_cacheFilename), m_cached(false), m_numCandidates(0)
+{
+}
+
+std::string AutoTuner::getKey(const ParticleSystem* particleSystem, int integrator, float dt, float tolerance)
+{
+    std::ostringstream key;
+    key << getMachineName() << " " << particleSystem->getParticles().size() << " " << particleSystem->getSprings().size() << " "
+        << getIntegratorName(integrator) << " " << dt << " " << tolerance;
+    return key.str();
+}
+
+bool AutoTuner::load(const std::string& key, TunedConfig& config) const
+{
+    std::ifstream file(m_cacheFilename);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, key.size() + 1, key + " ") != 0)
+            continue;
+
+        std::istringstream values(line.substr(key.size() + 1));
+        std::string method;
+        TunedConfig loaded;
+        if (values >> method >> loaded.maxIterations >> loaded.numThreads >> loaded.dt >> loaded.msPerStep)
+        {
+            loaded.method = findSolverMethod(method.c_str());
+            if (loaded.method >= 0 && loaded.maxIterations >= 1 && loaded.numThreads >= 1 && loaded.dt > 0.0f)
+            {
+                loaded.tolerance = config.tolerance;
+                config = loaded;
+                return true;
+            }
+        }
+        std::cerr << "AutoTuner: ignoring the malformed entry of " << m_cacheFilename << " for " << key << std::endl;
+    }
+    return false;
+}
+
+bool AutoTuner::save(const std::string& key, const TunedConfig& config) const
+{
+    // Keep the entries of the other machines and problems.
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(m_cacheFilename);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line.compare(0, key.size() + 1, key + " ") != 0)
+                lines.push_back(line);
+        }
+    }
+
+    std::ofstream file(m_cacheFilename, std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "AutoTuner: unable to write " << m_cacheFilename << std::endl;
+        return false;
+    }
+    for (const std::string& line : lines) file << line << "\n";
+    file << key << " " << getSolverMethodName(config.method) << " " << config.maxIterations << " " << config.numThreads << " "
+         << config.dt << " " << config.msPerStep << "\n";
+    return (bool)file;
+}
+
+bool AutoTuner::measure(ParticleSystem* particleSystem, int integrator, const Eigen::VectorXf& q0, const TunedConfig& config, double& msPerStep, int& maxSweeps)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    ++m_numCandidates;
+    particleSystem->wakeAll();
+    particleSystem->setState(q0);
+    apply(particleSystem, config);
+    StabilityWatchdog watchdog;
+    watchdog.reset(integrator);
+    MatrixFreePGS* solver = particleSystem->getSolver();
+
+    // The first step, which sizes the buffers and estimates the spectral
+    // radius, is not timed.  The watchdog checks a step at the beginning of
+    // the next one, so one more step follows the timed ones.
+    maxSweeps = 0;
+    Clock::time_point start = Clock::now(), end = start;
+    for (int i = 0; i <= kCalibrationSteps + 1; ++i)
+    {
+        if (i == 1) start = Clock::now();
+        particleSystem->computeForces();
+        if (!watchdog.step(particleSystem, config.dt) || watchdog.getNumRollbacks() > 0)
+            return false;
+        if (i == kCalibrationSteps) end = Clock::now();
+
+        if (isImplicit(integrator))
+        {
+            if (solver->getResidual() > config.tolerance)
+                return false;
+            maxSweeps = std::max(maxSweeps, solver->getNumIterations());
+        }
+    }
+    msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / kCalibrationSteps;
+    return true;
+}
+
+bool AutoTuner::tune(ParticleSystem* particleSystem, int integrator, float dt, float tolerance, TunedConfig& config)
+{
+    m_cached = false;
+    m_numCandidates = 0;
+    const std::string key = getKey(particleSystem, integrator, dt, tolerance);
+    config.tolerance = tolerance;
+    if (!m_cacheFilename.empty() && load(key, config))
+    {
+        m_cached = true;
+        return true;
+    }
+
+    Eigen::VectorXf q0;
+    particleSystem->getState(q0);
+    const int maxThreads = getLoopThreads();
+
+    TunedConfig best;
+    best.method = particleSystem->getSolver()->getMethod();
+    best.maxIterations = isImplicit(integrator) ? kMaxIterations : particleSystem->getSolver()->getMaxIterations();
+    best.tolerance = tolerance;
+    best.numThreads = maxThreads;
+    best.dt = dt;
+    double bestTime = HUGE_VAL;
+    int bestSweeps = 0;
+
+    // 1. Solver method, by the time to reach the tolerance.
+    for (int method = 0; method < (isImplicit(integrator) ? kNumSolverMethods : 1); ++method)
+    {
+        TunedConfig candidate = best;
+        if (isImplicit(integrator)) candidate.method = method;
+        double time;
+        int sweeps;
+        if (measure(particleSystem, integrator, q0, candidate, time, sweeps) && time < bestTime)
+        {
+            best.method = candidate.method;
+            bestTime = time;
+            bestSweeps = sweeps;
+        }
+    }
+    if (bestTime == HUGE_VAL)
+    {
+        particleSystem->wakeAll();
+        particleSystem->setState(q0);
+        setLoopThreads(maxThreads);
+        std::cerr << "AutoTuner: no stable configuration at dt = " << dt << std::endl;
+        return false;
+    }
+
+    // 2. Time step, by the time per simulated second.
+    for (int factor = 2; factor <= kMaxTimeStepFactor; factor *= 2)
+    {
+        TunedConfig candidate = best;
+        candidate.dt = factor * dt;
+        double time;
+        int sweeps;
+        if (!measure(particleSystem, integrator, q0, candidate, time, sweeps))
+            break;
+        if (time / candidate.dt < bestTime / best.dt)
+        {
+            best.dt = candidate.dt;
+            bestTime = time;
+            bestSweeps = sweeps;
+        }
+    }
+
+    // 3. Threads, by the time per step.
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        TunedConfig candidate = best;
+        candidate.numThreads = threads;
+        double time;
+        int sweeps;
+        if (measure(particleSystem, integrator, q0, candidate, time, sweeps) && time < bestTime)
+        {
+            best.numThreads = threads;
+            bestTime = time;
+        }
+    }
+
+    if (isImplicit(integrator))
+    {
+        best.maxIterations = std::min(kMaxIterations, std::max(1, (int)std::ceil(kIterationMargin * bestSweeps)));
+    }
+    best.msPerStep = (float)bestTime;
+    config = best;
+
+    particleSystem->wakeAll();
+    particleSystem->setState(q0);
+    setLoopThreads(maxThreads);
+    if (!m_cacheFilename.empty()) save(key, config);
+    return true;
+}
+
+void AutoTuner::apply(ParticleSystem* particleSystem, const TunedConfig& config)
+{
+    MatrixFreePGS* solver = particleSystem->getSolver();
+    solver->setMethod(config.method);
+    solver->setMaxIterations(config.maxIterations);
+    solver->setTolerance(config.tolerance);
+    setLoopThreads(config.numThreads);
+}
@@ -1,13 +1,115 @@
 #include "Solvers/MatrixFreePGS.h"
 
 #include "Eigen/src/Core/Matrix.h"
+#include "Forces/TriangleMembrane.h"
 #include "ParticleSystem.h"
+#include "Profiling/Profiler.h"
 
-MatrixFreePGS::MatrixFreePGS(ParticleSystem* _particleSystem) : m_particleSystem(_particleSystem), m_iters(20)
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+const int MatrixFreePGS::kBatch;
+const int MatrixFreePGS::kEstimateInterval;
+const int MatrixFreePGS::kPowerIterations;
+
+namespace
+{
+    // Particles below which a pass is not worth running in parallel.
+    const int kMinParallelParticles = 4096;
+
+    // Largest spectral radius used for the relaxation factor of SOR.
+    const float kMaxSpectralRadius = 0.99f;
+
+    // Growth of the change of a Chebyshev sweep, relative to the first sweep,
+    // beyond which the iteration diverges.  Converging iterations peak at a
+    // few times the first change.
+    const double kMaxChangeGrowth = 10.0;
+
+    // Determinant, relative to the cube of the largest diagonal entry, below
+    // which a block is not inverted in closed form.
+    const float kMinRelativeDeterminant = 1e-6f;
+
+    // Product of the symmetric block of particle @a i in the batched array
+    // @a blocks with @a x.
+    inline Eigen::Vector3f multiplyBlock(const std::vector<float>& blocks, int i, const Eigen::Vector3f& x)
+    {
+        const int kBatch = MatrixFreePGS::kBatch;
+        const float* b = &blocks[6 * kBatch * (i / kBatch) + i % kBatch];
+        const float xx = b[0], xy = b[kBatch], xz = b[2 * kBatch];
+        const float yy = b[3 * kBatch], yz = b[4 * kBatch], zz = b[5 * kBatch];
+        return Eigen::Vector3f(xx * x.x() + xy * x.y() + xz * x.z(),
+                               xy * x.x() + yy * x.y() + yz * x.z(),
+                               xz * x.x() + yz * x.y() + zz * x.z());
+    }
+
+    // Jacobian K = alpha I - w w^T of a spring of stiffness @a k and rest
+    // length @a r, stretched by @a delta of norm @a length.
+    inline void springJacobian(float k, float r, const Eigen::Vector3f& delta, float length, float& alpha, Eigen::Vector3f& w)
+    {
+        alpha = -k * (1 - r / length);
+        w = (std::sqrt(std::max(0.0f, k * r / length)) / length) * delta;
+    }
+
+    static const char* names[kNumSolverMethods] = {
+        "gauss-seidel",
+        "sor",
+        "chebyshev"
+    };
+}
+
+const char* getSolverMethodName(int index)
+{
+    assert(index >= 0 && index < kNumSolverMethods);
+    return names[index];
+}
+
+int findSolverMethod(const char* name)
+{
+    for (int i = 0; i < kNumSolverMethods; ++i)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+MatrixFreePGS::MatrixFreePGS(ParticleSystem* _particleSystem) : m_particleSystem(_particleSystem), m_iters(1), m_tolerance(0.0f),
+    m_method(kGaussSeidel), m_omega(0.0f), m_implicitMaterials(~0u), m_jacobianTolerance(0.0f), m_jacobianTopologyVersion(0), m_jacobianLayoutVersion(0), m_jacobianMaterials(~0u), m_blockDt(0.0f),
+    m_numUpdatedJacobians(0), m_numUpdatedBlocks(0), m_spectralRadius(0.0f), m_jacobiDiverged(false), m_estimateDt(0.0f),
+    m_solvesSinceEstimate(0), m_numIterations(0), m_residual(0.0f)
+{
+}
+
+void MatrixFreePGS::setJacobianTolerance(float _tolerance)
+{
+    assert(_tolerance >= 0.0f);
+    m_jacobianTolerance = _tolerance;
+    // The Jacobians stored by assemble() are not tracked.
+    m_springStates.clear();
+}
+
+void MatrixFreePGS::setMethod(int _method)
+{
+    assert(_method >= 0 && _method < kNumSolverMethods);
+    m_method = _method;
+}
+
+float MatrixFreePGS::getRelaxation() const
+{
+    if (m_omega > 0.0f)
+        return m_omega;
+    const float rho = std::min(m_spectralRadius, kMaxSpectralRadius);
+    return 2.0f / (1.0f + std::sqrt(1.0f - rho * rho));
+}
+
+bool MatrixFreePGS::isActive(int i) const
 {
+    return !m_particleSystem->getParticles()[i]->fixed && !m_particleSystem->isAsleep(i);
 }
 
-void MatrixFreePGS::solve(float dt, std::vector<Eigen::Vector3f>& x)
+void MatrixFreePGS::solve(float dt, std::vector<Eigen::Vector3f>& x, uint32_t implicitMaterials)
 {
     // TODO implement the matrix-free PGS solver for the particle systems to solve
     //  for (M - dt*dfdv - dt*dt*dfdx) x = dt * f + dt * dt * dfdx * v
@@ -15,69 +117,515 @@ void MatrixFreePGS::solve(float dt, std::vector<Eigen::Vector3f>& x)
     // where x is assumed to be the velocity updates deltav used by the
     // integrator.
     //
-    m_particleSystem->dfdx();
     int nbParticules = m_particleSystem->getParticles().size();
 
-    x.resize(nbParticules);
-    std::vector<Eigen::Vector3f> b(nbParticules);
-    std::vector<Eigen::LDLT<Eigen::Matrix3f>> P(nbParticules);
-    buildRHS(dt, b);
-    buildBlockDiagonal(dt, P);
+    x.assign(nbParticules, Eigen::Vector3f::Zero());
+    m_implicitMaterials = implicitMaterials;
+    if (m_jacobianTolerance > 0.0f) assembleLazy(dt);
+    else assemble(dt);
 
+    const bool needsEstimate = m_method == kChebyshevJacobi || (m_method == kSOR && m_omega <= 0.0f);
+    if (needsEstimate && (m_solvesSinceEstimate >= kEstimateInterval || dt != m_estimateDt || (int)m_eigenvector.size() != nbParticules))
+    {
+        estimateSpectralRadius(dt);
+    }
+    ++m_solvesSinceEstimate;
+
+    // Jacobi does not converge when the spectral radius reaches 1, SOR still
+    // does for a positive definite matrix.
+    int method = (m_method == kChebyshevJacobi && (m_spectralRadius >= 1.0f || m_jacobiDiverged)) ? kSOR : m_method;
+    double firstChange2 = 0.0;
+    const float rho2 = m_spectralRadius * m_spectralRadius;
+    float omega = 1.0f;
+    if (method == kChebyshevJacobi)
+    {
+        m_previous.assign(nbParticules, Eigen::Vector3f::Zero());
+        m_next.resize(nbParticules);
+    }
+
+    m_residual = 0.0f;
+    m_numIterations = 0;
+    while (m_numIterations < m_iters)
+    {
+        switch (method)
+        {
+        case kChebyshevJacobi:
+            // x(k+1) = omega(k+1) (jacobi(x(k)) - x(k-1)) + x(k-1)
+            if (m_numIterations == 1) omega = 2.0f / (2.0f - rho2);
+            else if (m_numIterations > 1) omega = 4.0f / (4.0f - rho2 * omega);
+            {
+                const double change2 = sweepJacobi(dt, omega, x, m_previous, m_next);
+                m_previous.swap(x);
+                x.swap(m_next);
+                if (m_numIterations == 0) firstChange2 = change2;
+                else if (change2 > kMaxChangeGrowth * kMaxChangeGrowth * firstChange2) {
+                    // The estimate missed a mode that does not converge (compressed
+                    // springs make the matrix indefinite): start over with SOR
+                    // until the next estimate.
+                    x.assign(nbParticules, Eigen::Vector3f::Zero());
+                    method = kSOR;
+                    m_jacobiDiverged = true;
+                }
+            }
+            break;
+        case kSOR:
+            sweepGaussSeidel(dt, getRelaxation(), x);
+            break;
+        default:
+            sweepGaussSeidel(dt, 1.0f, x);
+            break;
+        }
+        ++m_numIterations;
+
+        if (m_tolerance > 0.0f)
+        {
+            m_residual = relativeResidual(dt, x);
+            if (m_residual < m_tolerance)
+                break;
+        }
+    }
+}
+
+Eigen::Vector3f MatrixFreePGS::offDiagonalProduct(int i, float dt, const std::vector<Eigen::Vector3f>& x) const
+{
+    const Particle* p = m_particleSystem->getParticles()[i];
+    Eigen::Vector3f r = Eigen::Vector3f::Zero();
+    for(std::pair<Spring *, int> pair : p->springs) {
+        int j = (pair.second+1)%2;
+        Spring *s = pair.first;
+        if (!isImplicit(s->material)) continue;
+        const Eigen::Vector3f& y = x[s->particles[j]->index];
+        const float* K = &m_springJacobians[4 * s->index];
+        const Eigen::Map<const Eigen::Vector3f> w(K);
+        r += K[3] * y - w * w.dot(y);
+    }
+    if (const TriangleMembrane* membrane = m_particleSystem->getMembrane()) {
+        Eigen::Vector3f Kx = Eigen::Vector3f::Zero();
+        membrane->addOffDiagonalProduct(i, [&x](int j) { return x[j]; }, Kx);
+        r -= Kx;
+    }
+    return dt*dt*r;
+}
+
+void MatrixFreePGS::sweepGaussSeidel(float dt, float omega, std::vector<Eigen::Vector3f>& x)
+{
+    PROFILE_SCOPE("PGS sweep");
+    const int nbParticules = x.size();
     for (int i = 0; i < nbParticules; i++) {
-        Particle *p = m_particleSystem->getParticles()[i];
-        if (p->fixed) x[i] = Eigen::Vector3f::Zero();
+        if (!isActive(i)) x[i] = Eigen::Vector3f::Zero();
         else {
-            x[i] = b[i];
-            for(std::pair<Spring *, int> pair : p->springs) {
-                int j = (pair.second+1)%2;
-                Spring *s = pair.first;
-                x[i] -= (dt*dt*s->dfdx) * x[s->particles[j]->index];
-            }
-            x[i] = P[i].solve(x[i]);
+            const Eigen::Vector3f y = multiplyBlock(m_inverse, i, m_b[i] - offDiagonalProduct(i, dt, x));
+            x[i] += omega * (y - x[i]);
         }
     }
 }
 
-void MatrixFreePGS::buildRHS(float dt, std::vector<Eigen::Vector3f>& b)
+double MatrixFreePGS::sweepJacobi(float dt, float omega, const std::vector<Eigen::Vector3f>& x, const std::vector<Eigen::Vector3f>& previous, std::vector<Eigen::Vector3f>& y)
 {
-    // TODO Build the right-hand side block vector:
-    //   b = dt * f + dt * dt * dfdx * v
-    // for each particle
-    b.resize(m_particleSystem->getParticles().size());
-
-    for (Particle* p : m_particleSystem->getParticles()) {
-        b[p->index] = dt*p->f;
-        for(std::pair<Spring *, int> pair : p->springs) {
-            int j = (pair.second + 1) % 2;
-            Particle* otherParticle = pair.first->particles[j];
-            Spring *s = pair.first;
-            b[p->index] += dt*dt*(s->dfdx * p->v - s->dfdx * otherParticle->v);
+    PROFILE_SCOPE("Jacobi sweep");
+    const int nbParticules = x.size();
+    double change2 = 0.0;
+    #pragma omp parallel for reduction(+ : change2) if (nbParticules >= kMinParallelParticles)
+    for (int i = 0; i < nbParticules; i++) {
+        if (!isActive(i)) y[i] = Eigen::Vector3f::Zero();
+        else {
+            const Eigen::Vector3f jacobi = multiplyBlock(m_inverse, i, m_b[i] - offDiagonalProduct(i, dt, x));
+            y[i] = omega * (jacobi - previous[i]) + previous[i];
+            change2 += (y[i] - x[i]).squaredNorm();
+        }
+    }
+    return change2;
+}
+
+float MatrixFreePGS::relativeResidual(float dt, const std::vector<Eigen::Vector3f>& x)
+{
+    PROFILE_SCOPE("PGS residual");
+    const int nbParticules = x.size();
+    double residual2 = 0.0, rhs2 = 0.0;
+    #pragma omp parallel for reduction(+ : residual2, rhs2) if (nbParticules >= kMinParallelParticles)
+    for (int i = 0; i < nbParticules; i++) {
+        if (isActive(i)) {
+            residual2 += (m_b[i] - multiplyBlock(m_diagonal, i, x[i]) - offDiagonalProduct(i, dt, x)).squaredNorm();
+            rhs2 += m_b[i].squaredNorm();
         }
     }
+    return (rhs2 > 0.0) ? (float)std::sqrt(residual2 / rhs2) : 0.0f;
 }
 
-void MatrixFreePGS::buildBlockDiagonal(float dt, std::vector<Eigen::LDLT<Eigen::Matrix3f>>& P)
+void MatrixFreePGS::estimateSpectralRadius(float dt)
 {
-    // TODO Build and compute the Cholesky decomposition of the block diagonal matrices
-    //   A = M - dt*dfdv - dt*dt*dfdx
-    // Store the result in the array P, such that each entry contains
-    //    P = llt(A)
-    // for each particle.
+    PROFILE_SCOPE("estimateSpectralRadius");
     const int nbParticules = m_particleSystem->getParticles().size();
-    std::vector<Eigen::Matrix3f> M(nbParticules);
-    P.resize(nbParticules);
 
-    for (Particle* p : m_particleSystem->getParticles()) {
-        M[p->index] = p->m * Eigen::Matrix3f::Identity();
+    // The slowest modes of the Jacobi iteration are smooth: start from a
+    // uniform vector, or from the last estimate.
+    if ((int)m_eigenvector.size() != nbParticules) {
+        m_eigenvector.assign(nbParticules, Eigen::Vector3f(1.0f, 0.5f, -0.25f));
+    }
+    for (int i = 0; i < nbParticules; i++) {
+        if (!isActive(i)) m_eigenvector[i].setZero();
+    }
 
-        for(std::pair<Spring *, int> pair : p->springs) {
-            Spring* s = pair.first;
-            M[p->index] -= dt*dt*s->dfdx;
+    // Power iterations on the Jacobi iteration matrix -P^-1 (A - D).
+    m_next.resize(nbParticules);
+    float rho = 0.0f;
+    for (int k = 0; k < kPowerIterations; k++) {
+        double norm2 = 0.0, imageNorm2 = 0.0;
+        #pragma omp parallel for reduction(+ : norm2, imageNorm2) if (nbParticules >= kMinParallelParticles)
+        for (int i = 0; i < nbParticules; i++) {
+            if (!isActive(i)) m_next[i].setZero();
+            else m_next[i] = -multiplyBlock(m_inverse, i, offDiagonalProduct(i, dt, m_eigenvector));
+            norm2 += m_eigenvector[i].squaredNorm();
+            imageNorm2 += m_next[i].squaredNorm();
+        }
+        if (norm2 <= 0.0 || imageNorm2 <= 0.0) {
+            rho = 0.0f;
+            break;
+        }
+        rho = (float)std::sqrt(imageNorm2 / norm2);
+        const float scale = (float)(1.0 / std::sqrt(imageNorm2));
+        for (int i = 0; i < nbParticules; i++) {
+            m_eigenvector[i] = scale * m_next[i];
         }
-        P[p->index] = M[p->index].ldlt();
     }
+
+    m_spectralRadius = rho;
+    m_jacobiDiverged = false;
+    m_estimateDt = dt;
+    m_solvesSinceEstimate = 0;
+}
+
+void MatrixFreePGS::assemble(float dt)
+{
+    // Build, in one pass over the particles and their springs:
+    //   b = dt * f + dt * dt * dfdx * v
+    //   A = M - dt*dfdv - dt*dt*dfdx   (diagonal blocks)
+    // The Jacobian of a spring of stiffness k, rest length r and current
+    // length l along n is
+    //   K = -k (1 - r/l) I - k (r/l) n n^T = alpha I - w w^T
+    // with w = sqrt(k r/l) n.  Each particle computes it for its own
+    // springs, and one of the two ends stores alpha and w for the sweeps.
+    PROFILE_SCOPE("assemble");
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const std::vector<SpringMaterial>& materials = m_particleSystem->getMaterials();
+    if (TriangleMembrane* membrane = m_particleSystem->getMembrane())
+        membrane->computeJacobians(particles);
+
+    const int nbParticules = particles.size();
+    const int numBatches = (nbParticules + kBatch - 1) / kBatch;
+    const float dt2 = dt*dt;
+    m_b.resize(nbParticules);
+    m_diagonal.resize(6 * kBatch * numBatches);
+    m_inverse.resize(6 * kBatch * numBatches);
+    m_springJacobians.resize(4 * m_particleSystem->getSprings().size());
+
+    #pragma omp parallel for if (nbParticules >= kMinParallelParticles)
+    for (int batch = 0; batch < numBatches; batch++) {
+        for (int l = 0; l < kBatch; l++) {
+            // The lanes past the last particle hold identity blocks.
+            const int i = batch * kBatch + l;
+            Eigen::Matrix3f M = Eigen::Matrix3f::Identity();
+            if (i < nbParticules) {
+                const Particle* p = particles[i];
+                M *= p->m;
+                m_b[i] = dt*p->f;
+            }
+            if (i < nbParticules && isActive(i)) {
+                const Particle* p = particles[i];
+                addFieldTerms(i, dt, M);
+                for(std::pair<Spring *, int> pair : p->springs) {
+                    const Spring* s = pair.first;
+                    if (!isImplicit(s->material)) continue;
+                    const Particle* other = s->particles[(pair.second + 1) % 2];
+                    const Eigen::Vector3f delta = other->x - p->x;
+                    const float length = std::max(delta.norm(), 1e-6f);
+                    float alpha;
+                    Eigen::Vector3f w;
+                    springJacobian(materials[s->material].k, s->r, delta, length, alpha, w);
+
+                    M.diagonal().array() -= dt2*alpha;
+                    M += dt2 * (w * w.transpose());
+                    const Eigen::Vector3f dv = p->v - other->v;
+                    m_b[i] += dt2 * (alpha * dv - w * w.dot(dv));
+
+                    // The end in slot 0 stores the Jacobian, or this end if the other one is not solved.
+                    if (pair.second == 0 || !isActive(other->index)) {
+                        float* K = &m_springJacobians[4 * s->index];
+                        K[0] = w.x(); K[1] = w.y(); K[2] = w.z(); K[3] = alpha;
+                    }
+                }
+            }
+            storeBlock(i, M);
+        }
+    }
+
+    invertBlocks();
+    m_numUpdatedJacobians = m_particleSystem->getSprings().size();
+    m_numUpdatedBlocks = nbParticules;
 }
 
+void MatrixFreePGS::assembleLazy(float dt)
+{
+    // Same system as assemble(), in two passes: the springs whose strain or
+    // direction moved past the tolerance compute their Jacobian again, then
+    // each particle builds its right-hand side from the stored Jacobians, and
+    // its diagonal block only if one of them changed.
+    PROFILE_SCOPE("assembleLazy");
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const std::vector<Spring*>& springs = m_particleSystem->getSprings();
+    const std::vector<SpringMaterial>& materials = m_particleSystem->getMaterials();
+    const bool fields = !m_particleSystem->getFieldDfdx().empty();
+    TriangleMembrane* membrane = m_particleSystem->getMembrane();
+    if (membrane) membrane->computeJacobians(particles);
+
+    const int nbParticules = particles.size();
+    const int nbSprings = springs.size();
+    const int numBatches = (nbParticules + kBatch - 1) / kBatch;
+    const float dt2 = dt*dt;
 
+    // Start over when the materials, the particles or the spring layout
+    // changed; removed springs only invalidate their slots.
+    std::vector<float> stiffness(materials.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        stiffness[m] = materials[m].k;
+    }
+    bool rebuild = dt != m_blockDt || (int)m_blockActive.size() != nbParticules;
+    if (m_springStates.empty() || m_jacobianLayoutVersion != m_particleSystem->getLayoutVersion() ||
+        m_jacobianMaterials != m_implicitMaterials || stiffness != m_jacobianStiffness) {
+        m_springStates.assign(4 * nbSprings, 0.0f);
+        m_springJacobians.resize(4 * nbSprings);
+        m_springOwners.assign(springs.begin(), springs.end());
+        m_springEnds.resize(2 * nbSprings);
+        for (int k = 0; k < nbSprings; k++) {
+            m_springEnds[2 * k] = springs[k]->particles[0]->index;
+            m_springEnds[2 * k + 1] = springs[k]->particles[1]->index;
+        }
+        m_jacobianTopologyVersion = m_particleSystem->getTopologyVersion();
+        m_jacobianLayoutVersion = m_particleSystem->getLayoutVersion();
+        m_jacobianMaterials = m_implicitMaterials;
+        m_jacobianStiffness.swap(stiffness);
+        rebuild = true;
+    }
+    if (rebuild) {
+        m_b.resize(nbParticules);
+        m_diagonal.resize(6 * kBatch * numBatches);
+        m_inverse.resize(6 * kBatch * numBatches);
+        m_blockActive.assign(nbParticules, 0);
+        m_blockStale.assign(nbParticules, 0);
+        m_blockDt = dt;
+    }
+    if ((int)m_springOwners.size() != nbSprings || m_jacobianTopologyVersion != m_particleSystem->getTopologyVersion()) {
+        invalidateRemovedSprings();
+    }
+    m_springUpdated.resize(nbSprings);
+
+    const float minCosine = std::cos(std::min(m_jacobianTolerance, 1.0f));
+    int numUpdatedJacobians = 0;
+    #pragma omp parallel for reduction(+ : numUpdatedJacobians) if (nbParticules >= kMinParallelParticles)
+    for (int k = 0; k < nbSprings; k++) {
+        const Spring* s = springs[k];
+        m_springUpdated[s->index] = 0;
+        if (!isImplicit(s->material) || (!isActive(s->particles[0]->index) && !isActive(s->particles[1]->index)))
+            continue;
+        const Eigen::Vector3f delta = s->particles[1]->x - s->particles[0]->x;
+        const float length = std::max(delta.norm(), 1e-6f);
+        float* state = &m_springStates[4 * s->index];
+        const Eigen::Map<const Eigen::Vector3f> direction(state);
+        if (state[3] > 0.0f && std::abs(length - state[3]) <= m_jacobianTolerance * s->r && direction.dot(delta) >= minCosine * length)
+            continue;
+
+        float alpha;
+        Eigen::Vector3f w;
+        springJacobian(materials[s->material].k, s->r, delta, length, alpha, w);
+        float* K = &m_springJacobians[4 * s->index];
+        K[0] = w.x(); K[1] = w.y(); K[2] = w.z(); K[3] = alpha;
+        state[0] = delta.x() / length; state[1] = delta.y() / length; state[2] = delta.z() / length; state[3] = length;
+        m_springUpdated[s->index] = 1;
+        ++numUpdatedJacobians;
+    }
 
+    int numUpdatedBlocks = 0;
+    #pragma omp parallel for reduction(+ : numUpdatedBlocks) if (nbParticules >= kMinParallelParticles)
+    for (int batch = 0; batch < numBatches; batch++) {
+        bool batchUpdated = false;
+        for (int l = 0; l < kBatch; l++) {
+            const int i = batch * kBatch + l;
+            if (i >= nbParticules) {
+                if (rebuild) storeBlock(i, Eigen::Matrix3f::Identity());
+                continue;
+            }
+            const Particle* p = particles[i];
+            Eigen::Matrix3f M = p->m * Eigen::Matrix3f::Identity();
+            m_b[i] = dt*p->f;
+            const bool active = isActive(i);
+            bool updated = rebuild || m_blockStale[i] != 0 || active != (m_blockActive[i] != 0);
+            if (active) {
+                // The field and membrane Jacobians change at every step.
+                updated |= fields || membrane;
+                addFieldTerms(i, dt, M);
+                for(std::pair<Spring *, int> pair : p->springs) {
+                    const Spring* s = pair.first;
+                    if (!isImplicit(s->material)) continue;
+                    const Particle* other = s->particles[(pair.second + 1) % 2];
+                    const float* K = &m_springJacobians[4 * s->index];
+                    const Eigen::Map<const Eigen::Vector3f> w(K);
+                    const float alpha = K[3];
+
+                    M.diagonal().array() -= dt2*alpha;
+                    M += dt2 * (w * w.transpose());
+                    const Eigen::Vector3f dv = p->v - other->v;
+                    m_b[i] += dt2 * (alpha * dv - w * w.dot(dv));
+                    updated |= m_springUpdated[s->index] != 0;
+                }
+            }
+            if (updated) {
+                storeBlock(i, M);
+                m_blockActive[i] = active;
+                m_blockStale[i] = 0;
+                batchUpdated = true;
+                ++numUpdatedBlocks;
+            }
+        }
+        if (batchUpdated) invertBatch(batch);
+    }
+
+    m_numUpdatedJacobians = numUpdatedJacobians;
+    m_numUpdatedBlocks = numUpdatedBlocks;
+}
+
+void MatrixFreePGS::invalidateRemovedSprings()
+{
+    // Removing a spring moves the last spring into its slot, so a slot either
+    // keeps its spring or now holds one whose Jacobian was stored elsewhere,
+    // and the slots past the new end are gone.  The springs are not allocated
+    // again within a layout version, so a slot holding the same spring with
+    // the same particles still holds the stored Jacobian.
+    const std::vector<Spring*>& springs = m_particleSystem->getSprings();
+    const int nbSprings = springs.size();
+    const int nbSlots = m_springOwners.size();
+    const int nbParticules = m_blockStale.size();
+    m_springStates.resize(4 * nbSprings, 0.0f);
+    m_springJacobians.resize(4 * nbSprings);
+    m_springEnds.resize(2 * std::max(nbSprings, nbSlots));
+    for (int k = 0; k < std::max(nbSprings, nbSlots); k++) {
+        const Spring* s = k < nbSprings ? springs[k] : nullptr;
+        if (k < nbSlots && s == m_springOwners[k] && s->particles[0]->index == m_springEnds[2 * k] &&
+            s->particles[1]->index == m_springEnds[2 * k + 1])
+            continue;
+        // The particles of the spring that left the slot lose its term.
+        if (k < nbSlots) {
+            for (int side = 0; side < 2; side++) {
+                const int i = m_springEnds[2 * k + side];
+                if (i < nbParticules) m_blockStale[i] = 1;
+            }
+        }
+        // The spring that took the slot computes its Jacobian again, which
+        // updates the blocks of its particles.
+        if (s) {
+            float* state = &m_springStates[4 * k];
+            state[0] = state[1] = state[2] = state[3] = 0.0f;
+            m_springEnds[2 * k] = s->particles[0]->index;
+            m_springEnds[2 * k + 1] = s->particles[1]->index;
+        }
+    }
+    m_springOwners.assign(springs.begin(), springs.end());
+    m_springEnds.resize(2 * nbSprings);
+    m_jacobianTopologyVersion = m_particleSystem->getTopologyVersion();
+}
+
+void MatrixFreePGS::addFieldTerms(int i, float dt, Eigen::Matrix3f& M)
+{
+    const std::vector<Particle*>& particles = m_particleSystem->getParticles();
+    const std::vector<Eigen::Matrix3f>& fieldDfdx = m_particleSystem->getFieldDfdx();
+    const float dt2 = dt*dt;
+    const Particle* p = particles[i];
+    if (!fieldDfdx.empty()) {
+        M -= dt*m_particleSystem->getFieldDfdv()[i] + dt2*fieldDfdx[i];
+        m_b[i] += dt2*fieldDfdx[i] * p->v;
+    }
+    if (const TriangleMembrane* membrane = m_particleSystem->getMembrane()) {
+        const Eigen::Matrix3f K = membrane->getDiagonalBlock(i);
+        Eigen::Vector3f Kv = K * p->v;
+        membrane->addOffDiagonalProduct(i, [&particles](int j) { return particles[j]->v; }, Kv);
+        M -= dt2*K;
+        m_b[i] += dt2*Kv;
+    }
+}
+
+void MatrixFreePGS::storeBlock(int i, const Eigen::Matrix3f& M)
+{
+    float* d = &m_diagonal[6 * kBatch * (i / kBatch) + i % kBatch];
+    d[0] = M(0, 0);
+    d[kBatch] = M(0, 1);
+    d[2 * kBatch] = M(0, 2);
+    d[3 * kBatch] = M(1, 1);
+    d[4 * kBatch] = M(1, 2);
+    d[5 * kBatch] = M(2, 2);
+}
+
+void MatrixFreePGS::invertBlocks()
+{
+    const int numBatches = m_diagonal.size() / (6 * kBatch);
+    #pragma omp parallel for if (numBatches * kBatch >= kMinParallelParticles)
+    for (int batch = 0; batch < numBatches; batch++) {
+        invertBatch(batch);
+    }
+}
+
+void MatrixFreePGS::invertBatch(int batch)
+{
+    const float* d = &m_diagonal[6 * kBatch * batch];
+    float* inverse = &m_inverse[6 * kBatch * batch];
+    int singular = 0;
+
+    #pragma omp simd reduction(| : singular)
+    for (int l = 0; l < kBatch; l++) {
+        const float xx = d[l], xy = d[kBatch + l], xz = d[2 * kBatch + l];
+        const float yy = d[3 * kBatch + l], yz = d[4 * kBatch + l], zz = d[5 * kBatch + l];
+
+        // Cofactors of the first row and of the lower right entries.
+        const float c00 = yy * zz - yz * yz;
+        const float c01 = xz * yz - xy * zz;
+        const float c02 = xy * yz - xz * yy;
+        const float c11 = xx * zz - xz * xz;
+        const float c12 = xy * xz - xx * yz;
+        const float c22 = xx * yy - xy * xy;
+        const float det = xx * c00 + xy * c01 + xz * c02;
+
+        const float scale = std::max(std::max(std::abs(xx), std::abs(yy)), std::abs(zz));
+        const bool invertible = std::abs(det) > kMinRelativeDeterminant * scale * scale * scale;
+        const float invDet = invertible ? 1.0f / det : 0.0f;
+        inverse[l] = c00 * invDet;
+        inverse[kBatch + l] = c01 * invDet;
+        inverse[2 * kBatch + l] = c02 * invDet;
+        inverse[3 * kBatch + l] = c11 * invDet;
+        inverse[4 * kBatch + l] = c12 * invDet;
+        inverse[5 * kBatch + l] = c22 * invDet;
+        singular |= invertible ? 0 : (1 << l);
+    }
+
+    // Near-singular blocks: the LDLT solve drops the null pivots.
+    for (int l = 0; singular != 0 && l < kBatch; l++) {
+        if (!(singular & (1 << l)))
+            continue;
+        Eigen::Matrix3f A;
+        A << d[l],              d[kBatch + l],     d[2 * kBatch + l],
+             d[kBatch + l],     d[3 * kBatch + l], d[4 * kBatch + l],
+             d[2 * kBatch + l], d[4 * kBatch + l], d[5 * kBatch + l];
+        const Eigen::Matrix3f Ainv = A.ldlt().solve(Eigen::Matrix3f::Identity());
+        inverse[l] = Ainv(0, 0);
+        inverse[kBatch + l] = 0.5f * (Ainv(0, 1) + Ainv(1, 0));
+        inverse[2 * kBatch + l] = 0.5f * (Ainv(0, 2) + Ainv(2, 0));
+        inverse[3 * kBatch + l] = Ainv(1, 1);
+        inverse[4 * kBatch + l] = 0.5f * (Ainv(1, 2) + Ainv(2, 1));
+        inverse[5 * kBatch + l] = Ainv(2, 2);
+    }
+}
+
+size_t MatrixFreePGS::getMemoryUsage() const
+{
+    return (m_diagonal.capacity() + m_inverse.capacity() + m_springJacobians.capacity() + m_springStates.capacity() +
+            m_jacobianStiffness.capacity()) * sizeof(float) + m_springUpdated.capacity() + m_blockActive.capacity() + m_blockStale.capacity() +
+           m_springOwners.capacity() * sizeof(const Spring*) + m_springEnds.capacity() * sizeof(int) +
+           (m_b.capacity() + m_previous.capacity() + m_next.capacity() + m_eigenvector.capacity()) * sizeof(Eigen::Vector3f);
+}